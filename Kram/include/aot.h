@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.h"
+#include "bindata.h"
+#include "runtime.h"
+#include "jit.h"
+
+namespace kram::aot
+{
+#if defined(_WIN32)
+	constexpr const char* DefaultCompiler = "cl";
+#else
+	constexpr const char* DefaultCompiler = "cc";
+#endif
+
+	/* FNV-1a of the host ABI version and the chunk code, stored in every library translated from it */
+	UInt64 checksum(const bin::Chunk* chunk);
+
+	/* Writes C source with one function per bin::Function of "chunk", exported as
+	 * "<prefix>_f<index>" with the jit::CompiledFunction ABI. VM registers become locals,
+	 * every memory location is resolved while translating and branches become gotos.
+	 * Instructions without a translation, CALL and RET among them, return their offset
+	 * for the interpreter to resume at, like the JIT. Functions that start with one, or
+	 * where the flags could be read after such an exit, are not emitted. "prefix" must
+	 * be a C identifier. Returns the number of functions emitted.
+	 */
+	Size translate(std::ostream& os, const bin::Chunk* chunk, const std::string& prefix);
+
+	/* Compiles translated source into a shared object with the system C compiler.
+	 * "compiler" is a command, the paths are quoted.
+	 */
+	bool compile(const std::string& source, const std::string& library, const std::string& compiler = DefaultCompiler);
+
+	/* Translates "chunk" into "<library>.c" and compiles it into "library" */
+	bool build(const bin::Chunk* chunk, const std::string& library, const std::string& prefix, const std::string& compiler = DefaultCompiler);
+
+
+	/* Per-VM translated libraries. execute() runs the native function of a loaded
+	 * chunk whenever the library exports one, with no writable and executable memory.
+	 */
+	class AotCache
+	{
+	private:
+		struct Library
+		{
+			void* handle;
+			const std::byte* source;
+			std::vector<jit::CompiledFunction> functions;
+		};
+
+	private:
+		std::map<const bin::Chunk*, Library> _libraries;
+
+	public:
+		AotCache() = default;
+		~AotCache();
+
+		AotCache(const AotCache&) = delete;
+		AotCache& operator= (const AotCache&) = delete;
+
+		/* Fails if the library can not be opened or was translated from other code */
+		bool load(const bin::Chunk* chunk, const std::string& library, const std::string& prefix);
+
+		jit::CompiledFunction find(const bin::Chunk* chunk, runtime::FunctionOffset function) const;
+
+		void release(const bin::Chunk* chunk);
+	};
+}
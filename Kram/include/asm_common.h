@@ -73,13 +73,13 @@ namespace kram::assembler
 	private:
 		template<typename _Ty>
 		requires std::integral<_Ty> || std::floating_point<_Ty>
-			static constexpr UInt8 _adapt(_Ty data)
+			static constexpr UInt64 _adapt(_Ty data)
 		{
 			if constexpr (std::integral<_Ty>)
 				return static_cast<UInt64>(data);
 			else if constexpr (sizeof(_Ty) == 4)
-				return static_cast<UInt64>(reinterpret_cast<UInt32>(&data));
-			else return reinterpret_cast<UInt64>(&data);
+				return static_cast<UInt64>(std::bit_cast<UInt32>(data));
+			else return std::bit_cast<UInt64>(data);
 		}
 
 		template<typename _Ty>
@@ -318,4 +318,98 @@ namespace kram::assembler::instruction
 
 	Instruction cst(DataType dest_type, DataType src_type, Register target);
 	Instruction cst(DataType dest_type, DataType src_type, const MemoryLocation& target);
+
+	Instruction call(UInt8 connection, UInt16 function);
+	inline Instruction call(UInt16 function) { return call(op::SelfConnection, function); }
+
+	/* "target" holds (connection << 16) | function */
+	Instruction callr(Register target);
+
+	Instruction ret();
+
+	Instruction tailcall(UInt8 connection, UInt16 function);
+	inline Instruction tailcall(UInt16 function) { return tailcall(op::SelfConnection, function); }
+
+	Instruction cmp(DataSize size, Register left, Register right);
+	Instruction cmp(DataSize size, Register left, const Value& right);
+	Instruction cmp(DataSize size, Register left, const MemoryLocation& right);
+
+	Instruction test(DataSize size, Register left, Register right);
+	Instruction test(DataSize size, Register left, const Value& right);
+
+	/* Branches are emitted in their short form with a zero offset. Their targets are
+	 * set with op::InstructionBuilder::branch(), which also picks the final form.
+	 */
+	Instruction jmp();
+	Instruction jcc(op::Condition condition);
+
+	Instruction cmpj(op::Condition condition, DataSize size, Register left, const Value& right);
+	Instruction cmpj(op::Condition condition, DataSize size, Register left, const MemoryLocation& right);
+
+	Instruction loop(Register counter);
+
+	Instruction switch_(Register index);
+
+	/* Three-address arithmetic: dest = left <op> right. Floating types select the F* opcodes. */
+	Instruction add(DataType type, Register dest, Register left, Register right);
+	Instruction add(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction sub(DataType type, Register dest, Register left, Register right);
+	Instruction sub(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction mul(DataType type, Register dest, Register left, Register right);
+	Instruction mul(DataType type, Register dest, Register left, const MemoryLocation& right);
+	/* Integer DIV and REM by zero do not trap, see op::Opcode::DIV_r_r_r */
+	Instruction div(DataType type, Register dest, Register left, Register right);
+	Instruction div(DataType type, Register dest, Register left, const MemoryLocation& right);
+
+	Instruction rem(DataType type, Register dest, Register left, Register right);
+	Instruction rem(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction and_(DataType type, Register dest, Register left, Register right);
+	Instruction and_(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction or_(DataType type, Register dest, Register left, Register right);
+	Instruction or_(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction xor_(DataType type, Register dest, Register left, Register right);
+	Instruction xor_(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction shl(DataType type, Register dest, Register left, Register right);
+	Instruction shl(DataType type, Register dest, Register left, const MemoryLocation& right);
+	Instruction shr(DataType type, Register dest, Register left, Register right);
+	Instruction shr(DataType type, Register dest, Register left, const MemoryLocation& right);
+
+	/* "double_precision" selects f64 over f32 */
+	Instruction sqrt(bool double_precision, Register dest, Register src);
+	Instruction sqrt(bool double_precision, Register dest, const MemoryLocation& src);
+
+	/* dest = left * right + addend */
+	Instruction fma(bool double_precision, Register dest, Register left, Register right, Register addend);
+	Instruction fma(bool double_precision, Register dest, Register left, Register right, const MemoryLocation& addend);
+
+	/* Vector opcodes: every register but "count" holds the address of a block */
+	Instruction vadd(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vsub(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vmul(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vmin(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vmax(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vfma(DataType type, Register dest, Register left, Register right, Register count);
+	Instruction vcmp(op::Condition condition, DataType type, Register mask, Register left, Register right, Register count);
+	Instruction vselect(DataType type, Register dest, Register mask, Register left, Register right, Register count);
+
+	/* Reductions of the block at "src" into the register "dest" */
+	Instruction vsum(DataType type, Register dest, Register src, Register count);
+	Instruction vrmin(DataType type, Register dest, Register src, Register count);
+	Instruction vrmax(DataType type, Register dest, Register src, Register count);
+	Instruction vargmin(DataType type, Register dest, Register src, Register count);
+	Instruction vargmax(DataType type, Register dest, Register src, Register count);
+	Instruction vdot(DataType type, Register dest, Register left, Register right, Register count);
+
+	/* Prefix sums from the block at "src" into the block at "dest" */
+	Instruction vscan(bool exclusive, DataType type, Register dest, Register src, Register count);
+
+	/* Bulk memory: "size" registers count bytes, "count" registers elements of "size" */
+	Instruction mset(DataSize size, Register dest, Register value, Register count);
+	Instruction mcmp(Register dest, Register left, Register right, Register size);
+	Instruction mfind(Register dest, Register src, Register size, Register pattern, Register pattern_size);
+	Instruction mfind(Register dest, Register src, Register size, Register value);
+
+	/* "indices" and "dest"/"src" hold block addresses; "table" is resolved once */
+	Instruction gather(DataSize size, DataSize index_size, Register dest, const MemoryLocation& table, Register indices, Register count);
+	Instruction scatter(DataSize size, DataSize index_size, const MemoryLocation& table, Register src, Register indices, Register count);
 }
@@ -138,15 +138,33 @@ namespace kram::bin
 }
 
 
+namespace kram::runtime
+{
+	struct DecodedCode;
+}
+
 namespace kram::bin
 {
+	/* r0-r8 */
+	constexpr UInt16 GeneralRegisterMask = 0x1FF;
+
 	struct Function
 	{
 		Size parameterCount;
 		Size stackCount;
 		std::uintptr_t codeOffset;
+		UInt16 registerMask = GeneralRegisterMask;	/* r0-r8 the function uses, declared by the assembler */
+
+		/* Calling convention: the first "registerArguments" arguments arrive in r0, r1...
+		 * and the first "registerResults" results go back to the caller the same way,
+		 * besides sr. Any other argument is passed on the stack (parameterCount).
+		 */
+		UInt8 registerArguments = 0;
+		UInt8 registerResults = 0;
 	};
 
+	constexpr UInt8 MaxRegisterArguments = 9;
+
 	struct Chunk
 	{
 	private:
@@ -161,9 +179,11 @@ namespace kram::bin
 		
 		std::byte* statics = nullptr;
 		Function* functions = nullptr;
-		Chunk* connections = nullptr;
+		Chunk** connections = nullptr;
 		std::byte* code = nullptr;
 
+		runtime::DecodedCode* decoded = nullptr;
+
 		Chunk() = default;
 		Chunk(Size size);
 		~Chunk();
@@ -181,6 +201,10 @@ namespace kram::bin
 	private:
 		Size _params = 0;
 		Size _stackSize = 0;
+		UInt16 _registers = 0;
+		bool _declaredRegisters = false;
+		UInt8 _registerArgs = 0;
+		UInt8 _registerResults = 0;
 		op::InstructionBuilder _code;
 		Size __codeByteCount = 0;
 
@@ -199,6 +223,20 @@ namespace kram::bin
 		inline Size parameters() const { return _params; }
 		inline Size stack_size() const { return _stackSize; }
 
+		/* r0-r8 the function uses. Taken from the code on build if never declared */
+		inline void registers(UInt16 mask) { _registers = mask & GeneralRegisterMask; _declaredRegisters = true; }
+		inline UInt16 registers() const { return _registers; }
+		inline bool declared_registers() const { return _declaredRegisters; }
+
+		/* Arguments and results passed in r0-r8, at most MaxRegisterArguments each */
+		inline void convention(UInt8 register_args, UInt8 register_results)
+		{
+			_registerArgs = std::min(register_args, MaxRegisterArguments);
+			_registerResults = std::min(register_results, MaxRegisterArguments);
+		}
+		inline UInt8 register_arguments() const { return _registerArgs; }
+		inline UInt8 register_results() const { return _registerResults; }
+
 		inline void code(const op::InstructionBuilder& code) { _code = code; }
 		inline void code(op::InstructionBuilder&& code) { _code = std::move(code); }
 		inline const op::InstructionBuilder& code() const { return _code; }
@@ -212,6 +250,7 @@ namespace kram::bin
 		std::vector<Size> _statics;
 		std::vector<FunctionBuilder> _functions;
 		std::vector<Chunk*> _connections;
+		bool _fuse = true;
 
 	public:
 		ChunkBuilder() = default;
@@ -230,6 +269,14 @@ namespace kram::bin
 		inline ChunkBuilder& operator<< (const FunctionBuilder& function) { return add_function(function), *this; }
 		inline ChunkBuilder& operator<< (Chunk* chunk) { return add_connection(chunk), *this; }
 
+		/* build() fuses superinstructions into the code of every function, and turns its
+		 * CALLs directly followed by RET into TAILCALL where the callee is a function of
+		 * this chunk with the same register results, see op::InstructionBuilder.
+		 * fuse(false) keeps the code as it was written.
+		 */
+		inline void fuse(bool enabled) { _fuse = enabled; }
+		inline bool fuse() const { return _fuse; }
+
 		void build(Chunk* chunk);
 	};
 }
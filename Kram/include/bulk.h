@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+
+namespace kram::bulk
+{
+	constexpr Size NotFound = ~Size(0);
+
+	/* Copies of at least "threshold" bytes bypass the cache with non-temporal stores;
+	 * 0 turns them off. The default is 4 MiB.
+	 */
+	void streaming(Size threshold);
+
+	/* memmove: the blocks may overlap */
+	void copy(void* dest, const void* src, Size size);
+
+	/* Repeats the low "element_size" (1, 2, 4 or 8) bytes of "value" "count" times */
+	void fill(void* dest, UInt64 value, Size element_size, Size count);
+
+	/* Offset of the first byte that differs, "size" when the blocks are equal */
+	Size mismatch(const void* left, const void* right, Size size);
+
+	/* Offset of the first occurrence of "value" or of the "pattern" block, NotFound
+	 * when there is none. An empty pattern is found at 0.
+	 */
+	Size find(const void* src, Size size, UInt8 value);
+	Size find(const void* src, Size size, const void* pattern, Size pattern_size);
+}
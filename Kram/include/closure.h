@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+#include "bindata.h"
+#include "runtime.h"
+#include "decoder.h"
+
+namespace kram::runtime
+{
+	constexpr Size DefaultClosureThreshold = 16;
+
+	/* Per-VM function-pointer threaded code. Once execute() has entered a chunk
+	 * "threshold" times it is decoded by decode_chunk() into records whose handlers
+	 * tail-call each other, so dispatch needs neither computed goto nor executable
+	 * memory. Calls, returns and branches run on the records like in the decoded
+	 * stream, and the raw interpreter hands frames back to them at calls and back
+	 * edges. 0 disables the tier.
+	 */
+	class ClosureCache
+	{
+	private:
+		struct Entry
+		{
+			const std::byte* source;
+			Size calls;
+			DecodedCode* code;
+		};
+
+	private:
+		std::map<const bin::Chunk*, Entry> _entries;
+		Size _threshold;
+		Size _runs;
+
+	public:
+		ClosureCache();
+		~ClosureCache();
+
+		ClosureCache(const ClosureCache&) = delete;
+		ClosureCache& operator= (const ClosureCache&) = delete;
+
+		inline void threshold(Size threshold) { _threshold = threshold; }
+		inline Size threshold() const { return _threshold; }
+
+		/* Times a frame went on to closure records */
+		inline Size runs() const { return _runs; }
+		inline void count_run() { _runs++; }
+
+		/* Counts an execute() of the chunk and, once it is warm, points its targets at the
+		 * records. Returns them, or nullptr while the chunk is cold.
+		 */
+		const DecodedCode* warm(const bin::Chunk* chunk, const CallTarget* targets);
+
+		void release(const bin::Chunk* chunk);
+	};
+}
@@ -275,10 +275,27 @@ namespace kram::utils
 
 #if defined(_MSC_VER) || defined(_MSVC_LANG)
 	#define forceinline __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+	#define forceinline inline __attribute__((always_inline))
 #else
 	#define forceinline inline
 #endif
 
+#if !defined(KRAM_NO_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+	#define KRAM_THREADED_DISPATCH
+#endif
+
+/* Guaranteed tail call, used by the closure tier to chain handlers. Without it
+ * handlers return the next record to a driver loop.
+ */
+#if defined(__has_cpp_attribute)
+	#if __has_cpp_attribute(clang::musttail)
+		#define KRAM_MUSTTAIL [[clang::musttail]]
+	#elif __has_cpp_attribute(gnu::musttail)
+		#define KRAM_MUSTTAIL [[gnu::musttail]]
+	#endif
+#endif
+
 #define scast(_Type, _Value) static_cast<_Type>(_Value)
 #define rcast(_Type, _Value) reinterpret_cast<_Type>(_Value)
 
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "common.h"
+#include "opcodes.h"
+#include "bindata.h"
+
+namespace kram::runtime
+{
+	struct RuntimeState;
+	union Registers;
+	struct LocalState;
+	struct DecodedInstruction;
+
+	/* Closure-tier handler: runs "inst" and chains to the next record. Returns the record
+	 * its caller has to run next, or nullptr once the raw interpreter has to take over.
+	 */
+	typedef const DecodedInstruction* (*ClosureHandler)(LocalState& state, const DecodedInstruction* inst);
+
+	/* Fixed-width form of one bytecode instruction, with every operand already
+	 * extracted from its bit fields. Memory locations are resolved to
+	 * <segment, base, index << scale, delta>, so handlers never touch the
+	 * <segment|has_reg2|reg2_split|has_delta|delta_size> encoding again.
+	 *
+	 * Control flow and arithmetic records:
+	 *   CMP_r_r, TEST_r_r: reg, aux second register, imm size
+	 *   CMP_r_imm, TEST_r_imm, CMP_r_m: reg, aux size, imm value or the memory location
+	 *   JMP_s32, JCC_s32 (aux condition), LOOP_s32 (reg counter): imm branch offset,
+	 *     sign-extended and relative to the end of the instruction. CMPJ decodes into
+	 *     a CMP record and a JCC record, short forms into the long one.
+	 *   CALL, TAILCALL: aux connection, imm function. CALLR: reg.
+	 *   Arithmetic: reg dest, aux src1, imm the byte after them, src2 and its size,
+	 *     signed or double bits in place. FFMA_r_r_r_r keeps its double bit in bit 8
+	 *     and FSQRT_r_m its double bit in imm.
+	 */
+	struct DecodedInstruction
+	{
+		union
+		{
+			const void* handler;	/* execute_decoded() label */
+			ClosureHandler closure;
+		};
+
+		op::Opcode opcode;
+		UInt8 reg;		/* dest/src register */
+		UInt8 aux;		/* second register, add_ref/ref_inc flag or cast types, depending on opcode */
+
+		UInt8 segment;
+		UInt8 base;
+		bool indexed;
+		UInt8 index;
+		UInt8 scale;	/* index shift: 0, 1, 2 or 3 */
+
+		UInt64 delta;
+		UInt64 imm;
+	};
+	static_assert(sizeof(DecodedInstruction) == 32, "DecodedInstruction must stay fixed-width");
+
+	/* Record index of a code offset that does not start an instruction */
+	constexpr Size NoRecord = static_cast<Size>(-1);
+
+	/* A chunk decoded by decode_chunk(). Branch records hold the distance in records to
+	 * their target in "imm" and its code offset in "delta"; calls hold the offset they
+	 * return to in "delta".
+	 */
+	struct DecodedCode
+	{
+		Size count;
+		DecodedInstruction* code;
+		Size* indices;	/* record index of each code offset, codeCount + 1 of them */
+	};
+
+	/* Sentinel opcode closing every decoded stream. "imm" holds the code offset where
+	 * the raw interpreter resumes, the end of the code for the last record, which has
+	 * "aux" set.
+	 */
+	constexpr op::Opcode DecodedEnd = static_cast<op::Opcode>(op::OpcodeCount);
+
+	/* Appends the record(s) of the instruction at "code" to "out". Returns the instruction
+	 * size in bytes, or 0 if the opcode is unknown or its operands run past "end".
+	 */
+	Size decode_one(const std::byte* code, const std::byte* end, std::vector<DecodedInstruction>& out);
+
+	/* Size in bytes of the instruction at "code", whether it decodes to records or not.
+	 * 0 if the opcode is unknown or its operands run past "end".
+	 */
+	Size instruction_size(const std::byte* code, const std::byte* end);
+
+	/* Registers r0-r8 the code reads or writes, all of them if it holds an unknown opcode */
+	UInt16 used_registers(const std::byte* code, Size size);
+
+	/* The instructions of a function for the native tiers, from "start" up to the first
+	 * unknown opcode. Instructions without a record have no "records".
+	 */
+	struct DecodedFunction
+	{
+		struct Instruction
+		{
+			Size offset;
+			Size size;
+			std::vector<DecodedInstruction> records;
+		};
+
+		Size start;
+		std::vector<Instruction> code;
+		std::vector<Size> indices;	/* instruction at each offset from "start" to the end, NoRecord between them */
+
+		/* NoRecord if no instruction of the function starts at "offset" */
+		inline Size index(Size offset) const { return offset >= start && offset - start < indices.size() ? indices[offset - start] : NoRecord; }
+
+		/* Code offset a JMP, JCC or LOOP record of "inst" branches to */
+		static inline Size target(const Instruction& inst, const DecodedInstruction& record)
+		{
+			return static_cast<Size>(static_cast<Int64>(inst.offset + inst.size) + static_cast<Int64>(record.imm));
+		}
+	};
+
+	DecodedFunction decode_function(const bin::Chunk* chunk, Size start, Size end);
+
+	/* Whether a JCC may read the flags before they are written again, from the start of
+	 * each instruction of "function" on. Offsets without an instruction count as reading
+	 * them; CALL, CALLR, TAILCALL and RET leave them undefined.
+	 */
+	std::vector<bool> flags_live(const bin::Chunk* chunk, const DecodedFunction& function);
+
+	/* Flags only live in the interpreter, so native code handing a frame back to it loses
+	 * them. True unless a JCC may read flags written by native code after one of the
+	 * "exits", the instructions left to the interpreter, after a branch to an offset that
+	 * starts no instruction of the function, or past its last instruction. CALL, CALLR,
+	 * TAILCALL and RET leave the flags undefined.
+	 */
+	bool flags_survive_exits(const bin::Chunk* chunk, const DecodedFunction& function, const std::vector<bool>& exits);
+
+	/* Decodes the whole chunk, with execute_decoded() handlers. Instructions that have no
+	 * record, vector, bulk memory and SWITCH opcodes, become end records that hand the
+	 * frame to the raw interpreter. nullptr if a function starts past the code.
+	 */
+	DecodedCode* decode_chunk(const bin::Chunk* chunk);
+
+	/* Stores decode_chunk() in the chunk, which execute() then runs on */
+	bool predecode(bin::Chunk* chunk);
+
+	void _destroy_decoded(DecodedCode* decoded);
+
+	const void* _decoded_handler(op::Opcode opcode);
+
+	ClosureHandler _closure_handler(op::Opcode opcode);
+
+	/* Runs a single data, compare or arithmetic record on the window "regs" with "flags".
+	 * Returns the flags it leaves.
+	 */
+	UInt8 _execute_step(RuntimeState* state, Registers* regs, const DecodedInstruction& inst, UInt8 flags);
+}
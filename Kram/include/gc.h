@@ -0,0 +1,120 @@
+#pragma once
+
+#include "common.h"
+#include "heap.h"
+#include "bindata.h"
+#include "runtime.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace kram::gc
+{
+	constexpr Size DefaultSweepBatch = 4096;
+
+	/* Tracing mark-sweep collection of a Heap, for scripts that do not count references.
+	 * Roots are the statics of added chunks, pinned blocks, blocks with refs above 0 and,
+	 * inside execute(), every live frame: the registers and stack of each window up to
+	 * the innermost one and the statics of the chunks they run. Registers are read as
+	 * whole words. Statics, frames and blocks with a layout (see root_layout and
+	 * Heap::layout) are read only at the offsets of their pointers; without one they are
+	 * scanned conservatively at every byte offset, since the VM packs values with no
+	 * alignment. Unreachable blocks are freed by sweep(), a batch at a time, through
+	 * Heap::reclaim, which leaves blocks already on the remote list to their drain.
+	 * Heap::garbage_collector and gc_step free unreferenced blocks, so they must not be
+	 * used on the same heap. Nothing is collected while the heap is in arena mode.
+	 */
+	class Collector
+	{
+	private:
+		/* A run of slots, or a single large block with stride 0 */
+		struct Region
+		{
+			std::uintptr_t begin;
+			std::uintptr_t end;
+			Size stride;
+			Size marks;	/* index of the mark bit of its first block */
+		};
+
+		/* Offsets of the pointers in one element, repeated over the whole block */
+		struct Layout
+		{
+			Size size;
+			std::vector<Size> pointers;
+		};
+
+		/* Layouts of the roots of one chunk, null where unknown */
+		struct RootLayout
+		{
+			const bin::DataType* statics = nullptr;
+			std::vector<const bin::DataType*> frames;	/* by function */
+		};
+
+	private:
+		Heap& _heap;
+		Size _batch;
+		Size _interval;
+		Size _countdown;
+		std::vector<const bin::Chunk*> _chunks;
+		std::vector<void*> _pins;
+		std::vector<Region> _regions;
+		std::vector<UInt64> _marks;
+		std::vector<Heap::Header*> _pending;	/* marked, not scanned yet */
+		std::vector<void*> _garbage;
+		std::unordered_map<const bin::DataType*, Layout> _layouts;
+		std::unordered_map<const bin::Chunk*, RootLayout> _roots;
+
+	public:
+		explicit Collector(Heap& heap, Size batch = DefaultSweepBatch);
+		~Collector() = default;
+
+		Collector(const Collector&) = delete;
+		Collector& operator= (const Collector&) = delete;
+
+		void add_root(const bin::Chunk* chunk);
+		void remove_root(const bin::Chunk* chunk);
+
+		/* Layout of the statics of "chunk", or of the parameters and locals of one of its
+		 * functions, each laid out as one struct from the start of its segment. Null goes
+		 * back to scanning them conservatively. The type must outlive the collector.
+		 */
+		void root_layout(const bin::Chunk* chunk, const bin::DataType* statics);
+		void root_layout(const bin::Chunk* chunk, runtime::FunctionOffset function, const bin::DataType* frame);
+
+		/* Keeps a block the host holds alive without touching its reference count */
+		void pin(void* block);
+		void unpin(void* block);
+
+		/* Marks from the roots and queues every unreachable block for sweep(). "window" is
+		 * the innermost register window of "state" while execute() runs it. Blocks left
+		 * from the previous collection are freed first. Returns the blocks queued.
+		 */
+		Size collect(const runtime::RuntimeState* state = nullptr, const runtime::Registers* window = nullptr);
+
+		/* Frees up to a batch of queued blocks, and gives the runs the last batch leaves
+		 * empty back with Heap::release_runs. Returns true once none are left.
+		 */
+		bool sweep();
+
+		inline Size pending() const { return _garbage.size(); }
+
+		/* Collects every "interval" safepoints, 0 disables it, and sweeps a batch at each
+		 * safepoint in between. execute() calls safepoint() when the collector is set on
+		 * its KramState, see Heap::gc_pacing for where.
+		 */
+		inline void pacing(Size interval) { _interval = interval; _countdown = interval; }
+		void safepoint(const runtime::RuntimeState* state, const runtime::Registers* window);
+
+	private:
+		void _index();
+		Heap::Header* _find(std::uintptr_t address, Size& mark) const;
+		void _mark(std::uintptr_t address);
+		void _scan(const std::byte* begin, const std::byte* end);
+		void _scan_typed(const std::byte* begin, const std::byte* end, const bin::DataType* type);
+		void _scan_block(Heap::Header* header);
+		void _scan_statics(const bin::Chunk* chunk);
+		void _scan_frames(const runtime::RuntimeState* state, const runtime::Registers* window);
+		const bin::DataType* _frame_layout(const runtime::RuntimeState* state, const runtime::Registers* regs) const;
+		const Layout& _layout(const bin::DataType* type);
+	};
+}
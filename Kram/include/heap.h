@@ -2,29 +2,168 @@
 
 #include "common.h"
 
+#include <atomic>
+#include <chrono>
+
+namespace kram::bin
+{
+	class DataType;
+}
+
 namespace kram
 {
+	/* Runs, free lists and the collector state belong to a Heap, that is to one KramState,
+	 * not to a thread. Whichever thread runs the state owns them while it does; nothing
+	 * but free() may be called on the heap from another thread at the same time.
+	 * Every block names its owner in its Header, which nothing rewrites while it lives.
+	 */
 	class Heap
 	{
 	public:
 		struct Header
 		{
-			Header* next;
-			Header* prev;
+			union
+			{
+				Header* next;
+				const bin::DataType* layout;	/* small blocks while live */
+			};
+			Heap* owner;
 			Size size;
 			UInt64 refs;
 		};
 
+		/* Blocks up to SmallBlockLimit bytes come from runs of RunSize bytes, each run
+		 * holding slots of a single size class. Larger blocks are allocated one by one.
+		 * Runs come from a pool shared by every heap of the process, RunBatch at a time;
+		 * runs left empty go back at the end of each collection, and a destroyed heap
+		 * gives all of its runs back.
+		 */
+		static constexpr Size SmallBlockLimit = 1024;
+		static constexpr Size RunSize = 64 * 1024;
+		static constexpr Size SizeClassCount = 20;
+		static constexpr Size RunBatch = 8;
+
+		/* A freed slot keeps its header with this size, which no live block can have */
+		static constexpr Size FreeSlot = ~Size(0);
+
+		/* Refs of a block being freed, which keeps it until its owner drains it when it
+		 * was freed from another thread
+		 */
+		static constexpr UInt64 RemoteRefs = ~UInt64(0);
+
+		/* Arena pages are at least this big; larger blocks get a page of their own */
+		static constexpr Size ArenaPageSize = 256 * 1024;
+
+		/* Blocks a timed gc_step visits between two clock reads */
+		static constexpr Size GcBatch = 256;
+
 	private:
+		/* Runs are aligned to RunSize, so a slot finds its run by masking its address */
+		struct alignas(16) Run
+		{
+			Run* next;
+			Size carved;	/* slots handed out at least once */
+			Size capacity;
+			Size stride;
+			Size live;
+		};
+
+		/* Large blocks are preceded by the back link of the large list and by the link of
+		 * the remote list, which cannot reuse "next" while the block is still linked in
+		 * the owner's list. The remote link is only needed once the block is dead, so it
+		 * shares the slot with the layout, which small blocks keep in "next".
+		 */
+		struct LargePrefix
+		{
+			Header* prev;
+			union
+			{
+				Header* remote;
+				const bin::DataType* layout;
+			};
+		};
+
+		struct SizeClass
+		{
+			Header* free;
+			Run* runs;
+		};
+
+		struct ArenaPage
+		{
+			ArenaPage* next;
+			Size size;
+		};
+
+		/* Where gc_step resumes: the large list first, then the runs of every class */
+		struct GcCursor
+		{
+			Header* large;
+			Size cls;
+			Run* run;
+			Size slot;
+			bool active;
+		};
+
+		struct RunPool;
+		static RunPool _pool;
+
 		Header* _last;
 		Size _size;
+		SizeClass _classes[SizeClassCount];
+		Run* _spare;
+		std::atomic<Header*> _remote;
+
+		GcCursor _gc;
+		Size _gc_interval;
+		Size _gc_countdown;
+		std::chrono::nanoseconds _gc_budget;
+
+		bool _arena;
+		ArenaPage* _pages;
+		ArenaPage* _page;
+		std::byte* _top;
+		std::byte* _end;
 
 	public:
 		Heap();
+		Heap(const Heap&) = delete;
 		~Heap();
 
+		Heap& operator= (const Heap&) = delete;
+
 		void* malloc(Size block_size, bool assign_ref = true);
-		inline void free(void* ptr) { _free(reinterpret_cast<Header*>(ptr) - 1); }
+
+		/* Any thread may free a block. A block of another heap is pushed onto that heap's
+		 * remote list without locking, and its owner releases the whole list the next
+		 * time it runs short of slots or collects. The owner must outlive its blocks.
+		 * Another thread may only free a block the owner's collectors can not release
+		 * meanwhile: one it holds a reference to, or any while the owner is not
+		 * collecting. The block is claimed by swapping RemoteRefs into its refs before
+		 * its size is read, so collectors leave it alone until the owner drains it.
+		 */
+		void free(void* ptr);
+
+		/* free() for collectors running on the owner: claims an unreferenced block like
+		 * garbage_collector does. Returns false, leaving the block alone, when it is
+		 * referenced again or already on the remote list.
+		 */
+		bool reclaim(void* ptr);
+
+		/* In arena mode malloc bumps a pointer through pages the heap keeps, blocks have
+		 * no Header, and free and the reference counting members do nothing. Nothing is
+		 * released until reset(). Leaving arena mode resets it; blocks allocated before
+		 * entering it must not be freed while it lasts.
+		 */
+		void arena(bool enabled);
+		inline bool arena() const { return _arena; }
+
+		/* Drops every arena block at once, keeping the pages for the next allocations */
+		void reset();
+
+		/* Reference counting through the heap, which knows whether blocks have a Header */
+		inline void add_ref(void* ptr) { if (!_arena) increase_ref(ptr); }
+		inline void remove_ref(void* ptr) { if (!_arena) decrease_ref(ptr); }
 
 		static inline Header& header(void* ptr) { return *(reinterpret_cast<Header*>(ptr) - 1); }
 		static inline const Header& header(const void* ptr) { return *(reinterpret_cast<const Header*>(ptr) - 1); }
@@ -44,7 +183,79 @@ namespace kram
 
 		void garbage_collector();
 
+		/* Incremental collection. Each step resumes where the previous one stopped and
+		 * frees the unreferenced blocks among the next "max_blocks" it visits, or among
+		 * those it visits before "budget" elapses. Returns true when the step finishes a
+		 * pass over the whole heap; the next step starts a new one.
+		 */
+		bool gc_step(Size max_blocks);
+		bool gc_step(std::chrono::nanoseconds budget);
+
+		/* Runs gc_step(budget) every "interval" safepoints, 0 disables it. execute() is a
+		 * safepoint. While pacing or a gc::Collector is set when execute() starts, so are
+		 * every CALL, CALLR and TAILCALL and every taken backward JMP, JCC, CMPJ and LOOP
+		 * of the raw interpreter; code running on the JIT, AOT libraries or traces has none.
+		 */
+		void gc_pacing(Size interval, std::chrono::nanoseconds budget);
+		inline bool paced() const { return _gc_interval != 0; }
+		inline void safepoint()
+		{
+			if (_gc_countdown != 0 && --_gc_countdown == 0)
+			{
+				_gc_countdown = _gc_interval;
+				gc_step(_gc_budget);
+			}
+		}
+
+		/* Releases the blocks other threads freed, which steps and collections do first */
+		void drain_remote();
+
+		/* Gives the runs without live slots back to the shared pool in one batch, dropping
+		 * their free slots from the free lists. garbage_collector, the step finishing a
+		 * pass and gc::Collector once it has swept do it; a pass in progress restarts.
+		 */
+		void release_runs();
+
+		/* Gives the runs pooled by destroyed heaps back to the system */
+		static void trim();
+
+		/* Layout of the values a block holds, for tracing collectors; null unless set.
+		 * malloc clears it, and the type must outlive the block.
+		 */
+		static void layout(void* ptr, const bin::DataType* type);
+		static const bin::DataType* layout(const void* ptr);
+
+		/* For tracing collectors: "func(slots, stride, carved)" for every run, each slot
+		 * a Header followed by its block, and "func(header)" for every large block.
+		 */
+		template<typename _Func>
+		void for_each_run(_Func func) const
+		{
+			for (const SizeClass& cls : _classes)
+				for (const Run* run = cls.runs; run; run = run->next)
+					func(reinterpret_cast<std::byte*>(const_cast<Run*>(run) + 1), run->stride, run->carved);
+		}
+
+		template<typename _Func>
+		void for_each_large(_Func func) const
+		{
+			for (Header* header = _last; header; header = _prefix(header).prev)
+				func(header);
+		}
+
 	private:
+		static inline LargePrefix& _prefix(Header* header) { return *(reinterpret_cast<LargePrefix*>(header) - 1); }
+		static inline Run* _run(Header* header)
+		{
+			return reinterpret_cast<Run*>(reinterpret_cast<std::uintptr_t>(header) & ~std::uintptr_t(RunSize - 1));
+		}
+		static Header*& _remote_next(Header* header);
+
+		void* _alloc_arena(Size block_size);
+		Header* _alloc_small(Size block_size);
+		Run* _new_run();
+		void _free_small(Header* header);
 		void _free(Header* header);
+		void _free_remote(Header* header);
 	};
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common.h"
+#include "bindata.h"
+#include "runtime.h"
+
+#if !defined(KRAM_NO_JIT) && (defined(__x86_64__) || defined(_M_X64))
+	#define KRAM_JIT_X64
+#endif
+
+namespace kram::jit
+{
+	/* Machine code of a bin::Function. Returns the offset, inside the chunk code, where
+	 * the interpreter has to resume: an instruction it could not compile, a branch target
+	 * outside the function, or the end of the function.
+	 */
+	typedef runtime::NativeFunction CompiledFunction;
+
+	struct CompiledCode
+	{
+		CompiledFunction entry;
+		void* memory;
+		Size memorySize;
+		Size bytecodeSize;	/* bytecode bytes covered by "entry" */
+	};
+
+	constexpr Size DefaultThreshold = 1000;
+
+	bool available();
+
+	/* Offset of the next function entry after "start", or the end of the chunk code */
+	Size function_end(const bin::Chunk* chunk, Size start);
+
+	/* Compiles "function", loops included; unsupported instructions exit to the interpreter.
+	 * "entry" is null when the first instruction is unsupported, or when an exit could lose
+	 * the flags a later JCC reads.
+	 */
+	CompiledCode compile(const bin::Chunk* chunk, runtime::FunctionOffset function);
+
+	void release(CompiledCode& code);
+
+
+	/* Per-VM call counters and compiled code. A function is compiled once execute()
+	 * and CALL, CALLR or TAILCALL have entered it "threshold" times; 0 disables promotion.
+	 */
+	class JitCache
+	{
+	private:
+		struct Entry
+		{
+			const std::byte* source;
+			Size calls;
+			bool compiled;
+			CompiledCode code;
+		};
+
+	private:
+		std::map<std::pair<const bin::Chunk*, runtime::FunctionOffset>, Entry> _entries;
+		Size _threshold;
+
+	public:
+		JitCache();
+		~JitCache();
+
+		JitCache(const JitCache&) = delete;
+		JitCache& operator= (const JitCache&) = delete;
+
+		inline void threshold(Size threshold) { _threshold = threshold; }
+		inline Size threshold() const { return _threshold; }
+
+		/* Counts "calls" calls. Returns the compiled code once the function has been promoted. */
+		CompiledFunction promote(const bin::Chunk* chunk, runtime::FunctionOffset function, Size calls = 1);
+
+		void release(const bin::Chunk* chunk);
+	};
+}
@@ -0,0 +1,381 @@
+#pragma once
+
+#include "common.h"
+#include "jit.h"
+#include "decoder.h"
+
+#if defined(KRAM_JIT_X64)
+namespace kram::jit::x64
+{
+	enum class HostReg : UInt8
+	{
+		rax = 0, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+		r8, r9, r10, r11, r12, r13, r14, r15
+	};
+
+	/* Generated code keeps the VM registers, frame base, statics and heap in callee-saved
+	 * host registers, and uses rax/rcx/rdx plus the argument registers as scratch.
+	 */
+	constexpr HostReg RegsReg = HostReg::rbx;
+	constexpr HostReg FrameReg = HostReg::r12;
+	constexpr HostReg StaticsReg = HostReg::r13;
+	constexpr HostReg HeapReg = HostReg::r14;
+
+	/* The last CMP or TEST keeps the flags in the byte above the Win64 shadow space,
+	 * as op::Condition lays them out
+	 */
+	constexpr Int32 FlagsDisp = 32;
+
+	/* Condition codes of the Jcc and SETcc encodings */
+	enum class HostCondition : UInt8
+	{
+		Below = 0x2, AboveEqual = 0x3, Equal = 0x4, NotEqual = 0x5, Sign = 0x8, Less = 0xC
+	};
+
+#if defined(_WIN32)
+	constexpr HostReg ArgRegs[] = { HostReg::rcx, HostReg::rdx, HostReg::r8, HostReg::r9 };
+#else
+	constexpr HostReg ArgRegs[] = { HostReg::rdi, HostReg::rsi, HostReg::rdx, HostReg::rcx };
+#endif
+
+	/* Host functions called from generated code */
+	void* heap_malloc(Heap* heap, Size size, bool add_ref);
+	void heap_free(Heap* heap, void* ptr);
+	void heap_increase_ref(Heap* heap, void* ptr);
+	void heap_decrease_ref(Heap* heap, void* ptr);
+	void memory_copy(void* dst, const void* src, Size size);
+
+	/* DIV and REM of the low "mode & 0xFF" bytes, signed if bit 8 is set and REM if bit 9
+	 * is, with the results op::Opcode::DIV_r_r_r defines for 0 and MIN / -1
+	 */
+	UInt64 integer_divide(UInt64 left, UInt64 right, UInt32 mode);
+
+	class Emitter;
+
+	/* Instructions the templates below handle */
+	bool supported(const runtime::DecodedInstruction& inst);
+
+	/* Address of the instruction's memory location into rax. Clobbers rcx. */
+	void emit_address(Emitter& em, const runtime::DecodedInstruction& inst);
+
+	/* Generic template of "inst", reading and writing VM registers in memory */
+	void emit_instruction(Emitter& em, const runtime::DecodedInstruction& inst);
+
+	/* Template of a JMP, JCC or LOOP record. Returns the position of its rel32, which
+	 * Emitter::patch() points at the target once it is known. With "taken" false, the
+	 * JCC or LOOP jumps where the record falls through instead.
+	 */
+	Size emit_branch(Emitter& em, const runtime::DecodedInstruction& inst, bool taken = true);
+
+	/* Copies "code" into a fresh executable region */
+	bool install(const std::vector<UInt8>& code, CompiledCode& result);
+	void uninstall(CompiledCode& code);
+
+	forceinline Int32 reg_disp(UInt8 reg) { return scast(Int32, reg * sizeof(runtime::Register)); }
+
+	forceinline bool fits_int32(UInt64 value) { return scast(Int64, value) == scast(Int64, scast(Int32, value)); }
+
+	class Emitter
+	{
+	private:
+		std::vector<UInt8> _code;
+
+	public:
+		inline const std::vector<UInt8>& code() const { return _code; }
+		inline Size size() const { return _code.size(); }
+
+		inline void byte(UInt8 value) { _code.push_back(value); }
+
+		inline void dword(UInt32 value)
+		{
+			for (int i = 0; i < 4; i++)
+				byte(scast(UInt8, value >> (i * 8)));
+		}
+
+		inline void qword(UInt64 value)
+		{
+			for (int i = 0; i < 8; i++)
+				byte(scast(UInt8, value >> (i * 8)));
+		}
+
+		/* REX prefix, omitted when it would be 0x40 and "force" is false */
+		void rex(bool w, HostReg reg, HostReg rm, bool force = false)
+		{
+			UInt8 value = 0x40 | (w ? 0x08 : 0) | (scast(UInt8, reg) >= 8 ? 0x04 : 0) | (scast(UInt8, rm) >= 8 ? 0x01 : 0);
+			if (value != 0x40 || force)
+				byte(value);
+		}
+
+		/* [base + disp32] */
+		void modrm_mem(HostReg reg, HostReg base, Int32 disp)
+		{
+			byte(0x80 | ((scast(UInt8, reg) & 7) << 3) | (scast(UInt8, base) & 7));
+			if ((scast(UInt8, base) & 7) == 4)
+				byte(0x24);
+			dword(scast(UInt32, disp));
+		}
+
+		void modrm_reg(HostReg reg, HostReg rm)
+		{
+			byte(0xC0 | ((scast(UInt8, reg) & 7) << 3) | (scast(UInt8, rm) & 7));
+		}
+
+		/* Zero-extending load of 1, 2, 4 or 8 bytes */
+		void load(Size width, HostReg dst, HostReg base, Int32 disp)
+		{
+			switch (width)
+			{
+				case 1: rex(false, dst, base); byte(0x0F); byte(0xB6); break;
+				case 2: rex(false, dst, base); byte(0x0F); byte(0xB7); break;
+				case 4: rex(false, dst, base); byte(0x8B); break;
+				default: rex(true, dst, base); byte(0x8B); break;
+			}
+			modrm_mem(dst, base, disp);
+		}
+
+		/* Sign-extending load of 1, 2, 4 or 8 bytes */
+		void load_signed(Size width, HostReg dst, HostReg base, Int32 disp)
+		{
+			rex(true, dst, base);
+			switch (width)
+			{
+				case 1: byte(0x0F); byte(0xBE); break;
+				case 2: byte(0x0F); byte(0xBF); break;
+				case 4: byte(0x63); break;
+				default: byte(0x8B); break;
+			}
+			modrm_mem(dst, base, disp);
+		}
+
+		void store(Size width, HostReg base, Int32 disp, HostReg src)
+		{
+			switch (width)
+			{
+				case 1: rex(false, src, base, scast(UInt8, src) >= 4); byte(0x88); break;
+				case 2: byte(0x66); rex(false, src, base); byte(0x89); break;
+				case 4: rex(false, src, base); byte(0x89); break;
+				default: rex(true, src, base); byte(0x89); break;
+			}
+			modrm_mem(src, base, disp);
+		}
+
+		void lea(HostReg dst, HostReg base, Int32 disp)
+		{
+			rex(true, dst, base);
+			byte(0x8D);
+			modrm_mem(dst, base, disp);
+		}
+
+		void mov(HostReg dst, HostReg src)
+		{
+			rex(true, src, dst);
+			byte(0x89);
+			modrm_reg(src, dst);
+		}
+
+		void mov_imm(HostReg dst, UInt64 imm)
+		{
+			rex(true, HostReg::rax, dst);
+			byte(0xB8 | (scast(UInt8, dst) & 7));
+			qword(imm);
+		}
+
+		void add(HostReg dst, HostReg src)
+		{
+			rex(true, src, dst);
+			byte(0x01);
+			modrm_reg(src, dst);
+		}
+
+		void add_imm(HostReg dst, Int32 imm)
+		{
+			rex(true, HostReg::rax, dst);
+			byte(0x81);
+			modrm_reg(HostReg::rax, dst);
+			dword(scast(UInt32, imm));
+		}
+
+		void and_imm(HostReg dst, Int32 imm)
+		{
+			rex(true, HostReg::rsp, dst);
+			byte(0x81);
+			modrm_reg(HostReg::rsp, dst);
+			dword(scast(UInt32, imm));
+		}
+
+		/* add, or, and, sub, xor, cmp or test dst, src by its opcode byte */
+		void alu(UInt8 opcode, HostReg dst, HostReg src)
+		{
+			rex(true, src, dst);
+			byte(opcode);
+			modrm_reg(src, dst);
+		}
+
+		void imul(HostReg dst, HostReg src)
+		{
+			rex(true, dst, src);
+			byte(0x0F);
+			byte(0xAF);
+			modrm_reg(dst, src);
+		}
+
+		/* shl (4), shr (5) or sar (7) dst, cl */
+		void shift_cl(UInt8 extension, HostReg dst)
+		{
+			rex(true, HostReg::rax, dst);
+			byte(0xD3);
+			modrm_reg(scast(HostReg, extension), dst);
+		}
+
+		/* Low byte of one of rax, rcx, rdx or rbx */
+		void setcc(HostCondition condition, HostReg dst)
+		{
+			byte(0x0F);
+			byte(0x90 | scast(UInt8, condition));
+			modrm_reg(HostReg::rax, dst);
+		}
+
+		/* bt base32, bit32: carry is bit "bit" of "base" */
+		void bt(HostReg base, HostReg bit)
+		{
+			rex(false, bit, base);
+			byte(0x0F);
+			byte(0xA3);
+			modrm_reg(bit, base);
+		}
+
+		void shl_imm(HostReg dst, UInt8 amount)
+		{
+			rex(true, HostReg::rsp, dst);
+			byte(0xC1);
+			modrm_reg(HostReg::rsp, dst);
+			byte(amount);
+		}
+
+		void cmp(HostReg left, HostReg right)
+		{
+			rex(true, right, left);
+			byte(0x39);
+			modrm_reg(right, left);
+		}
+
+		/* jne rel32, returns the position to patch() */
+		Size jne()
+		{
+			return jcc(HostCondition::NotEqual);
+		}
+
+		/* jcc rel32, Below being the carry, returns the position to patch() */
+		Size jcc(HostCondition condition)
+		{
+			byte(0x0F);
+			byte(0x80 | scast(UInt8, condition));
+			dword(0);
+			return size() - 4;
+		}
+
+		/* jmp rel32, returns the position to patch() */
+		Size jmp()
+		{
+			byte(0xE9);
+			dword(0);
+			return size() - 4;
+		}
+
+		void patch(Size position, Size target)
+		{
+			UInt32 rel = scast(UInt32, scast(Int32, scast(Int64, target) - scast(Int64, position + 4)));
+			for (int i = 0; i < 4; i++)
+				_code[position + i] = scast(UInt8, rel >> (i * 8));
+		}
+
+		/* cvtsi2sd xmm0, src */
+		void cvtsi2sd(HostReg src)
+		{
+			byte(0xF2);
+			rex(true, HostReg::rax, src);
+			byte(0x0F);
+			byte(0x2A);
+			modrm_reg(HostReg::rax, src);
+		}
+
+		/* cvttsd2si dst, xmm0 */
+		void cvttsd2si(HostReg dst)
+		{
+			byte(0xF2);
+			rex(true, dst, HostReg::rax);
+			byte(0x0F);
+			byte(0x2C);
+			modrm_reg(dst, HostReg::rax);
+		}
+
+		/* movsd xmm0, [base + disp32] */
+		void movsd_load(HostReg base, Int32 disp)
+		{
+			byte(0xF2);
+			rex(false, HostReg::rax, base);
+			byte(0x0F);
+			byte(0x10);
+			modrm_mem(HostReg::rax, base, disp);
+		}
+
+		/* movsd [base + disp32], xmm0 */
+		void movsd_store(HostReg base, Int32 disp)
+		{
+			byte(0xF2);
+			rex(false, HostReg::rax, base);
+			byte(0x0F);
+			byte(0x11);
+			modrm_mem(HostReg::rax, base, disp);
+		}
+
+		void push(HostReg reg)
+		{
+			if (scast(UInt8, reg) >= 8)
+				byte(0x41);
+			byte(0x50 | (scast(UInt8, reg) & 7));
+		}
+
+		void pop(HostReg reg)
+		{
+			if (scast(UInt8, reg) >= 8)
+				byte(0x41);
+			byte(0x58 | (scast(UInt8, reg) & 7));
+		}
+
+		void call(const void* function)
+		{
+			mov_imm(HostReg::rax, rcast(UInt64, function));
+			byte(0xFF);
+			byte(0xD0);
+		}
+
+		/* Four pushes plus 40 bytes keep rsp 16-byte aligned at calls, with the Win64 shadow space */
+		void prologue()
+		{
+			push(RegsReg);
+			push(FrameReg);
+			push(StaticsReg);
+			push(HeapReg);
+			byte(0x48); byte(0x83); byte(0xEC); byte(40);
+
+			mov(RegsReg, ArgRegs[0]);
+			mov(FrameReg, ArgRegs[1]);
+			mov(StaticsReg, ArgRegs[2]);
+			mov(HeapReg, ArgRegs[3]);
+		}
+
+		/* Returns "resume_offset" to the interpreter */
+		void exit(Size resume_offset)
+		{
+			mov_imm(HostReg::rax, resume_offset);
+			byte(0x48); byte(0x83); byte(0xC4); byte(40);
+			pop(HeapReg);
+			pop(StaticsReg);
+			pop(FrameReg);
+			pop(RegsReg);
+			byte(0xC3);
+		}
+	};
+}
+#endif
@@ -85,7 +85,364 @@ namespace kram::op
 		CST_m, /* <dest_type:4|src_type:4>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
 				* Increase or decrease memory heap object counter reference from memory
 				*/
+
+
+		MOV_r8_stk_d8,
+		MOV_r16_stk_d8,
+		MOV_r32_stk_d8,
+		MOV_r64_stk_d8, /* <dest_reg:4|(padding):4>, <delta:8>
+						 * Move stack data at "delta" to register.
+						 */
+
+		MOV_stk_d8_r8,
+		MOV_stk_d8_r16,
+		MOV_stk_d8_r32,
+		MOV_stk_d8_r64, /* <src_reg:4|(padding):4>, <delta:8>
+						 * Move register data to stack at "delta".
+						 */
+
+		MOV_r8_reg_idx1,
+		MOV_r16_reg_idx2,
+		MOV_r32_reg_idx4,
+		MOV_r64_reg_idx8, /* <dest_reg:4|(padding):4>, <base_reg:4|split_reg:4>
+						   * Move element "split_reg" of the array pointed by "base_reg" to register.
+						   */
+
+		MOV_reg_idx1_r8,
+		MOV_reg_idx2_r16,
+		MOV_reg_idx4_r32,
+		MOV_reg_idx8_r64, /* <src_reg:4|(padding):4>, <base_reg:4|split_reg:4>
+						   * Move register data to element "split_reg" of the array pointed by "base_reg".
+						   */
+
+
+		/* Quickened opcodes. They never appear in a bin::Chunk: execute() rewrites the
+		 * generic opcode into one of these inside the VM's own copy of the code, once the
+		 * first execution has seen the operand shape. Encodings match the generic opcode.
+		 */
+		MOV_r8_m8_qreg,
+		MOV_r16_m16_qreg,
+		MOV_r32_m32_qreg,
+		MOV_r64_m64_qreg,
+		MOV_m8_r8_qreg,
+		MOV_m16_r16_qreg,
+		MOV_m32_r32_qreg,
+		MOV_m64_r64_qreg, /* MOV_*_m* / MOV_m*_* with a register segment, no split and no delta */
+
+		MOV_r8_m8_qreg_d8,
+		MOV_r16_m16_qreg_d8,
+		MOV_r32_m32_qreg_d8,
+		MOV_r64_m64_qreg_d8,
+		MOV_m8_r8_qreg_d8,
+		MOV_m16_r16_qreg_d8,
+		MOV_m32_r32_qreg_d8,
+		MOV_m64_r64_qreg_d8, /* MOV_*_m* / MOV_m*_* with a register segment, no split and an 8-bit delta */
+
+		CST_r_q,
+		CST_m_q, /* CST_r / CST_m with valid types, cast through a single <dest_type|src_type> table lookup */
+
+
+		/* Superinstructions. One dispatch runs every component opcode in order; the
+		 * operands are those of each component, concatenated. Emitted only by
+		 * InstructionBuilder::fuse_superinstructions(), see op::Superinstructions.
+		 */
+		MOV_r64_m64__MOV_m64_r64,
+		MOV_r64_m64__MOV_r64_m64,
+		MOV_r64_stk_d8__MOV_stk_d8_r64,
+		MOV_r32_stk_d8__MOV_stk_d8_r32,
+		LEA__MMB_sb,
+		LEA__LEA__MMB_sb,
+
+
+		CALL, /* <connection:8>, <function:16>
+			   * Call "function" of the chunk at "connection" (0xFF for the current chunk).
+			   * Register arguments are taken from r0 onwards, stack parameters from the
+			   * caller's "sp" onwards, which becomes the callee's "sb".
+			   */
+
+		CALLR, /* <reg:4|(padding):4>
+				* Call the function encoded in "reg" as (connection << 16) | function.
+				*/
+
+		RET, /* Return to the caller with "sr" and the register results of the callee */
+
+		TAILCALL, /* <connection:8>, <function:16>
+				   * CALL then RET, reusing the current frame: the callee returns straight
+				   * to the caller of the current function.
+				   */
+
+
+		/* Branches. "size" selects the operand width (0: 8, 1: 16, 2: 32, 3: 64 bits) and
+		 * "offset" is signed and relative to the end of the instruction. Flags are only
+		 * kept inside the running function: calls and returns leave them undefined.
+		 */
+		CMP_r_r, /* <reg1:4|reg2:4>, <size:2|(padding):6>
+				  * Compare reg1 with reg2 and set the flags.
+				  */
+
+		CMP_r_imm, /* <reg:4|size:2|(padding):2>, <value:8-64>
+					* Compare reg with an immediate value and set the flags.
+					*/
+
+		CMP_r_m, /* <reg:4|size:2|(padding):2>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+				  * Compare reg with memory data and set the flags.
+				  */
+
+		TEST_r_r, /* <reg1:4|reg2:4>, <size:2|(padding):6>
+				   * Set the flags from reg1 & reg2.
+				   */
+
+		TEST_r_imm, /* <reg:4|size:2|(padding):2>, <value:8-64>
+					 * Set the flags from reg & value.
+					 */
+
+		JMP_s8,
+		JMP_s32, /* <offset:8-32>
+				  * Jump unconditionally.
+				  */
+
+		JCC_s8,
+		JCC_s32, /* <condition:4|(padding):4>, <offset:8-32>
+				  * Jump if "condition" holds for the current flags.
+				  */
+
+		CMPJ_r_imm_s8,
+		CMPJ_r_imm_s32, /* <reg:4|size:2|(padding):2>, <condition:4|(padding):4>, <value:8-64>, <offset:8-32>
+						 * CMP_r_imm then JCC in one dispatch.
+						 */
+
+		CMPJ_r_m_s8,
+		CMPJ_r_m_s32, /* <reg:4|size:2|(padding):2>, <condition:4|(padding):4>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64], <offset:8-32>
+					   * CMP_r_m then JCC in one dispatch.
+					   */
+
+		LOOP_s8,
+		LOOP_s32, /* <reg:4|(padding):4>, <offset:8-32>
+				   * Decrement the 64 bits of reg and jump while it is not zero. Flags are kept.
+				   */
+
+		SWITCH, /* <reg:4|(padding):4>, <count:16>, <default:32>, <offset:32> * count
+				 * Jump to the offset at index reg (64 bits, unsigned), or to "default" past
+				 * the end of the table. Offsets are relative to the end of the table.
+				 */
+
+
+		/* Integer arithmetic. "size" selects the width as in branches and only the low
+		 * "size" bits of dest are written. "signed" only changes DIV, REM and SHR.
+		 * Shift counts wrap at the width.
+		 * No operation traps, division by zero included, and the results are defined
+		 * the way RISC-V defines them:
+		 *   DIV x, 0 = all ones (-1 signed, the maximum unsigned)
+		 *   REM x, 0 = x
+		 *   signed DIV MIN, -1 = MIN and REM MIN, -1 = 0
+		 * Scripts that need a division error have to test the divisor themselves.
+		 */
+		ADD_r_r_r,
+		ADD_r_r_m,
+		SUB_r_r_r,
+		SUB_r_r_m,
+		MUL_r_r_r,
+		MUL_r_r_m,
+		DIV_r_r_r,
+		DIV_r_r_m,
+		REM_r_r_r,
+		REM_r_r_m,
+		AND_r_r_r,
+		AND_r_r_m,
+		OR_r_r_r,
+		OR_r_r_m,
+		XOR_r_r_r,
+		XOR_r_r_m,
+		SHL_r_r_r,
+		SHL_r_r_m,
+		SHR_r_r_r,
+		SHR_r_r_m, /* r_r_r: <dest_reg:4|src1_reg:4>, <src2_reg:4|size:2|signed:1|(padding):1>
+					* r_r_m: <dest_reg:4|src1_reg:4>, <size:2|signed:1|(padding):5>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+					* dest = src1 <op> src2, src2 being a register or memory data.
+					*/
+
+		/* Floating point arithmetic, "double" selects f64 over f32 */
+		FADD_r_r_r,
+		FADD_r_r_m,
+		FSUB_r_r_r,
+		FSUB_r_r_m,
+		FMUL_r_r_r,
+		FMUL_r_r_m,
+		FDIV_r_r_r,
+		FDIV_r_r_m, /* r_r_r: <dest_reg:4|src1_reg:4>, <src2_reg:4|double:1|(padding):3>
+					 * r_r_m: <dest_reg:4|src1_reg:4>, <double:1|(padding):7>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+					 * dest = src1 <op> src2, src2 being a register or memory data.
+					 */
+
+		FSQRT_r_r, /* <dest_reg:4|src_reg:4>, <double:1|(padding):7>
+					* dest = sqrt(src)
+					*/
+
+		FSQRT_r_m, /* <dest_reg:4|double:1|(padding):3>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+					* dest = sqrt(memory data)
+					*/
+
+		FFMA_r_r_r_r, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|src3_reg:4>, <double:1|(padding):7>
+					   * dest = src1 * src2 + src3 with a single rounding.
+					   */
+
+		FFMA_r_r_r_m, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|double:1|(padding):3>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+					   * dest = src1 * src2 + memory data with a single rounding.
+					   */
+
+
+		/* Vector opcodes. dest_reg, src1_reg, src2_reg and mask_reg hold block addresses
+		 * and count_reg the 64 bit element count. "type" is an assembler::DataType. The
+		 * work runs on simd:: kernels picked for the running CPU.
+		 */
+		VADD,
+		VSUB,
+		VMUL,
+		VMIN,
+		VMAX, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|count_reg:4>, <type:4|(padding):4>
+			   * dest[i] = src1[i] <op> src2[i]
+			   */
+
+		VFMA, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|count_reg:4>, <type:4|(padding):4>
+			   * dest[i] = src1[i] * src2[i] + dest[i]
+			   */
+
+		VCMP, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|count_reg:4>, <type:4|condition:4>
+			   * dest[i] = 1 byte, 1 where "condition" holds for src1[i], src2[i] and 0 elsewhere.
+			   */
+
+		VSELECT, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|count_reg:4>, <type:4|mask_reg:4>
+				  * dest[i] = mask[i] ? src1[i] : src2[i], mask holding 1 byte per element.
+				  */
+
+		/* Reductions leave their result in dest_reg as simd::reduce() describes */
+		VSUM,
+		VRMIN,
+		VRMAX,
+		VARGMIN,
+		VARGMAX, /* <dest_reg:4|src_reg:4>, <count_reg:4|type:4>
+				  * dest = src[0] <op> ... <op> src[count - 1], or the index of the first extreme for the arg forms.
+				  */
+
+		VDOT, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|count_reg:4>, <type:4|(padding):4>
+			   * dest = src1[0] * src2[0] + ... + src1[count - 1] * src2[count - 1]
+			   */
+
+		VSCAN,
+		VSCANX, /* <dest_reg:4|src_reg:4>, <count_reg:4|type:4>
+				 * dest[i] = src[0] + ... + src[i], stopping at src[i - 1] for the exclusive VSCANX.
+				 */
+
+
+		/* Bulk memory opcodes. Register operands named after blocks hold their address,
+		 * sizes are in bytes and "not found" is ~0.
+		 */
+		MSET, /* <dest_reg:4|value_reg:4>, <count_reg:4|size:2|(padding):2>
+			   * dest[i] = low "size" bytes of value, for i < count elements.
+			   */
+
+		MCMP, /* <dest_reg:4|src1_reg:4>, <src2_reg:4|size_reg:4>
+			   * dest = offset of the first differing byte or size. Sets the flags like a CMP of those two bytes, equal when there is none.
+			   */
+
+		MFIND, /* <dest_reg:4|src_reg:4>, <size_reg:4|pattern_reg:4>, <pattern_size_reg:4|(padding):4>
+				* dest = offset of the first occurrence of the pattern block in src.
+				*/
+
+		MFINDB, /* <dest_reg:4|src_reg:4>, <size_reg:4|value_reg:4>
+				 * dest = offset of the first byte of src equal to the low byte of value.
+				 */
+
+
+		/* The memory location is the table, resolved once. indices_reg holds the address of
+		 * "count" unsigned indices of "index_size", each one counting "size" elements.
+		 */
+		GATHER, /* <dest_reg:4|indices_reg:4>, <count_reg:4|size:2|index_size:2>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+				 * dest[i] = table[indices[i]]
+				 */
+
+		SCATTER, /* <src_reg:4|indices_reg:4>, <count_reg:4|size:2|index_size:2>, <segment:2|has_reg2:1|reg2_split:2|has_delta:1|delta_size:2>, <base_reg:4|split_reg:4>, [delta:8-64]
+				  * table[indices[i]] = src[i], in order.
+				  */
 	};
+
+	constexpr Size OpcodeCount = static_cast<Size>(Opcode::SCATTER) + 1;
+
+	constexpr UInt8 SelfConnection = 0xFF;
+
+
+	/* Flags set by CMP and TEST: bit 0 equal (zero), bit 1 signed less, bit 2 unsigned below */
+	enum class Condition : UInt8
+	{
+		Equal,
+		NotEqual,
+		Less,
+		GreaterEqual,
+		LessEqual,
+		Greater,
+		Below,
+		AboveEqual,
+		BelowEqual,
+		Above
+	};
+
+	/* Bit "flags" of ConditionTable[condition] tells whether the condition holds.
+	 * Padded to 16 entries so any 4 bit condition field is a valid index.
+	 */
+	constexpr UInt8 ConditionTable[16] = {
+		0xAA, 0x55,
+		0xCC, 0x33,
+		0xEE, 0x11,
+		0xF0, 0x0F,
+		0xFA, 0x05
+	};
+
+	constexpr bool condition_holds(UInt8 condition, UInt8 flags)
+	{
+		return (ConditionTable[condition & 0xF] >> flags) & 1;
+	}
+
+	struct BranchForms
+	{
+		Opcode shortForm;	/* 8 bits offset */
+		Opcode longForm;	/* 32 bits offset */
+	};
+
+	constexpr BranchForms Branches[] = {
+		{ Opcode::JMP_s8, Opcode::JMP_s32 },
+		{ Opcode::JCC_s8, Opcode::JCC_s32 },
+		{ Opcode::CMPJ_r_imm_s8, Opcode::CMPJ_r_imm_s32 },
+		{ Opcode::CMPJ_r_m_s8, Opcode::CMPJ_r_m_s32 },
+		{ Opcode::LOOP_s8, Opcode::LOOP_s32 },
+	};
+
+	/* Short and long forms of a branch opcode, nullptr if it has no offset operand */
+	const BranchForms* find_branch(Opcode opcode);
+
+
+	struct Superinstruction
+	{
+		Opcode opcode;
+		Size length;
+		Opcode sequence[3];
+	};
+
+	/* Longest sequences first: the fusion pass takes the first match. */
+	constexpr Superinstruction Superinstructions[] = {
+		{ Opcode::LEA__LEA__MMB_sb, 3, { Opcode::LEA, Opcode::LEA, Opcode::MMB_sb } },
+		{ Opcode::MOV_r64_m64__MOV_m64_r64, 2, { Opcode::MOV_r64_m64, Opcode::MOV_m64_r64 } },
+		{ Opcode::MOV_r64_m64__MOV_r64_m64, 2, { Opcode::MOV_r64_m64, Opcode::MOV_r64_m64 } },
+		{ Opcode::MOV_r64_stk_d8__MOV_stk_d8_r64, 2, { Opcode::MOV_r64_stk_d8, Opcode::MOV_stk_d8_r64 } },
+		{ Opcode::MOV_r32_stk_d8__MOV_stk_d8_r32, 2, { Opcode::MOV_r32_stk_d8, Opcode::MOV_stk_d8_r32 } },
+		{ Opcode::LEA__MMB_sb, 2, { Opcode::LEA, Opcode::MMB_sb } },
+	};
+
+	const Superinstruction* find_superinstruction(Opcode opcode);
+
+	/* Maps a quickened opcode back to the generic opcode it was rewritten from. */
+	Opcode generic_opcode(Opcode opcode);
+
+	const char* opcode_name(Opcode opcode);
 }
 
 namespace kram::assembler
@@ -101,7 +458,51 @@ namespace kram::assembler
 		DEL,
 		MHRI,
 		MHRD,
-		CAST
+		CAST,
+		CALL,
+		CALLR,
+		RET,
+		TAILCALL,
+		CMP,
+		TEST,
+		JMP,
+		JCC,
+		CMPJ,
+		LOOP,
+		SWITCH,
+		ADD,
+		SUB,
+		MUL,
+		DIV,
+		REM,
+		AND,
+		OR,
+		XOR,
+		SHL,
+		SHR,
+		SQRT,
+		FMA,
+		VADD,
+		VSUB,
+		VMUL,
+		VMIN,
+		VMAX,
+		VFMA,
+		VCMP,
+		VSELECT,
+		VSUM,
+		VRMIN,
+		VRMAX,
+		VARGMIN,
+		VARGMAX,
+		VDOT,
+		VSCAN,
+		VSCANX,
+		MSET,
+		MCMP,
+		MFIND,
+		GATHER,
+		SCATTER
 	};
 
 	constexpr const char* asm_opcode_name(AssemblerOpcode opcode)
@@ -118,6 +519,50 @@ namespace kram::assembler
 			case AssemblerOpcode::MHRI: return "mhri";
 			case AssemblerOpcode::MHRD: return "mhrd";
 			case AssemblerOpcode::CAST: return "cast";
+			case AssemblerOpcode::CALL: return "call";
+			case AssemblerOpcode::CALLR: return "callr";
+			case AssemblerOpcode::RET: return "ret";
+			case AssemblerOpcode::TAILCALL: return "tailcall";
+			case AssemblerOpcode::CMP: return "cmp";
+			case AssemblerOpcode::TEST: return "test";
+			case AssemblerOpcode::JMP: return "jmp";
+			case AssemblerOpcode::JCC: return "jcc";
+			case AssemblerOpcode::CMPJ: return "cmpj";
+			case AssemblerOpcode::LOOP: return "loop";
+			case AssemblerOpcode::SWITCH: return "switch";
+			case AssemblerOpcode::ADD: return "add";
+			case AssemblerOpcode::SUB: return "sub";
+			case AssemblerOpcode::MUL: return "mul";
+			case AssemblerOpcode::DIV: return "div";
+			case AssemblerOpcode::REM: return "rem";
+			case AssemblerOpcode::AND: return "and";
+			case AssemblerOpcode::OR: return "or";
+			case AssemblerOpcode::XOR: return "xor";
+			case AssemblerOpcode::SHL: return "shl";
+			case AssemblerOpcode::SHR: return "shr";
+			case AssemblerOpcode::SQRT: return "sqrt";
+			case AssemblerOpcode::FMA: return "fma";
+			case AssemblerOpcode::VADD: return "vadd";
+			case AssemblerOpcode::VSUB: return "vsub";
+			case AssemblerOpcode::VMUL: return "vmul";
+			case AssemblerOpcode::VMIN: return "vmin";
+			case AssemblerOpcode::VMAX: return "vmax";
+			case AssemblerOpcode::VFMA: return "vfma";
+			case AssemblerOpcode::VCMP: return "vcmp";
+			case AssemblerOpcode::VSELECT: return "vselect";
+			case AssemblerOpcode::VSUM: return "vsum";
+			case AssemblerOpcode::VRMIN: return "vrmin";
+			case AssemblerOpcode::VRMAX: return "vrmax";
+			case AssemblerOpcode::VARGMIN: return "vargmin";
+			case AssemblerOpcode::VARGMAX: return "vargmax";
+			case AssemblerOpcode::VDOT: return "vdot";
+			case AssemblerOpcode::VSCAN: return "vscan";
+			case AssemblerOpcode::VSCANX: return "vscanx";
+			case AssemblerOpcode::MSET: return "mset";
+			case AssemblerOpcode::MCMP: return "mcmp";
+			case AssemblerOpcode::MFIND: return "mfind";
+			case AssemblerOpcode::GATHER: return "gather";
+			case AssemblerOpcode::SCATTER: return "scatter";
 		}
 
 		return "<unknown-opcode>";
@@ -178,10 +623,12 @@ namespace kram::op
 
 		inline Size byte_count() const { return _args.size() + sizeof(Opcode); }
 
+		inline const std::vector<std::byte>& args() const { return _args; }
+
 		template<typename _Ty>
 		inline _Ty& arg(unsigned int index)
 		{
-			if (_args.size() >= (index + (sizeof(_Ty) - 1)))
+			if (_args.size() < (index + sizeof(_Ty)))
 				_args.resize(index + sizeof(_Ty), static_cast<std::byte>(0));
 
 			return reinterpret_cast<_Ty&>(_args[index]);
@@ -218,6 +665,9 @@ namespace kram::op
 			Instruction _instruction;
 			Node* _next = nullptr;
 			Node* _prev = nullptr;
+			std::vector<Node*> _targets;	/* branch targets, nullptr is the end of the code. SWITCH: default first */
+			Size _labels = 0;	/* branches targeting this node */
+			Size _offset = 0;	/* scratch of branch resolution */
 
 		public:
 			inline Location next() { return _next; }
@@ -271,6 +721,27 @@ namespace kram::op
 		inline Size size() const { return _size; }
 		inline bool empty() const { return !_size; }
 
+		/* Rewrites every op::Superinstructions sequence into its fused opcode.
+		 * Returns the number of instructions removed.
+		 */
+		Size fuse_superinstructions();
+
+		/* Rewrites every CALL directly followed by RET into TAILCALL, when "fusable"
+		 * accepts its connection and function: the callee must return the same register
+		 * results as the function it replaces. The RET is kept, it may still be reached
+		 * by a jump. Returns the number of calls rewritten.
+		 */
+		Size fuse_tail_calls(const std::function<bool(UInt8, UInt16)>& fusable);
+
+		/* Makes the branch at "jump" land on "target" (nullptr for the end of the code).
+		 * The offset is resolved on build: each branch takes its 8 bit form unless the
+		 * distance does not fit.
+		 */
+		void branch(Location jump, Location target);
+
+		/* Sets the default and case targets of the SWITCH at "jump", resizing its table */
+		void branch(Location jump, Location default_target, const std::vector<Location>& cases);
+
 	public:
 		Location push_front(InstructionBuilder&& builder);
 		Location push_back(InstructionBuilder&& builder);
@@ -308,6 +779,10 @@ namespace kram::op
 		Node* _push_front(Node* newnode);
 		Node* _push_back(Node* newnode);
 		Node* _insert(Node* next, Node* newnode);
+		Node* _unlink(Node* node);
+
+		void _set_targets(Node* node, std::vector<Node*>&& targets);
+		void _resolve_branches() const;
 
 	public:
 		inline InstructionBuilder(const InstructionBuilder& ib) :
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "common.h"
+#include "opcodes.h"
+
+namespace kram::runtime
+{
+	/* Opcode bigram and trigram counts, filled by execute() when it is built with
+	 * KRAM_OPCODE_PROFILING. Only the raw bytecode loop records; quickened opcodes are
+	 * counted as their generic opcode, so sequences match what the assembler emits.
+	 */
+	class OpcodeProfile
+	{
+	public:
+		struct Sequence
+		{
+			std::vector<op::Opcode> opcodes;
+			UInt64 count;
+
+			/* Dispatches a superinstruction for this sequence would have removed */
+			inline UInt64 saved_dispatches() const { return count * (opcodes.size() - 1); }
+		};
+
+	private:
+		std::vector<UInt64> _bigrams;
+		std::unordered_map<UInt32, UInt64> _trigrams;
+		UInt64 _dispatches;
+		op::Opcode _history[2];
+		UInt8 _historySize;
+
+	public:
+		OpcodeProfile();
+
+		OpcodeProfile(const OpcodeProfile&) = default;
+		OpcodeProfile(OpcodeProfile&&) noexcept = default;
+
+		OpcodeProfile& operator= (const OpcodeProfile&) = default;
+		OpcodeProfile& operator= (OpcodeProfile&&) noexcept = default;
+
+		void record(op::Opcode opcode);
+
+		/* Called on every execute() entry, so sequences never span two runs */
+		inline void break_sequence() { _historySize = 0; }
+
+		void clear();
+
+		inline UInt64 dispatches() const { return _dispatches; }
+
+		UInt64 count(op::Opcode first, op::Opcode second) const;
+		UInt64 count(op::Opcode first, op::Opcode second, op::Opcode third) const;
+
+		/* Fusable sequences ordered by saved dispatches, most profitable first */
+		std::vector<Sequence> top(Size count) const;
+
+		/* Writes the op::Opcode entries, op::Superinstructions rows, dispatch table entries
+		 * and execute() handlers for the "count" most profitable sequences.
+		 */
+		void emit_superinstructions(std::ostream& os, Size count) const;
+
+	private:
+		static inline UInt32 trigram_key(op::Opcode first, op::Opcode second, op::Opcode third)
+		{
+			return (scast(UInt32, first) << 16) | (scast(UInt32, second) << 8) | scast(UInt32, third);
+		}
+	};
+}
@@ -4,11 +4,18 @@
 #include "opcodes.h"
 #include "bindata.h"
 
+namespace kram::gc
+{
+	class Collector;
+}
+
 namespace kram::runtime
 {
 	struct CallInfo;
 	struct Stack;
 	struct RuntimeState;
+	struct DecodedCode;
+	class CodeCache;
 
 	typedef UInt16 InstructionOffset;
 	typedef UInt8 RegisterOffset;
@@ -101,44 +108,114 @@ namespace kram::runtime
 		Register by_index[16];
 	};
 
-	/*struct CallInfo
-	{
-		op::Opcode* inst;
-		bin::Chunk* chunk;
+	/* Machine code of a bin::Function prefix, see jit::CompiledFunction */
+	typedef Size (*NativeFunction)(Registers* regs, StackUnit* frame, StackUnit* statics, Heap* heap);
 
-		std::ptrdiff_t top;
-		std::ptrdiff_t regs;
-		std::ptrdiff_t data;
+	/* Calls through a target between looks at the AOT libraries and the JIT for its callee */
+	constexpr UInt32 TierLookupInterval = 16;
 
-		RegisterOffset returnRegisterOffset;
+	/* Call site of a bin::Function, resolved once per chunk by CodeCache */
+	struct CallTarget
+	{
+		std::byte* entry;	/* in the VM's copy of the code */
+		Size parameters;	/* stack parameters */
+		Size windowOffset;	/* parameters + locals, 8-byte aligned */
+		Size frameSize;		/* windowOffset + FrameOverhead */
+		UInt16 registerMask;	/* copied from the caller window on CALL */
+		UInt16 resultMask;		/* copied back to the caller window on RET */
+
+		/* Native code the callee runs on from now on. It belongs to the JitCache or AotCache
+		 * of the VM, which KramState::release_chunk drops together with these targets.
+		 */
+		mutable UInt32 countdown;
+		mutable NativeFunction native;
+
+		/* Closure records of the whole chunk once the ClosureCache of the VM has compiled
+		 * them, shared by its targets
+		 */
+		mutable const DecodedCode* closures;
+	};
 
-		UInt8 __padding[7];
-	};*/
+	/* Right after the window of every called frame */
+	struct CallInfo
+	{
+		std::uintptr_t caller;	/* stack offset of the caller window, or RootWindow */
+		const CallTarget* targets;
+		UInt16 resultMask;
+	};
+
+	/* Register windows: each called frame is laid out as <parameters, locals, 8-byte
+	 * padding, Registers, CallInfo>, and a call only moves the window the interpreter
+	 * works on. The frame execute() enters keeps RuntimeState::regs as its window but
+	 * reserves the same overhead, so a caller always writes the parameters of a call at
+	 * sb + align8(its parameters + locals) + FrameOverhead.
+	 */
+	constexpr std::uintptr_t RootWindow = static_cast<std::uintptr_t>(-1);
+	constexpr Size FrameOverhead = sizeof(Registers) + sizeof(CallInfo);
 
 	struct Stack
 	{
 		StackUnit* roof;
 		StackUnit* base;
+		StackUnit* limit;	/* frames ending past it grow the stack, roof - size / 2 */
 	};
 
 	struct RuntimeState
 	{
-		Registers regs;
+		Registers regs;	/* window of the frame execute() entered */
 
 		Stack* stack;
 		Heap* heap;
+		CodeCache* code;	/* resolves cross-chunk calls, null outside execute() */
+		KramState* owner;	/* whose tiers calls look callees up in, null outside execute() */
+		gc::Collector* collector;	/* traces at safepoints when set */
+		bool safepoints;	/* calls and backward branches pace the collectors, see Heap::gc_pacing */
 
 		bool exit;
 
 		ErrorCode error;
 
-		RuntimeState(Stack* stack, Heap* heap);
+		RuntimeState(Stack* stack, Heap* heap, CodeCache* code = nullptr, KramState* owner = nullptr);
+	};
+
+	/* Per-VM writable copies of chunk code. execute() runs from these copies and
+	 * quickens generic opcodes in place, so a shared bin::Chunk is never written.
+	 */
+	class CodeCache
+	{
+	private:
+		struct Entry
+		{
+			const std::byte* source;
+			Size size;
+			std::byte* code;
+			std::vector<CallTarget> targets;
+		};
+
+		std::map<const bin::Chunk*, Entry> _entries;
+
+	public:
+		CodeCache() = default;
+		CodeCache(const CodeCache&) = delete;
+		~CodeCache();
+
+		CodeCache& operator= (const CodeCache&) = delete;
+
+		std::byte* code(const bin::Chunk* chunk);
+
+		/* One entry per bin::Function, pointing into code(chunk) */
+		const CallTarget* targets(const bin::Chunk* chunk);
+
+		void release(const bin::Chunk* chunk);
 	};
 
 	void _build_stack(Stack* stack, Size size);
-	void _resize_stack(Stack* stack, Size extra = 0);
+	void _resize_stack(Stack* stack, Size min = 0);
 	void _destroy_stack(Stack* stack);
 
+	/* CST on a value in place, <dest_type:4|src_type:4> */
+	void _cast_value(UInt8 types, void* value);
+
 	void execute(KramState* kstate, bin::Chunk* chunk, FunctionOffset function);
 }
 
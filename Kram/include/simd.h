@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.h"
+#include "opcodes.h"
+
+#if !defined(KRAM_NO_SIMD_TARGETS) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#define KRAM_SIMD_X86_TARGETS
+	#define KRAM_TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#define KRAM_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma")))
+#endif
+
+namespace kram::simd
+{
+	/* Same numbering as assembler::DataType */
+	enum class ElementType : UInt8
+	{
+		SignedByte, SignedWord, SignedDoubleWord, SignedQuadWord,
+		UnsignedByte, UnsignedWord, UnsignedDoubleWord, UnsignedQuadWord,
+		FloatingDecimal, DoubleDecimal
+	};
+
+	constexpr Size ElementTypeCount = 10;
+
+	enum class Operation : UInt8 { Add, Sub, Mul, Min, Max };
+
+	constexpr Size OperationCount = 5;
+
+	enum class Reduction : UInt8 { Sum, Min, Max, ArgMin, ArgMax };
+
+	constexpr Size ReductionCount = 5;
+
+	/* Instruction sets the kernels are compiled for, best last. Without GCC or Clang on
+	 * x86 only Scalar exists; it is still plain loops the compiler can vectorize for
+	 * the baseline of the target.
+	 */
+	enum class Isa : UInt8 { Scalar, Avx2, Avx512 };
+
+	/* Best instruction set of the running CPU, capped by limit() */
+	Isa isa();
+
+	/* Caps the kernels dispatched from now on, mostly to check the fallbacks */
+	void limit(Isa max);
+
+	/* Reductions and scans over at least "threshold" elements are split across a pool
+	 * of "threads" workers, the calling thread included. A threshold of 0 (the default)
+	 * keeps everything on the calling thread and 0 threads means one per hardware thread.
+	 */
+	void parallel(Size threshold, Size threads = 0);
+
+	inline Size element_size(ElementType type)
+	{
+		switch (type)
+		{
+			case ElementType::SignedByte: case ElementType::UnsignedByte: return 1;
+			case ElementType::SignedWord: case ElementType::UnsignedWord: return 2;
+			case ElementType::SignedDoubleWord: case ElementType::UnsignedDoubleWord: case ElementType::FloatingDecimal: return 4;
+			default: return 8;
+		}
+	}
+
+	/* Every kernel works on "count" elements. Integers wrap; unknown types do nothing.
+	 * Blocks may alias as long as they do not partially overlap.
+	 */
+
+	/* dest[i] = left[i] <op> right[i] */
+	void binary(Operation op, ElementType type, void* dest, const void* left, const void* right, Size count);
+
+	/* dest[i] = left[i] * right[i] + dest[i], fused for floating types */
+	void fma(ElementType type, void* dest, const void* left, const void* right, Size count);
+
+	/* mask[i] = 1 where "condition" holds for left[i], right[i], 0 elsewhere. The order is
+	 * the one of "type", so Below/Above act as Less/Greater.
+	 */
+	void compare(op::Condition condition, ElementType type, UInt8* mask, const void* left, const void* right, Size count);
+
+	/* dest[i] = mask[i] ? left[i] : right[i] */
+	void select(ElementType type, void* dest, const UInt8* mask, const void* left, const void* right, Size count);
+
+	/* Reductions return the raw bits of a register. Integer sums wrap at 64 bits, Min and
+	 * Max are extended from the element, ArgMin and ArgMax give the first index of the
+	 * extreme element and floating results keep their own format. Over an empty block
+	 * the arg reductions give ~0 and the rest 0. Floating sums are reassociated.
+	 */
+	UInt64 reduce(Reduction reduction, ElementType type, const void* src, Size count);
+
+	/* Sum of left[i] * right[i], reduced like Reduction::Sum */
+	UInt64 dot(ElementType type, const void* left, const void* right, Size count);
+
+	/* dest[i] = src[0] + ... + src[i], or up to src[i - 1] when "exclusive". dest may be src. */
+	void scan(bool exclusive, ElementType type, void* dest, const void* src, Size count);
+
+	/* Elements are 1 << element_log2 bytes and indices unsigned integers of 1 << index_log2
+	 * bytes; both logs go from 0 to 3. An index counts elements from "table".
+	 */
+
+	/* dest[i] = table[indices[i]] */
+	void gather(UInt8 element_log2, UInt8 index_log2, void* dest, const void* table, const void* indices, Size count);
+
+	/* table[indices[i]] = src[i], in order, so the last of repeated indices wins */
+	void scatter(UInt8 element_log2, UInt8 index_log2, void* table, const void* src, const void* indices, Size count);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+#include "jit.h"
+#include "decoder.h"
+
+namespace kram::jit
+{
+	constexpr Size DefaultTraceThreshold = 200;
+	constexpr Size MaxTraceLength = 1024;
+	constexpr Size MaxTraceSideExits = 64;
+
+	/* One executed record, with the concrete values seen while recording it */
+	struct TraceStep
+	{
+		runtime::DecodedInstruction inst;
+		Size offset;	/* bytecode offset of the instruction the record belongs to */
+		UInt64 base;	/* value of the base register of a register-segment location */
+		bool taken;		/* JCC and LOOP: whether the branch went to its target */
+		Size other;		/* JCC and LOOP: offset of the side recording did not follow */
+	};
+
+	/* Path recorded from a trace head along the branches it took, up to the first
+	 * instruction that can not be traced. A function entry head stops at the first
+	 * instruction it reaches again; a loop head, the target of a backward branch, has
+	 * to come back to itself.
+	 */
+	struct Trace
+	{
+		Size start;
+		Size end;	/* where a linear trace leaves, or where a loop trace leaves the loop */
+		Size size;	/* bytecode bytes of the instructions recorded */
+		bool loop;	/* ends with a jump back to "start" */
+		runtime::StackUnit* frame;
+		runtime::StackUnit* statics;
+		std::vector<TraceStep> steps;
+	};
+
+	/* Executes the code from "start" one record at a time on the window "regs", recording
+	 * every step and following the branches. "flags" come in and go out like those of
+	 * the interpreter. Returns the offset the interpreter has to resume at. A loop trace
+	 * that did not come back to "start" is left empty.
+	 */
+	Size record_trace(Trace& trace, runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size start, bool loop, UInt8& flags);
+
+	/* Compiles a trace specialized to its recorded values:
+	 * - stack and static locations become absolute addresses, guarded once on entry
+	 *   against the recorded frame base and statics pointer;
+	 * - register-segment locations of a linear trace are guarded on the recorded base
+	 *   register value; a loop trace computes them on every round;
+	 * - registers loaded with constants are folded and only written back at exits;
+	 * - CST of the recorded types is inlined, or folded on constants;
+	 * - JCC and LOOP become guards on the side recording took.
+	 * A failed guard side-exits with every VM register written back.
+	 */
+	CompiledCode compile_trace(const Trace& trace);
+
+
+	/* Per-VM trace heads. A function entry is traced once execute() has entered it
+	 * "threshold" times, a loop head once "threshold" looks of the interpreters at their
+	 * backward branches found it, see TierLookupInterval; 0 disables tracing. Traces that
+	 * side-exit too often, or whose exits would lose flags a JCC reads, are dropped and
+	 * the code is left to the other tiers.
+	 */
+	class TraceCache
+	{
+	private:
+		struct Entry
+		{
+			const std::byte* source;
+			Size calls;
+			Size exits;
+			Size end;
+			bool blacklisted;
+			CompiledCode code;
+		};
+
+	private:
+		std::map<std::pair<const bin::Chunk*, runtime::FunctionOffset>, Entry> _entries;
+		std::map<std::pair<const bin::Chunk*, Size>, Entry> _loops;
+		Size _threshold;
+
+	private:
+		bool enter(Entry& entry, runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size start, bool loop, UInt8& flags, Size& resume);
+
+	public:
+		TraceCache();
+		~TraceCache();
+
+		TraceCache(const TraceCache&) = delete;
+		TraceCache& operator= (const TraceCache&) = delete;
+
+		inline void threshold(Size threshold) { _threshold = threshold; }
+		inline Size threshold() const { return _threshold; }
+
+		/* Runs, or records, the trace of "function". Returns false if neither happened;
+		 * otherwise "resume" is the offset the interpreter continues from, with "flags".
+		 */
+		bool run(runtime::RuntimeState* state, const bin::Chunk* chunk, runtime::FunctionOffset function, UInt8& flags, Size& resume);
+
+		/* Same for the loop headed at "head", in the frame of the window "regs" */
+		bool loop(runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size head, UInt8& flags, Size& resume);
+
+		void release(const bin::Chunk* chunk);
+	};
+}
@@ -3,6 +3,12 @@
 #include "common.h"
 #include "heap.h"
 #include "runtime.h"
+#include "profiler.h"
+#include "jit.h"
+#include "trace.h"
+#include "aot.h"
+#include "closure.h"
+#include "gc.h"
 
 namespace kram
 {
@@ -10,11 +16,33 @@ namespace kram
 	{
 	private:
 		runtime::Stack _rstack;
+		runtime::CodeCache _code;
+		runtime::ClosureCache _closures;
+		runtime::OpcodeProfile* _profile = nullptr;
+		gc::Collector* _collector = nullptr;
+		jit::JitCache _jit;
+		jit::TraceCache _traces;
+		aot::AotCache _aot;
 
 	public:
 		KramState();
 		~KramState();
 
+		inline void release_chunk(const bin::Chunk* chunk) { _code.release(chunk); _closures.release(chunk); _jit.release(chunk); _traces.release(chunk); _aot.release(chunk); }
+
+		inline runtime::ClosureCache& closures() { return _closures; }
+		inline jit::JitCache& jit() { return _jit; }
+		inline jit::TraceCache& traces() { return _traces; }
+		inline aot::AotCache& aot() { return _aot; }
+
+		/* Only recorded into when built with KRAM_OPCODE_PROFILING */
+		inline void profile(runtime::OpcodeProfile* profile) { _profile = profile; }
+		inline runtime::OpcodeProfile* profile() const { return _profile; }
+
+		/* Traces this state's heap at execute()'s safepoints; null turns it off */
+		inline void collector(gc::Collector* collector) { _collector = collector; }
+		inline gc::Collector* collector() const { return _collector; }
+
 	public:
 		friend void runtime::execute(KramState* state, bin::Chunk* chunk, FunctionOffset function);
 	};
@@ -0,0 +1,637 @@
+#include "aot.h"
+
+#include "bulk.h"
+#include "decoder.h"
+#include "heap.h"
+
+#include <fstream>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using kram::op::Opcode;
+using kram::runtime::DecodedInstruction;
+using kram::runtime::NoRecord;
+
+namespace kram::aot
+{
+	/* Host functions handed to a library through "<prefix>_bind" */
+	struct Host
+	{
+		void* (*malloc)(void* heap, std::size_t size, int add_ref);
+		void (*free)(void* heap, void* ptr);
+		void (*increase_ref)(void* heap, void* ptr);
+		void (*decrease_ref)(void* heap, void* ptr);
+		void (*copy)(void* dest, const void* src, std::size_t size);
+	};
+
+	static void* host_malloc(void* heap, std::size_t size, int add_ref) { return rcast(Heap*, heap)->malloc(size, add_ref != 0); }
+	static void host_free(void* heap, void* ptr) { rcast(Heap*, heap)->free(ptr); }
+	static void host_increase_ref(void* heap, void* ptr) { rcast(Heap*, heap)->add_ref(ptr); }
+	static void host_decrease_ref(void* heap, void* ptr) { rcast(Heap*, heap)->remove_ref(ptr); }
+	static void host_copy(void* dest, const void* src, std::size_t size) { bulk::copy(dest, src, size); }
+
+	static const Host host = { &host_malloc, &host_free, &host_increase_ref, &host_decrease_ref, &host_copy };
+
+	static const char* const Preamble =
+		"#include <stdint.h>\n"
+		"#include <stddef.h>\n"
+		"#include <string.h>\n"
+		"#include <math.h>\n"
+		"\n"
+		"#if defined(_WIN32)\n"
+		"#define KRAM_AOT_EXPORT __declspec(dllexport)\n"
+		"#else\n"
+		"#define KRAM_AOT_EXPORT __attribute__((visibility(\"default\")))\n"
+		"#endif\n"
+		"\n"
+		"struct kram_aot_host\n"
+		"{\n"
+		"\tvoid* (*malloc)(void* heap, size_t size, int add_ref);\n"
+		"\tvoid (*free)(void* heap, void* ptr);\n"
+		"\tvoid (*increase_ref)(void* heap, void* ptr);\n"
+		"\tvoid (*decrease_ref)(void* heap, void* ptr);\n"
+		"\tvoid (*copy)(void* dest, const void* src, size_t size);\n"
+		"};\n"
+		"\n"
+		"static const struct kram_aot_host* kr_host;\n"
+		"\n"
+		"static inline uint64_t kr_ld(const unsigned char* p, size_t n) { uint64_t v = 0; memcpy(&v, p, n); return v; }\n"
+		"static inline void kr_st(unsigned char* p, uint64_t v, size_t n) { memcpy(p, &v, n); }\n"
+		"static inline uint64_t kr_mask(size_t n) { return n >= 8 ? ~0ull : (1ull << (n * 8)) - 1; }\n"
+		"static inline uint64_t kr_set(uint64_t r, uint64_t v, size_t n) { uint64_t m = kr_mask(n); return (r & ~m) | (v & m); }\n"
+		"static inline int64_t kr_sext(uint64_t v, size_t n) { return n >= 8 ? (int64_t)v : (int64_t)(v << (64 - n * 8)) >> (64 - n * 8); }\n"
+		"\n"
+		"/* Flags and division as the interpreter defines them, see op::Condition and the integer opcodes */\n"
+		"static inline unsigned kr_cmp(uint64_t a, uint64_t b, size_t n)\n"
+		"{\n"
+		"\ta &= kr_mask(n); b &= kr_mask(n);\n"
+		"\treturn (unsigned)(a == b) | ((unsigned)(kr_sext(a, n) < kr_sext(b, n)) << 1) | ((unsigned)(a < b) << 2);\n"
+		"}\n"
+		"static inline unsigned kr_test(uint64_t a, uint64_t b, size_t n) { uint64_t r = a & b & kr_mask(n); return (unsigned)(r == 0) | ((unsigned)(kr_sext(r, n) < 0) << 1); }\n"
+		"static inline uint64_t kr_divu(uint64_t a, uint64_t b, size_t n) { a &= kr_mask(n); b &= kr_mask(n); return b ? a / b : ~0ull; }\n"
+		"static inline uint64_t kr_remu(uint64_t a, uint64_t b, size_t n) { a &= kr_mask(n); b &= kr_mask(n); return b ? a % b : a; }\n"
+		"static inline uint64_t kr_divs(uint64_t a, uint64_t b, size_t n)\n"
+		"{\n"
+		"\tint64_t x = kr_sext(a, n), y = kr_sext(b, n);\n"
+		"\treturn !y ? ~0ull : y == -1 ? 0 - (uint64_t)x : (uint64_t)(x / y);\n"
+		"}\n"
+		"static inline uint64_t kr_rems(uint64_t a, uint64_t b, size_t n)\n"
+		"{\n"
+		"\tint64_t x = kr_sext(a, n), y = kr_sext(b, n);\n"
+		"\treturn !y ? a : y == -1 ? 0 : (uint64_t)(x % y);\n"
+		"}\n"
+		"static inline uint64_t kr_shrs(uint64_t a, uint64_t b, size_t n) { return (uint64_t)(kr_sext(a, n) >> (b & (n * 8 - 1))); }\n"
+		"\n"
+		"/* f32 lives in the low 4 bytes of a register, and writing one keeps the upper half */\n"
+		"static inline float kr_f(uint64_t r) { float v; memcpy(&v, &r, 4); return v; }\n"
+		"static inline double kr_d(uint64_t r) { double v; memcpy(&v, &r, 8); return v; }\n"
+		"static inline uint64_t kr_setf(uint64_t r, float v) { memcpy(&r, &v, 4); return r; }\n"
+		"static inline uint64_t kr_setd(double v) { uint64_t r; memcpy(&r, &v, 8); return r; }\n"
+		"\n";
+
+	static const char* const CastTypes[] = {
+		"uint8_t", "uint16_t", "uint32_t", "uint64_t",
+		"int8_t", "int16_t", "int32_t", "int64_t",
+		"float", "double"
+	};
+
+	struct Translation
+	{
+		std::ostringstream body;
+		bool used[16] = {};
+		bool written[16] = {};
+		Size start = 0;
+		Size next = 0;	/* offset after the instruction being translated */
+		std::vector<bool> labels;	/* branch targets with a label, from "start" on */
+	};
+
+	static std::string hex(UInt64 value)
+	{
+		std::ostringstream os;
+		os << "0x" << std::hex << value << "ull";
+		return os.str();
+	}
+
+	static std::string reg(Translation& tr, UInt8 index, bool write = false)
+	{
+		tr.used[index & 0xf] = true;
+		if (write)
+			tr.written[index & 0xf] = true;
+		return "r" + std::to_string(index & 0xf);
+	}
+
+	/* Stores the registers back and returns "offset" for the interpreter to resume at */
+	static std::string exit_to(Size offset)
+	{
+		return "{ kr_next = " + std::to_string(offset) + "; goto kr_exit; }";
+	}
+
+	/* A goto to the label of "target", or an exit if it has none */
+	static std::string jump(const Translation& tr, Size target)
+	{
+		if (target >= tr.start && target - tr.start < tr.labels.size() && tr.labels[target - tr.start])
+			return "goto kr_" + std::to_string(target) + ";";
+		return exit_to(target);
+	}
+
+	static Size branch_target(const Translation& tr, const DecodedInstruction& inst)
+	{
+		return scast(Size, scast(Int64, tr.next) + scast(Int64, inst.imm));
+	}
+
+	static bool is_branch(Opcode opcode)
+	{
+		return opcode == Opcode::JMP_s32 || opcode == Opcode::JCC_s32 || opcode == Opcode::LOOP_s32;
+	}
+
+	static bool has_location(Opcode opcode)
+	{
+		/* Arithmetic alternates register and memory forms */
+		if (opcode >= Opcode::ADD_r_r_r && opcode <= Opcode::FFMA_r_r_r_m)
+			return (scast(Size, opcode) - scast(Size, Opcode::ADD_r_r_r)) % 2 == 1;
+
+		switch (opcode)
+		{
+			case Opcode::CMP_r_m:
+			case Opcode::MOV_r8_m8: case Opcode::MOV_r16_m16: case Opcode::MOV_r32_m32: case Opcode::MOV_r64_m64:
+			case Opcode::MOV_m8_r8: case Opcode::MOV_m16_r16: case Opcode::MOV_m32_r32: case Opcode::MOV_m64_r64:
+			case Opcode::MOV_m8_imm8: case Opcode::MOV_m16_imm16: case Opcode::MOV_m32_imm32: case Opcode::MOV_m64_imm64:
+			case Opcode::LEA:
+			case Opcode::NEW_m_s:
+			case Opcode::DEL_m:
+			case Opcode::MHR_m:
+			case Opcode::CST_m:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	/* <segment, base, index << scale, delta> as a C expression */
+	static std::string location(Translation& tr, const DecodedInstruction& inst)
+	{
+		std::string addr;
+		switch (inst.segment)
+		{
+			case 0: break;
+			case 1: addr = "(uintptr_t)frame"; break;
+			case 2: addr = "(uintptr_t)statics"; break;
+			default: addr = reg(tr, inst.base); break;
+		}
+
+		if (inst.delta != 0 || addr.empty())
+			addr += (addr.empty() ? "" : " + ") + hex(inst.delta);
+
+		if (inst.indexed)
+		{
+			addr += " + (" + reg(tr, inst.index);
+			if (inst.scale)
+				addr += " << " + std::to_string(inst.scale);
+			addr += ")";
+		}
+		return "(unsigned char*)(uintptr_t)(" + addr + ")";
+	}
+
+	static void cast(Translation& tr, UInt8 types, const std::string& load, const std::string& store, const char* indent = "\t")
+	{
+		UInt8 dst = types & 0xf;
+		UInt8 src = (types >> 4) & 0xf;
+		if (dst > 9 || src > 9)
+			return;
+
+		tr.body << indent << "{ " << CastTypes[src] << " s; " << CastTypes[dst] << " d; " << load
+				<< " d = (" << CastTypes[dst] << ")s; " << store << " }\n";
+	}
+
+	static void store_float(Translation& tr, UInt8 index, bool is_double, const std::string& value)
+	{
+		std::string dst = reg(tr, index, true);
+		if (is_double)
+			tr.body << "\t" << dst << " = kr_setd(" << value << ");\n";
+		else tr.body << "\t" << dst << " = kr_setf(" << dst << ", " << value << ");\n";
+	}
+
+	static bool translate_instruction(Translation& tr, const DecodedInstruction& inst)
+	{
+		std::ostringstream& os = tr.body;
+
+		/* The interpreter traps a null absolute location; leave that to it */
+		if (has_location(inst.opcode) && inst.segment == 0 && !inst.indexed && inst.delta == 0)
+			return false;
+
+		switch (inst.opcode)
+		{
+			case Opcode::NOP:
+				return true;
+
+			case Opcode::MOV_r8_r8: case Opcode::MOV_r16_r16: case Opcode::MOV_r32_r32: case Opcode::MOV_r64_r64: {
+				Size width = Size(1) << (scast(Size, inst.opcode) - scast(Size, Opcode::MOV_r8_r8));
+				std::string dst = reg(tr, inst.reg, true);
+				os << "\t" << dst << " = kr_set(" << dst << ", " << reg(tr, inst.aux) << ", " << width << ");\n";
+			} return true;
+
+			case Opcode::MOV_r8_m8: case Opcode::MOV_r16_m16: case Opcode::MOV_r32_m32: case Opcode::MOV_r64_m64: {
+				Size width = Size(1) << (scast(Size, inst.opcode) - scast(Size, Opcode::MOV_r8_m8));
+				std::string dst = reg(tr, inst.reg, true);
+				os << "\t" << dst << " = kr_set(" << dst << ", kr_ld(" << location(tr, inst) << ", " << width << "), " << width << ");\n";
+			} return true;
+
+			case Opcode::MOV_m8_r8: case Opcode::MOV_m16_r16: case Opcode::MOV_m32_r32: case Opcode::MOV_m64_r64: {
+				Size width = Size(1) << (scast(Size, inst.opcode) - scast(Size, Opcode::MOV_m8_r8));
+				os << "\tkr_st(" << location(tr, inst) << ", " << reg(tr, inst.reg) << ", " << width << ");\n";
+			} return true;
+
+			case Opcode::MOV_r8_imm8: case Opcode::MOV_r16_imm16: case Opcode::MOV_r32_imm32: case Opcode::MOV_r64_imm64: {
+				Size width = Size(1) << (scast(Size, inst.opcode) - scast(Size, Opcode::MOV_r8_imm8));
+				std::string dst = reg(tr, inst.reg, true);
+				os << "\t" << dst << " = kr_set(" << dst << ", " << hex(inst.imm) << ", " << width << ");\n";
+			} return true;
+
+			case Opcode::MOV_m8_imm8: case Opcode::MOV_m16_imm16: case Opcode::MOV_m32_imm32: case Opcode::MOV_m64_imm64: {
+				Size width = Size(1) << (scast(Size, inst.opcode) - scast(Size, Opcode::MOV_m8_imm8));
+				os << "\tkr_st(" << location(tr, inst) << ", " << hex(inst.imm) << ", " << width << ");\n";
+			} return true;
+
+			case Opcode::LEA:
+				os << "\t" << reg(tr, inst.reg, true) << " = (uint64_t)(uintptr_t)" << location(tr, inst) << ";\n";
+				return true;
+
+			/* Through bulk::copy like the interpreter and the JIT, so blocks get the same
+			 * overlap handling and streaming stores on every tier.
+			 */
+			case Opcode::MMB_sb: case Opcode::MMB_sw: case Opcode::MMB_sd: case Opcode::MMB_sq:
+				os << "\tkr_host->copy((void*)(uintptr_t)" << reg(tr, inst.reg) << ", (const void*)(uintptr_t)" << reg(tr, inst.aux)
+				   << ", (size_t)" << hex(inst.imm) << ");\n";
+				return true;
+
+			case Opcode::NEW_r_s:
+				os << "\t" << reg(tr, inst.reg, true) << " = (uint64_t)(uintptr_t)kr_host->malloc(heap, (size_t)" << hex(inst.imm)
+				   << ", " << (inst.aux ? 1 : 0) << ");\n";
+				return true;
+
+			case Opcode::NEW_m_s:
+				os << "\t{ uint64_t p = (uint64_t)(uintptr_t)kr_host->malloc(heap, (size_t)" << hex(inst.imm) << ", " << (inst.aux ? 1 : 0)
+				   << "); kr_st(" << location(tr, inst) << ", p, 8); }\n";
+				return true;
+
+			case Opcode::DEL_r:
+				os << "\tkr_host->free(heap, (void*)(uintptr_t)" << reg(tr, inst.reg) << ");\n";
+				return true;
+
+			case Opcode::DEL_m:
+				os << "\tkr_host->free(heap, (void*)(uintptr_t)kr_ld(" << location(tr, inst) << ", 8));\n";
+				return true;
+
+			case Opcode::MHR_r:
+				os << "\tkr_host->" << (inst.aux ? "increase_ref" : "decrease_ref") << "(heap, (void*)(uintptr_t)" << reg(tr, inst.reg) << ");\n";
+				return true;
+
+			case Opcode::MHR_m:
+				os << "\tkr_host->" << (inst.aux ? "increase_ref" : "decrease_ref") << "(heap, (void*)(uintptr_t)kr_ld(" << location(tr, inst) << ", 8));\n";
+				return true;
+
+			case Opcode::CST_r: {
+				std::string r = reg(tr, inst.reg, true);
+				cast(tr, inst.aux, "memcpy(&s, &" + r + ", sizeof s);", "memcpy(&" + r + ", &d, sizeof d);");
+			} return true;
+
+			case Opcode::CST_m:
+				os << "\t{\n\t\tunsigned char* p = " << location(tr, inst) << ";\n";
+				cast(tr, inst.aux, "memcpy(&s, p, sizeof s);", "memcpy(p, &d, sizeof d);", "\t\t");
+				os << "\t}\n";
+				return true;
+
+			case Opcode::CMP_r_r:
+				os << "\tkr_flags = kr_cmp(" << reg(tr, inst.reg) << ", " << reg(tr, inst.aux) << ", " << (Size(1) << (inst.imm & 3)) << ");\n";
+				return true;
+
+			case Opcode::CMP_r_imm:
+				os << "\tkr_flags = kr_cmp(" << reg(tr, inst.reg) << ", " << hex(inst.imm) << ", " << (Size(1) << (inst.aux & 3)) << ");\n";
+				return true;
+
+			case Opcode::CMP_r_m: {
+				Size width = Size(1) << (inst.aux & 3);
+				os << "\tkr_flags = kr_cmp(" << reg(tr, inst.reg) << ", kr_ld(" << location(tr, inst) << ", " << width << "), " << width << ");\n";
+			} return true;
+
+			case Opcode::TEST_r_r:
+				os << "\tkr_flags = kr_test(" << reg(tr, inst.reg) << ", " << reg(tr, inst.aux) << ", " << (Size(1) << (inst.imm & 3)) << ");\n";
+				return true;
+
+			case Opcode::TEST_r_imm:
+				os << "\tkr_flags = kr_test(" << reg(tr, inst.reg) << ", " << hex(inst.imm) << ", " << (Size(1) << (inst.aux & 3)) << ");\n";
+				return true;
+
+			/* Branches become gotos within the function. Back edges are no safepoints here,
+			 * see Heap::gc_pacing.
+			 */
+			case Opcode::JMP_s32:
+				os << "\t" << jump(tr, branch_target(tr, inst)) << "\n";
+				return true;
+
+			case Opcode::JCC_s32:
+				os << "\tif ((" << hex(op::ConditionTable[inst.aux & 0xF]) << " >> kr_flags) & 1) " << jump(tr, branch_target(tr, inst)) << "\n";
+				return true;
+
+			case Opcode::LOOP_s32:
+				os << "\tif (--" << reg(tr, inst.reg, true) << ") " << jump(tr, branch_target(tr, inst)) << "\n";
+				return true;
+
+			case Opcode::ADD_r_r_r: case Opcode::ADD_r_r_m: case Opcode::SUB_r_r_r: case Opcode::SUB_r_r_m:
+			case Opcode::MUL_r_r_r: case Opcode::MUL_r_r_m: case Opcode::DIV_r_r_r: case Opcode::DIV_r_r_m:
+			case Opcode::REM_r_r_r: case Opcode::REM_r_r_m: case Opcode::AND_r_r_r: case Opcode::AND_r_r_m:
+			case Opcode::OR_r_r_r: case Opcode::OR_r_r_m: case Opcode::XOR_r_r_r: case Opcode::XOR_r_r_m:
+			case Opcode::SHL_r_r_r: case Opcode::SHL_r_r_m: case Opcode::SHR_r_r_r: case Opcode::SHR_r_r_m: {
+				Size index = scast(Size, inst.opcode) - scast(Size, Opcode::ADD_r_r_r);
+				UInt8 pars = scast(UInt8, inst.imm);
+				bool memory = index % 2 == 1;
+				Size width = Size(1) << (memory ? pars & 3 : (pars >> 4) & 3);
+				bool is_signed = memory ? (pars >> 2) & 1 : (pars >> 6) & 1;
+				std::string a = reg(tr, inst.aux);
+				std::string b = memory ? "kr_ld(" + location(tr, inst) + ", " + std::to_string(width) + ")" : reg(tr, pars & 0xF);
+				std::string n = std::to_string(width);
+				std::string shift = "(" + b + " & " + std::to_string(width * 8 - 1) + ")";
+
+				std::string value;
+				switch (index / 2)
+				{
+					case 0: value = a + " + " + b; break;
+					case 1: value = a + " - " + b; break;
+					case 2: value = a + " * " + b; break;
+					case 3: value = (is_signed ? "kr_divs(" : "kr_divu(") + a + ", " + b + ", " + n + ")"; break;
+					case 4: value = (is_signed ? "kr_rems(" : "kr_remu(") + a + ", " + b + ", " + n + ")"; break;
+					case 5: value = a + " & " + b; break;
+					case 6: value = a + " | " + b; break;
+					case 7: value = a + " ^ " + b; break;
+					case 8: value = a + " << " + shift; break;
+					default: value = is_signed ? "kr_shrs(" + a + ", " + b + ", " + n + ")" : "(" + a + " & kr_mask(" + n + ")) >> " + shift; break;
+				}
+				std::string dst = reg(tr, inst.reg, true);
+				os << "\t" << dst << " = kr_set(" << dst << ", " << value << ", " << n << ");\n";
+			} return true;
+
+			case Opcode::FADD_r_r_r: case Opcode::FADD_r_r_m: case Opcode::FSUB_r_r_r: case Opcode::FSUB_r_r_m:
+			case Opcode::FMUL_r_r_r: case Opcode::FMUL_r_r_m: case Opcode::FDIV_r_r_r: case Opcode::FDIV_r_r_m: {
+				static const char* const Operators[] = { " + ", " - ", " * ", " / " };
+				Size index = scast(Size, inst.opcode) - scast(Size, Opcode::FADD_r_r_r);
+				UInt8 pars = scast(UInt8, inst.imm);
+				bool memory = index % 2 == 1;
+				bool is_double = memory ? pars & 1 : (pars >> 4) & 1;
+				const char* load = is_double ? "kr_d(" : "kr_f(";
+				std::string b = memory ? "kr_ld(" + location(tr, inst) + (is_double ? ", 8)" : ", 4)") : reg(tr, pars & 0xF);
+				std::string value = load + reg(tr, inst.aux) + ")" + Operators[index / 2] + load + b + ")";
+				store_float(tr, inst.reg, is_double, value);
+			} return true;
+
+			case Opcode::FSQRT_r_r: case Opcode::FSQRT_r_m: {
+				bool is_double = inst.imm & 1;
+				std::string source = inst.opcode == Opcode::FSQRT_r_m ? "kr_ld(" + location(tr, inst) + (is_double ? ", 8)" : ", 4)") : reg(tr, inst.aux);
+				store_float(tr, inst.reg, is_double, (is_double ? "sqrt(kr_d(" : "sqrtf(kr_f(") + source + "))");
+			} return true;
+
+			case Opcode::FFMA_r_r_r_r: case Opcode::FFMA_r_r_r_m: {
+				bool memory = inst.opcode == Opcode::FFMA_r_r_r_m;
+				UInt8 pars = scast(UInt8, inst.imm);
+				bool is_double = memory ? (pars >> 4) & 1 : (inst.imm >> 8) & 1;
+				const char* load = is_double ? "kr_d(" : "kr_f(";
+				std::string c = memory ? "kr_ld(" + location(tr, inst) + (is_double ? ", 8)" : ", 4)") : reg(tr, (pars >> 4) & 0xF);
+				std::string value = std::string(is_double ? "fma(" : "fmaf(") + load + reg(tr, inst.aux) + "), " + load + reg(tr, pars & 0xF) + "), " + load + c + "))";
+				store_float(tr, inst.reg, is_double, value);
+			} return true;
+
+			default:
+				return false;
+		}
+	}
+
+	static void drop_from(Translation& tr, std::ostringstream::pos_type mark)
+	{
+		std::string body = tr.body.str();
+		body.resize(scast(Size, mark));
+		tr.body.str(body);
+		tr.body.seekp(0, std::ios_base::end);
+	}
+
+	static bool translate_function(std::ostream& os, const bin::Chunk* chunk, runtime::FunctionOffset function, const std::string& prefix)
+	{
+		Size start = chunk->functions[function].codeOffset;
+		runtime::DecodedFunction decoded = runtime::decode_function(chunk, start, jit::function_end(chunk, start));
+		const std::vector<runtime::DecodedFunction::Instruction>& code = decoded.code;
+		if (code.empty())
+			return false;
+
+		Translation tr;
+		tr.start = start;
+		tr.labels.assign(decoded.indices.size(), false);
+		for (const runtime::DecodedFunction::Instruction& inst : code)
+			for (const DecodedInstruction& record : inst.records)
+				if (is_branch(record.opcode) && decoded.index(runtime::DecodedFunction::target(inst, record)) != NoRecord)
+					tr.labels[runtime::DecodedFunction::target(inst, record) - start] = true;
+
+		/* Every instruction without a translation, calls and returns among them, hands the
+		 * frame to the interpreter at its start, and the code after it is translated on
+		 * for the branches that get there.
+		 */
+		std::vector<bool> exits(code.size(), false);
+		for (Size i = 0; i < code.size(); i++)
+		{
+			const runtime::DecodedFunction::Instruction& inst = code[i];
+			tr.next = inst.offset + inst.size;
+			if (tr.labels[inst.offset - start])
+				tr.body << "kr_" << inst.offset << ": ;\n";
+			tr.body << "\t/* " << inst.offset << ": " << op::opcode_name(op::generic_opcode(scast(Opcode, chunk->code[inst.offset]))) << " */\n";
+
+			std::ostringstream::pos_type mark = tr.body.tellp();
+			bool translated = !inst.records.empty();
+			for (const DecodedInstruction& record : inst.records)
+				translated = translated && translate_instruction(tr, record);
+
+			if (!translated)
+			{
+				drop_from(tr, mark);
+				tr.body << "\t" << exit_to(inst.offset) << "\n";
+				exits[i] = true;
+			}
+		}
+
+		if (exits.front() || !runtime::flags_survive_exits(chunk, decoded, exits))
+			return false;
+
+		os << "KRAM_AOT_EXPORT size_t " << prefix << "_f" << function << "(uint64_t* regs, unsigned char* frame, unsigned char* statics, void* heap)\n{\n";
+		os << "\tsize_t kr_next;\n";
+		os << "\tunsigned kr_flags = 0;\n";
+		os << "\t(void)frame; (void)statics; (void)heap; (void)kr_flags;\n";
+		for (UInt8 i = 0; i < 16; i++)
+			if (tr.used[i])
+				os << "\tuint64_t r" << int(i) << " = regs[" << int(i) << "];\n";
+		os << "\n" << tr.body.str();
+		os << "\tkr_next = " << code.back().offset + code.back().size << ";\n";
+		os << "kr_exit:\n";
+		for (UInt8 i = 0; i < 16; i++)
+			if (tr.written[i])
+				os << "\tregs[" << int(i) << "] = r" << int(i) << ";\n";
+		os << "\treturn kr_next;\n}\n\n";
+		return true;
+	}
+
+	/* Bumped whenever Host changes, so libraries built against an older one are rejected */
+	static constexpr UInt8 HostVersion = 2;
+
+	UInt64 checksum(const bin::Chunk* chunk)
+	{
+		UInt64 hash = (0xcbf29ce484222325ull ^ HostVersion) * 0x100000001b3ull;
+		for (Size i = 0; i < chunk->codeCount; i++)
+		{
+			hash ^= scast(UInt8, chunk->code[i]);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	Size translate(std::ostream& os, const bin::Chunk* chunk, const std::string& prefix)
+	{
+		os << Preamble;
+		os << "KRAM_AOT_EXPORT const uint64_t " << prefix << "_checksum = " << hex(checksum(chunk)) << ";\n\n";
+		os << "KRAM_AOT_EXPORT void " << prefix << "_bind(const struct kram_aot_host* host) { kr_host = host; }\n\n";
+
+		Size count = 0;
+		for (runtime::FunctionOffset i = 0; i < chunk->functionCount; i++)
+			if (translate_function(os, chunk, i, prefix))
+				count++;
+		return count;
+	}
+
+	/* "path" as one shell word. cmd.exe has no escape for a double quote inside one, so
+	 * such paths are refused.
+	 */
+	static bool quote(const std::string& path, std::string& quoted)
+	{
+#if defined(_WIN32)
+		if (path.find('"') != std::string::npos)
+			return false;
+		quoted = "\"" + path + "\"";
+#else
+		quoted = "'";
+		for (char c : path)
+			quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+		quoted += "'";
+#endif
+		return true;
+	}
+
+	bool compile(const std::string& source, const std::string& library, const std::string& compiler)
+	{
+		std::string src, lib;
+		if (!quote(source, src) || !quote(library, lib))
+			return false;
+
+		std::ostringstream cmd;
+#if defined(_WIN32)
+		cmd << compiler << " /nologo /O2 /LD " << src << " /Fe" << lib;
+#else
+		cmd << compiler << " -O2 -shared -fPIC -o " << lib << " " << src << " -lm";
+#endif
+		return std::system(cmd.str().c_str()) == 0;
+	}
+
+	bool build(const bin::Chunk* chunk, const std::string& library, const std::string& prefix, const std::string& compiler)
+	{
+		std::string source = library + ".c";
+		{
+			std::ofstream file{ source };
+			if (!file)
+				return false;
+			translate(file, chunk, prefix);
+			if (!file)
+				return false;
+		}
+		return compile(source, library, compiler);
+	}
+
+
+	static void* open_library(const std::string& path)
+	{
+#if defined(_WIN32)
+		return rcast(void*, LoadLibraryA(path.c_str()));
+#else
+		return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+	}
+
+	static void* find_symbol(void* handle, const std::string& name)
+	{
+#if defined(_WIN32)
+		return rcast(void*, GetProcAddress(rcast(HMODULE, handle), name.c_str()));
+#else
+		return dlsym(handle, name.c_str());
+#endif
+	}
+
+	static void close_library(void* handle)
+	{
+#if defined(_WIN32)
+		FreeLibrary(rcast(HMODULE, handle));
+#else
+		dlclose(handle);
+#endif
+	}
+
+	AotCache::~AotCache()
+	{
+		for (auto& library : _libraries)
+			close_library(library.second.handle);
+		_libraries.clear();
+	}
+
+	bool AotCache::load(const bin::Chunk* chunk, const std::string& library, const std::string& prefix)
+	{
+		void* handle = open_library(library);
+		if (!handle)
+			return false;
+
+		const UInt64* sum = rcast(const UInt64*, find_symbol(handle, prefix + "_checksum"));
+		auto bind = rcast(void(*)(const Host*), find_symbol(handle, prefix + "_bind"));
+		if (!sum || !bind || *sum != checksum(chunk))
+		{
+			close_library(handle);
+			return false;
+		}
+		bind(&host);
+
+		release(chunk);
+		Library& lib = _libraries[chunk];
+		lib.handle = handle;
+		lib.source = chunk->code;
+		lib.functions.resize(chunk->functionCount);
+		for (Size i = 0; i < chunk->functionCount; i++)
+			lib.functions[i] = rcast(jit::CompiledFunction, find_symbol(handle, prefix + "_f" + std::to_string(i)));
+		return true;
+	}
+
+	jit::CompiledFunction AotCache::find(const bin::Chunk* chunk, runtime::FunctionOffset function) const
+	{
+		if (_libraries.empty())
+			return nullptr;
+
+		auto it = _libraries.find(chunk);
+		if (it == _libraries.end() || it->second.source != chunk->code || function >= it->second.functions.size())
+			return nullptr;
+		return it->second.functions[function];
+	}
+
+	void AotCache::release(const bin::Chunk* chunk)
+	{
+		auto it = _libraries.find(chunk);
+		if (it != _libraries.end())
+		{
+			close_library(it->second.handle);
+			_libraries.erase(it);
+		}
+	}
+}
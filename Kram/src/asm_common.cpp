@@ -78,10 +78,66 @@ namespace kram::assembler::instruction
 		return inst;
 	}
 
+	Instruction& add_sized_value(Instruction& inst, DataSize size, UInt64 value)
+	{
+		switch (size)
+		{
+			case DataSize::Byte: inst.add_byte(scast(UInt8, value)); break;
+			case DataSize::Word: inst.add_word(scast(UInt16, value)); break;
+			case DataSize::DoubleWord: inst.add_dword(scast(UInt32, value)); break;
+			case DataSize::QuadWord: inst.add_qword(value); break;
+		}
+		return inst;
+	}
+
+	/* Stack + 8-bit delta, the usual local variable access. */
+	static inline bool is_stack_d8_location(const MemoryLocation& loc)
+	{
+		return loc.segment.id == Segment::Stack && !loc.split.enabled && loc.delta.bytes() == DataSize::Byte;
+	}
+
+	/* Register base + index scaled by the element size, the usual array access. */
+	static inline bool is_register_index_location(DataSize size, const MemoryLocation& loc)
+	{
+		return loc.segment.id == Segment::Register && loc.split.enabled && loc.split.size == size && loc.delta.is_zero();
+	}
+
 	Instruction mov(DataSize size, bool mem_to_reg, const MemoryLocation& location, Register reg)
 	{
 		Instruction inst;
 
+		if (is_stack_d8_location(location))
+		{
+			switch (size)
+			{
+				case DataSize::Byte: inst.opcode(mem_to_reg ? Opcode::MOV_r8_stk_d8 : Opcode::MOV_stk_d8_r8); break;
+				case DataSize::Word: inst.opcode(mem_to_reg ? Opcode::MOV_r16_stk_d8 : Opcode::MOV_stk_d8_r16); break;
+				case DataSize::DoubleWord: inst.opcode(mem_to_reg ? Opcode::MOV_r32_stk_d8 : Opcode::MOV_stk_d8_r32); break;
+				case DataSize::QuadWord: inst.opcode(mem_to_reg ? Opcode::MOV_r64_stk_d8 : Opcode::MOV_stk_d8_r64); break;
+			}
+
+			inst.add_byte(bits<0, 4>(reg));
+			inst.add_byte(scast(UInt8, scast(UInt64, location.delta)));
+
+			return inst;
+		}
+
+		if (is_register_index_location(size, location))
+		{
+			switch (size)
+			{
+				case DataSize::Byte: inst.opcode(mem_to_reg ? Opcode::MOV_r8_reg_idx1 : Opcode::MOV_reg_idx1_r8); break;
+				case DataSize::Word: inst.opcode(mem_to_reg ? Opcode::MOV_r16_reg_idx2 : Opcode::MOV_reg_idx2_r16); break;
+				case DataSize::DoubleWord: inst.opcode(mem_to_reg ? Opcode::MOV_r32_reg_idx4 : Opcode::MOV_reg_idx4_r32); break;
+				case DataSize::QuadWord: inst.opcode(mem_to_reg ? Opcode::MOV_r64_reg_idx8 : Opcode::MOV_reg_idx8_r64); break;
+			}
+
+			inst.add_byte(bits<0, 4>(reg));
+			inst.add_byte(bits<0, 4>(location.segment.reg) | bits<4, 4>(location.split.reg));
+
+			return inst;
+		}
+
 		switch (size)
 		{
 			case DataSize::Byte: inst.opcode(mem_to_reg ? Opcode::MOV_r8_m8 : Opcode::MOV_m8_r8); break;
@@ -109,7 +165,7 @@ namespace kram::assembler::instruction
 		}
 
 		inst.add_byte(bits<0, 4>(dest));
-		add_value(inst, immediateValue);
+		add_sized_value(inst, size, immediateValue);
 
 		return inst;
 	}
@@ -126,7 +182,7 @@ namespace kram::assembler::instruction
 			case DataSize::QuadWord: inst.opcode(Opcode::MOV_m64_imm64); break;
 		}
 
-		add_value(inst, immediateValue);
+		add_sized_value(inst, size, immediateValue);
 		add_location(inst, dest);
 
 		return inst;
@@ -255,4 +311,417 @@ namespace kram::assembler::instruction
 
 		return inst;
 	}
+
+	Instruction call(UInt8 connection, UInt16 function)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CALL);
+
+		inst.add_byte(connection);
+		inst.add_word(function);
+
+		return inst;
+	}
+
+	Instruction callr(Register target)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CALLR);
+
+		inst.add_byte(bits<0, 4>(target));
+
+		return inst;
+	}
+
+	Instruction ret()
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::RET);
+
+		return inst;
+	}
+
+	Instruction tailcall(UInt8 connection, UInt16 function)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::TAILCALL);
+
+		inst.add_byte(connection);
+		inst.add_word(function);
+
+		return inst;
+	}
+
+	Instruction cmp(DataSize size, Register left, Register right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CMP_r_r);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 4>(right));
+		inst.add_byte(bits<0, 2>(size));
+
+		return inst;
+	}
+
+	Instruction cmp(DataSize size, Register left, const Value& right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CMP_r_imm);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 2>(size));
+		add_sized_value(inst, size, right);
+
+		return inst;
+	}
+
+	Instruction cmp(DataSize size, Register left, const MemoryLocation& right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CMP_r_m);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 2>(size));
+		add_location(inst, right);
+
+		return inst;
+	}
+
+	Instruction test(DataSize size, Register left, Register right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::TEST_r_r);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 4>(right));
+		inst.add_byte(bits<0, 2>(size));
+
+		return inst;
+	}
+
+	Instruction test(DataSize size, Register left, const Value& right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::TEST_r_imm);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 2>(size));
+		add_sized_value(inst, size, right);
+
+		return inst;
+	}
+
+	Instruction jmp()
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::JMP_s8);
+
+		inst.add_sbyte(0);
+
+		return inst;
+	}
+
+	Instruction jcc(op::Condition condition)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::JCC_s8);
+
+		inst.add_byte(bits<0, 4>(condition));
+		inst.add_sbyte(0);
+
+		return inst;
+	}
+
+	Instruction cmpj(op::Condition condition, DataSize size, Register left, const Value& right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CMPJ_r_imm_s8);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 2>(size));
+		inst.add_byte(bits<0, 4>(condition));
+		add_sized_value(inst, size, right);
+		inst.add_sbyte(0);
+
+		return inst;
+	}
+
+	Instruction cmpj(op::Condition condition, DataSize size, Register left, const MemoryLocation& right)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::CMPJ_r_m_s8);
+
+		inst.add_byte(bits<0, 4>(left) | bits<4, 2>(size));
+		inst.add_byte(bits<0, 4>(condition));
+		add_location(inst, right);
+		inst.add_sbyte(0);
+
+		return inst;
+	}
+
+	Instruction loop(Register counter)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::LOOP_s8);
+
+		inst.add_byte(bits<0, 4>(counter));
+		inst.add_sbyte(0);
+
+		return inst;
+	}
+
+	Instruction switch_(Register index)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::SWITCH);
+
+		inst.add_byte(bits<0, 4>(index));
+		inst.add_word(0);
+		inst.add_sdword(0);
+
+		return inst;
+	}
+
+	static inline bool is_floating(DataType type)
+	{
+		return type == DataType::FloatingDecimal || type == DataType::DoubleDecimal;
+	}
+
+	/* "opcode" is the r_r_r form, the r_r_m form follows it */
+	static Instruction arithmetic(Opcode opcode, DataType type, Register dest, Register left, Register right)
+	{
+		Instruction inst;
+
+		inst.opcode(opcode);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		if (is_floating(type))
+			inst.add_byte(bits<0, 4>(right) | bits<4, 1>(type == DataType::DoubleDecimal));
+		else inst.add_byte(bits<0, 4>(right) | bits<4, 2>(scast(UInt8, type) & 0x3) | bits<6, 1>(type < DataType::UnsignedByte));
+
+		return inst;
+	}
+
+	static Instruction arithmetic(Opcode opcode, DataType type, Register dest, Register left, const MemoryLocation& right)
+	{
+		Instruction inst;
+
+		inst.opcode(scast(Opcode, scast(UInt8, opcode) + 1));
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		if (is_floating(type))
+			inst.add_byte(bits<0, 1>(type == DataType::DoubleDecimal));
+		else inst.add_byte(bits<0, 2>(scast(UInt8, type) & 0x3) | bits<2, 1>(type < DataType::UnsignedByte));
+		add_location(inst, right);
+
+		return inst;
+	}
+
+	Instruction add(DataType type, Register dest, Register left, Register right) { return arithmetic(is_floating(type) ? Opcode::FADD_r_r_r : Opcode::ADD_r_r_r, type, dest, left, right); }
+	Instruction add(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(is_floating(type) ? Opcode::FADD_r_r_r : Opcode::ADD_r_r_r, type, dest, left, right); }
+	Instruction sub(DataType type, Register dest, Register left, Register right) { return arithmetic(is_floating(type) ? Opcode::FSUB_r_r_r : Opcode::SUB_r_r_r, type, dest, left, right); }
+	Instruction sub(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(is_floating(type) ? Opcode::FSUB_r_r_r : Opcode::SUB_r_r_r, type, dest, left, right); }
+	Instruction mul(DataType type, Register dest, Register left, Register right) { return arithmetic(is_floating(type) ? Opcode::FMUL_r_r_r : Opcode::MUL_r_r_r, type, dest, left, right); }
+	Instruction mul(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(is_floating(type) ? Opcode::FMUL_r_r_r : Opcode::MUL_r_r_r, type, dest, left, right); }
+	Instruction div(DataType type, Register dest, Register left, Register right) { return arithmetic(is_floating(type) ? Opcode::FDIV_r_r_r : Opcode::DIV_r_r_r, type, dest, left, right); }
+	Instruction div(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(is_floating(type) ? Opcode::FDIV_r_r_r : Opcode::DIV_r_r_r, type, dest, left, right); }
+
+	Instruction rem(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::REM_r_r_r, type, dest, left, right); }
+	Instruction rem(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::REM_r_r_r, type, dest, left, right); }
+	Instruction and_(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::AND_r_r_r, type, dest, left, right); }
+	Instruction and_(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::AND_r_r_r, type, dest, left, right); }
+	Instruction or_(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::OR_r_r_r, type, dest, left, right); }
+	Instruction or_(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::OR_r_r_r, type, dest, left, right); }
+	Instruction xor_(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::XOR_r_r_r, type, dest, left, right); }
+	Instruction xor_(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::XOR_r_r_r, type, dest, left, right); }
+	Instruction shl(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::SHL_r_r_r, type, dest, left, right); }
+	Instruction shl(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::SHL_r_r_r, type, dest, left, right); }
+	Instruction shr(DataType type, Register dest, Register left, Register right) { return arithmetic(Opcode::SHR_r_r_r, type, dest, left, right); }
+	Instruction shr(DataType type, Register dest, Register left, const MemoryLocation& right) { return arithmetic(Opcode::SHR_r_r_r, type, dest, left, right); }
+
+	Instruction sqrt(bool double_precision, Register dest, Register src)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::FSQRT_r_r);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(src));
+		inst.add_byte(bits<0, 1>(double_precision));
+
+		return inst;
+	}
+
+	Instruction sqrt(bool double_precision, Register dest, const MemoryLocation& src)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::FSQRT_r_m);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 1>(double_precision));
+		add_location(inst, src);
+
+		return inst;
+	}
+
+	Instruction fma(bool double_precision, Register dest, Register left, Register right, Register addend)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::FFMA_r_r_r_r);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		inst.add_byte(bits<0, 4>(right) | bits<4, 4>(addend));
+		inst.add_byte(bits<0, 1>(double_precision));
+
+		return inst;
+	}
+
+	Instruction fma(bool double_precision, Register dest, Register left, Register right, const MemoryLocation& addend)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::FFMA_r_r_r_m);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		inst.add_byte(bits<0, 4>(right) | bits<4, 1>(double_precision));
+		add_location(inst, addend);
+
+		return inst;
+	}
+
+	static Instruction vector(Opcode opcode, DataType type, Register dest, Register left, Register right, Register count, UInt8 extra)
+	{
+		Instruction inst;
+
+		inst.opcode(opcode);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		inst.add_byte(bits<0, 4>(right) | bits<4, 4>(count));
+		inst.add_byte(bits<0, 4>(type) | bits<4, 4>(extra));
+
+		return inst;
+	}
+
+	Instruction vadd(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VADD, type, dest, left, right, count, 0); }
+	Instruction vsub(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VSUB, type, dest, left, right, count, 0); }
+	Instruction vmul(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VMUL, type, dest, left, right, count, 0); }
+	Instruction vmin(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VMIN, type, dest, left, right, count, 0); }
+	Instruction vmax(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VMAX, type, dest, left, right, count, 0); }
+	Instruction vfma(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VFMA, type, dest, left, right, count, 0); }
+
+	Instruction vcmp(op::Condition condition, DataType type, Register mask, Register left, Register right, Register count)
+	{
+		return vector(Opcode::VCMP, type, mask, left, right, count, scast(UInt8, condition));
+	}
+
+	Instruction vselect(DataType type, Register dest, Register mask, Register left, Register right, Register count)
+	{
+		return vector(Opcode::VSELECT, type, dest, left, right, count, scast(UInt8, mask));
+	}
+
+	static Instruction reduction(Opcode opcode, DataType type, Register dest, Register src, Register count)
+	{
+		Instruction inst;
+
+		inst.opcode(opcode);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(src));
+		inst.add_byte(bits<0, 4>(count) | bits<4, 4>(type));
+
+		return inst;
+	}
+
+	Instruction vsum(DataType type, Register dest, Register src, Register count) { return reduction(Opcode::VSUM, type, dest, src, count); }
+	Instruction vrmin(DataType type, Register dest, Register src, Register count) { return reduction(Opcode::VRMIN, type, dest, src, count); }
+	Instruction vrmax(DataType type, Register dest, Register src, Register count) { return reduction(Opcode::VRMAX, type, dest, src, count); }
+	Instruction vargmin(DataType type, Register dest, Register src, Register count) { return reduction(Opcode::VARGMIN, type, dest, src, count); }
+	Instruction vargmax(DataType type, Register dest, Register src, Register count) { return reduction(Opcode::VARGMAX, type, dest, src, count); }
+	Instruction vdot(DataType type, Register dest, Register left, Register right, Register count) { return vector(Opcode::VDOT, type, dest, left, right, count, 0); }
+
+	Instruction vscan(bool exclusive, DataType type, Register dest, Register src, Register count)
+	{
+		return reduction(exclusive ? Opcode::VSCANX : Opcode::VSCAN, type, dest, src, count);
+	}
+
+	Instruction mset(DataSize size, Register dest, Register value, Register count)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::MSET);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(value));
+		inst.add_byte(bits<0, 4>(count) | bits<4, 2>(size));
+
+		return inst;
+	}
+
+	Instruction mcmp(Register dest, Register left, Register right, Register size)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::MCMP);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(left));
+		inst.add_byte(bits<0, 4>(right) | bits<4, 4>(size));
+
+		return inst;
+	}
+
+	Instruction mfind(Register dest, Register src, Register size, Register pattern, Register pattern_size)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::MFIND);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(src));
+		inst.add_byte(bits<0, 4>(size) | bits<4, 4>(pattern));
+		inst.add_byte(bits<0, 4>(pattern_size));
+
+		return inst;
+	}
+
+	Instruction mfind(Register dest, Register src, Register size, Register value)
+	{
+		Instruction inst;
+
+		inst.opcode(Opcode::MFINDB);
+
+		inst.add_byte(bits<0, 4>(dest) | bits<4, 4>(src));
+		inst.add_byte(bits<0, 4>(size) | bits<4, 4>(value));
+
+		return inst;
+	}
+
+	static Instruction indexed(Opcode opcode, DataSize size, DataSize index_size, Register block, const MemoryLocation& table, Register indices, Register count)
+	{
+		Instruction inst;
+
+		inst.opcode(opcode);
+
+		inst.add_byte(bits<0, 4>(block) | bits<4, 4>(indices));
+		inst.add_byte(bits<0, 4>(count) | bits<4, 2>(size) | bits<6, 2>(index_size));
+		add_location(inst, table);
+
+		return inst;
+	}
+
+	Instruction gather(DataSize size, DataSize index_size, Register dest, const MemoryLocation& table, Register indices, Register count)
+	{
+		return indexed(Opcode::GATHER, size, index_size, dest, table, indices, count);
+	}
+
+	Instruction scatter(DataSize size, DataSize index_size, const MemoryLocation& table, Register src, Register indices, Register count)
+	{
+		return indexed(Opcode::SCATTER, size, index_size, src, table, indices, count);
+	}
 }
@@ -1,4 +1,5 @@
 #include "bindata.h"
+#include "decoder.h"
 
 namespace kram::bin
 {
@@ -115,6 +116,9 @@ namespace kram::bin
 	}
 	Chunk::~Chunk()
 	{
+		runtime::_destroy_decoded(decoded);
+		decoded = nullptr;
+
 		if (_data)
 		{
 			utils::free_raw(_data);
@@ -301,6 +305,14 @@ namespace kram::bin
 		size += (functions_size = _functions.size() * sizeof(Function));
 		for (FunctionBuilder& fb : _functions)
 		{
+			if (_fuse)
+			{
+				fb._code.fuse_tail_calls([&](UInt8 connection, UInt16 function) {
+					return connection == op::SelfConnection && function < _functions.size()
+						&& _functions[function].register_results() == fb.register_results();
+				});
+				fb._code.fuse_superinstructions();
+			}
 			fb.__codeByteCount = fb.code().byte_count();
 			code_size += fb.__codeByteCount;
 			size += fb.__codeByteCount;
@@ -311,8 +323,9 @@ namespace kram::bin
 		utils::construct(*chunk, size);
 
 		chunk->staticCount = statics_size;
-		chunk->functionCount = functions_size;
-		chunk->connectionCount = connections_size;
+		chunk->functionCount = _functions.size();
+		chunk->connectionCount = _connections.size();
+		chunk->codeCount = code_size;
 
 		chunk->connect_ptr(rcast(void**, &chunk->statics), connections_size);
 		chunk->connect_ptr(rcast(void**, &chunk->functions), statics_size + connections_size);
@@ -329,6 +342,8 @@ namespace kram::bin
 		{
 			functionsPtrOffset->parameterCount = fb.parameters();
 			functionsPtrOffset->stackCount = fb.stack_size();
+			functionsPtrOffset->registerArguments = fb.register_arguments();
+			functionsPtrOffset->registerResults = fb.register_results();
 			functionsPtrOffset->codeOffset = codeOffset;
 
 			code.push_back(fb.code());
@@ -338,5 +353,14 @@ namespace kram::bin
 		}
 
 		code.build(chunk->code, code_size);
+
+		functionsPtrOffset = chunk->functions;
+		for (const FunctionBuilder& fb : _functions)
+		{
+			if (fb.declared_registers())
+				functionsPtrOffset->registerMask = fb.registers();
+			else functionsPtrOffset->registerMask = runtime::used_registers(chunk->code + functionsPtrOffset->codeOffset, fb.__codeByteCount);
+			functionsPtrOffset++;
+		}
 	}
 }
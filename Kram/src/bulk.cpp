@@ -0,0 +1,270 @@
+#include "bulk.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define KRAM_BULK_STREAMING
+#endif
+
+#if defined(KRAM_SIMD_X86_TARGETS)
+	#include <immintrin.h>
+#endif
+
+namespace kram::bulk
+{
+	static std::atomic<Size> streaming_threshold{ Size(4) << 20 };
+
+	void streaming(Size threshold)
+	{
+		streaming_threshold.store(threshold, std::memory_order_relaxed);
+	}
+
+	static inline bool streams(Size size)
+	{
+		Size threshold = streaming_threshold.load(std::memory_order_relaxed);
+		return threshold != 0 && size >= threshold;
+	}
+
+	static inline Size misalignment(const void* ptr)
+	{
+		return (16 - (reinterpret_cast<std::uintptr_t>(ptr) & 15)) & 15;
+	}
+
+
+#if defined(KRAM_BULK_STREAMING)
+	/* SSE2 is part of x86-64, so these need no runtime check. The stores are aligned,
+	 * the loads are not, and the final fence orders them before later plain stores.
+	 * Blocks shorter than their misaligned head are copied whole by it.
+	 */
+	static void stream_copy(std::byte* dest, const std::byte* src, Size size)
+	{
+		Size head = std::min(misalignment(dest), size);
+		std::memcpy(dest, src, head);
+		dest += head;
+		src += head;
+		size -= head;
+
+		for (; size >= 64; size -= 64, dest += 64, src += 64)
+		{
+			__m128i a = _mm_loadu_si128(rcast(const __m128i*, src));
+			__m128i b = _mm_loadu_si128(rcast(const __m128i*, src + 16));
+			__m128i c = _mm_loadu_si128(rcast(const __m128i*, src + 32));
+			__m128i d = _mm_loadu_si128(rcast(const __m128i*, src + 48));
+			_mm_stream_si128(rcast(__m128i*, dest), a);
+			_mm_stream_si128(rcast(__m128i*, dest + 16), b);
+			_mm_stream_si128(rcast(__m128i*, dest + 32), c);
+			_mm_stream_si128(rcast(__m128i*, dest + 48), d);
+		}
+		_mm_sfence();
+
+		std::memcpy(dest, src, size);
+	}
+
+	/* "pattern" holds the element repeated over 32 bytes, so any 16 byte window of it
+	 * starting before the second element is a valid phase.
+	 */
+	static void stream_fill(std::byte* dest, const std::byte* pattern, Size element_size, Size size)
+	{
+		Size head = std::min(misalignment(dest), size);
+		std::memcpy(dest, pattern, head);
+		dest += head;
+		size -= head;
+
+		const std::byte* phase = pattern + head % element_size;
+		__m128i value = _mm_loadu_si128(rcast(const __m128i*, phase));
+		for (; size >= 16; size -= 16, dest += 16)
+			_mm_stream_si128(rcast(__m128i*, dest), value);
+		_mm_sfence();
+
+		std::memcpy(dest, phase, size);
+	}
+#endif
+
+	void copy(void* dest, const void* src, Size size)
+	{
+#if defined(KRAM_BULK_STREAMING)
+		std::uintptr_t d = reinterpret_cast<std::uintptr_t>(dest);
+		std::uintptr_t s = reinterpret_cast<std::uintptr_t>(src);
+		if (streams(size) && (d + size <= s || s + size <= d))
+		{
+			stream_copy(rcast(std::byte*, dest), rcast(const std::byte*, src), size);
+			return;
+		}
+#endif
+		std::memmove(dest, src, size);
+	}
+
+	template<typename _Ty>
+	static inline void fill_elements(void* dest, UInt64 value, Size count)
+	{
+		_Ty* elements = rcast(_Ty*, dest);
+		_Ty element = scast(_Ty, value);
+		for (Size i = 0; i < count; i++)
+			elements[i] = element;
+	}
+
+	void fill(void* dest, UInt64 value, Size element_size, Size count)
+	{
+#if defined(KRAM_BULK_STREAMING)
+		if (streams(element_size * count))
+		{
+			std::byte pattern[32];
+			for (Size offset = 0; offset < sizeof(pattern); offset += element_size)
+				std::memcpy(pattern + offset, &value, element_size);
+			stream_fill(rcast(std::byte*, dest), pattern, element_size, element_size * count);
+			return;
+		}
+#endif
+		switch (element_size)
+		{
+			case 1: std::memset(dest, scast(int, value & 0xFF), count); break;
+			case 2: fill_elements<UInt16>(dest, value, count); break;
+			case 4: fill_elements<UInt32>(dest, value, count); break;
+			default: fill_elements<UInt64>(dest, value, count); break;
+		}
+	}
+
+
+	static Size mismatch_scalar(const UInt8* left, const UInt8* right, Size size)
+	{
+		Size i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			UInt64 a, b;
+			std::memcpy(&a, left + i, 8);
+			std::memcpy(&b, right + i, 8);
+			if (a != b)
+				return i + std::countr_zero(a ^ b) / 8;
+		}
+
+		for (; i < size; i++)
+		{
+			if (left[i] != right[i])
+				return i;
+		}
+		return size;
+	}
+
+	static Size find_scalar(const UInt8* src, Size size, UInt8 value)
+	{
+		const void* found = std::memchr(src, value, size);
+		return found ? scast(Size, rcast(const UInt8*, found) - src) : NotFound;
+	}
+
+	/* Candidates come from memchr on the first byte of the pattern */
+	static Size find_scalar(const UInt8* src, Size size, const UInt8* pattern, Size pattern_size)
+	{
+		if (pattern_size > size)
+			return NotFound;
+
+		Size last = size - pattern_size;
+		for (Size i = 0; i <= last; i++)
+		{
+			Size offset = find_scalar(src + i, last - i + 1, pattern[0]);
+			if (offset == NotFound)
+				break;
+
+			i += offset;
+			if (std::memcmp(src + i + 1, pattern + 1, pattern_size - 1) == 0)
+				return i;
+		}
+		return NotFound;
+	}
+
+#if defined(KRAM_SIMD_X86_TARGETS)
+	KRAM_TARGET_AVX2 static Size mismatch_avx2(const UInt8* left, const UInt8* right, Size size)
+	{
+		Size i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i a = _mm256_loadu_si256(rcast(const __m256i*, left + i));
+			__m256i b = _mm256_loadu_si256(rcast(const __m256i*, right + i));
+			UInt32 equal = scast(UInt32, _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+			if (equal != 0xFFFFFFFFU)
+				return i + std::countr_zero(~equal);
+		}
+		return i + mismatch_scalar(left + i, right + i, size - i);
+	}
+
+	KRAM_TARGET_AVX2 static Size find_avx2(const UInt8* src, Size size, UInt8 value)
+	{
+		__m256i needle = _mm256_set1_epi8(scast(char, value));
+		Size i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i block = _mm256_loadu_si256(rcast(const __m256i*, src + i));
+			UInt32 found = scast(UInt32, _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+			if (found != 0)
+				return i + std::countr_zero(found);
+		}
+
+		Size offset = find_scalar(src + i, size - i, value);
+		return offset == NotFound ? NotFound : i + offset;
+	}
+
+	/* Positions whose first and last bytes both match the pattern are checked in full */
+	KRAM_TARGET_AVX2 static Size find_avx2(const UInt8* src, Size size, const UInt8* pattern, Size pattern_size)
+	{
+		__m256i first = _mm256_set1_epi8(scast(char, pattern[0]));
+		__m256i last = _mm256_set1_epi8(scast(char, pattern[pattern_size - 1]));
+		Size end = size - pattern_size + 1;
+		Size i = 0;
+		for (; i + 32 <= end; i += 32)
+		{
+			__m256i head = _mm256_loadu_si256(rcast(const __m256i*, src + i));
+			__m256i tail = _mm256_loadu_si256(rcast(const __m256i*, src + i + pattern_size - 1));
+			UInt32 candidates = scast(UInt32, _mm256_movemask_epi8(
+				_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+
+			for (; candidates != 0; candidates &= candidates - 1)
+			{
+				Size offset = i + std::countr_zero(candidates);
+				if (std::memcmp(src + offset + 1, pattern + 1, pattern_size - 1) == 0)
+					return offset;
+			}
+		}
+
+		Size offset = find_scalar(src + i, size - i, pattern, pattern_size);
+		return offset == NotFound ? NotFound : i + offset;
+	}
+
+	static inline bool has_avx2() { return simd::isa() >= simd::Isa::Avx2; }
+#endif
+
+	Size mismatch(const void* left, const void* right, Size size)
+	{
+#if defined(KRAM_SIMD_X86_TARGETS)
+		if (has_avx2())
+			return mismatch_avx2(rcast(const UInt8*, left), rcast(const UInt8*, right), size);
+#endif
+		return mismatch_scalar(rcast(const UInt8*, left), rcast(const UInt8*, right), size);
+	}
+
+	Size find(const void* src, Size size, UInt8 value)
+	{
+#if defined(KRAM_SIMD_X86_TARGETS)
+		if (has_avx2())
+			return find_avx2(rcast(const UInt8*, src), size, value);
+#endif
+		return find_scalar(rcast(const UInt8*, src), size, value);
+	}
+
+	Size find(const void* src, Size size, const void* pattern, Size pattern_size)
+	{
+		if (pattern_size == 0)
+			return 0;
+		if (pattern_size > size)
+			return NotFound;
+
+#if defined(KRAM_SIMD_X86_TARGETS)
+		if (has_avx2())
+			return find_avx2(rcast(const UInt8*, src), size, rcast(const UInt8*, pattern), pattern_size);
+#endif
+		return find_scalar(rcast(const UInt8*, src), size, rcast(const UInt8*, pattern), pattern_size);
+	}
+}
@@ -0,0 +1,53 @@
+#include "closure.h"
+
+namespace kram::runtime
+{
+	ClosureCache::ClosureCache() :
+		_entries{},
+		_threshold{ DefaultClosureThreshold },
+		_runs{ 0 }
+	{}
+
+	ClosureCache::~ClosureCache()
+	{
+		for (auto& entry : _entries)
+			_destroy_decoded(entry.second.code);
+	}
+
+	const DecodedCode* ClosureCache::warm(const bin::Chunk* chunk, const CallTarget* targets)
+	{
+		if (!_threshold)
+			return nullptr;
+
+		Entry& entry = _entries[chunk];
+		if (entry.source != chunk->code)
+		{
+			_destroy_decoded(entry.code);
+			entry = { chunk->code, 0, nullptr };
+		}
+
+		if (!entry.code)
+		{
+			if (++entry.calls < _threshold || !(entry.code = decode_chunk(chunk)))
+				return nullptr;
+			for (Size i = 0; i < entry.code->count; i++)
+				entry.code->code[i].closure = _closure_handler(entry.code->code[i].opcode);
+		}
+
+		/* The targets of a chunk are dropped and built again together with its code copy */
+		if (targets->closures != entry.code)
+			for (Size i = 0; i < chunk->functionCount; i++)
+				targets[i].closures = entry.code;
+		return entry.code;
+	}
+
+	void ClosureCache::release(const bin::Chunk* chunk)
+	{
+		auto it = _entries.find(chunk);
+		if (it != _entries.end())
+		{
+			_destroy_decoded(it->second.code);
+			_entries.erase(it);
+		}
+	}
+}
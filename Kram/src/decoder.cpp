@@ -0,0 +1,866 @@
+#include "decoder.h"
+
+using kram::op::Opcode;
+
+namespace kram::runtime
+{
+	struct CodeReader
+	{
+		const std::byte* ptr;
+		const std::byte* end;
+		bool overflow = false;
+
+		template<std::unsigned_integral _Ty>
+		_Ty pop()
+		{
+			if (ptr + sizeof(_Ty) > end)
+			{
+				overflow = true;
+				ptr = end;
+				return 0;
+			}
+
+			_Ty value;
+			std::memcpy(&value, ptr, sizeof(_Ty));
+			ptr += sizeof(_Ty);
+			return value;
+		}
+
+		UInt64 pop_sized(UInt8 size)
+		{
+			switch (size)
+			{
+				case 0: return pop<UInt8>();
+				case 1: return pop<UInt16>();
+				case 2: return pop<UInt32>();
+				default: return pop<UInt64>();
+			}
+		}
+	};
+
+	static void decode_memloc(CodeReader& reader, DecodedInstruction& inst)
+	{
+		UInt8 pars = reader.pop<UInt8>();
+		UInt8 regs = reader.pop<UInt8>();
+
+		inst.segment = utils::get_bits<0, 2>(pars);
+		inst.base = utils::get_bits<0, 4>(regs);
+		inst.indexed = utils::get_bits<2, 1>(pars);
+		inst.index = inst.indexed ? utils::get_bits<4, 4>(regs) : 0;
+		inst.scale = inst.indexed ? utils::get_bits<3, 2>(pars) : 0;
+		inst.delta = utils::get_bits<5, 1>(pars) ? reader.pop_sized(utils::get_bits<6, 2>(pars)) : 0;
+	}
+
+	static void decode_fixed_memloc(CodeReader& reader, DecodedInstruction& inst, Opcode generic, UInt8 segment, bool has_split, UInt8 split_scale, int delta_size)
+	{
+		inst.opcode = generic;
+		inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+		inst.segment = segment;
+
+		if (has_split || segment == 3)
+		{
+			UInt8 regs = reader.pop<UInt8>();
+			inst.base = utils::get_bits<0, 4>(regs);
+			inst.index = has_split ? utils::get_bits<4, 4>(regs) : 0;
+		}
+
+		inst.indexed = has_split;
+		inst.scale = has_split ? split_scale : 0;
+		inst.delta = delta_size >= 0 ? reader.pop_sized(scast(UInt8, delta_size)) : 0;
+	}
+
+	/* Branch offsets come last. Records keep them sign-extended in "imm" */
+	static UInt64 pop_offset(CodeReader& reader, Opcode opcode)
+	{
+		if (opcode == op::find_branch(opcode)->longForm)
+			return scast(UInt64, scast(Int64, scast(Int32, reader.pop<UInt32>())));
+		return scast(UInt64, scast(Int64, scast(Int8, reader.pop<UInt8>())));
+	}
+
+	static bool decode_operands(CodeReader& reader, DecodedInstruction& inst, Opcode opcode)
+	{
+		std::memset(&inst, 0, sizeof(inst));
+		inst.opcode = opcode;
+
+		switch (inst.opcode)
+		{
+			case Opcode::NOP:
+				break;
+
+			case Opcode::MOV_r8_r8:
+			case Opcode::MOV_r16_r16:
+			case Opcode::MOV_r32_r32:
+			case Opcode::MOV_r64_r64:
+			case Opcode::MMB_sb:
+			case Opcode::MMB_sw:
+			case Opcode::MMB_sd:
+			case Opcode::MMB_sq: {
+				UInt8 regs = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(regs);
+				inst.aux = utils::get_bits<4, 4>(regs);
+
+				switch (inst.opcode)
+				{
+					case Opcode::MMB_sb: inst.imm = reader.pop<UInt8>(); break;
+					case Opcode::MMB_sw: inst.imm = reader.pop<UInt16>(); break;
+					case Opcode::MMB_sd: inst.imm = reader.pop<UInt32>(); break;
+					case Opcode::MMB_sq: inst.imm = reader.pop<UInt64>(); break;
+					default: break;
+				}
+			} break;
+
+			case Opcode::MOV_r8_m8:
+			case Opcode::MOV_r8_m8_qreg:
+			case Opcode::MOV_r8_m8_qreg_d8:
+			case Opcode::MOV_r16_m16:
+			case Opcode::MOV_r16_m16_qreg:
+			case Opcode::MOV_r16_m16_qreg_d8:
+			case Opcode::MOV_r32_m32:
+			case Opcode::MOV_r32_m32_qreg:
+			case Opcode::MOV_r32_m32_qreg_d8:
+			case Opcode::MOV_r64_m64:
+			case Opcode::MOV_r64_m64_qreg:
+			case Opcode::MOV_r64_m64_qreg_d8:
+			case Opcode::MOV_m8_r8:
+			case Opcode::MOV_m8_r8_qreg:
+			case Opcode::MOV_m8_r8_qreg_d8:
+			case Opcode::MOV_m16_r16:
+			case Opcode::MOV_m16_r16_qreg:
+			case Opcode::MOV_m16_r16_qreg_d8:
+			case Opcode::MOV_m32_r32:
+			case Opcode::MOV_m32_r32_qreg:
+			case Opcode::MOV_m32_r32_qreg_d8:
+			case Opcode::MOV_m64_r64:
+			case Opcode::MOV_m64_r64_qreg:
+			case Opcode::MOV_m64_r64_qreg_d8:
+			case Opcode::LEA:
+				inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				inst.opcode = op::generic_opcode(inst.opcode);
+				decode_memloc(reader, inst);
+				break;
+
+			case Opcode::MOV_r8_imm8: inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>()); inst.imm = reader.pop<UInt8>(); break;
+			case Opcode::MOV_r16_imm16: inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>()); inst.imm = reader.pop<UInt16>(); break;
+			case Opcode::MOV_r32_imm32: inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>()); inst.imm = reader.pop<UInt32>(); break;
+			case Opcode::MOV_r64_imm64: inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>()); inst.imm = reader.pop<UInt64>(); break;
+
+			case Opcode::MOV_m8_imm8: inst.imm = reader.pop<UInt8>(); decode_memloc(reader, inst); break;
+			case Opcode::MOV_m16_imm16: inst.imm = reader.pop<UInt16>(); decode_memloc(reader, inst); break;
+			case Opcode::MOV_m32_imm32: inst.imm = reader.pop<UInt32>(); decode_memloc(reader, inst); break;
+			case Opcode::MOV_m64_imm64: inst.imm = reader.pop<UInt64>(); decode_memloc(reader, inst); break;
+
+			case Opcode::NEW_r_s: {
+				UInt8 pars = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(pars);
+				inst.aux = utils::get_bits<6, 1>(pars);
+				inst.imm = reader.pop_sized(utils::get_bits<4, 2>(pars));
+			} break;
+
+			case Opcode::NEW_m_s: {
+				UInt8 pars = reader.pop<UInt8>();
+				inst.aux = utils::get_bits<2, 1>(pars);
+				inst.imm = reader.pop_sized(utils::get_bits<0, 2>(pars));
+				decode_memloc(reader, inst);
+			} break;
+
+			case Opcode::DEL_r:
+				inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				break;
+
+			case Opcode::DEL_m:
+				decode_memloc(reader, inst);
+				break;
+
+			case Opcode::MHR_r: {
+				UInt8 pars = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(pars);
+				inst.aux = utils::get_bits<4, 1>(pars);
+			} break;
+
+			case Opcode::MHR_m:
+				inst.aux = utils::get_bits<0, 1>(reader.pop<UInt8>());
+				decode_memloc(reader, inst);
+				break;
+
+			case Opcode::CST_r:
+			case Opcode::CST_r_q:
+				inst.opcode = Opcode::CST_r;
+				inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				inst.aux = reader.pop<UInt8>();
+				break;
+
+			case Opcode::CST_m:
+			case Opcode::CST_m_q:
+				inst.opcode = Opcode::CST_m;
+				inst.aux = reader.pop<UInt8>();
+				decode_memloc(reader, inst);
+				break;
+
+			case Opcode::CALL:
+			case Opcode::TAILCALL:
+				inst.aux = reader.pop<UInt8>();
+				inst.imm = reader.pop<UInt16>();
+				break;
+
+			case Opcode::CALLR:
+				inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				break;
+
+			case Opcode::RET:
+				break;
+
+			case Opcode::CMP_r_r:
+			case Opcode::TEST_r_r: {
+				UInt8 regs = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(regs);
+				inst.aux = utils::get_bits<4, 4>(regs);
+				inst.imm = utils::get_bits<0, 2>(reader.pop<UInt8>());
+			} break;
+
+			case Opcode::CMP_r_imm:
+			case Opcode::TEST_r_imm:
+			case Opcode::CMP_r_m: {
+				UInt8 pars = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(pars);
+				inst.aux = utils::get_bits<4, 2>(pars);
+				if (inst.opcode == Opcode::CMP_r_m)
+					decode_memloc(reader, inst);
+				else inst.imm = reader.pop_sized(inst.aux);
+			} break;
+
+			case Opcode::JMP_s8:
+			case Opcode::JMP_s32:
+				inst.opcode = Opcode::JMP_s32;
+				inst.imm = pop_offset(reader, opcode);
+				break;
+
+			case Opcode::JCC_s8:
+			case Opcode::JCC_s32:
+				inst.opcode = Opcode::JCC_s32;
+				inst.aux = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				inst.imm = pop_offset(reader, opcode);
+				break;
+
+			case Opcode::LOOP_s8:
+			case Opcode::LOOP_s32:
+				inst.opcode = Opcode::LOOP_s32;
+				inst.reg = utils::get_bits<0, 4>(reader.pop<UInt8>());
+				inst.imm = pop_offset(reader, opcode);
+				break;
+
+			case Opcode::ADD_r_r_r:
+			case Opcode::SUB_r_r_r:
+			case Opcode::MUL_r_r_r:
+			case Opcode::DIV_r_r_r:
+			case Opcode::REM_r_r_r:
+			case Opcode::AND_r_r_r:
+			case Opcode::OR_r_r_r:
+			case Opcode::XOR_r_r_r:
+			case Opcode::SHL_r_r_r:
+			case Opcode::SHR_r_r_r:
+			case Opcode::FADD_r_r_r:
+			case Opcode::FSUB_r_r_r:
+			case Opcode::FMUL_r_r_r:
+			case Opcode::FDIV_r_r_r:
+			case Opcode::FSQRT_r_r: {
+				UInt8 regs = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(regs);
+				inst.aux = utils::get_bits<4, 4>(regs);
+				inst.imm = reader.pop<UInt8>();
+			} break;
+
+			case Opcode::ADD_r_r_m:
+			case Opcode::SUB_r_r_m:
+			case Opcode::MUL_r_r_m:
+			case Opcode::DIV_r_r_m:
+			case Opcode::REM_r_r_m:
+			case Opcode::AND_r_r_m:
+			case Opcode::OR_r_r_m:
+			case Opcode::XOR_r_r_m:
+			case Opcode::SHL_r_r_m:
+			case Opcode::SHR_r_r_m:
+			case Opcode::FADD_r_r_m:
+			case Opcode::FSUB_r_r_m:
+			case Opcode::FMUL_r_r_m:
+			case Opcode::FDIV_r_r_m:
+			case Opcode::FFMA_r_r_r_m: {
+				UInt8 regs = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(regs);
+				inst.aux = utils::get_bits<4, 4>(regs);
+				inst.imm = reader.pop<UInt8>();
+				decode_memloc(reader, inst);
+			} break;
+
+			case Opcode::FSQRT_r_m: {
+				UInt8 pars = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(pars);
+				inst.imm = utils::get_bits<4, 1>(pars);
+				decode_memloc(reader, inst);
+			} break;
+
+			case Opcode::FFMA_r_r_r_r: {
+				UInt8 regs = reader.pop<UInt8>();
+				inst.reg = utils::get_bits<0, 4>(regs);
+				inst.aux = utils::get_bits<4, 4>(regs);
+				UInt8 sources = reader.pop<UInt8>();
+				inst.imm = sources | (UInt64(utils::get_bits<0, 1>(reader.pop<UInt8>())) << 8);
+			} break;
+
+			case Opcode::MOV_r8_stk_d8: decode_fixed_memloc(reader, inst, Opcode::MOV_r8_m8, 1, false, 0, 0); break;
+			case Opcode::MOV_r16_stk_d8: decode_fixed_memloc(reader, inst, Opcode::MOV_r16_m16, 1, false, 0, 0); break;
+			case Opcode::MOV_r32_stk_d8: decode_fixed_memloc(reader, inst, Opcode::MOV_r32_m32, 1, false, 0, 0); break;
+			case Opcode::MOV_r64_stk_d8: decode_fixed_memloc(reader, inst, Opcode::MOV_r64_m64, 1, false, 0, 0); break;
+			case Opcode::MOV_stk_d8_r8: decode_fixed_memloc(reader, inst, Opcode::MOV_m8_r8, 1, false, 0, 0); break;
+			case Opcode::MOV_stk_d8_r16: decode_fixed_memloc(reader, inst, Opcode::MOV_m16_r16, 1, false, 0, 0); break;
+			case Opcode::MOV_stk_d8_r32: decode_fixed_memloc(reader, inst, Opcode::MOV_m32_r32, 1, false, 0, 0); break;
+			case Opcode::MOV_stk_d8_r64: decode_fixed_memloc(reader, inst, Opcode::MOV_m64_r64, 1, false, 0, 0); break;
+
+			case Opcode::MOV_r8_reg_idx1: decode_fixed_memloc(reader, inst, Opcode::MOV_r8_m8, 3, true, 0, -1); break;
+			case Opcode::MOV_r16_reg_idx2: decode_fixed_memloc(reader, inst, Opcode::MOV_r16_m16, 3, true, 1, -1); break;
+			case Opcode::MOV_r32_reg_idx4: decode_fixed_memloc(reader, inst, Opcode::MOV_r32_m32, 3, true, 2, -1); break;
+			case Opcode::MOV_r64_reg_idx8: decode_fixed_memloc(reader, inst, Opcode::MOV_r64_m64, 3, true, 3, -1); break;
+			case Opcode::MOV_reg_idx1_r8: decode_fixed_memloc(reader, inst, Opcode::MOV_m8_r8, 3, true, 0, -1); break;
+			case Opcode::MOV_reg_idx2_r16: decode_fixed_memloc(reader, inst, Opcode::MOV_m16_r16, 3, true, 1, -1); break;
+			case Opcode::MOV_reg_idx4_r32: decode_fixed_memloc(reader, inst, Opcode::MOV_m32_r32, 3, true, 2, -1); break;
+			case Opcode::MOV_reg_idx8_r64: decode_fixed_memloc(reader, inst, Opcode::MOV_m64_r64, 3, true, 3, -1); break;
+
+			default:
+				return false;
+		}
+
+		inst.handler = _decoded_handler(inst.opcode);
+		return !reader.overflow;
+	}
+
+	/* CMPJ decodes into its CMP record and a JCC record */
+	static bool decode_cmpj(CodeReader& reader, std::vector<DecodedInstruction>& code, Opcode opcode)
+	{
+		bool memory = opcode == Opcode::CMPJ_r_m_s8 || opcode == Opcode::CMPJ_r_m_s32;
+
+		DecodedInstruction cmp;
+		std::memset(&cmp, 0, sizeof(cmp));
+		UInt8 pars = reader.pop<UInt8>();
+		UInt8 condition = utils::get_bits<0, 4>(reader.pop<UInt8>());
+		cmp.opcode = memory ? Opcode::CMP_r_m : Opcode::CMP_r_imm;
+		cmp.reg = utils::get_bits<0, 4>(pars);
+		cmp.aux = utils::get_bits<4, 2>(pars);
+		if (memory)
+			decode_memloc(reader, cmp);
+		else cmp.imm = reader.pop_sized(cmp.aux);
+		cmp.handler = _decoded_handler(cmp.opcode);
+
+		DecodedInstruction jcc;
+		std::memset(&jcc, 0, sizeof(jcc));
+		jcc.opcode = Opcode::JCC_s32;
+		jcc.aux = condition;
+		jcc.imm = pop_offset(reader, opcode);
+		jcc.handler = _decoded_handler(jcc.opcode);
+
+		code.push_back(cmp);
+		code.push_back(jcc);
+		return !reader.overflow;
+	}
+
+	/* A superinstruction decodes into one record per component: the decoded loop
+	 * already dispatches through a single indirect jump per record.
+	 */
+	static bool decode_instruction(CodeReader& reader, std::vector<DecodedInstruction>& code)
+	{
+		Opcode opcode = scast(Opcode, reader.pop<UInt8>());
+		switch (opcode)
+		{
+			case Opcode::CMPJ_r_imm_s8:
+			case Opcode::CMPJ_r_imm_s32:
+			case Opcode::CMPJ_r_m_s8:
+			case Opcode::CMPJ_r_m_s32:
+				return decode_cmpj(reader, code, opcode);
+
+			default:
+				break;
+		}
+
+		const op::Superinstruction* si = op::find_superinstruction(opcode);
+		if (!si)
+			return decode_operands(reader, code.emplace_back(), opcode);
+
+		for (Size i = 0; i < si->length; i++)
+			if (!decode_operands(reader, code.emplace_back(), si->sequence[i]))
+				return false;
+		return true;
+	}
+
+	Size decode_one(const std::byte* code, const std::byte* end, std::vector<DecodedInstruction>& out)
+	{
+		Size first = out.size();
+		CodeReader reader{ code, end };
+
+		if (code >= end || !decode_instruction(reader, out))
+		{
+			out.resize(first);
+			return 0;
+		}
+		return scast(Size, reader.ptr - code);
+	}
+
+	/* Registers r0-r8 a decoded record reads or writes */
+	static UInt16 record_registers(const DecodedInstruction& inst)
+	{
+		UInt16 mask = 0;
+		switch (inst.opcode)
+		{
+			case Opcode::ADD_r_r_r:
+			case Opcode::SUB_r_r_r:
+			case Opcode::MUL_r_r_r:
+			case Opcode::DIV_r_r_r:
+			case Opcode::REM_r_r_r:
+			case Opcode::AND_r_r_r:
+			case Opcode::OR_r_r_r:
+			case Opcode::XOR_r_r_r:
+			case Opcode::SHL_r_r_r:
+			case Opcode::SHR_r_r_r:
+			case Opcode::FADD_r_r_r:
+			case Opcode::FSUB_r_r_r:
+			case Opcode::FMUL_r_r_r:
+			case Opcode::FDIV_r_r_r:
+			case Opcode::FFMA_r_r_r_m:
+				mask |= 1 << utils::get_bits<0, 4>(scast(UInt8, inst.imm));
+				[[fallthrough]];
+
+			case Opcode::MOV_r8_r8:
+			case Opcode::MOV_r16_r16:
+			case Opcode::MOV_r32_r32:
+			case Opcode::MOV_r64_r64:
+			case Opcode::MMB_sb:
+			case Opcode::MMB_sw:
+			case Opcode::MMB_sd:
+			case Opcode::MMB_sq:
+			case Opcode::CMP_r_r:
+			case Opcode::TEST_r_r:
+			case Opcode::ADD_r_r_m:
+			case Opcode::SUB_r_r_m:
+			case Opcode::MUL_r_r_m:
+			case Opcode::DIV_r_r_m:
+			case Opcode::REM_r_r_m:
+			case Opcode::AND_r_r_m:
+			case Opcode::OR_r_r_m:
+			case Opcode::XOR_r_r_m:
+			case Opcode::SHL_r_r_m:
+			case Opcode::SHR_r_r_m:
+			case Opcode::FADD_r_r_m:
+			case Opcode::FSUB_r_r_m:
+			case Opcode::FMUL_r_r_m:
+			case Opcode::FDIV_r_r_m:
+			case Opcode::FSQRT_r_r:
+				mask |= 1 << inst.aux;
+				[[fallthrough]];
+
+			case Opcode::MOV_r8_m8:
+			case Opcode::MOV_r16_m16:
+			case Opcode::MOV_r32_m32:
+			case Opcode::MOV_r64_m64:
+			case Opcode::MOV_m8_r8:
+			case Opcode::MOV_m16_r16:
+			case Opcode::MOV_m32_r32:
+			case Opcode::MOV_m64_r64:
+			case Opcode::MOV_r8_imm8:
+			case Opcode::MOV_r16_imm16:
+			case Opcode::MOV_r32_imm32:
+			case Opcode::MOV_r64_imm64:
+			case Opcode::LEA:
+			case Opcode::NEW_r_s:
+			case Opcode::DEL_r:
+			case Opcode::MHR_r:
+			case Opcode::CST_r:
+			case Opcode::CMP_r_imm:
+			case Opcode::CMP_r_m:
+			case Opcode::TEST_r_imm:
+			case Opcode::LOOP_s32:
+			case Opcode::CALLR:
+			case Opcode::FSQRT_r_m:
+				mask |= 1 << inst.reg;
+				break;
+
+			case Opcode::FFMA_r_r_r_r:
+				mask |= (1 << inst.reg) | (1 << inst.aux);
+				mask |= (1 << utils::get_bits<0, 4>(scast(UInt8, inst.imm))) | (1 << utils::get_bits<4, 4>(scast(UInt8, inst.imm)));
+				break;
+
+			default:
+				break;
+		}
+
+		if (inst.segment == 3)
+			mask |= 1 << inst.base;
+		if (inst.indexed)
+			mask |= 1 << inst.index;
+
+		return scast(UInt16, mask & bin::GeneralRegisterMask);
+	}
+
+	/* Vector, bulk memory and SWITCH opcodes are never decoded: reads their operands
+	 * by hand and records the registers they name. Returns false on anything else.
+	 */
+	static bool interpreted_registers(CodeReader& reader, UInt16& mask)
+	{
+		DecodedInstruction memloc;
+		std::memset(&memloc, 0, sizeof(memloc));
+
+		Opcode opcode = scast(Opcode, reader.pop<UInt8>());
+		switch (opcode)
+		{
+			case Opcode::GATHER:
+			case Opcode::SCATTER: {
+				UInt8 regs = reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= 1 << utils::get_bits<0, 4>(reader.pop<UInt8>());
+				decode_memloc(reader, memloc);
+			} break;
+
+			case Opcode::VADD:
+			case Opcode::VSUB:
+			case Opcode::VMUL:
+			case Opcode::VMIN:
+			case Opcode::VMAX:
+			case Opcode::VFMA:
+			case Opcode::VCMP:
+			case Opcode::VSELECT: {
+				UInt8 regs = reader.pop<UInt8>();
+				UInt8 sources = reader.pop<UInt8>();
+				UInt8 pars = reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= (1 << utils::get_bits<0, 4>(sources)) | (1 << utils::get_bits<4, 4>(sources));
+				if (opcode == Opcode::VSELECT)
+					mask |= 1 << utils::get_bits<4, 4>(pars);
+			} break;
+
+			case Opcode::VDOT: {
+				UInt8 regs = reader.pop<UInt8>();
+				UInt8 sources = reader.pop<UInt8>();
+				reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= (1 << utils::get_bits<0, 4>(sources)) | (1 << utils::get_bits<4, 4>(sources));
+			} break;
+
+			case Opcode::MCMP:
+			case Opcode::MFINDB:
+			case Opcode::MSET: {
+				UInt8 regs = reader.pop<UInt8>();
+				UInt8 pars = reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= 1 << utils::get_bits<0, 4>(pars);
+				if (opcode != Opcode::MSET)
+					mask |= 1 << utils::get_bits<4, 4>(pars);
+			} break;
+
+			case Opcode::MFIND: {
+				UInt8 regs = reader.pop<UInt8>();
+				UInt8 sources = reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= (1 << utils::get_bits<0, 4>(sources)) | (1 << utils::get_bits<4, 4>(sources));
+				mask |= 1 << utils::get_bits<0, 4>(reader.pop<UInt8>());
+			} break;
+
+			case Opcode::VSUM:
+			case Opcode::VRMIN:
+			case Opcode::VRMAX:
+			case Opcode::VARGMIN:
+			case Opcode::VARGMAX:
+			case Opcode::VSCAN:
+			case Opcode::VSCANX: {
+				UInt8 regs = reader.pop<UInt8>();
+				UInt8 pars = reader.pop<UInt8>();
+				mask |= (1 << utils::get_bits<0, 4>(regs)) | (1 << utils::get_bits<4, 4>(regs));
+				mask |= 1 << utils::get_bits<0, 4>(pars);
+			} break;
+
+			case Opcode::SWITCH: {
+				mask |= 1 << utils::get_bits<0, 4>(reader.pop<UInt8>());
+				UInt16 count = reader.pop<UInt16>();
+				reader.pop<UInt32>();
+				for (UInt16 i = 0; i < count && !reader.overflow; i++)
+					reader.pop<UInt32>();
+			} break;
+
+			default:
+				return false;
+		}
+
+		if (memloc.segment == 3)
+			mask |= 1 << memloc.base;
+		if (memloc.indexed)
+			mask |= 1 << memloc.index;
+
+		return !reader.overflow;
+	}
+
+	Size instruction_size(const std::byte* code, const std::byte* end)
+	{
+		std::vector<DecodedInstruction> insts;
+		if (Size size = decode_one(code, end, insts))
+			return size;
+
+		CodeReader reader{ code, end };
+		UInt16 mask = 0;
+		if (!interpreted_registers(reader, mask))
+			return 0;
+		return scast(Size, reader.ptr - code);
+	}
+
+	UInt16 used_registers(const std::byte* code, Size size)
+	{
+		const std::byte* end = code + size;
+		std::vector<DecodedInstruction> insts;
+		UInt16 mask = 0;
+
+		while (code < end)
+		{
+			insts.clear();
+			Size inst_size = decode_one(code, end, insts);
+			if (!inst_size)
+			{
+				CodeReader reader{ code, end };
+				if (!interpreted_registers(reader, mask))
+					return bin::GeneralRegisterMask;
+				inst_size = scast(Size, reader.ptr - code);
+			}
+
+			for (const DecodedInstruction& inst : insts)
+				mask |= record_registers(inst);
+			code += inst_size;
+		}
+
+		return scast(UInt16, mask & bin::GeneralRegisterMask);
+	}
+
+	DecodedFunction decode_function(const bin::Chunk* chunk, Size start, Size end)
+	{
+		DecodedFunction function{ start, {}, std::vector<Size>(end - start + 1, NoRecord) };
+		for (Size offset = start; offset < end; )
+		{
+			DecodedFunction::Instruction inst{ offset, 0, {} };
+			inst.size = decode_one(chunk->code + offset, chunk->code + end, inst.records);
+			if (!inst.size && !(inst.size = instruction_size(chunk->code + offset, chunk->code + end)))
+				break;
+			function.indices[offset - start] = function.code.size();
+			offset += inst.size;
+			function.code.push_back(std::move(inst));
+		}
+		return function;
+	}
+
+	static bool writes_flags(Opcode opcode)
+	{
+		return opcode >= Opcode::CMP_r_r && opcode <= Opcode::TEST_r_imm;
+	}
+
+	std::vector<bool> flags_live(const bin::Chunk* chunk, const DecodedFunction& function)
+	{
+		const std::vector<DecodedFunction::Instruction>& code = function.code;
+		std::vector<bool> live(code.size(), false);
+		auto live_at = [&](Size offset) {
+			Size index = function.index(offset);
+			return index == NoRecord || live[index];
+		};
+
+		for (bool changed = true; changed; )
+		{
+			changed = false;
+			for (Size i = code.size(); i-- > 0; )
+			{
+				const DecodedFunction::Instruction& inst = code[i];
+				bool in = live_at(inst.offset + inst.size);
+				if (inst.records.empty())
+				{
+					switch (scast(Opcode, chunk->code[inst.offset]))
+					{
+						case Opcode::MCMP: in = false; break;
+						case Opcode::SWITCH: in = true; break;
+						default: break;
+					}
+				}
+
+				/* Backwards through the records: the first one touching the flags decides */
+				for (Size r = inst.records.size(); r-- > 0; )
+				{
+					const DecodedInstruction& record = inst.records[r];
+					if (writes_flags(record.opcode))
+						in = false;
+					else switch (record.opcode)
+					{
+						case Opcode::CALL: case Opcode::CALLR: case Opcode::TAILCALL: case Opcode::RET: in = false; break;
+						case Opcode::JCC_s32: in = true; break;
+						case Opcode::JMP_s32: in = live_at(DecodedFunction::target(inst, record)); break;
+						case Opcode::LOOP_s32: in = in || live_at(DecodedFunction::target(inst, record)); break;
+						default: break;
+					}
+				}
+
+				if (in && !live[i])
+				{
+					live[i] = true;
+					changed = true;
+				}
+			}
+		}
+		return live;
+	}
+
+	bool flags_survive_exits(const bin::Chunk* chunk, const DecodedFunction& function, const std::vector<bool>& exits)
+	{
+		const std::vector<DecodedFunction::Instruction>& code = function.code;
+
+		/* Only flags native code wrote can be lost, along with the way out */
+		bool written = false, leaves = false;
+		for (Size i = 0; i < code.size(); i++)
+			if (!exits[i])
+				for (const DecodedInstruction& record : code[i].records)
+				{
+					written = written || writes_flags(record.opcode);
+					if (record.opcode == Opcode::JMP_s32 || record.opcode == Opcode::JCC_s32 || record.opcode == Opcode::LOOP_s32)
+						leaves = leaves || function.index(DecodedFunction::target(code[i], record)) == NoRecord;
+				}
+		if (!written || code.empty())
+			return true;
+
+		const DecodedFunction::Instruction& last = code.back();
+		if (leaves || (!exits.back() && (last.records.empty() || last.records.back().opcode != Opcode::JMP_s32)))
+			return false;
+
+		std::vector<bool> live = flags_live(chunk, function);
+		for (Size i = 0; i < code.size(); i++)
+			if (exits[i] && live[i])
+				return false;
+		return true;
+	}
+
+	/* Closes the stream at an instruction it cannot run: the raw interpreter takes the
+	 * frame over at "offset", or execute() returns once "offset" is the end of the code.
+	 */
+	static void append_end(std::vector<DecodedInstruction>& code, Size offset, bool last = false)
+	{
+		DecodedInstruction& end = code.emplace_back();
+		std::memset(&end, 0, sizeof(end));
+		end.opcode = DecodedEnd;
+		end.handler = _decoded_handler(DecodedEnd);
+		end.aux = last;
+		end.imm = offset;
+	}
+
+	DecodedCode* decode_chunk(const bin::Chunk* chunk)
+	{
+		/* Branch records, resolved once every instruction has its record index */
+		struct Branch
+		{
+			Size record;
+			Size offset;	/* of the instruction */
+			Size target;
+		};
+
+		CodeReader reader{ chunk->code, chunk->code + chunk->codeCount };
+		std::vector<DecodedInstruction> code;
+		std::vector<Size> indices(chunk->codeCount + 1, NoRecord);
+		std::vector<Branch> branches;
+
+		while (reader.ptr < reader.end)
+		{
+			Size offset = scast(Size, reader.ptr - chunk->code);
+			Size first = code.size();
+			indices[offset] = first;
+			if (decode_instruction(reader, code))
+			{
+				Size next = scast(Size, reader.ptr - chunk->code);
+				for (Size i = first; i < code.size(); i++)
+				{
+					DecodedInstruction& inst = code[i];
+					switch (inst.opcode)
+					{
+						case Opcode::JMP_s32:
+						case Opcode::JCC_s32:
+						case Opcode::LOOP_s32:
+							branches.push_back({ i, offset, next + inst.imm });
+							break;
+
+						case Opcode::CALL:
+						case Opcode::CALLR:
+						case Opcode::TAILCALL:
+							inst.delta = next;
+							break;
+
+						default:
+							break;
+					}
+				}
+				continue;
+			}
+
+			code.resize(first);
+			append_end(code, offset);
+
+			/* Stepped over by its encoded size. Nothing past an unknown opcode is decoded. */
+			UInt16 mask = 0;
+			reader = { chunk->code + offset, reader.end };
+			if (!interpreted_registers(reader, mask))
+				break;
+		}
+		indices[chunk->codeCount] = code.size();
+		append_end(code, chunk->codeCount, true);
+
+		/* Entries the loop never reached start on an end record of their own */
+		for (Size i = 0; i < chunk->functionCount; i++)
+		{
+			Size offset = chunk->functions[i].codeOffset;
+			if (offset > chunk->codeCount)
+				return nullptr;
+			if (indices[offset] == NoRecord)
+			{
+				indices[offset] = code.size();
+				append_end(code, offset);
+			}
+		}
+
+		/* A branch into the middle of an instruction, or past the code, is left to the
+		 * raw interpreter, which runs the branch itself.
+		 */
+		for (const Branch& branch : branches)
+		{
+			DecodedInstruction& inst = code[branch.record];
+			if (branch.target <= chunk->codeCount && indices[branch.target] != NoRecord)
+			{
+				inst.imm = scast(UInt64, scast(Int64, indices[branch.target]) - scast(Int64, branch.record));
+				inst.delta = branch.target;
+			}
+			else
+			{
+				std::memset(&inst, 0, sizeof(inst));
+				inst.opcode = DecodedEnd;
+				inst.handler = _decoded_handler(DecodedEnd);
+				inst.imm = branch.offset;
+			}
+		}
+
+		DecodedCode* decoded = new DecodedCode();
+		decoded->count = code.size();
+		decoded->code = new DecodedInstruction[code.size()];
+		std::copy(code.begin(), code.end(), decoded->code);
+		decoded->indices = new Size[indices.size()];
+		std::copy(indices.begin(), indices.end(), decoded->indices);
+		return decoded;
+	}
+
+	bool predecode(bin::Chunk* chunk)
+	{
+		if (!chunk->decoded)
+			chunk->decoded = decode_chunk(chunk);
+		return chunk->decoded != nullptr;
+	}
+
+	void _destroy_decoded(DecodedCode* decoded)
+	{
+		if (decoded)
+		{
+			delete[] decoded->code;
+			delete[] decoded->indices;
+			delete decoded;
+		}
+	}
+}
@@ -0,0 +1,402 @@
+#include "gc.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace kram::gc
+{
+	/* C layout: fields in order at their natural alignment, the size padded to the largest */
+	static Size append_pointers(const bin::DataType& type, Size offset, std::vector<Size>& pointers, Size& align)
+	{
+		using bin::TypeIdentifier;
+
+		switch (type.id())
+		{
+			case TypeIdentifier::Void:
+				align = 1;
+				return 0;
+
+			case TypeIdentifier::UnsignedByte:
+			case TypeIdentifier::SignedByte:
+			case TypeIdentifier::Character:
+			case TypeIdentifier::Boolean:
+				align = 1;
+				return 1;
+
+			case TypeIdentifier::UnsignedShort:
+			case TypeIdentifier::SignedShort:
+				align = 2;
+				return 2;
+
+			case TypeIdentifier::UnsignedInteger:
+			case TypeIdentifier::SignedInteger:
+			case TypeIdentifier::Float:
+				align = 4;
+				return 4;
+
+			case TypeIdentifier::Pointer:
+				pointers.push_back(offset);
+				align = 8;
+				return 8;
+
+			case TypeIdentifier::Array: {
+				std::vector<Size> element;
+				Size size = append_pointers(type.arrayType(), 0, element, align);
+				for (Size i = 0; !element.empty() && i < type.arrayLength(); i++)
+					for (Size pointer : element)
+						pointers.push_back(offset + i * size + pointer);
+				return size * type.arrayLength();
+			}
+
+			case TypeIdentifier::Struct: {
+				Size size = 0;
+				align = 1;
+				for (Size i = 0; i < type.structFieldCount(); i++)
+				{
+					Size field_align;
+					std::vector<Size> field;
+					Size field_size = append_pointers(*type.structField(i).type, 0, field, field_align);
+					size = (size + field_align - 1) & ~(field_align - 1);
+					for (Size pointer : field)
+						pointers.push_back(offset + size + pointer);
+					size += field_size;
+					align = std::max(align, field_align);
+				}
+				return (size + align - 1) & ~(align - 1);
+			}
+
+			case TypeIdentifier::UnsignedLong:
+			case TypeIdentifier::SignedLong:
+			case TypeIdentifier::Double:
+			default:
+				align = 8;
+				return 8;
+		}
+	}
+
+	static inline std::uintptr_t load_word(const std::byte* ptr)
+	{
+		std::uintptr_t word;
+		std::memcpy(&word, ptr, sizeof(word));
+		return word;
+	}
+
+
+	Collector::Collector(Heap& heap, Size batch) :
+		_heap{ heap },
+		_batch{ batch },
+		_interval{ 0 },
+		_countdown{ 0 },
+		_chunks{},
+		_pins{},
+		_regions{},
+		_marks{},
+		_pending{},
+		_garbage{},
+		_layouts{}
+	{}
+
+	void Collector::add_root(const bin::Chunk* chunk)
+	{
+		_chunks.push_back(chunk);
+	}
+	void Collector::remove_root(const bin::Chunk* chunk)
+	{
+		auto it = std::find(_chunks.begin(), _chunks.end(), chunk);
+		if (it != _chunks.end())
+			_chunks.erase(it);
+	}
+
+	void Collector::root_layout(const bin::Chunk* chunk, const bin::DataType* statics)
+	{
+		_roots[chunk].statics = statics;
+	}
+	void Collector::root_layout(const bin::Chunk* chunk, runtime::FunctionOffset function, const bin::DataType* frame)
+	{
+		std::vector<const bin::DataType*>& frames = _roots[chunk].frames;
+		if (frames.size() <= function)
+			frames.resize(function + 1, nullptr);
+		frames[function] = frame;
+	}
+
+	void Collector::pin(void* block)
+	{
+		_pins.push_back(block);
+	}
+	void Collector::unpin(void* block)
+	{
+		auto it = std::find(_pins.begin(), _pins.end(), block);
+		if (it != _pins.end())
+			_pins.erase(it);
+	}
+
+	Size Collector::collect(const runtime::RuntimeState* state, const runtime::Registers* window)
+	{
+		while (!sweep());
+		if (_heap.arena())
+			return 0;
+
+		_heap.drain_remote();
+		_index();
+
+		/* Blocks the host or MHR still references are roots, and so are the blocks other
+		 * threads free meanwhile, which stay pinned until the next drain.
+		 */
+		for (const Region& region : _regions)
+		{
+			Size count = region.stride ? (region.end - region.begin) / region.stride : 1;
+			for (Size i = 0; i < count; i++)
+			{
+				Heap::Header* header = rcast(Heap::Header*, region.begin + i * region.stride);
+				if (header->size != Heap::FreeSlot && std::atomic_ref<UInt64>{ header->refs }.load(std::memory_order_relaxed) > 0)
+					_mark(rcast(std::uintptr_t, header + 1));
+			}
+		}
+
+		for (void* block : _pins)
+			_mark(rcast(std::uintptr_t, block));
+		for (const bin::Chunk* chunk : _chunks)
+			_scan_statics(chunk);
+		if (state)
+			_scan_frames(state, window ? window : &state->regs);
+
+		while (!_pending.empty())
+		{
+			Heap::Header* header = _pending.back();
+			_pending.pop_back();
+			_scan_block(header);
+		}
+
+		for (const Region& region : _regions)
+		{
+			Size count = region.stride ? (region.end - region.begin) / region.stride : 1;
+			for (Size i = 0; i < count; i++)
+			{
+				Size mark = region.marks + i;
+				Heap::Header* header = rcast(Heap::Header*, region.begin + i * region.stride);
+				if (header->size != Heap::FreeSlot && !(_marks[mark / 64] & (UInt64(1) << (mark % 64))))
+					_garbage.push_back(header + 1);
+			}
+		}
+		return _garbage.size();
+	}
+
+	bool Collector::sweep()
+	{
+		Size count = std::min(_batch, _garbage.size());
+		for (Size i = 0; i < count; i++)
+		{
+			_heap.reclaim(_garbage.back());
+			_garbage.pop_back();
+		}
+		if (count == 0 || !_garbage.empty())
+			return _garbage.empty();
+
+		_heap.release_runs();
+		return true;
+	}
+
+	void Collector::safepoint(const runtime::RuntimeState* state, const runtime::Registers* window)
+	{
+		if (!_garbage.empty())
+			sweep();
+		else if (_countdown != 0 && --_countdown == 0)
+		{
+			_countdown = _interval;
+			collect(state, window);
+		}
+	}
+
+	/* Regions sorted by address, so any word can be resolved to its block by binary search */
+	void Collector::_index()
+	{
+		_regions.clear();
+		Size marks = 0;
+		_heap.for_each_run([&](std::byte* slots, Size stride, Size carved) {
+			if (carved == 0)
+				return;
+			std::uintptr_t begin = rcast(std::uintptr_t, slots);
+			_regions.push_back({ begin, begin + stride * carved, stride, marks });
+			marks += carved;
+		});
+		_heap.for_each_large([&](Heap::Header* header) {
+			std::uintptr_t begin = rcast(std::uintptr_t, header);
+			_regions.push_back({ begin, begin + sizeof(Heap::Header) + header->size, 0, marks++ });
+		});
+
+		std::sort(_regions.begin(), _regions.end(), [](const Region& left, const Region& right) { return left.begin < right.begin; });
+		_marks.assign((marks + 63) / 64, 0);
+	}
+
+	/* Words pointing into a block, not only at its start, keep it alive */
+	Heap::Header* Collector::_find(std::uintptr_t address, Size& mark) const
+	{
+		auto it = std::upper_bound(_regions.begin(), _regions.end(), address,
+			[](std::uintptr_t value, const Region& region) { return value < region.begin; });
+		if (it == _regions.begin())
+			return nullptr;
+
+		const Region& region = *--it;
+		if (address >= region.end)
+			return nullptr;
+
+		Size index = region.stride ? (address - region.begin) / region.stride : 0;
+		Heap::Header* header = rcast(Heap::Header*, region.begin + index * region.stride);
+		std::uintptr_t block = rcast(std::uintptr_t, header + 1);
+		if (header->size == Heap::FreeSlot || address < block || address >= block + header->size)
+			return nullptr;
+
+		mark = region.marks + index;
+		return header;
+	}
+
+	void Collector::_mark(std::uintptr_t address)
+	{
+		Size mark;
+		Heap::Header* header = _find(address, mark);
+		if (!header)
+			return;
+
+		UInt64& bits = _marks[mark / 64];
+		UInt64 bit = UInt64(1) << (mark % 64);
+		if (!(bits & bit))
+		{
+			bits |= bit;
+			_pending.push_back(header);
+		}
+	}
+
+	/* Statics, frames and blocks are packed with no alignment, so a pointer may start at
+	 * any byte. Most words fall outside the heap and never reach the binary search.
+	 */
+	void Collector::_scan(const std::byte* begin, const std::byte* end)
+	{
+		if (_regions.empty())
+			return;
+
+		std::uintptr_t low = _regions.front().begin, high = _regions.back().end;
+		Size size = scast(Size, end - begin);
+		for (Size offset = 0; offset + sizeof(std::uintptr_t) <= size; offset++)
+		{
+			std::uintptr_t word = load_word(begin + offset);
+			if (word >= low && word < high)
+				_mark(word);
+		}
+	}
+
+	/* Only the pointers inside [begin, end) of one "type" laid out at "begin" */
+	void Collector::_scan_typed(const std::byte* begin, const std::byte* end, const bin::DataType* type)
+	{
+		if (!type)
+		{
+			_scan(begin, end);
+			return;
+		}
+
+		Size size = scast(Size, end - begin);
+		for (Size pointer : _layout(type).pointers)
+			if (pointer + sizeof(std::uintptr_t) <= size)
+				_mark(load_word(begin + pointer));
+	}
+
+	void Collector::_scan_block(Heap::Header* header)
+	{
+		if (std::atomic_ref<UInt64>{ header->refs }.load(std::memory_order_relaxed) == Heap::RemoteRefs)
+			return;
+
+		const std::byte* block = rcast(const std::byte*, header + 1);
+		const bin::DataType* type = Heap::layout(block);
+		if (!type)
+		{
+			_scan(block, block + header->size);
+			return;
+		}
+
+		const Layout& layout = _layout(type);
+		if (layout.pointers.empty())
+			return;
+
+		for (Size offset = 0; offset + layout.size <= header->size; offset += layout.size)
+			for (Size pointer : layout.pointers)
+				_mark(load_word(block + offset + pointer));
+	}
+
+	void Collector::_scan_statics(const bin::Chunk* chunk)
+	{
+		auto it = _roots.find(chunk);
+		_scan_typed(chunk->statics, chunk->statics + chunk->staticCount, it != _roots.end() ? it->second.statics : nullptr);
+	}
+
+	/* Frames are walked from the innermost window out. Each holds its parameters and
+	 * locals from sb up to its window, then the window and its CallInfo; the entered
+	 * frame keeps its window in RuntimeState and its locals end at sp. Of a window only
+	 * the general registers and sr can hold blocks.
+	 */
+	void Collector::_scan_frames(const runtime::RuntimeState* state, const runtime::Registers* window)
+	{
+		const std::byte* base = state->stack->base;
+		std::vector<const bin::Chunk*> chunks;
+		for (const runtime::Registers* regs = window;;)
+		{
+			for (Size i = 0; i <= 8; i++)
+				_mark(regs->by_index[i]._value);
+			_mark(regs->sr._value);
+
+			const std::byte* frame = base + regs->sb.stack_offset;
+			const std::byte* end = regs == &state->regs ? base + regs->sp.stack_offset : rcast(const std::byte*, regs);
+			_scan_typed(frame, end, _frame_layout(state, regs));
+
+			const bin::Chunk* chunk = regs->ch.addr_chunk;
+			if (chunk && std::find(chunks.begin(), chunks.end(), chunk) == chunks.end())
+			{
+				chunks.push_back(chunk);
+				_scan_statics(chunk);
+			}
+
+			if (regs == &state->regs)
+				break;
+
+			const runtime::CallInfo* info = rcast(const runtime::CallInfo*, regs + 1);
+			regs = info->caller == runtime::RootWindow ? &state->regs : rcast(const runtime::Registers*, base + info->caller);
+		}
+	}
+
+	/* The function a window runs is the one whose code holds its ip, which safepoints
+	 * store before collecting.
+	 */
+	const bin::DataType* Collector::_frame_layout(const runtime::RuntimeState* state, const runtime::Registers* regs) const
+	{
+		const bin::Chunk* chunk = regs->ch.addr_chunk;
+		auto it = chunk && state->code ? _roots.find(chunk) : _roots.end();
+		if (it == _roots.end() || it->second.frames.empty())
+			return nullptr;
+
+		const std::byte* code = state->code->code(chunk);
+		if (regs->ip.addr_bytes < code || regs->ip.addr_bytes >= code + chunk->codeCount)
+			return nullptr;
+
+		Size offset = scast(Size, regs->ip.addr_bytes - code);
+		Size function = chunk->functionCount;
+		for (Size i = 0; i < chunk->functionCount; i++)
+			if (chunk->functions[i].codeOffset <= offset && (function == chunk->functionCount || chunk->functions[i].codeOffset > chunk->functions[function].codeOffset))
+				function = i;
+
+		const std::vector<const bin::DataType*>& frames = it->second.frames;
+		return function < frames.size() ? frames[function] : nullptr;
+	}
+
+	const Collector::Layout& Collector::_layout(const bin::DataType* type)
+	{
+		auto it = _layouts.find(type);
+		if (it == _layouts.end())
+		{
+			Layout layout;
+			Size align;
+			layout.size = append_pointers(*type, 0, layout.pointers, align);
+			if (layout.size == 0)
+				layout.pointers.clear();
+			it = _layouts.emplace(type, std::move(layout)).first;
+		}
+		return it->second;
+	}
+}
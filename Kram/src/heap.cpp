@@ -1,76 +1,503 @@
 #include "heap.h"
 
+#include <array>
+#include <mutex>
+
 namespace kram
 {
-	static inline void free_block(Heap::Header* node)
+	static constexpr std::array<Size, Heap::SizeClassCount> ClassSizes = {
+		16, 32, 48, 64, 80, 96, 112, 128,
+		160, 192, 224, 256,
+		320, 384, 448, 512,
+		640, 768, 896, 1024
+	};
+
+	/* Size class of every 16 byte step up to SmallBlockLimit */
+	static constexpr auto ClassOfStep = []() {
+		std::array<UInt8, Heap::SmallBlockLimit / 16> table{};
+		UInt8 cls = 0;
+		for (Size step = 0; step < table.size(); step++)
+		{
+			while (ClassSizes[cls] < (step + 1) * 16)
+				cls++;
+			table[step] = cls;
+		}
+		return table;
+	}();
+
+	static inline Size size_class(Size block_size)
+	{
+		return block_size == 0 ? 0 : ClassOfStep[(block_size - 1) / 16];
+	}
+
+	/* Remotely freed blocks stay pinned with RemoteRefs until their owner drains them, so
+	 * its collector skips them. Both sides swap RemoteRefs in atomically and only the one
+	 * that finds the old count frees the block: the collector claims 0, a remote free
+	 * anything but RemoteRefs.
+	 */
+	static inline bool claim(Heap::Header* node)
+	{
+		std::atomic_ref<UInt64> refs{ node->refs };
+		UInt64 expected = 0;
+		return refs.load(std::memory_order_relaxed) == 0
+			&& refs.compare_exchange_strong(expected, Heap::RemoteRefs, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	inline Heap::Header*& Heap::_remote_next(Header* node)
 	{
-		delete reinterpret_cast<std::byte*>(node);
+		return node->size <= Heap::SmallBlockLimit ? node->next : _prefix(node).remote;
 	}
 
+	struct Heap::RunPool
+	{
+		std::mutex lock;
+		Run* runs = nullptr;
+	};
+
+	Heap::RunPool Heap::_pool;
+
 	Heap::Heap() :
 		_last{ nullptr },
-		_size{ 0 }
+		_size{ 0 },
+		_classes{},
+		_spare{ nullptr },
+		_remote{ nullptr },
+		_gc{},
+		_gc_interval{ 0 },
+		_gc_countdown{ 0 },
+		_gc_budget{ 0 },
+		_arena{ false },
+		_pages{ nullptr },
+		_page{ nullptr },
+		_top{ nullptr },
+		_end{ nullptr }
 	{}
 	Heap::~Heap()
 	{
 		for (Header* node = _last, *prev; node; node = prev)
 		{
-			prev = node->prev;
-			free_block(node);
+			prev = _prefix(node).prev;
+			delete[] reinterpret_cast<std::byte*>(&_prefix(node));
 		}
 		_last = nullptr;
+
+		Run* runs = _spare;
+		for (SizeClass& cls : _classes)
+		{
+			for (Run* run = cls.runs, *next; run; run = next)
+			{
+				next = run->next;
+				run->next = runs;
+				runs = run;
+			}
+			cls = {};
+		}
+		_spare = nullptr;
 		_size = 0;
+
+		if (runs)
+		{
+			Run* tail = runs;
+			while (tail->next)
+				tail = tail->next;
+
+			std::lock_guard<std::mutex> guard{ _pool.lock };
+			tail->next = _pool.runs;
+			_pool.runs = runs;
+		}
+
+		for (ArenaPage* page = _pages, *next; page; page = next)
+		{
+			next = page->next;
+			delete[] reinterpret_cast<std::byte*>(page);
+		}
+		_pages = _page = nullptr;
+		_top = _end = nullptr;
 	}
 
 	void* Heap::malloc(Size block_size, bool assign_ref)
 	{
-		Header* header = reinterpret_cast<Heap::Header*>(new std::byte[block_size + sizeof(Heap::Header)]);
-		void* block = reinterpret_cast<void*>(header + 1);
-		
-		header->next = nullptr;
-		header->prev = _last;
-		header->refs = assign_ref & 0x1U;
-		header->size = block_size;
+		if (_arena)
+			return _alloc_arena(block_size);
 
-		if (!_last)
-			_last = header;
+		Header* header;
+		if (block_size <= SmallBlockLimit)
+		{
+			header = _alloc_small(block_size);
+			header->layout = nullptr;
+			_run(header)->live++;
+		}
 		else
 		{
-			_last->next = header;
+			if (_remote.load(std::memory_order_relaxed))
+				drain_remote();
+
+			std::byte* block = new std::byte[sizeof(LargePrefix) + sizeof(Heap::Header) + block_size];
+			header = reinterpret_cast<Heap::Header*>(block + sizeof(LargePrefix));
+			_prefix(header).prev = _last;
+			_prefix(header).layout = nullptr;
+			header->next = nullptr;
+
+			if (_last)
+				_last->next = header;
 			_last = header;
 		}
 
+		header->owner = this;
+		header->refs = assign_ref & 0x1U;
+		header->size = block_size;
+
 		_size++;
 
+		return reinterpret_cast<void*>(header + 1);
+	}
+	void Heap::free(void* ptr)
+	{
+		if (_arena)
+			return;
+
+		Header* node = reinterpret_cast<Header*>(ptr) - 1;
+		if (Heap* owner = node->owner; owner != this)
+			owner->_free_remote(node);
+		else if (node->size <= SmallBlockLimit)
+			_free_small(node);
+		else _free(node);
+	}
+
+	void Heap::arena(bool enabled)
+	{
+		if (_arena && !enabled)
+			reset();
+		_arena = enabled;
+	}
+
+	void Heap::reset()
+	{
+		_page = _pages;
+		_top = _page ? reinterpret_cast<std::byte*>(_page + 1) : nullptr;
+		_end = _page ? _top + _page->size : nullptr;
+	}
+
+	void Heap::layout(void* ptr, const bin::DataType* type)
+	{
+		Header* node = reinterpret_cast<Header*>(ptr) - 1;
+		if (node->size <= SmallBlockLimit)
+			node->layout = type;
+		else _prefix(node).layout = type;
+	}
+
+	const bin::DataType* Heap::layout(const void* ptr)
+	{
+		Header* node = const_cast<Header*>(reinterpret_cast<const Header*>(ptr)) - 1;
+		if (node->size <= SmallBlockLimit)
+			return node->layout;
+		return _prefix(node).layout;
+	}
+
+	/* Blocks keep 16 byte alignment. A block that does not fit moves on to the next
+	 * page kept from before the last reset, or to a new page linked after the current one.
+	 * Empty blocks take 16 bytes as well, so each gets a distinct non-null address.
+	 */
+	void* Heap::_alloc_arena(Size block_size)
+	{
+		Size size = block_size == 0 ? 16 : (block_size + 15) & ~Size(15);
+		if (scast(Size, _end - _top) < size)
+		{
+			ArenaPage* next = _page ? _page->next : _pages;
+			if (!next || next->size < size)
+			{
+				Size page_size = size > ArenaPageSize ? size : ArenaPageSize;
+				ArenaPage* page = reinterpret_cast<ArenaPage*>(new std::byte[sizeof(ArenaPage) + page_size]);
+				page->size = page_size;
+				page->next = next;
+				if (_page)
+					_page->next = page;
+				else _pages = page;
+				next = page;
+			}
+
+			_page = next;
+			_top = reinterpret_cast<std::byte*>(_page + 1);
+			_end = _top + _page->size;
+		}
+
+		void* block = _top;
+		_top += size;
 		return block;
 	}
-	void Heap::_free(Header* node)
+
+	/* Slots come from the free list of the class, then from the blocks other threads
+	 * freed, then from the uncarved tail of its newest run, then from a new run.
+	 */
+	Heap::Header* Heap::_alloc_small(Size block_size)
 	{
-		if (node == _last)
+		SizeClass& cls = _classes[size_class(block_size)];
+		if (Header* header = cls.free)
 		{
-			_last = node->prev;
-			if (_last)
-				_last->next = nullptr;
-			free_block(node);
+			cls.free = header->next;
+			return header;
 		}
-		else
+
+		if (_remote.load(std::memory_order_relaxed))
+		{
+			drain_remote();
+			if (Header* header = cls.free)
+			{
+				cls.free = header->next;
+				return header;
+			}
+		}
+
+		Run* run = cls.runs;
+		if (!run || run->carved == run->capacity)
 		{
-			node->next->prev = node->prev;
-			node->prev->next = node->next;
-			free_block(node);
+			Size stride = sizeof(Header) + ClassSizes[size_class(block_size)];
+			run = _new_run();
+			run->next = cls.runs;
+			run->carved = 0;
+			run->capacity = (RunSize - sizeof(Run)) / stride;
+			run->stride = stride;
+			run->live = 0;
+			cls.runs = run;
 		}
+
+		return reinterpret_cast<Header*>(reinterpret_cast<std::byte*>(run + 1) + run->stride * run->carved++);
+	}
+	/* Takes RunBatch runs from the shared pool at once, so the lock is rarely contended */
+	Heap::Run* Heap::_new_run()
+	{
+		if (!_spare)
+		{
+			std::lock_guard<std::mutex> guard{ _pool.lock };
+			Run* last = _pool.runs;
+			for (Size i = 1; last && last->next && i < RunBatch; i++)
+				last = last->next;
+
+			if (last)
+			{
+				_spare = _pool.runs;
+				_pool.runs = last->next;
+				last->next = nullptr;
+			}
+		}
+
+		if (Run* run = _spare)
+		{
+			_spare = run->next;
+			return run;
+		}
+		return reinterpret_cast<Run*>(::operator new(RunSize, std::align_val_t{ RunSize }));
+	}
+
+	void Heap::_free_small(Header* node)
+	{
+		SizeClass& cls = _classes[size_class(node->size)];
+		node->size = FreeSlot;
+		node->next = cls.free;
+		cls.free = node;
+		_run(node)->live--;
 		_size--;
 	}
+	void Heap::_free(Header* node)
+	{
+		Header* prev = _prefix(node).prev;
+		if (_gc.large == node)
+			_gc.large = prev;
+
+		if (node->next)
+			_prefix(node->next).prev = prev;
+		else _last = prev;
+
+		if (prev)
+			prev->next = node->next;
+
+		delete[] reinterpret_cast<std::byte*>(&_prefix(node));
+		_size--;
+	}
+
+	/* Claimed before its size is read and before it is linked, so the owner's collector
+	 * can not release it meanwhile; a block that is already claimed is left to whoever
+	 * claimed it.
+	 */
+	void Heap::_free_remote(Header* node)
+	{
+		if (std::atomic_ref<UInt64>{ node->refs }.exchange(RemoteRefs, std::memory_order_acq_rel) == RemoteRefs)
+			return;
+
+		Header* head = _remote.load(std::memory_order_relaxed);
+		do _remote_next(node) = head;
+		while (!_remote.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	bool Heap::reclaim(void* ptr)
+	{
+		if (_arena)
+			return false;
+
+		Header* node = reinterpret_cast<Header*>(ptr) - 1;
+		if (!claim(node))
+			return false;
+		if (node->size <= SmallBlockLimit)
+			_free_small(node);
+		else _free(node);
+		return true;
+	}
+
+	void Heap::drain_remote()
+	{
+		Header* node = _remote.exchange(nullptr, std::memory_order_acquire);
+		while (node)
+		{
+			Header* next = _remote_next(node);
+			if (node->size <= SmallBlockLimit)
+				_free_small(node);
+			else _free(node);
+			node = next;
+		}
+	}
+
+	void Heap::release_runs()
+	{
+		Run* released = nullptr, *tail = nullptr;
+		for (SizeClass& cls : _classes)
+		{
+			bool any = false;
+			for (Run** link = &cls.runs; *link; )
+			{
+				Run* run = *link;
+				if (run->live != 0)
+				{
+					link = &run->next;
+					continue;
+				}
+
+				*link = run->next;
+				run->next = released;
+				released = run;
+				if (!tail)
+					tail = run;
+				any = true;
+			}
+
+			if (any)
+				for (Header** link = &cls.free; *link; )
+				{
+					if (_run(*link)->live == 0)
+						*link = (*link)->next;
+					else link = &(*link)->next;
+				}
+		}
+
+		if (released)
+		{
+			_gc.active = false;
+
+			std::lock_guard<std::mutex> guard{ _pool.lock };
+			tail->next = _pool.runs;
+			_pool.runs = released;
+		}
+	}
 
 	void Heap::garbage_collector()
 	{
+		drain_remote();
+
 		Header* header = _last, *prev = nullptr;
 		while (header)
 		{
-			prev = header->prev;
-			if (header->refs == 0)
+			prev = _prefix(header).prev;
+			if (claim(header))
 				_free(header);
 			header = prev;
 		}
+
+		for (SizeClass& cls : _classes)
+		{
+			for (Run* run = cls.runs; run; run = run->next)
+			{
+				std::byte* slot = reinterpret_cast<std::byte*>(run + 1);
+				for (Size i = 0; i < run->carved; i++, slot += run->stride)
+				{
+					Header* node = reinterpret_cast<Header*>(slot);
+					if (node->size != FreeSlot && claim(node))
+						_free_small(node);
+				}
+			}
+		}
+
+		release_runs();
+	}
+
+	bool Heap::gc_step(Size max_blocks)
+	{
+		drain_remote();
+
+		if (!_gc.active)
+			_gc = { _last, 0, nullptr, 0, true };
+
+		for (; max_blocks > 0; max_blocks--)
+		{
+			if (Header* node = _gc.large)
+			{
+				_gc.large = _prefix(node).prev;
+				if (claim(node))
+					_free(node);
+				continue;
+			}
+
+			while (!_gc.run || _gc.slot == _gc.run->carved)
+			{
+				if (_gc.run)
+					_gc.run = _gc.run->next;
+				else if (_gc.cls < SizeClassCount)
+					_gc.run = _classes[_gc.cls++].runs;
+				else
+				{
+					_gc.active = false;
+					release_runs();
+					return true;
+				}
+				_gc.slot = 0;
+			}
+
+			Header* node = reinterpret_cast<Header*>(reinterpret_cast<std::byte*>(_gc.run + 1) + _gc.run->stride * _gc.slot++);
+			if (node->size != FreeSlot && claim(node))
+				_free_small(node);
+		}
+		return false;
+	}
+
+	bool Heap::gc_step(std::chrono::nanoseconds budget)
+	{
+		auto deadline = std::chrono::steady_clock::now() + budget;
+		do
+		{
+			if (gc_step(GcBatch))
+				return true;
+		} while (std::chrono::steady_clock::now() < deadline);
+		return false;
+	}
+
+	void Heap::gc_pacing(Size interval, std::chrono::nanoseconds budget)
+	{
+		_gc_interval = interval;
+		_gc_countdown = interval;
+		_gc_budget = budget;
+	}
+
+	void Heap::trim()
+	{
+		Run* runs;
+		{
+			std::lock_guard<std::mutex> guard{ _pool.lock };
+			runs = _pool.runs;
+			_pool.runs = nullptr;
+		}
+
+		for (Run* next; runs; runs = next)
+		{
+			next = runs->next;
+			::operator delete(runs, std::align_val_t{ RunSize });
+		}
 	}
 }
@@ -0,0 +1,651 @@
+#include "jit.h"
+
+#include "jit_x64.h"
+#include "decoder.h"
+#include "heap.h"
+#include "bulk.h"
+
+#if defined(KRAM_JIT_X64)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#endif
+
+using kram::op::Opcode;
+using kram::runtime::DecodedInstruction;
+using kram::runtime::NoRecord;
+
+namespace kram::jit
+{
+	bool available()
+	{
+#if defined(KRAM_JIT_X64)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	Size function_end(const bin::Chunk* chunk, Size start)
+	{
+		Size end = chunk->codeCount;
+		for (Size i = 0; i < chunk->functionCount; i++)
+			if (chunk->functions[i].codeOffset > start && chunk->functions[i].codeOffset < end)
+				end = chunk->functions[i].codeOffset;
+		return end;
+	}
+
+	CompiledCode compile(const bin::Chunk* chunk, runtime::FunctionOffset function)
+	{
+		CompiledCode result{ nullptr, nullptr, 0, 0 };
+
+#if defined(KRAM_JIT_X64)
+		using namespace x64;
+
+		if (function >= chunk->functionCount)
+			return result;
+
+		Size start = chunk->functions[function].codeOffset;
+		runtime::DecodedFunction decoded = runtime::decode_function(chunk, start, function_end(chunk, start));
+		const std::vector<runtime::DecodedFunction::Instruction>& code = decoded.code;
+		if (code.empty())
+			return result;
+
+		Emitter em;
+		em.prologue();
+		em.mov_imm(HostReg::rcx, 0);
+		em.store(1, HostReg::rsp, FlagsDisp, HostReg::rcx);
+
+		/* Unsupported instructions, calls and returns among them, exit to the interpreter at
+		 * their start. Branches are patched once every instruction has its position.
+		 */
+		struct Branch
+		{
+			Size position;
+			Size target;
+		};
+		std::vector<Branch> branches;
+		std::vector<Size> positions(code.size());
+		std::vector<bool> exits(code.size(), false);
+		for (Size i = 0; i < code.size(); i++)
+		{
+			const runtime::DecodedFunction::Instruction& inst = code[i];
+			positions[i] = em.size();
+			if (inst.records.empty() || !std::all_of(inst.records.begin(), inst.records.end(), &supported))
+			{
+				em.exit(inst.offset);
+				exits[i] = true;
+				continue;
+			}
+
+			for (const DecodedInstruction& record : inst.records)
+			{
+				if (record.opcode == Opcode::JMP_s32 || record.opcode == Opcode::JCC_s32 || record.opcode == Opcode::LOOP_s32)
+					branches.push_back({ emit_branch(em, record), runtime::DecodedFunction::target(inst, record) });
+				else emit_instruction(em, record);
+			}
+		}
+
+		if (exits.front() || !runtime::flags_survive_exits(chunk, decoded, exits))
+			return result;
+
+		Size end = code.back().offset + code.back().size;
+		em.exit(end);
+
+		/* Targets outside the function get an exit of their own */
+		std::map<Size, Size> stubs;
+		for (const Branch& branch : branches)
+		{
+			Size index = decoded.index(branch.target);
+			if (index == NoRecord)
+			{
+				auto stub = stubs.try_emplace(branch.target, em.size());
+				if (stub.second)
+					em.exit(branch.target);
+				em.patch(branch.position, stub.first->second);
+			}
+			else em.patch(branch.position, positions[index]);
+		}
+
+		if (!install(em.code(), result))
+			return result;
+
+		result.bytecodeSize = end - start;
+#endif
+
+		return result;
+	}
+
+	void release(CompiledCode& code)
+	{
+#if defined(KRAM_JIT_X64)
+		x64::uninstall(code);
+#endif
+		code = { nullptr, nullptr, 0, 0 };
+	}
+
+
+	JitCache::JitCache() :
+		_entries{},
+		_threshold{ available() ? DefaultThreshold : 0 }
+	{}
+
+	JitCache::~JitCache()
+	{
+		for (auto& entry : _entries)
+			jit::release(entry.second.code);
+		_entries.clear();
+	}
+
+	CompiledFunction JitCache::promote(const bin::Chunk* chunk, runtime::FunctionOffset function, Size calls)
+	{
+		if (!_threshold)
+			return nullptr;
+
+		Entry& entry = _entries[{ chunk, function }];
+		if (entry.source != chunk->code)
+		{
+			jit::release(entry.code);
+			entry = { chunk->code, 0, false, { nullptr, nullptr, 0, 0 } };
+		}
+
+		if (entry.compiled)
+			return entry.code.entry;
+
+		if ((entry.calls += calls) >= _threshold)
+		{
+			entry.code = compile(chunk, function);
+			entry.compiled = true;
+			return entry.code.entry;
+		}
+		return nullptr;
+	}
+
+	void JitCache::release(const bin::Chunk* chunk)
+	{
+		for (auto it = _entries.begin(); it != _entries.end();)
+		{
+			if (it->first.first == chunk)
+			{
+				jit::release(it->second.code);
+				it = _entries.erase(it);
+			}
+			else ++it;
+		}
+	}
+}
+
+#if defined(KRAM_JIT_X64)
+namespace kram::jit::x64
+{
+	bool supported(const DecodedInstruction& inst)
+	{
+		switch (inst.opcode)
+		{
+			case Opcode::MOV_r8_m8:
+			case Opcode::MOV_r16_m16:
+			case Opcode::MOV_r32_m32:
+			case Opcode::MOV_r64_m64:
+			case Opcode::MOV_m8_r8:
+			case Opcode::MOV_m16_r16:
+			case Opcode::MOV_m32_r32:
+			case Opcode::MOV_m64_r64:
+			case Opcode::MOV_m8_imm8:
+			case Opcode::MOV_m16_imm16:
+			case Opcode::MOV_m32_imm32:
+			case Opcode::MOV_m64_imm64:
+			case Opcode::LEA:
+			case Opcode::NEW_m_s:
+			case Opcode::DEL_m:
+			case Opcode::MHR_m:
+			case Opcode::CST_m:
+			case Opcode::CMP_r_m:
+			case Opcode::ADD_r_r_m:
+			case Opcode::SUB_r_r_m:
+			case Opcode::MUL_r_r_m:
+			case Opcode::DIV_r_r_m:
+			case Opcode::REM_r_r_m:
+			case Opcode::AND_r_r_m:
+			case Opcode::OR_r_r_m:
+			case Opcode::XOR_r_r_m:
+			case Opcode::SHL_r_r_m:
+			case Opcode::SHR_r_r_m:
+				/* The interpreter traps a null absolute location; leave that to it */
+				return inst.segment != 0 || inst.indexed || inst.delta != 0;
+
+			case Opcode::NOP:
+			case Opcode::MOV_r8_r8:
+			case Opcode::MOV_r16_r16:
+			case Opcode::MOV_r32_r32:
+			case Opcode::MOV_r64_r64:
+			case Opcode::MOV_r8_imm8:
+			case Opcode::MOV_r16_imm16:
+			case Opcode::MOV_r32_imm32:
+			case Opcode::MOV_r64_imm64:
+			case Opcode::MMB_sb:
+			case Opcode::MMB_sw:
+			case Opcode::MMB_sd:
+			case Opcode::MMB_sq:
+			case Opcode::NEW_r_s:
+			case Opcode::DEL_r:
+			case Opcode::MHR_r:
+			case Opcode::CST_r:
+			case Opcode::CMP_r_r:
+			case Opcode::CMP_r_imm:
+			case Opcode::TEST_r_r:
+			case Opcode::TEST_r_imm:
+			case Opcode::JMP_s32:
+			case Opcode::JCC_s32:
+			case Opcode::LOOP_s32:
+			case Opcode::ADD_r_r_r:
+			case Opcode::SUB_r_r_r:
+			case Opcode::MUL_r_r_r:
+			case Opcode::DIV_r_r_r:
+			case Opcode::REM_r_r_r:
+			case Opcode::AND_r_r_r:
+			case Opcode::OR_r_r_r:
+			case Opcode::XOR_r_r_r:
+			case Opcode::SHL_r_r_r:
+			case Opcode::SHR_r_r_r:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	/* Flags of a compare from rax and rcx, both sign-extended from the compared width:
+	 * the unsigned order of such values is that of the narrow ones.
+	 */
+	static void emit_compare_flags(Emitter& em)
+	{
+		em.alu(0x39, HostReg::rax, HostReg::rcx);
+		em.setcc(HostCondition::Equal, HostReg::rdx);
+		em.setcc(HostCondition::Less, HostReg::rcx);
+		em.setcc(HostCondition::Below, HostReg::rax);
+		em.shl_imm(HostReg::rax, 2);
+		em.alu(0x01, HostReg::rcx, HostReg::rcx);
+		em.alu(0x09, HostReg::rdx, HostReg::rax);
+		em.alu(0x09, HostReg::rdx, HostReg::rcx);
+		em.store(1, HostReg::rsp, FlagsDisp, HostReg::rdx);
+	}
+
+	/* Flags of rax & rcx, both sign-extended from the tested width */
+	static void emit_test_flags(Emitter& em)
+	{
+		em.alu(0x21, HostReg::rax, HostReg::rcx);
+		em.setcc(HostCondition::Equal, HostReg::rdx);
+		em.setcc(HostCondition::Sign, HostReg::rcx);
+		em.alu(0x01, HostReg::rcx, HostReg::rcx);
+		em.alu(0x09, HostReg::rdx, HostReg::rcx);
+		em.store(1, HostReg::rsp, FlagsDisp, HostReg::rdx);
+	}
+
+	static UInt64 sign_extend(UInt64 value, Size width)
+	{
+		return width >= 8 ? value : scast(UInt64, scast(Int64, value << (64 - width * 8)) >> (64 - width * 8));
+	}
+
+	/* dest = src1 <op> src2 for ADD_r_r_r..SHR_r_r_m, writing the low "size" bytes */
+	static void emit_arithmetic(Emitter& em, const DecodedInstruction& inst)
+	{
+		Size index = scast(Size, inst.opcode) - scast(Size, Opcode::ADD_r_r_r);
+		UInt8 pars = scast(UInt8, inst.imm);
+		bool memory = index % 2 == 1;
+		Size width = Size(1) << (memory ? pars & 3 : (pars >> 4) & 3);
+		bool is_signed = memory ? (pars >> 2) & 1 : (pars >> 6) & 1;
+
+		if (memory)
+		{
+			emit_address(em, inst);
+			em.load(width, HostReg::rcx, HostReg::rax, 0);
+		}
+		else em.load(8, HostReg::rcx, RegsReg, reg_disp(pars & 0xF));
+
+		switch (index / 2)
+		{
+			case 3:
+			case 4:
+				em.mov(ArgRegs[1], HostReg::rcx);
+				em.load(8, ArgRegs[0], RegsReg, reg_disp(inst.aux));
+				em.mov_imm(ArgRegs[2], width | (is_signed ? 0x100 : 0) | (index / 2 == 4 ? 0x200 : 0));
+				em.call(rcast(const void*, &integer_divide));
+				break;
+
+			case 8:
+			case 9:
+				em.and_imm(HostReg::rcx, scast(Int32, width * 8 - 1));
+				if (index / 2 == 8)
+					em.load(8, HostReg::rax, RegsReg, reg_disp(inst.aux));
+				else if (is_signed)
+					em.load_signed(width, HostReg::rax, RegsReg, reg_disp(inst.aux));
+				else em.load(width, HostReg::rax, RegsReg, reg_disp(inst.aux));
+				em.shift_cl(index / 2 == 8 ? 4 : is_signed ? 7 : 5, HostReg::rax);
+				break;
+
+			case 2:
+				em.load(8, HostReg::rax, RegsReg, reg_disp(inst.aux));
+				em.imul(HostReg::rax, HostReg::rcx);
+				break;
+
+			default: {
+				static const UInt8 Opcodes[] = { 0x01, 0x29, 0, 0, 0, 0x21, 0x09, 0x31 };
+				em.load(8, HostReg::rax, RegsReg, reg_disp(inst.aux));
+				em.alu(Opcodes[index / 2], HostReg::rax, HostReg::rcx);
+			} break;
+		}
+		em.store(width, RegsReg, reg_disp(inst.reg), HostReg::rax);
+	}
+
+	Size emit_branch(Emitter& em, const DecodedInstruction& inst, bool taken)
+	{
+		switch (inst.opcode)
+		{
+			case Opcode::JCC_s32:
+				em.load(1, HostReg::rcx, HostReg::rsp, FlagsDisp);
+				em.mov_imm(HostReg::rax, op::ConditionTable[inst.aux & 0xF]);
+				em.bt(HostReg::rax, HostReg::rcx);
+				return em.jcc(taken ? HostCondition::Below : HostCondition::AboveEqual);
+
+			case Opcode::LOOP_s32:
+				em.load(8, HostReg::rax, RegsReg, reg_disp(inst.reg));
+				em.add_imm(HostReg::rax, -1);
+				em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rax);
+				return em.jcc(taken ? HostCondition::NotEqual : HostCondition::Equal);
+
+			default:
+				return em.jmp();
+		}
+	}
+
+	/* Address of the instruction's memory location into rax. Clobbers rcx. */
+	void emit_address(Emitter& em, const DecodedInstruction& inst)
+	{
+		bool delta_done = fits_int32(inst.delta);
+
+		switch (inst.segment)
+		{
+			case 0:
+				em.mov_imm(HostReg::rax, inst.delta);
+				delta_done = true;
+				break;
+			case 1:
+				if (delta_done)
+					em.lea(HostReg::rax, FrameReg, scast(Int32, inst.delta));
+				else em.mov(HostReg::rax, FrameReg);
+				break;
+			case 2:
+				if (delta_done)
+					em.lea(HostReg::rax, StaticsReg, scast(Int32, inst.delta));
+				else em.mov(HostReg::rax, StaticsReg);
+				break;
+			default:
+				em.load(8, HostReg::rax, RegsReg, reg_disp(inst.base));
+				if (delta_done && inst.delta != 0)
+					em.add_imm(HostReg::rax, scast(Int32, inst.delta));
+				break;
+		}
+
+		if (!delta_done)
+		{
+			em.mov_imm(HostReg::rcx, inst.delta);
+			em.add(HostReg::rax, HostReg::rcx);
+		}
+
+		if (inst.indexed)
+		{
+			em.load(8, HostReg::rcx, RegsReg, reg_disp(inst.index));
+			if (inst.scale)
+				em.shl_imm(HostReg::rcx, inst.scale);
+			em.add(HostReg::rax, HostReg::rcx);
+		}
+	}
+
+	void emit_instruction(Emitter& em, const DecodedInstruction& inst)
+	{
+		switch (inst.opcode)
+		{
+			case Opcode::NOP:
+				break;
+
+			case Opcode::MOV_r8_r8: em.load(1, HostReg::rcx, RegsReg, reg_disp(inst.aux)); em.store(1, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r16_r16: em.load(2, HostReg::rcx, RegsReg, reg_disp(inst.aux)); em.store(2, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r32_r32: em.load(4, HostReg::rcx, RegsReg, reg_disp(inst.aux)); em.store(4, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r64_r64: em.load(8, HostReg::rcx, RegsReg, reg_disp(inst.aux)); em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+
+			case Opcode::MOV_r8_m8: emit_address(em, inst); em.load(1, HostReg::rcx, HostReg::rax, 0); em.store(1, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r16_m16: emit_address(em, inst); em.load(2, HostReg::rcx, HostReg::rax, 0); em.store(2, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r32_m32: emit_address(em, inst); em.load(4, HostReg::rcx, HostReg::rax, 0); em.store(4, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r64_m64: emit_address(em, inst); em.load(8, HostReg::rcx, HostReg::rax, 0); em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+
+			case Opcode::MOV_m8_r8: emit_address(em, inst); em.load(1, HostReg::rcx, RegsReg, reg_disp(inst.reg)); em.store(1, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m16_r16: emit_address(em, inst); em.load(2, HostReg::rcx, RegsReg, reg_disp(inst.reg)); em.store(2, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m32_r32: emit_address(em, inst); em.load(4, HostReg::rcx, RegsReg, reg_disp(inst.reg)); em.store(4, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m64_r64: emit_address(em, inst); em.load(8, HostReg::rcx, RegsReg, reg_disp(inst.reg)); em.store(8, HostReg::rax, 0, HostReg::rcx); break;
+
+			case Opcode::MOV_r8_imm8: em.mov_imm(HostReg::rcx, inst.imm); em.store(1, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r16_imm16: em.mov_imm(HostReg::rcx, inst.imm); em.store(2, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r32_imm32: em.mov_imm(HostReg::rcx, inst.imm); em.store(4, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+			case Opcode::MOV_r64_imm64: em.mov_imm(HostReg::rcx, inst.imm); em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rcx); break;
+
+			case Opcode::MOV_m8_imm8: emit_address(em, inst); em.mov_imm(HostReg::rcx, inst.imm); em.store(1, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m16_imm16: emit_address(em, inst); em.mov_imm(HostReg::rcx, inst.imm); em.store(2, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m32_imm32: emit_address(em, inst); em.mov_imm(HostReg::rcx, inst.imm); em.store(4, HostReg::rax, 0, HostReg::rcx); break;
+			case Opcode::MOV_m64_imm64: emit_address(em, inst); em.mov_imm(HostReg::rcx, inst.imm); em.store(8, HostReg::rax, 0, HostReg::rcx); break;
+
+			case Opcode::LEA:
+				emit_address(em, inst);
+				em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rax);
+				break;
+
+			case Opcode::MMB_sb:
+			case Opcode::MMB_sw:
+			case Opcode::MMB_sd:
+			case Opcode::MMB_sq:
+				em.load(8, ArgRegs[0], RegsReg, reg_disp(inst.reg));
+				em.load(8, ArgRegs[1], RegsReg, reg_disp(inst.aux));
+				em.mov_imm(ArgRegs[2], inst.imm);
+				em.call(rcast(const void*, &memory_copy));
+				break;
+
+			case Opcode::NEW_r_s:
+				em.mov(ArgRegs[0], HeapReg);
+				em.mov_imm(ArgRegs[1], inst.imm);
+				em.mov_imm(ArgRegs[2], inst.aux ? 1 : 0);
+				em.call(rcast(const void*, &heap_malloc));
+				em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rax);
+				break;
+
+			case Opcode::NEW_m_s:
+				em.mov(ArgRegs[0], HeapReg);
+				em.mov_imm(ArgRegs[1], inst.imm);
+				em.mov_imm(ArgRegs[2], inst.aux ? 1 : 0);
+				em.call(rcast(const void*, &heap_malloc));
+				em.mov(HostReg::rdx, HostReg::rax);
+				emit_address(em, inst);
+				em.store(8, HostReg::rax, 0, HostReg::rdx);
+				break;
+
+			case Opcode::DEL_r:
+				em.load(8, ArgRegs[1], RegsReg, reg_disp(inst.reg));
+				em.mov(ArgRegs[0], HeapReg);
+				em.call(rcast(const void*, &heap_free));
+				break;
+
+			case Opcode::DEL_m:
+				emit_address(em, inst);
+				em.load(8, ArgRegs[1], HostReg::rax, 0);
+				em.mov(ArgRegs[0], HeapReg);
+				em.call(rcast(const void*, &heap_free));
+				break;
+
+			case Opcode::MHR_r:
+				em.load(8, ArgRegs[1], RegsReg, reg_disp(inst.reg));
+				em.mov(ArgRegs[0], HeapReg);
+				em.call(inst.aux ? rcast(const void*, &heap_increase_ref) : rcast(const void*, &heap_decrease_ref));
+				break;
+
+			case Opcode::MHR_m:
+				emit_address(em, inst);
+				em.load(8, ArgRegs[1], HostReg::rax, 0);
+				em.mov(ArgRegs[0], HeapReg);
+				em.call(inst.aux ? rcast(const void*, &heap_increase_ref) : rcast(const void*, &heap_decrease_ref));
+				break;
+
+			case Opcode::CST_r:
+				em.mov_imm(ArgRegs[0], inst.aux);
+				em.lea(ArgRegs[1], RegsReg, reg_disp(inst.reg));
+				em.call(rcast(const void*, &runtime::_cast_value));
+				break;
+
+			case Opcode::CST_m:
+				emit_address(em, inst);
+				em.mov(ArgRegs[1], HostReg::rax);
+				em.mov_imm(ArgRegs[0], inst.aux);
+				em.call(rcast(const void*, &runtime::_cast_value));
+				break;
+
+			case Opcode::CMP_r_r:
+				em.load_signed(Size(1) << (inst.imm & 3), HostReg::rax, RegsReg, reg_disp(inst.reg));
+				em.load_signed(Size(1) << (inst.imm & 3), HostReg::rcx, RegsReg, reg_disp(inst.aux));
+				emit_compare_flags(em);
+				break;
+
+			case Opcode::CMP_r_imm:
+				em.load_signed(Size(1) << (inst.aux & 3), HostReg::rax, RegsReg, reg_disp(inst.reg));
+				em.mov_imm(HostReg::rcx, sign_extend(inst.imm, Size(1) << (inst.aux & 3)));
+				emit_compare_flags(em);
+				break;
+
+			case Opcode::CMP_r_m:
+				emit_address(em, inst);
+				em.load_signed(Size(1) << (inst.aux & 3), HostReg::rcx, HostReg::rax, 0);
+				em.load_signed(Size(1) << (inst.aux & 3), HostReg::rax, RegsReg, reg_disp(inst.reg));
+				emit_compare_flags(em);
+				break;
+
+			case Opcode::TEST_r_r:
+				em.load_signed(Size(1) << (inst.imm & 3), HostReg::rax, RegsReg, reg_disp(inst.reg));
+				em.load_signed(Size(1) << (inst.imm & 3), HostReg::rcx, RegsReg, reg_disp(inst.aux));
+				emit_test_flags(em);
+				break;
+
+			case Opcode::TEST_r_imm:
+				em.load_signed(Size(1) << (inst.aux & 3), HostReg::rax, RegsReg, reg_disp(inst.reg));
+				em.mov_imm(HostReg::rcx, sign_extend(inst.imm, Size(1) << (inst.aux & 3)));
+				emit_test_flags(em);
+				break;
+
+			case Opcode::ADD_r_r_r: case Opcode::ADD_r_r_m: case Opcode::SUB_r_r_r: case Opcode::SUB_r_r_m:
+			case Opcode::MUL_r_r_r: case Opcode::MUL_r_r_m: case Opcode::DIV_r_r_r: case Opcode::DIV_r_r_m:
+			case Opcode::REM_r_r_r: case Opcode::REM_r_r_m: case Opcode::AND_r_r_r: case Opcode::AND_r_r_m:
+			case Opcode::OR_r_r_r: case Opcode::OR_r_r_m: case Opcode::XOR_r_r_r: case Opcode::XOR_r_r_m:
+			case Opcode::SHL_r_r_r: case Opcode::SHL_r_r_m: case Opcode::SHR_r_r_r: case Opcode::SHR_r_r_m:
+				emit_arithmetic(em, inst);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	void* heap_malloc(Heap* heap, Size size, bool add_ref) { return heap->malloc(size, add_ref); }
+	void heap_free(Heap* heap, void* ptr) { heap->free(ptr); }
+	void heap_increase_ref(Heap* heap, void* ptr) { heap->add_ref(ptr); }
+	void heap_decrease_ref(Heap* heap, void* ptr) { heap->remove_ref(ptr); }
+	void memory_copy(void* dst, const void* src, Size size) { bulk::copy(dst, src, size); }
+
+	template<std::integral _Ty>
+	static UInt64 divide(UInt64 left, UInt64 right, bool remainder)
+	{
+		_Ty a = scast(_Ty, left), b = scast(_Ty, right);
+		if (b == 0)
+			return remainder ? left : ~UInt64(0);
+		if constexpr (std::signed_integral<_Ty>)
+			if (b == -1)
+				return remainder ? 0 : UInt64(0) - scast(UInt64, a);
+		return scast(UInt64, remainder ? a % b : a / b);
+	}
+
+	UInt64 integer_divide(UInt64 left, UInt64 right, UInt32 mode)
+	{
+		bool remainder = (mode >> 9) & 1;
+		switch ((mode & 0xFF) | (mode & 0x100))
+		{
+			case 1: return divide<UInt8>(left, right, remainder);
+			case 2: return divide<UInt16>(left, right, remainder);
+			case 4: return divide<UInt32>(left, right, remainder);
+			case 0x101: return divide<Int8>(left, right, remainder);
+			case 0x102: return divide<Int16>(left, right, remainder);
+			case 0x104: return divide<Int32>(left, right, remainder);
+			case 0x108: return divide<Int64>(left, right, remainder);
+			default: return divide<UInt64>(left, right, remainder);
+		}
+	}
+
+	static Size page_size()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return scast(Size, sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	bool install(const std::vector<UInt8>& code, CompiledCode& result)
+	{
+		Size page = page_size();
+		Size size = (code.size() + page - 1) / page * page;
+
+#if defined(_WIN32)
+		void* memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!memory)
+			return false;
+
+		std::memcpy(memory, code.data(), code.size());
+
+		DWORD old;
+		if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &old))
+		{
+			VirtualFree(memory, 0, MEM_RELEASE);
+			return false;
+		}
+		FlushInstructionCache(GetCurrentProcess(), memory, size);
+#else
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED)
+			return false;
+
+		std::memcpy(memory, code.data(), code.size());
+
+		if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, size);
+			return false;
+		}
+#endif
+
+		result.entry = rcast(CompiledFunction, memory);
+		result.memory = memory;
+		result.memorySize = size;
+		return true;
+	}
+
+	void uninstall(CompiledCode& code)
+	{
+		if (!code.memory)
+			return;
+
+#if defined(_WIN32)
+		VirtualFree(code.memory, 0, MEM_RELEASE);
+#else
+		munmap(code.memory, code.memorySize);
+#endif
+	}
+}
+#endif
@@ -17,6 +17,50 @@ namespace kram::assembler
 		{ asm_opcode_name(AssemblerOpcode::MHRI), AssemblerOpcode::MHRI },
 		{ asm_opcode_name(AssemblerOpcode::MHRD), AssemblerOpcode::MHRD },
 		{ asm_opcode_name(AssemblerOpcode::CAST), AssemblerOpcode::CAST },
+		{ asm_opcode_name(AssemblerOpcode::CALL), AssemblerOpcode::CALL },
+		{ asm_opcode_name(AssemblerOpcode::CALLR), AssemblerOpcode::CALLR },
+		{ asm_opcode_name(AssemblerOpcode::RET), AssemblerOpcode::RET },
+		{ asm_opcode_name(AssemblerOpcode::TAILCALL), AssemblerOpcode::TAILCALL },
+		{ asm_opcode_name(AssemblerOpcode::CMP), AssemblerOpcode::CMP },
+		{ asm_opcode_name(AssemblerOpcode::TEST), AssemblerOpcode::TEST },
+		{ asm_opcode_name(AssemblerOpcode::JMP), AssemblerOpcode::JMP },
+		{ asm_opcode_name(AssemblerOpcode::JCC), AssemblerOpcode::JCC },
+		{ asm_opcode_name(AssemblerOpcode::CMPJ), AssemblerOpcode::CMPJ },
+		{ asm_opcode_name(AssemblerOpcode::LOOP), AssemblerOpcode::LOOP },
+		{ asm_opcode_name(AssemblerOpcode::SWITCH), AssemblerOpcode::SWITCH },
+		{ asm_opcode_name(AssemblerOpcode::ADD), AssemblerOpcode::ADD },
+		{ asm_opcode_name(AssemblerOpcode::SUB), AssemblerOpcode::SUB },
+		{ asm_opcode_name(AssemblerOpcode::MUL), AssemblerOpcode::MUL },
+		{ asm_opcode_name(AssemblerOpcode::DIV), AssemblerOpcode::DIV },
+		{ asm_opcode_name(AssemblerOpcode::REM), AssemblerOpcode::REM },
+		{ asm_opcode_name(AssemblerOpcode::AND), AssemblerOpcode::AND },
+		{ asm_opcode_name(AssemblerOpcode::OR), AssemblerOpcode::OR },
+		{ asm_opcode_name(AssemblerOpcode::XOR), AssemblerOpcode::XOR },
+		{ asm_opcode_name(AssemblerOpcode::SHL), AssemblerOpcode::SHL },
+		{ asm_opcode_name(AssemblerOpcode::SHR), AssemblerOpcode::SHR },
+		{ asm_opcode_name(AssemblerOpcode::SQRT), AssemblerOpcode::SQRT },
+		{ asm_opcode_name(AssemblerOpcode::FMA), AssemblerOpcode::FMA },
+		{ asm_opcode_name(AssemblerOpcode::VADD), AssemblerOpcode::VADD },
+		{ asm_opcode_name(AssemblerOpcode::VSUB), AssemblerOpcode::VSUB },
+		{ asm_opcode_name(AssemblerOpcode::VMUL), AssemblerOpcode::VMUL },
+		{ asm_opcode_name(AssemblerOpcode::VMIN), AssemblerOpcode::VMIN },
+		{ asm_opcode_name(AssemblerOpcode::VMAX), AssemblerOpcode::VMAX },
+		{ asm_opcode_name(AssemblerOpcode::VFMA), AssemblerOpcode::VFMA },
+		{ asm_opcode_name(AssemblerOpcode::VCMP), AssemblerOpcode::VCMP },
+		{ asm_opcode_name(AssemblerOpcode::VSELECT), AssemblerOpcode::VSELECT },
+		{ asm_opcode_name(AssemblerOpcode::VSUM), AssemblerOpcode::VSUM },
+		{ asm_opcode_name(AssemblerOpcode::VRMIN), AssemblerOpcode::VRMIN },
+		{ asm_opcode_name(AssemblerOpcode::VRMAX), AssemblerOpcode::VRMAX },
+		{ asm_opcode_name(AssemblerOpcode::VARGMIN), AssemblerOpcode::VARGMIN },
+		{ asm_opcode_name(AssemblerOpcode::VARGMAX), AssemblerOpcode::VARGMAX },
+		{ asm_opcode_name(AssemblerOpcode::VDOT), AssemblerOpcode::VDOT },
+		{ asm_opcode_name(AssemblerOpcode::VSCAN), AssemblerOpcode::VSCAN },
+		{ asm_opcode_name(AssemblerOpcode::VSCANX), AssemblerOpcode::VSCANX },
+		{ asm_opcode_name(AssemblerOpcode::MSET), AssemblerOpcode::MSET },
+		{ asm_opcode_name(AssemblerOpcode::MCMP), AssemblerOpcode::MCMP },
+		{ asm_opcode_name(AssemblerOpcode::MFIND), AssemblerOpcode::MFIND },
+		{ asm_opcode_name(AssemblerOpcode::GATHER), AssemblerOpcode::GATHER },
+		{ asm_opcode_name(AssemblerOpcode::SCATTER), AssemblerOpcode::SCATTER },
 	};
 
 	bool is_valid_asm_opcode(const char* name) { return Opcodes.find(name) != Opcodes.end(); }
@@ -83,15 +127,228 @@ namespace kram::op
 		Size remaining = std::min(buffer_size, byte_count());
 		
 		std::byte* buffer = rcast(std::byte*, _buffer);
-		if (remaining - sizeof(Opcode) >= 0)
-			*rcast(Opcode*, buffer) = _opcode;
+		if (remaining < sizeof(Opcode))
+			return;
+
+		*rcast(Opcode*, buffer) = _opcode;
+		buffer += sizeof(Opcode);
 		remaining -= sizeof(Opcode);
 
 		for (std::byte byte : _args)
 		{
 			if (remaining-- <= 0)
 				return;
-			*buffer = byte;
+			*(buffer++) = byte;
+		}
+	}
+
+	static const char* const OpcodeNames[] = {
+		"NOP",
+		"MOV_r8_r8",
+		"MOV_r16_r16",
+		"MOV_r32_r32",
+		"MOV_r64_r64",
+		"MOV_r8_m8",
+		"MOV_r16_m16",
+		"MOV_r32_m32",
+		"MOV_r64_m64",
+		"MOV_m8_r8",
+		"MOV_m16_r16",
+		"MOV_m32_r32",
+		"MOV_m64_r64",
+		"MOV_r8_imm8",
+		"MOV_r16_imm16",
+		"MOV_r32_imm32",
+		"MOV_r64_imm64",
+		"MOV_m8_imm8",
+		"MOV_m16_imm16",
+		"MOV_m32_imm32",
+		"MOV_m64_imm64",
+		"LEA",
+		"MMB_sb",
+		"MMB_sw",
+		"MMB_sd",
+		"MMB_sq",
+		"NEW_r_s",
+		"NEW_m_s",
+		"DEL_r",
+		"DEL_m",
+		"MHR_r",
+		"MHR_m",
+		"CST_r",
+		"CST_m",
+		"MOV_r8_stk_d8",
+		"MOV_r16_stk_d8",
+		"MOV_r32_stk_d8",
+		"MOV_r64_stk_d8",
+		"MOV_stk_d8_r8",
+		"MOV_stk_d8_r16",
+		"MOV_stk_d8_r32",
+		"MOV_stk_d8_r64",
+		"MOV_r8_reg_idx1",
+		"MOV_r16_reg_idx2",
+		"MOV_r32_reg_idx4",
+		"MOV_r64_reg_idx8",
+		"MOV_reg_idx1_r8",
+		"MOV_reg_idx2_r16",
+		"MOV_reg_idx4_r32",
+		"MOV_reg_idx8_r64",
+		"MOV_r8_m8_qreg",
+		"MOV_r16_m16_qreg",
+		"MOV_r32_m32_qreg",
+		"MOV_r64_m64_qreg",
+		"MOV_m8_r8_qreg",
+		"MOV_m16_r16_qreg",
+		"MOV_m32_r32_qreg",
+		"MOV_m64_r64_qreg",
+		"MOV_r8_m8_qreg_d8",
+		"MOV_r16_m16_qreg_d8",
+		"MOV_r32_m32_qreg_d8",
+		"MOV_r64_m64_qreg_d8",
+		"MOV_m8_r8_qreg_d8",
+		"MOV_m16_r16_qreg_d8",
+		"MOV_m32_r32_qreg_d8",
+		"MOV_m64_r64_qreg_d8",
+		"CST_r_q",
+		"CST_m_q",
+		"MOV_r64_m64__MOV_m64_r64",
+		"MOV_r64_m64__MOV_r64_m64",
+		"MOV_r64_stk_d8__MOV_stk_d8_r64",
+		"MOV_r32_stk_d8__MOV_stk_d8_r32",
+		"LEA__MMB_sb",
+		"LEA__LEA__MMB_sb",
+		"CALL",
+		"CALLR",
+		"RET",
+		"TAILCALL",
+		"CMP_r_r",
+		"CMP_r_imm",
+		"CMP_r_m",
+		"TEST_r_r",
+		"TEST_r_imm",
+		"JMP_s8",
+		"JMP_s32",
+		"JCC_s8",
+		"JCC_s32",
+		"CMPJ_r_imm_s8",
+		"CMPJ_r_imm_s32",
+		"CMPJ_r_m_s8",
+		"CMPJ_r_m_s32",
+		"LOOP_s8",
+		"LOOP_s32",
+		"SWITCH",
+		"ADD_r_r_r",
+		"ADD_r_r_m",
+		"SUB_r_r_r",
+		"SUB_r_r_m",
+		"MUL_r_r_r",
+		"MUL_r_r_m",
+		"DIV_r_r_r",
+		"DIV_r_r_m",
+		"REM_r_r_r",
+		"REM_r_r_m",
+		"AND_r_r_r",
+		"AND_r_r_m",
+		"OR_r_r_r",
+		"OR_r_r_m",
+		"XOR_r_r_r",
+		"XOR_r_r_m",
+		"SHL_r_r_r",
+		"SHL_r_r_m",
+		"SHR_r_r_r",
+		"SHR_r_r_m",
+		"FADD_r_r_r",
+		"FADD_r_r_m",
+		"FSUB_r_r_r",
+		"FSUB_r_r_m",
+		"FMUL_r_r_r",
+		"FMUL_r_r_m",
+		"FDIV_r_r_r",
+		"FDIV_r_r_m",
+		"FSQRT_r_r",
+		"FSQRT_r_m",
+		"FFMA_r_r_r_r",
+		"FFMA_r_r_r_m",
+		"VADD",
+		"VSUB",
+		"VMUL",
+		"VMIN",
+		"VMAX",
+		"VFMA",
+		"VCMP",
+		"VSELECT",
+		"VSUM",
+		"VRMIN",
+		"VRMAX",
+		"VARGMIN",
+		"VARGMAX",
+		"VDOT",
+		"VSCAN",
+		"VSCANX",
+		"MSET",
+		"MCMP",
+		"MFIND",
+		"MFINDB",
+		"GATHER",
+		"SCATTER",
+	};
+	static_assert(std::size(OpcodeNames) == OpcodeCount, "opcode names out of sync with op::Opcode");
+
+	const char* opcode_name(Opcode opcode)
+	{
+		return scast(Size, opcode) < OpcodeCount ? OpcodeNames[scast(UInt8, opcode)] : "<unknown-opcode>";
+	}
+
+	const Superinstruction* find_superinstruction(Opcode opcode)
+	{
+		for (const Superinstruction& si : Superinstructions)
+			if (si.opcode == opcode)
+				return &si;
+		return nullptr;
+	}
+
+	const BranchForms* find_branch(Opcode opcode)
+	{
+		for (const BranchForms& forms : Branches)
+			if (forms.shortForm == opcode || forms.longForm == opcode)
+				return &forms;
+		return nullptr;
+	}
+
+	Opcode generic_opcode(Opcode opcode)
+	{
+		switch (opcode)
+		{
+			case Opcode::MOV_r8_m8_qreg:
+			case Opcode::MOV_r8_m8_qreg_d8:
+				return Opcode::MOV_r8_m8;
+			case Opcode::MOV_m8_r8_qreg:
+			case Opcode::MOV_m8_r8_qreg_d8:
+				return Opcode::MOV_m8_r8;
+			case Opcode::MOV_r16_m16_qreg:
+			case Opcode::MOV_r16_m16_qreg_d8:
+				return Opcode::MOV_r16_m16;
+			case Opcode::MOV_m16_r16_qreg:
+			case Opcode::MOV_m16_r16_qreg_d8:
+				return Opcode::MOV_m16_r16;
+			case Opcode::MOV_r32_m32_qreg:
+			case Opcode::MOV_r32_m32_qreg_d8:
+				return Opcode::MOV_r32_m32;
+			case Opcode::MOV_m32_r32_qreg:
+			case Opcode::MOV_m32_r32_qreg_d8:
+				return Opcode::MOV_m32_r32;
+			case Opcode::MOV_r64_m64_qreg:
+			case Opcode::MOV_r64_m64_qreg_d8:
+				return Opcode::MOV_r64_m64;
+			case Opcode::MOV_m64_r64_qreg:
+			case Opcode::MOV_m64_r64_qreg_d8:
+				return Opcode::MOV_m64_r64;
+			case Opcode::CST_r_q:
+				return Opcode::CST_r;
+			case Opcode::CST_m_q:
+				return Opcode::CST_m;
+			default:
+				return opcode;
 		}
 	}
 
@@ -192,10 +449,20 @@ namespace kram::op
 				{
 					newnode->_next = nullptr;
 					newnode->_prev = _tail;
+					_tail->_next = newnode;
 					_tail = newnode;
 				}
 			}
 			_size = ib._size;
+
+			/* Branches must land on the copies of their targets */
+			std::map<const Node*, Node*> copies;
+			for (Node* src = ib._head, *dst = _head; src; src = src->_next, dst = dst->_next)
+				copies[src] = dst;
+			for (Node* node = _head; node; node = node->_next)
+				for (Node*& target : node->_targets)
+					if (target)
+						target = copies[target];
 		}
 		return *this;
 	}
@@ -241,8 +508,8 @@ namespace kram::op
 		{
 			newnode->_prev = _tail;
 			newnode->_next = nullptr;
-			_head->_next = newnode;
-			_head = newnode;
+			_tail->_next = newnode;
+			_tail = newnode;
 		}
 		return _size++, newnode;
 	}
@@ -254,6 +521,19 @@ namespace kram::op
 		next->_prev = newnode;
 		return _size++, newnode;
 	}
+	InstructionBuilder::Node* InstructionBuilder::_unlink(Node* node)
+	{
+		if (node->_prev)
+			node->_prev->_next = node->_next;
+		else _head = node->_next;
+
+		if (node->_next)
+			node->_next->_prev = node->_prev;
+		else _tail = node->_prev;
+
+		node->_next = node->_prev = nullptr;
+		return _size--, node;
+	}
 
 	InstructionBuilder::Location InstructionBuilder::push_front(const Instruction& inst)
 	{
@@ -302,13 +582,13 @@ namespace kram::op
 	{
 		if (position == _head)
 			return push_front(inst);
-		return insert(position->_prev, inst);
+		return insert(position, inst);
 	}
 	InstructionBuilder::Location InstructionBuilder::insert_before(Location position, Instruction&& inst)
 	{
 		if (position == _head)
 			return push_front(std::move(inst));
-		return insert(position->_prev, std::move(inst));
+		return insert(position, std::move(inst));
 	}
 
 	InstructionBuilder::Location InstructionBuilder::insert_after(Location position, const Instruction& inst)
@@ -324,15 +604,26 @@ namespace kram::op
 		return insert(position->_next, std::move(inst));
 	}
 
+	/* Moves keep the node itself, so branches to and from it stay attached */
 	void InstructionBuilder::move_before(Location position, Location target)
 	{
-		insert_before(target, std::move(position->_instruction));
-		erase(position);
+		if (position == target)
+			return;
+
+		_unlink(position);
+		if (target == _head)
+			_push_front(position);
+		else _insert(target, position);
 	}
 	void InstructionBuilder::move_after(Location position, Location target)
 	{
-		insert_after(target, std::move(position->_instruction));
-		erase(position);
+		if (position == target)
+			return;
+
+		_unlink(position);
+		if (target == _tail)
+			_push_back(position);
+		else _insert(target->_next, position);
 	}
 	void InstructionBuilder::move(Location position, int delta)
 	{
@@ -343,45 +634,47 @@ namespace kram::op
 		if (delta > 0)
 		{
 			for (; node && delta; node = node->_next, delta--);
+			if (node == position->_next)
+				return;
+
+			_unlink(position);
 			if (!node)
-				push_back(std::move(position->_instruction));
-			else insert(node, std::move(position->_instruction));
+				_push_back(position);
+			else _insert(node, position);
 		}
 		else
 		{
 			for (; node && delta; node = node->_prev, delta++);
-			if (!node)
-				push_front(std::move(position->_instruction));
-			else insert(node, std::move(position->_instruction));
+			_unlink(position);
+			if (!node || node == _head)
+				_push_front(position);
+			else _insert(node, position);
 		}
-
-		erase(position);
 	}
 
 	void InstructionBuilder::erase(Location node)
 	{
-		if (_head == node)
-		{
-			_head = node->_next;
-			if (!_head)
-				_tail = nullptr;
-			else _head->_prev = nullptr;
-		}
-		else if (_tail == node)
+		/* Branches to the erased node fall through to the next one */
+		if (node->_labels)
 		{
-			_tail = node->_prev;
-			if (!_tail)
-				_head = nullptr;
-			else _tail->_next = nullptr;
-		}
-		else
-		{
-			node->_prev->_next = node->_next;
-			node->_next->_prev = node->_prev;
+			for (Node* source = _head; source; source = source->_next)
+			{
+				for (Node*& target : source->_targets)
+				{
+					if (target == node)
+					{
+						target = node->_next;
+						if (target)
+							target->_labels++;
+					}
+				}
+			}
 		}
+		for (Node* target : node->_targets)
+			if (target)
+				target->_labels--;
 
-		delete node;
-		_size--;
+		delete _unlink(node);
 	}
 
 	void InstructionBuilder::swap(Location l0, Location l1)
@@ -389,13 +682,16 @@ namespace kram::op
 		Instruction aux = std::move(l0->_instruction);
 		l0->_instruction = std::move(l1->_instruction);
 		l1->_instruction = std::move(aux);
+		std::swap(l0->_targets, l1->_targets);
 	}
 
 	Size InstructionBuilder::byte_count() const
 	{
+		_resolve_branches();
+
 		Size count = 0;
 		for (Node* node = _head; node; node = node->_next)
-			count = node->_instruction.byte_count();
+			count += node->_instruction.byte_count();
 
 		return count;
 	}
@@ -469,31 +765,209 @@ namespace kram::op
 
 	InstructionBuilder::Location InstructionBuilder::insert_before(Location position, InstructionBuilder&& builder)
 	{
-		if (!position->_prev || position->_prev == _head)
+		if (position == _head)
 			return push_front(std::move(builder));
-		return insert(position->_prev, std::move(builder));
+		return insert(position, std::move(builder));
 	}
 
 	InstructionBuilder::Location InstructionBuilder::insert_after(Location position, InstructionBuilder&& builder)
 	{
-		if (!position->_next || position->_next == _tail)
+		if (!position->_next)
 			return push_back(std::move(builder));
 		return insert(position->_next, std::move(builder));
 	}
 
-	void InstructionBuilder::build(void* buffer, Size buffer_size) const
+	Size InstructionBuilder::fuse_superinstructions()
 	{
+		Size removed = 0;
+		for (Node* node = _head; node; node = node->_next)
+		{
+			for (const Superinstruction& si : Superinstructions)
+			{
+				Node* last = node;
+				Size matched = 0;
+				for (; last && matched < si.length; matched++, last = last->_next)
+					if (last->_instruction.opcode() != si.sequence[matched])
+						break;
+
+				if (matched < si.length)
+					continue;
+
+				/* A branch into the middle of the sequence would lose its target */
+				bool labeled = false;
+				for (Node* part = node->_next; part != last; part = part->_next)
+					labeled = labeled || part->_labels;
+				if (labeled)
+					continue;
+
+				std::vector<std::byte> args;
+				for (Node* part = node; part != last; part = part->_next)
+					args.insert(args.end(), part->_instruction.args().begin(), part->_instruction.args().end());
+
+				node->_instruction = Instruction(si.opcode, args);
+				while (node->_next != last)
+					erase(node->_next);
+
+				removed += si.length - 1;
+				break;
+			}
+		}
+
+		return removed;
+	}
+
+	Size InstructionBuilder::fuse_tail_calls(const std::function<bool(UInt8, UInt16)>& fusable)
+	{
+		Size rewritten = 0;
+		for (Node* node = _head; node && node->_next; node = node->_next)
+		{
+			Instruction& inst = node->_instruction;
+			if (inst.opcode() != Opcode::CALL || node->_next->_instruction.opcode() != Opcode::RET || inst.args().size() < 3)
+				continue;
+
+			if (fusable(inst.arg<UInt8>(0), inst.arg<UInt16>(1)))
+			{
+				inst.opcode(Opcode::TAILCALL);
+				rewritten++;
+			}
+		}
+
+		return rewritten;
+	}
+
+	void InstructionBuilder::branch(Location jump, Location target)
+	{
+		if (find_branch(jump->_instruction.opcode()))
+			_set_targets(jump, { target });
+	}
+
+	void InstructionBuilder::branch(Location jump, Location default_target, const std::vector<Location>& cases)
+	{
+		if (jump->_instruction.opcode() != Opcode::SWITCH || cases.size() > 0xFFFF)
+			return;
+
+		std::vector<Node*> targets{ default_target };
+		targets.insert(targets.end(), cases.begin(), cases.end());
+		_set_targets(jump, std::move(targets));
+
+		Instruction& inst = jump->_instruction;
+		std::vector<std::byte> args = inst.args();
+		args.resize(7 + cases.size() * 4, std::byte{ 0 });
+		inst = Instruction(Opcode::SWITCH, args);
+		inst.set_word(1, scast(UInt16, cases.size()));
+	}
+
+	void InstructionBuilder::_set_targets(Node* node, std::vector<Node*>&& targets)
+	{
+		for (Node* target : node->_targets)
+			if (target)
+				target->_labels--;
+
+		node->_targets = std::move(targets);
+		for (Node* target : node->_targets)
+			if (target)
+				target->_labels++;
+	}
+
+	static void set_branch_form(Instruction& inst, const BranchForms& forms, bool long_form)
+	{
+		bool is_long = inst.opcode() == forms.longForm;
+		if (is_long == long_form && !inst.args().empty())
+			return;
+
+		/* The offset is always the last operand */
+		std::vector<std::byte> args = inst.args();
+		Size offset_size = is_long ? 4 : 1;
+		args.resize((args.size() >= offset_size ? args.size() - offset_size : 0) + (long_form ? 4 : 1), std::byte{ 0 });
+		inst = Instruction(long_form ? forms.longForm : forms.shortForm, args);
+	}
+
+	void InstructionBuilder::_resolve_branches() const
+	{
+		bool any = false;
+		for (Node* node = _head; node; node = node->_next)
+		{
+			if (node->_targets.empty())
+				continue;
+
+			if (const BranchForms* forms = find_branch(node->_instruction.opcode()))
+				set_branch_form(node->_instruction, *forms, false);
+			any = true;
+		}
+		if (!any)
+			return;
+
+		/* Branches only ever grow from their short form, so this settles */
+		Size end;
+		for (bool grown = true; grown;)
+		{
+			grown = false;
+			end = 0;
+			for (Node* node = _head; node; node = node->_next)
+			{
+				node->_offset = end;
+				end += node->_instruction.byte_count();
+			}
+
+			for (Node* node = _head; node; node = node->_next)
+			{
+				const BranchForms* forms = node->_targets.empty() ? nullptr : find_branch(node->_instruction.opcode());
+				if (!forms || node->_instruction.opcode() == forms->longForm)
+					continue;
+
+				Node* target = node->_targets.front();
+				Int64 distance = scast(Int64, target ? target->_offset : end) - scast(Int64, node->_offset + node->_instruction.byte_count());
+				if (distance < -128 || distance > 127)
+				{
+					set_branch_form(node->_instruction, *forms, true);
+					grown = true;
+				}
+			}
+		}
+
+		for (Node* node = _head; node; node = node->_next)
+		{
+			if (node->_targets.empty())
+				continue;
+
+			Instruction& inst = node->_instruction;
+			Int64 from = scast(Int64, node->_offset + inst.byte_count());
+			auto distance = [&](Node* target) { return scast(Int64, target ? target->_offset : end) - from; };
+
+			if (inst.opcode() == Opcode::SWITCH)
+			{
+				for (Size i = 0; i < node->_targets.size(); i++)
+					inst.set_sdword(scast(unsigned int, 3 + i * 4), scast(Int32, distance(node->_targets[i])));
+			}
+			else if (const BranchForms* forms = find_branch(inst.opcode()))
+			{
+				Size size = inst.args().size();
+				if (inst.opcode() == forms->longForm)
+					inst.set_sdword(scast(unsigned int, size - 4), scast(Int32, distance(node->_targets.front())));
+				else inst.set_sbyte(scast(unsigned int, size - 1), scast(Int8, distance(node->_targets.front())));
+			}
+		}
+	}
+
+	void InstructionBuilder::build(void* _buffer, Size buffer_size) const
+	{
+		_resolve_branches();
+
+		std::byte* buffer = rcast(std::byte*, _buffer);
 		for (Node* node = _head; node; node = node->_next)
 		{
 			if (buffer_size <= 0)
 				return;
 			Size byte_count = node->_instruction.byte_count();
 			node->_instruction.write(buffer, buffer_size);
+			buffer += std::min(byte_count, buffer_size);
 			buffer_size = byte_count > buffer_size ? 0 : buffer_size - byte_count;
 		}
 	}
 	void InstructionBuilder::build(std::ostream& os) const
 	{
+		_resolve_branches();
+
 		for (Node* node = _head; node; node = node->_next)
 			os << node->_instruction;
 	}
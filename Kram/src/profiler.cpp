@@ -0,0 +1,144 @@
+#include "profiler.h"
+
+using kram::op::Opcode;
+
+namespace kram::runtime
+{
+	/* Plain data opcodes. Quickened opcodes are never recorded and superinstructions
+	 * are not fused again.
+	 */
+	static bool fusable(Opcode opcode)
+	{
+		return opcode != Opcode::NOP && opcode < Opcode::MOV_r8_m8_qreg;
+	}
+
+	static std::string fused_name(const std::vector<Opcode>& opcodes, const char* separator, const char* prefix = "")
+	{
+		std::string name;
+		for (Opcode opcode : opcodes)
+		{
+			if (!name.empty())
+				name += separator;
+			name += prefix;
+			name += op::opcode_name(opcode);
+		}
+		return name;
+	}
+
+	OpcodeProfile::OpcodeProfile() :
+		_bigrams(op::OpcodeCount * op::OpcodeCount, 0),
+		_trigrams{},
+		_dispatches{ 0 },
+		_history{},
+		_historySize{ 0 }
+	{}
+
+	void OpcodeProfile::record(Opcode opcode)
+	{
+		if (scast(Size, opcode) >= op::OpcodeCount)
+			return;
+
+		opcode = op::generic_opcode(opcode);
+		_dispatches++;
+
+		if (_historySize > 0)
+		{
+			_bigrams[scast(Size, _history[1]) * op::OpcodeCount + scast(Size, opcode)]++;
+			if (_historySize > 1)
+				_trigrams[trigram_key(_history[0], _history[1], opcode)]++;
+		}
+
+		_history[0] = _history[1];
+		_history[1] = opcode;
+		if (_historySize < 2)
+			_historySize++;
+	}
+
+	void OpcodeProfile::clear()
+	{
+		std::fill(_bigrams.begin(), _bigrams.end(), 0);
+		_trigrams.clear();
+		_dispatches = 0;
+		_historySize = 0;
+	}
+
+	UInt64 OpcodeProfile::count(Opcode first, Opcode second) const
+	{
+		if (scast(Size, first) >= op::OpcodeCount || scast(Size, second) >= op::OpcodeCount)
+			return 0;
+		return _bigrams[scast(Size, first) * op::OpcodeCount + scast(Size, second)];
+	}
+
+	UInt64 OpcodeProfile::count(Opcode first, Opcode second, Opcode third) const
+	{
+		auto it = _trigrams.find(trigram_key(first, second, third));
+		return it != _trigrams.end() ? it->second : 0;
+	}
+
+	std::vector<OpcodeProfile::Sequence> OpcodeProfile::top(Size count) const
+	{
+		std::vector<Sequence> seqs;
+
+		for (Size first = 0; first < op::OpcodeCount; first++)
+		{
+			for (Size second = 0; second < op::OpcodeCount; second++)
+			{
+				UInt64 times = _bigrams[first * op::OpcodeCount + second];
+				if (times > 0 && fusable(scast(Opcode, first)) && fusable(scast(Opcode, second)))
+					seqs.push_back({ { scast(Opcode, first), scast(Opcode, second) }, times });
+			}
+		}
+
+		for (const auto& trigram : _trigrams)
+		{
+			Opcode first = scast(Opcode, (trigram.first >> 16) & 0xff);
+			Opcode second = scast(Opcode, (trigram.first >> 8) & 0xff);
+			Opcode third = scast(Opcode, trigram.first & 0xff);
+			if (fusable(first) && fusable(second) && fusable(third))
+				seqs.push_back({ { first, second, third }, trigram.second });
+		}
+
+		std::stable_sort(seqs.begin(), seqs.end(), [](const Sequence& left, const Sequence& right) {
+			return left.saved_dispatches() > right.saved_dispatches();
+		});
+
+		if (seqs.size() > count)
+			seqs.resize(count);
+		return seqs;
+	}
+
+	void OpcodeProfile::emit_superinstructions(std::ostream& os, Size count) const
+	{
+		std::vector<Sequence> seqs = top(count);
+
+		os << "/* " << _dispatches << " dispatches profiled */" << std::endl;
+		for (const Sequence& seq : seqs)
+			os << "/* " << fused_name(seq.opcodes, " ") << ": " << seq.count << " times, "
+			   << seq.saved_dispatches() << " dispatches saved */" << std::endl;
+
+		os << std::endl << "/* op::Opcode */" << std::endl;
+		for (const Sequence& seq : seqs)
+			os << fused_name(seq.opcodes, "__") << "," << std::endl;
+
+		os << std::endl << "/* op::Superinstructions */" << std::endl;
+		for (const Sequence& seq : seqs)
+			os << "{ Opcode::" << fused_name(seq.opcodes, "__") << ", " << seq.opcodes.size()
+			   << ", { " << fused_name(seq.opcodes, ", ", "Opcode::") << " } }," << std::endl;
+
+		os << std::endl << "/* execute() dispatch_table */" << std::endl;
+		for (const Sequence& seq : seqs)
+			os << "&&opcode_" << fused_name(seq.opcodes, "__") << "," << std::endl;
+
+		os << std::endl << "/* execute_decoded() handler_table, the decoder expands superinstructions */" << std::endl;
+		for (Size i = 0; i < seqs.size(); i++)
+			os << "&&decoded_end," << std::endl;
+
+		os << std::endl << "/* execute() handlers */" << std::endl;
+		for (const Sequence& seq : seqs)
+		{
+			os << "do_opcode(" << fused_name(seq.opcodes, "__") << ")" << std::endl
+			   << "\tru::fused<" << fused_name(seq.opcodes, ", ", "Opcode::") << ">(state);" << std::endl
+			   << "end_opcode();" << std::endl << std::endl;
+		}
+	}
+}
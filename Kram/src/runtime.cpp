@@ -1,86 +1,142 @@
 #include "runtime.h"
 
 #include "vm.h"
+#include "decoder.h"
+#include "profiler.h"
+#include "jit.h"
+#include "simd.h"
+#include "bulk.h"
+
+#include <cmath>
+#include <limits>
 
 using namespace kram::bin;
 using kram::op::Opcode;
 
-#define SELF_CHUNK static_cast<ChunkOffset>(-1)
-
 namespace kram::runtime
 {
-	RuntimeState::RuntimeState(Stack* stack, Heap* heap) :
+	RuntimeState::RuntimeState(Stack* stack, Heap* heap, CodeCache* code, KramState* owner) :
 		regs{},
 		stack{ stack },
 		heap{ heap },
+		code{ code },
+		owner{ owner },
+		collector{ nullptr },
+		safepoints{ false },
 		exit{ false },
 		error{ ErrorCode::OK }
 	{}
 
-	static forceinline bool need_resize_stack(RuntimeState* state)
+	static forceinline bool need_resize_stack(Stack* stack, std::uintptr_t top)
+	{
+		return stack->base + top > stack->limit;
+	}
+
+	static constexpr Size align_frame(Size size)
 	{
-		Stack& stack = *state->stack;
-		return (stack.roof - (stack.base + state->regs.st.stack_offset)) < ((stack.roof - stack.base) / 2);
+		return (size + 7) & ~static_cast<Size>(7);
 	}
 
-	static void init_runtime(RuntimeState* state, Chunk* chunk, FunctionOffset functionOffset)
+	static void init_runtime(RuntimeState* state, Chunk* chunk, std::byte* code, FunctionOffset functionOffset)
 	{
 		Function* function = chunk->functions + functionOffset;
 
 		state->regs.sb.stack_offset = 0;
-		state->regs.sp.stack_offset = state->regs.sb.stack_offset + function->stackCount + sizeof(Registers);
-		state->regs.st.stack_offset = state->regs.sp.stack_offset + function->parameterCount;
+		state->regs.sp.stack_offset = state->regs.sb.stack_offset + align_frame(function->parameterCount + function->stackCount) + FrameOverhead;
+		state->regs.st.stack_offset = state->regs.sp.stack_offset;
 		state->regs.ch.addr_chunk = chunk;
-		state->regs.ip.addr_bytes = chunk->code + function->codeOffset;
+		state->regs.ip.addr_bytes = code + function->codeOffset;
 		state->regs.sd.addr_bytes = chunk->statics;
 
-		if (need_resize_stack(state))
-			_resize_stack(state->stack, state->regs.st.stack_offset - state->regs.sb.stack_offset);
+		if (need_resize_stack(state->stack, state->regs.st.stack_offset))
+			_resize_stack(state->stack, state->regs.st.stack_offset);
 	}
 
-	static void call_chunk(RuntimeState* state, ChunkOffset chunkOffset, FunctionOffset functionOffset)
+	static constexpr UInt16 register_range(UInt8 count)
 	{
-		Chunk* chunk = chunkOffset == SELF_CHUNK ? state->regs.ch.addr_chunk : state->regs.ch.addr_chunk->connections + chunkOffset;
-		Function* function = chunk->functions + functionOffset;
+		return scast(UInt16, ((1 << std::min(count, MaxRegisterArguments)) - 1));
+	}
+
+	static CallTarget resolve_target(const Chunk* chunk, std::byte* code, FunctionOffset functionOffset)
+	{
+		const Function& function = chunk->functions[functionOffset];
+		Size windowOffset = align_frame(function.parameterCount + function.stackCount);
+		return {
+			code + function.codeOffset,
+			function.parameterCount,
+			windowOffset,
+			windowOffset + FrameOverhead,
+			scast(UInt16, (function.registerMask | register_range(function.registerArguments)) & GeneralRegisterMask),
+			register_range(function.registerResults),
+			TierLookupInterval,
+			nullptr,
+			nullptr
+		};
+	}
 
-		Registers* oldregs = rcast(Registers*, state->stack->base + state->regs.sp.stack_offset) - 1;
-		*oldregs = state->regs;
+	CodeCache::~CodeCache()
+	{
+		for (auto& entry : _entries)
+			_kram_free(entry.second.code);
+		_entries.clear();
+	}
 
-		state->regs.sb = oldregs->sp;
-		state->regs.sp.stack_offset = state->regs.sb.stack_offset + function->stackCount + sizeof(Registers);
-		state->regs.st.stack_offset = state->regs.sp.stack_offset + function->parameterCount;
-		state->regs.ch.addr_chunk = chunk;
-		state->regs.ip.addr_bytes = chunk->code + function->codeOffset;
-		state->regs.sd.addr_bytes = chunk->statics;
+	std::byte* CodeCache::code(const bin::Chunk* chunk)
+	{
+		auto it = _entries.find(chunk);
+		if (it != _entries.end())
+		{
+			if (it->second.source == chunk->code && it->second.size == chunk->codeCount)
+				return it->second.code;
 
-		if (need_resize_stack(state))
-			_resize_stack(state->stack, state->regs.st.stack_offset - state->regs.sb.stack_offset);
+			_kram_free(it->second.code);
+			_entries.erase(it);
+		}
+
+		std::byte* code = _kram_malloc(std::byte, chunk->codeCount);
+		std::memcpy(code, chunk->code, chunk->codeCount);
+
+		std::vector<CallTarget> targets;
+		targets.reserve(chunk->functionCount);
+		for (FunctionOffset i = 0; i < chunk->functionCount; i++)
+			targets.push_back(resolve_target(chunk, code, i));
+
+		_entries[chunk] = { chunk->code, chunk->codeCount, code, std::move(targets) };
+		return code;
 	}
 
-	static void finish_call(RuntimeState* state)
+	const CallTarget* CodeCache::targets(const bin::Chunk* chunk)
 	{
-		if (state->regs.sb.stack_offset == 0)
-			state->exit = true;
+		code(chunk);
+		return _entries[chunk].targets.data();
+	}
 
-		Registers* oldregs = rcast(Registers*, state->stack->base + state->regs.sb.stack_offset) - 1;
-		oldregs->sr = state->regs.sr;
-		state->regs = *oldregs;
-		state->exit = false;
+	void CodeCache::release(const bin::Chunk* chunk)
+	{
+		auto it = _entries.find(chunk);
+		if (it != _entries.end())
+		{
+			_kram_free(it->second.code);
+			_entries.erase(it);
+		}
 	}
 
 	void _build_stack(Stack* stack, Size size)
 	{
 		stack->base = _kram_malloc(StackUnit, size);
 		stack->roof = stack->base + size;
+		stack->limit = stack->roof - size / 2;
 	}
+	/* The new stack is at least twice "min", so the frame ending at "min" fits below the limit */
 	void _resize_stack(Stack* stack, Size min)
 	{
 		Size size = static_cast<Size>(stack->roof - stack->base);
-		Size newsize = size * 2 + (size < min ? min - size : 0);
+		Size newsize = std::max(size, min) * 2;
 		StackUnit* old = stack->base;
 
 		stack->base = _kram_malloc(StackUnit, newsize);
 		stack->roof = stack->base + newsize;
+		stack->limit = stack->roof - newsize / 2;
 
 		std::memcpy(stack->base, old, size);
 
@@ -96,55 +152,259 @@ namespace kram::runtime
 
 
 
-#define do_opcode(_Inst) case _Inst : {
-#define end_opcode() } goto instruction_begin
-#define move_ip(_Amount) (state.regs.ip.addr_bytes += (_Amount))
+#if defined(KRAM_OPCODE_PROFILING)
+#define profile_opcode() (profile ? profile->record(*state.ip.addr_opcode) : void())
+#else
+#define profile_opcode() ((void) 0)
+#endif
+
+/* Stores ip first, so a tracing collector can tell which function each window runs */
+#define gc_safepoint() (state.runtime.safepoints \
+	? (state.store(), state.heap->safepoint(), state.runtime.collector ? state.runtime.collector->safepoint(&state.runtime, state.regs) : void()) \
+	: void())
+
+#if defined(KRAM_THREADED_DISPATCH)
+#define dispatch() profile_opcode(); goto *dispatch_table[scast(UInt8, *(state.ip.addr_opcode++))]
+#define do_opcode(_Inst) CONCAT_MACROS(opcode_, _Inst) : {
+#else
+#define dispatch() goto instruction_begin
+#define do_opcode(_Inst) case Opcode::_Inst : {
+#endif
+#define end_opcode() } dispatch()
+#define move_ip(_Amount) (state.ip.addr_bytes += (_Amount))
+/* Code of a predecoded chunk goes back to its stream, and code with closure records to
+ * them, wherever the raw interpreter takes a backward branch or enters or leaves a function
+ */
+#define decoded_reentry() if ((state.regs->ch.addr_chunk->decoded || state.targets->closures) && !reenter_decoded(state)) goto execute_end
+/* A backward branch of the raw interpreter first runs the trace of its loop, if any */
+#define back_edge() loop_trace(state, code_base(state)); decoded_reentry()
 
 namespace kram::runtime
 {
+	/* Working set of the interpreter loops, kept in execute()'s locals so the compiler
+	 * can hold it in host registers instead of reloading it through RuntimeState after
+	 * every store a handler makes. ip, the frame base (stack->base + sb) and the
+	 * statics pointer are written back to the window only around calls and on exit, so
+	 * ip, sb and sd read through regs->by_index see their value at the last store().
+	 */
+	struct LocalState
+	{
+		Register ip;
+		StackUnit* frame;
+		StackUnit* statics;
+		const CallTarget* targets;	/* of the current chunk, raw interpreter only */
+		Registers* regs;	/* window of the current frame */
+		Heap* heap;
+		RuntimeState& runtime;
+		UInt8 flags;	/* of the last CMP or TEST, see op::Condition */
+		UInt32 countdown;	/* backward branches left before the next look for a loop trace */
+
+		forceinline explicit LocalState(RuntimeState& runtime) :
+			ip{},
+			frame{ nullptr },
+			statics{ nullptr },
+			targets{ nullptr },
+			regs{ &runtime.regs },
+			heap{ runtime.heap },
+			runtime{ runtime },
+			flags{ 0 },
+			countdown{ TierLookupInterval }
+		{
+			load();
+		}
+
+		/* After anything that may move the stack or switch frames */
+		forceinline void load()
+		{
+			ip = regs->ip;
+			frame = runtime.stack->base + regs->sb.stack_offset;
+			statics = regs->sd.addr_stack_offset;
+		}
+
+		/* Before handing control to code that reads RuntimeState */
+		forceinline void store()
+		{
+			regs->ip = ip;
+		}
+	};
+
+	/* Opens the window of "function" at the caller's sp. Caller registers stay in their
+	 * own window; only the callee's register arguments and declared registers are
+	 * copied into the new one.
+	 */
+	static forceinline void call_chunk(LocalState& state, Chunk* chunk, const CallTarget* targets, FunctionOffset function)
+	{
+		const CallTarget& target = targets[function];
+		Stack* stack = state.runtime.stack;
+		Registers* caller = state.regs;
+
+		std::uintptr_t callerOffset = caller == &state.runtime.regs ? RootWindow : scast(std::uintptr_t, rcast(StackUnit*, caller) - stack->base);
+		std::uintptr_t sb = caller->sp.stack_offset;
+		std::uintptr_t top = sb + target.frameSize;
+		if (need_resize_stack(stack, top))
+		{
+			_resize_stack(stack, top);
+			if (callerOffset != RootWindow)
+				caller = rcast(Registers*, stack->base + callerOffset);
+		}
+
+		StackUnit* frame = stack->base + sb;
+		Registers* window = rcast(Registers*, frame + target.windowOffset);
+		CallInfo* info = rcast(CallInfo*, window + 1);
+		info->caller = callerOffset;
+		info->targets = state.targets;
+		info->resultMask = target.resultMask;
+
+		caller->ip = state.ip;
+		for (UInt16 mask = target.registerMask; mask; mask &= mask - 1)
+		{
+			int index = std::countr_zero(mask);
+			window->by_index[index] = caller->by_index[index];
+		}
+
+		window->sd.addr_bytes = chunk->statics;
+		window->sb.stack_offset = sb;
+		window->sp.stack_offset = top;
+		window->ch.addr_chunk = chunk;
+		window->st.stack_offset = top;
+
+		state.regs = window;
+		state.ip.addr_bytes = target.entry;
+		state.frame = frame;
+		state.statics = window->sd.addr_stack_offset;
+		state.targets = targets;
+	}
+
+	/* Slides back to the caller window with sr and the results of the callee's
+	 * convention. Returns false on the frame execute() entered.
+	 */
+	static forceinline bool finish_call(LocalState& state)
+	{
+		Registers* window = state.regs;
+		if (window == &state.runtime.regs)
+			return false;
+
+		StackUnit* base = state.runtime.stack->base;
+		const CallInfo* info = rcast(const CallInfo*, window + 1);
+		Registers* caller = info->caller == RootWindow ? &state.runtime.regs : rcast(Registers*, base + info->caller);
+		caller->sr = window->sr;
+		for (UInt16 mask = info->resultMask; mask; mask &= mask - 1)
+		{
+			int index = std::countr_zero(mask);
+			caller->by_index[index] = window->by_index[index];
+		}
+
+		state.regs = caller;
+		state.ip = caller->ip;
+		state.frame = base + caller->sb.stack_offset;
+		state.statics = caller->sd.addr_stack_offset;
+		state.targets = info->targets;
+		return true;
+	}
+
+	/* Turns the current frame into the frame of "function". Stack parameters move down
+	 * to sb and the window slides to the callee's offset, keeping its CallInfo, so the
+	 * stack does not grow across tail-recursive loops.
+	 */
+	static forceinline void tail_call(LocalState& state, Chunk* chunk, const CallTarget* targets, FunctionOffset function)
+	{
+		const CallTarget& target = targets[function];
+		Stack* stack = state.runtime.stack;
+		Registers* window = state.regs;
+		bool root = window == &state.runtime.regs;
+
+		std::uintptr_t sb = window->sb.stack_offset;
+		std::uintptr_t top = sb + target.frameSize;
+
+		/* The parameters may overlap the old window, keep what survives first */
+		Registers kept;
+		CallInfo info;
+		if (!root)
+		{
+			for (UInt16 mask = target.registerMask; mask; mask &= mask - 1)
+			{
+				int index = std::countr_zero(mask);
+				kept.by_index[index] = window->by_index[index];
+			}
+			info = *rcast(CallInfo*, window + 1);
+			info.resultMask = target.resultMask;
+		}
+
+		if (target.parameters)
+			std::memmove(stack->base + sb, stack->base + window->sp.stack_offset, target.parameters);
+
+		if (need_resize_stack(stack, top))
+			_resize_stack(stack, top);
+
+		StackUnit* frame = stack->base + sb;
+		if (!root)
+		{
+			window = rcast(Registers*, frame + target.windowOffset);
+			for (UInt16 mask = target.registerMask; mask; mask &= mask - 1)
+			{
+				int index = std::countr_zero(mask);
+				window->by_index[index] = kept.by_index[index];
+			}
+			*rcast(CallInfo*, window + 1) = info;
+		}
+
+		window->sd.addr_bytes = chunk->statics;
+		window->sb.stack_offset = sb;
+		window->sp.stack_offset = top;
+		window->ch.addr_chunk = chunk;
+		window->st.stack_offset = top;
+
+		state.regs = window;
+		state.ip.addr_bytes = target.entry;
+		state.frame = frame;
+		state.statics = window->sd.addr_stack_offset;
+		state.targets = targets;
+	}
+
+
 	namespace ru
 	{
 		template<std::integral _Ty>
-		forceinline _Ty pop_arg(RuntimeState& state)
+		forceinline _Ty pop_arg(LocalState& state)
 		{
 			if constexpr (sizeof(_Ty) == 1)
 			{
 				if constexpr (std::signed_integral<_Ty>)
-					return *(state.regs.ip.addr_s8++);
-				else return *(state.regs.ip.addr_u8++);
+					return *(state.ip.addr_s8++);
+				else return *(state.ip.addr_u8++);
 			}
 			else if constexpr (sizeof(_Ty) == 2)
 			{
 				if constexpr (std::signed_integral<_Ty>)
-					return *(state.regs.ip.addr_s16++);
-				else return *(state.regs.ip.addr_u16++);
+					return *(state.ip.addr_s16++);
+				else return *(state.ip.addr_u16++);
 			}
 			else if constexpr (sizeof(_Ty) == 4)
 			{
 				if constexpr (std::signed_integral<_Ty>)
-					return *(state.regs.ip.addr_s32++);
-				else return *(state.regs.ip.addr_u32++);
+					return *(state.ip.addr_s32++);
+				else return *(state.ip.addr_u32++);
 			}
 			else
 			{
 				if constexpr (std::signed_integral<_Ty>)
-					return *(state.regs.ip.addr_s64++);
-				else return *(state.regs.ip.addr_u64++);
+					return *(state.ip.addr_s64++);
+				else return *(state.ip.addr_u64++);
 			}
 		}
 
 		template<std::integral _Ty, unsigned int _ArgIdx>
-		forceinline _Ty get_arg(RuntimeState& state)
+		forceinline _Ty get_arg(LocalState& state)
 		{
 			if constexpr (sizeof(_Ty) == 1)
 			{
 				if constexpr (std::signed_integral<_Ty>)
-					return *(state.regs.ip.addr_s8 + _ArgIdx);
-				else return *(state.regs.ip.addr_u8 + _ArgIdx);
+					return *(state.ip.addr_s8 + _ArgIdx);
+				else return *(state.ip.addr_u8 + _ArgIdx);
 			}
 			else
 			{
-				return *reinterpret_cast<_Ty*>(state.regs.ip.addr_bytes + _ArgIdx);
+				return *reinterpret_cast<_Ty*>(state.ip.addr_bytes + _ArgIdx);
 			}
 		}
 
@@ -162,82 +422,82 @@ namespace kram::runtime
 
 
 		template<unsigned int _BitIdx, unsigned int _BitCount>
-		forceinline UInt8 pop_arg_bits(RuntimeState& state)
+		forceinline UInt8 pop_arg_bits(LocalState& state)
 		{
 			return bits<_BitIdx, _BitCount>(pop_arg<UInt8>(state));
 		}
 
 		template<unsigned int _ArgIdx, unsigned int _BitIdx, unsigned int _BitCount>
-		forceinline UInt8 get_arg_bits(RuntimeState& state)
+		forceinline UInt8 get_arg_bits(LocalState& state)
 		{
 			return bits<_BitIdx, _BitCount>(get_arg<UInt8, _ArgIdx>(state));
 		}
 
 		template<typename _Ty>
-		forceinline _Ty& reg(RuntimeState& state, unsigned int index)
+		forceinline _Ty& reg(LocalState& state, unsigned int index)
 		{
 			if constexpr (std::integral<_Ty>)
 			{
 				if constexpr (sizeof(_Ty) == 1)
 				{
 					if constexpr (std::signed_integral<_Ty>)
-						return state.regs.by_index[index].s8;
-					else return state.regs.by_index[index].u8;
+						return state.regs->by_index[index].s8;
+					else return state.regs->by_index[index].u8;
 				}
 				else if constexpr (sizeof(_Ty) == 2)
 				{
 					if constexpr (std::signed_integral<_Ty>)
-						return state.regs.by_index[index].s16;
-					else return state.regs.by_index[index].u16;
+						return state.regs->by_index[index].s16;
+					else return state.regs->by_index[index].u16;
 				}
 				else if constexpr (sizeof(_Ty) == 4)
 				{
 					if constexpr (std::signed_integral<_Ty>)
-						return state.regs.by_index[index].s32;
-					else return state.regs.by_index[index].u32;
+						return state.regs->by_index[index].s32;
+					else return state.regs->by_index[index].u32;
 				}
 				else
 				{
 					if constexpr (std::signed_integral<_Ty>)
-						return state.regs.by_index[index].s64;
-					else return state.regs.by_index[index].u64;
+						return state.regs->by_index[index].s64;
+					else return state.regs->by_index[index].u64;
 				}
 			}
 			else if constexpr (std::floating_point<_Ty>)
 			{
 				if constexpr (std::same_as<_Ty, float>)
-					return state.regs.by_index[index].f32;
-				else state.regs.by_index[index].f64;
+					return state.regs->by_index[index].f32;
+				else return state.regs->by_index[index].f64;
 			}
 			else
 			{
-				return *rcast(_Ty*, rcast(void*, &state.regs.by_index[index]._value));
+				return *rcast(_Ty*, rcast(void*, &state.regs->by_index[index]._value));
 			}
 		}
 
 		template<typename _Ty, bool _FromStack>
-		forceinline _Ty& from_mem(RuntimeState& state, std::uintptr_t offset)
+		forceinline _Ty& from_mem(LocalState& state, std::uintptr_t offset)
 		{
 			if constexpr (_FromStack)
 			{
-				return *rcast(_Ty*, (state.stack->base + state.regs.sb.stack_offset + offset));
+				return *rcast(_Ty*, (state.frame + offset));
 			}
 			else
 			{
-				return *rcast(_Ty*, (state.regs.sd.addr_stack_offset + offset));
+				return *rcast(_Ty*, (state.statics + offset));
 			}
 		}
 
 		template<typename _Ty>
-		forceinline _Ty& from_mem(RuntimeState& state, std::uintptr_t offset, bool from_stack)
+		forceinline _Ty& from_mem(LocalState& state, std::uintptr_t offset, bool from_stack)
 		{
 			return from_stack
-				? *rcast(_Ty*, (state.stack->base + state.regs.sb.stack_offset + offset))
-				: *rcast(_Ty*, (state.regs.sd.addr_stack_offset + offset));
+				? *rcast(_Ty*, (state.frame + offset))
+				: *rcast(_Ty*, (state.statics + offset));
 		}
 
 		template<typename _SizeType>
-		forceinline _SizeType& pop_memloc(RuntimeState& state)
+		forceinline _SizeType& pop_memloc(LocalState& state)
 		{
 			UInt8 pars = pop_arg<UInt8>(state);
 			UInt8 regs = pop_arg<UInt8>(state);
@@ -247,10 +507,10 @@ namespace kram::runtime
 			{
 				switch (bits<3, 2>(pars))
 				{
-					case 0: addr += state.regs.by_index[bits<4, 4>(regs)].u64; break;
-					case 1: addr += state.regs.by_index[bits<4, 4>(regs)].u64 * 2; break;
-					case 2: addr += state.regs.by_index[bits<4, 4>(regs)].u64 * 4; break;
-					case 3: addr += state.regs.by_index[bits<4, 4>(regs)].u64 * 8; break;
+					case 0: addr += state.regs->by_index[bits<4, 4>(regs)].u64; break;
+					case 1: addr += state.regs->by_index[bits<4, 4>(regs)].u64 * 2; break;
+					case 2: addr += state.regs->by_index[bits<4, 4>(regs)].u64 * 4; break;
+					case 3: addr += state.regs->by_index[bits<4, 4>(regs)].u64 * 8; break;
 				}
 			}
 			if (test<5>(pars))
@@ -268,12 +528,68 @@ namespace kram::runtime
 				case 0: return *rcast(_SizeType*, (addr != 0 ? addr : scast(std::uintptr_t, -1)));
 				case 1: return from_mem<_SizeType, true>(state, addr);
 				case 2: return from_mem<_SizeType, false>(state, addr);
-				case 3: return *rcast(_SizeType*, (state.regs.by_index[bits<0, 4>(regs)].addr_stack_offset + addr));
+				case 3: return *rcast(_SizeType*, (state.regs->by_index[bits<0, 4>(regs)].addr_stack_offset + addr));
 			}
 
 			return *rcast(_SizeType*, scast(std::uintptr_t, -1));
 		}
 
+		template<typename _SizeType>
+		forceinline _SizeType& decoded_memloc(LocalState& state, const DecodedInstruction& inst)
+		{
+			std::uintptr_t addr = inst.delta;
+			if (inst.indexed)
+				addr += state.regs->by_index[inst.index].u64 << inst.scale;
+
+			switch (inst.segment)
+			{
+				case 0: return *rcast(_SizeType*, (addr != 0 ? addr : scast(std::uintptr_t, -1)));
+				case 1: return from_mem<_SizeType, true>(state, addr);
+				case 2: return from_mem<_SizeType, false>(state, addr);
+				default: return *rcast(_SizeType*, (state.regs->by_index[inst.base].addr_stack_offset + addr));
+			}
+		}
+
+		constexpr UInt8 NoSegment = 0;
+		constexpr UInt8 StackSegment = 1;
+		constexpr UInt8 StaticSegment = 2;
+		constexpr UInt8 RegisterSegment = 3;
+
+		constexpr int NoDelta = -1;
+
+		/* Memory location whose shape is fixed by the opcode instead of a <segment|has_reg2|...> byte:
+		 * [<base_reg:4|split_reg:4>], [delta:8-64]
+		 */
+		template<typename _SizeType, UInt8 _Segment, bool _HasSplit, UInt8 _SplitScale, int _DeltaSize>
+		forceinline _SizeType& pop_fixed_memloc(LocalState& state)
+		{
+			std::uintptr_t addr = 0;
+			[[maybe_unused]] UInt8 regs = 0;
+
+			if constexpr (_HasSplit || _Segment == RegisterSegment)
+				regs = pop_arg<UInt8>(state);
+
+			if constexpr (_HasSplit)
+				addr += state.regs->by_index[bits<4, 4>(regs)].u64 << _SplitScale;
+
+			if constexpr (_DeltaSize == 0)
+				addr += pop_arg<UInt8>(state);
+			else if constexpr (_DeltaSize == 1)
+				addr += pop_arg<UInt16>(state);
+			else if constexpr (_DeltaSize == 2)
+				addr += pop_arg<UInt32>(state);
+			else if constexpr (_DeltaSize == 3)
+				addr += pop_arg<UInt64>(state);
+
+			if constexpr (_Segment == StackSegment)
+				return from_mem<_SizeType, true>(state, addr);
+			else if constexpr (_Segment == StaticSegment)
+				return from_mem<_SizeType, false>(state, addr);
+			else if constexpr (_Segment == RegisterSegment)
+				return *rcast(_SizeType*, (state.regs->by_index[bits<0, 4>(regs)].addr_stack_offset + addr));
+			else return *rcast(_SizeType*, (addr != 0 ? addr : scast(std::uintptr_t, -1)));
+		}
+
 		template<typename _DestType, typename _SrcType>
 		forceinline void raw_cast_to(void* dst, _SrcType value)
 		{
@@ -315,25 +631,63 @@ namespace kram::runtime
 			}
 		}
 
+		template<UInt8 _Type> struct cast_type { typedef void type; };
+		template<> struct cast_type<0> { typedef UInt8 type; };
+		template<> struct cast_type<1> { typedef UInt16 type; };
+		template<> struct cast_type<2> { typedef UInt32 type; };
+		template<> struct cast_type<3> { typedef UInt64 type; };
+		template<> struct cast_type<4> { typedef Int8 type; };
+		template<> struct cast_type<5> { typedef Int16 type; };
+		template<> struct cast_type<6> { typedef Int32 type; };
+		template<> struct cast_type<7> { typedef Int64 type; };
+		template<> struct cast_type<8> { typedef float type; };
+		template<> struct cast_type<9> { typedef double type; };
+
+		typedef void (*CastFunction)(void* dst, void* src);
+
+		/* <dest_type:4|src_type:4> */
+		template<UInt8 _Types>
+		void cast_pair(void* dst, void* src)
+		{
+			using _DestType = typename cast_type<(_Types & 0xF)>::type;
+			using _SrcType = typename cast_type<(_Types >> 4)>::type;
+
+			if constexpr (!std::is_void_v<_DestType> && !std::is_void_v<_SrcType>)
+				raw_cast_to<_DestType>(dst, *rcast(_SrcType*, src));
+		}
+
+		template<std::size_t... _Types>
+		constexpr std::array<CastFunction, sizeof...(_Types)> make_cast_table(std::index_sequence<_Types...>)
+		{
+			return { &cast_pair<scast(UInt8, _Types)>... };
+		}
+
+		static constexpr std::array<CastFunction, 256> cast_table = make_cast_table(std::make_index_sequence<256>());
+
+		forceinline bool valid_cast_types(UInt8 types)
+		{
+			return bits<0, 4>(types) <= 9 && bits<4, 4>(types) <= 9;
+		}
+
 
 
 		template<std::unsigned_integral _SizeType>
-		forceinline void mov_r_r(RuntimeState& state)
+		forceinline void mov_r_r(LocalState& state)
 		{
 			UInt8 regs = pop_arg<UInt8>(state);
 
 			if constexpr (sizeof(_SizeType) == 1)
-				state.regs.by_index[bits<0, 4>(regs)].u8 = state.regs.by_index[bits<4, 4>(regs)].u8;
+				state.regs->by_index[bits<0, 4>(regs)].u8 = state.regs->by_index[bits<4, 4>(regs)].u8;
 			else if constexpr (sizeof(_SizeType) == 2)
-				state.regs.by_index[bits<0, 4>(regs)].u16 = state.regs.by_index[bits<4, 4>(regs)].u16;
+				state.regs->by_index[bits<0, 4>(regs)].u16 = state.regs->by_index[bits<4, 4>(regs)].u16;
 			else if constexpr (sizeof(_SizeType) == 4)
-				state.regs.by_index[bits<0, 4>(regs)].u32 = state.regs.by_index[bits<4, 4>(regs)].u32;
+				state.regs->by_index[bits<0, 4>(regs)].u32 = state.regs->by_index[bits<4, 4>(regs)].u32;
 			else
-				state.regs.by_index[bits<0, 4>(regs)].u64 = state.regs.by_index[bits<4, 4>(regs)].u64;
+				state.regs->by_index[bits<0, 4>(regs)].u64 = state.regs->by_index[bits<4, 4>(regs)].u64;
 		}
 
 		template<std::unsigned_integral _SizeType, bool _Swap>
-		forceinline void mov_rm_rm(RuntimeState& state)
+		forceinline void mov_rm_rm(LocalState& state)
 		{
 			UInt8 regidx = pop_arg_bits<0, 4>(state);
 			_SizeType& loc = pop_memloc<_SizeType>(state);
@@ -343,43 +697,54 @@ namespace kram::runtime
 			else reg<_SizeType>(state, regidx) = loc;
 		}
 
+		template<std::unsigned_integral _SizeType, bool _Swap, UInt8 _Segment, bool _HasSplit, UInt8 _SplitScale, int _DeltaSize>
+		forceinline void mov_rm_fixed(LocalState& state)
+		{
+			UInt8 regidx = pop_arg_bits<0, 4>(state);
+			_SizeType& loc = pop_fixed_memloc<_SizeType, _Segment, _HasSplit, _SplitScale, _DeltaSize>(state);
+
+			if constexpr (_Swap)
+				loc = reg<_SizeType>(state, regidx);
+			else reg<_SizeType>(state, regidx) = loc;
+		}
+
 		template<std::unsigned_integral _SizeType>
-		forceinline void mov_r_imm(RuntimeState& state)
+		forceinline void mov_r_imm(LocalState& state)
 		{
 			UInt8 reg = pop_arg_bits<0, 4>(state);
 
 			if constexpr (sizeof(_SizeType) == 1)
-				state.regs.by_index[reg].u8 = pop_arg<UInt8>(state);
+				state.regs->by_index[reg].u8 = pop_arg<UInt8>(state);
 			else if constexpr (sizeof(_SizeType) == 2)
-				state.regs.by_index[reg].u16 = pop_arg<UInt16>(state);
+				state.regs->by_index[reg].u16 = pop_arg<UInt16>(state);
 			else if constexpr (sizeof(_SizeType) == 4)
-				state.regs.by_index[reg].u32 = pop_arg<UInt32>(state);
+				state.regs->by_index[reg].u32 = pop_arg<UInt32>(state);
 			else
-				state.regs.by_index[reg].u64 = pop_arg<UInt64>(state);
+				state.regs->by_index[reg].u64 = pop_arg<UInt64>(state);
 		}
 
 		template<std::unsigned_integral _SizeType>
-		forceinline void mov_m_imm(RuntimeState& state)
+		forceinline void mov_m_imm(LocalState& state)
 		{
 			_SizeType imm = pop_arg<_SizeType>(state);
 			pop_memloc<_SizeType>(state) = imm;
 		}
 
-		forceinline void lea(RuntimeState& state)
+		forceinline void lea(LocalState& state)
 		{
 			UInt8 reg = pop_arg_bits<0, 4>(state);
-			state.regs.by_index[reg].addr = &pop_memloc<void*>(state);
+			state.regs->by_index[reg].addr = &pop_memloc<void*>(state);
 		}
 
 		template<std::unsigned_integral _SizeType>
-		forceinline void mmb(RuntimeState& state)
+		forceinline void mmb(LocalState& state)
 		{
 			UInt8 regs = pop_arg<UInt8>(state);
 			Size size = static_cast<Size>(pop_arg<_SizeType>(state));
-			std::memcpy(state.regs.by_index[bits<0, 4>(regs)].addr, state.regs.by_index[bits<4, 4>(regs)].addr, size);
+			bulk::copy(state.regs->by_index[bits<0, 4>(regs)].addr, state.regs->by_index[bits<4, 4>(regs)].addr, size);
 		}
 
-		forceinline void new_r_s(RuntimeState& state)
+		forceinline void new_r_s(LocalState& state)
 		{
 			UInt8 pars = pop_arg<UInt8>(state);
 			Size size;
@@ -393,10 +758,10 @@ namespace kram::runtime
 				default: return;
 			}
 
-			state.regs.by_index[bits<0, 4>(pars)].addr = state.heap->malloc(size, test<6>(pars));
+			state.regs->by_index[bits<0, 4>(pars)].addr = state.heap->malloc(size, test<6>(pars));
 		}
 
-		forceinline void new_m_s(RuntimeState& state)
+		forceinline void new_m_s(LocalState& state)
 		{
 			UInt8 pars = pop_arg<UInt8>(state);
 			Size size;
@@ -412,208 +777,2560 @@ namespace kram::runtime
 			pop_memloc<void*>(state) = state.heap->malloc(size, test<2>(pars));
 		}
 
-		forceinline void del_r(RuntimeState& state)
+		forceinline void del_r(LocalState& state)
 		{
-			state.heap->free(state.regs.by_index[pop_arg_bits<0, 4>(state)].addr);
+			state.heap->free(state.regs->by_index[pop_arg_bits<0, 4>(state)].addr);
 		}
 
-		forceinline void del_m(RuntimeState& state)
+		forceinline void del_m(LocalState& state)
 		{
 			state.heap->free(pop_memloc<void*>(state));
 		}
 
-		forceinline void mhr_r(RuntimeState& state)
+		forceinline void mhr_r(LocalState& state)
 		{
 			UInt8 pars = pop_arg<UInt8>(state);
 			if (test<4>(pars))
-				state.heap->increase_ref(state.regs.by_index[bits<0, 4>(pars)].addr);
-			else state.heap->decrease_ref(state.regs.by_index[bits<0, 4>(pars)].addr);
+				state.heap->add_ref(state.regs->by_index[bits<0, 4>(pars)].addr);
+			else state.heap->remove_ref(state.regs->by_index[bits<0, 4>(pars)].addr);
 		}
 
-		forceinline void mhr_m(RuntimeState& state)
+		forceinline void mhr_m(LocalState& state)
 		{
 			if (pop_arg_bits<0, 1>(state))
-				state.heap->increase_ref(pop_memloc<void*>(state));
-			else state.heap->decrease_ref(pop_memloc<void*>(state));
+				state.heap->add_ref(pop_memloc<void*>(state));
+			else state.heap->remove_ref(pop_memloc<void*>(state));
 		}
 
-		forceinline void cst_r(RuntimeState& state)
+		forceinline void cst_r(LocalState& state)
 		{
-			void* reg = &state.regs.by_index[pop_arg_bits<0, 4>(state)]._value;
+			void* reg = &state.regs->by_index[pop_arg_bits<0, 4>(state)]._value;
 			UInt8 types = pop_arg<UInt8>(state);
 
 			cast_from_to(bits<0, 4>(types), reg, bits<4, 4>(types), reg);
 		}
 
-		forceinline void cst_m(RuntimeState& state)
+		forceinline void cst_m(LocalState& state)
 		{
 			UInt8 types = pop_arg<UInt8>(state);
-			void* ptr = pop_memloc<void*>(state);
+			void* ptr = &pop_memloc<void*>(state);
 
 			cast_from_to(bits<0, 4>(types), ptr, bits<4, 4>(types), ptr);
 		}
-	}
 
-	void execute(KramState* kstate, bin::Chunk* chunk, FunctionOffset function)
-	{
-		RuntimeState state{ &kstate->_rstack, kstate };
-		init_runtime(&state, chunk, function);
 
-		int x = ru::pop_arg<char>(state);
+		forceinline void quicken(LocalState& state, op::Opcode opcode)
+		{
+			*(state.ip.addr_opcode - 1) = opcode;
+		}
 
-	instruction_begin:
-		switch (*(state.regs.ip.addr_opcode++))
+		/* Called from a generic MOV_*_m* / MOV_m*_* handler before its operands are popped. */
+		template<op::Opcode _QuickReg, op::Opcode _QuickRegD8>
+		forceinline void quicken_mov(LocalState& state)
 		{
-			do_opcode(op::Opcode::NOP)
-			end_opcode();
+			UInt8 pars = get_arg<UInt8, 1>(state);
+			if (bits<0, 2>(pars) != RegisterSegment || test<2>(pars))
+				return;
+
+			if (!test<5>(pars))
+				quicken(state, _QuickReg);
+			else if (bits<6, 2>(pars) == 0)
+				quicken(state, _QuickRegD8);
+		}
 
+		/* Generic <segment|has_reg2|...> location whose shape is already known: the byte is skipped unread. */
+		template<std::unsigned_integral _SizeType, bool _Swap, UInt8 _Segment, bool _HasSplit, UInt8 _SplitScale, int _DeltaSize>
+		forceinline void mov_rm_quick(LocalState& state)
+		{
+			UInt8 regidx = pop_arg_bits<0, 4>(state);
+			move_ip(1);
+			_SizeType& loc = pop_fixed_memloc<_SizeType, _Segment, _HasSplit, _SplitScale, _DeltaSize>(state);
 
-			do_opcode(op::Opcode::MOV_r8_r8)
-				ru::mov_r_r<UInt8>(state);
-			end_opcode();
+			if constexpr (_Swap)
+				loc = reg<_SizeType>(state, regidx);
+			else reg<_SizeType>(state, regidx) = loc;
+		}
 
-			do_opcode(op::Opcode::MOV_r16_r16)
-				ru::mov_r_r<UInt16>(state);
-			end_opcode();
+		forceinline void cst_r_quicken(LocalState& state)
+		{
+			if (valid_cast_types(get_arg<UInt8, 1>(state)))
+				quicken(state, op::Opcode::CST_r_q);
+			cst_r(state);
+		}
 
-			do_opcode(op::Opcode::MOV_r32_r32)
-				ru::mov_r_r<UInt32>(state);
-			end_opcode();
+		forceinline void cst_m_quicken(LocalState& state)
+		{
+			if (valid_cast_types(get_arg<UInt8, 0>(state)))
+				quicken(state, op::Opcode::CST_m_q);
+			cst_m(state);
+		}
 
-			do_opcode(op::Opcode::MOV_r64_r64)
-				ru::mov_r_r<UInt64>(state);
-			end_opcode();
+		forceinline void cst_r_q(LocalState& state)
+		{
+			void* reg = &state.regs->by_index[pop_arg_bits<0, 4>(state)]._value;
+			cast_table[pop_arg<UInt8>(state)](reg, reg);
+		}
 
+		forceinline void cst_m_q(LocalState& state)
+		{
+			UInt8 types = pop_arg<UInt8>(state);
+			void* ptr = &pop_memloc<void*>(state);
+			cast_table[types](ptr, ptr);
+		}
 
-			do_opcode(op::Opcode::MOV_r8_m8)
-				ru::mov_rm_rm<UInt8, false>(state);
-			end_opcode();
 
-			do_opcode(op::Opcode::MOV_r16_m16)
-				ru::mov_rm_rm<UInt16, false>(state);
-			end_opcode();
+		/* Counts TierLookupInterval calls into the JIT at once. Traces are only ever run by
+		 * execute(): they are specialized to the frame and statics of the frame it entered.
+		 */
+		static void find_native(LocalState& state, const Chunk* chunk, FunctionOffset function, const CallTarget& target)
+		{
+			target.countdown = TierLookupInterval;
+			if (KramState* owner = state.runtime.owner)
+			{
+				target.native = owner->aot().find(chunk, function);
+				if (!target.native)
+					target.native = owner->jit().promote(chunk, function, TierLookupInterval);
+			}
+		}
 
-			do_opcode(op::Opcode::MOV_r32_m32)
-				ru::mov_rm_rm<UInt32, false>(state);
-			end_opcode();
+		/* Same-chunk calls reuse the targets of the running chunk; only cross-chunk
+		 * calls look the callee up in the CodeCache. The callee runs on native code
+		 * once the JIT or an AOT library has it, up to the offset that code returns.
+		 */
+		template<bool _Tail>
+		forceinline void call_function(LocalState& state, UInt8 connection, FunctionOffset function)
+		{
+			Chunk* chunk = state.regs->ch.addr_chunk;
+			const CallTarget* targets = state.targets;
+			if (connection != op::SelfConnection)
+			{
+				chunk = chunk->connections[connection];
+				targets = state.runtime.code->targets(chunk);
+			}
 
-			do_opcode(op::Opcode::MOV_r64_m64)
-				ru::mov_rm_rm<UInt64, false>(state);
-			end_opcode();
+			if constexpr (_Tail)
+				tail_call(state, chunk, targets, function);
+			else call_chunk(state, chunk, targets, function);
 
+			const CallTarget& target = targets[function];
+			if (!target.native && --target.countdown == 0)
+				find_native(state, chunk, function, target);
+			if (target.native)
+			{
+				Size resume = target.native(state.regs, state.frame, state.statics, state.heap);
+				state.ip.addr_bytes = target.entry - chunk->functions[function].codeOffset + resume;
+			}
+		}
 
-			do_opcode(op::Opcode::MOV_m8_r8)
-				ru::mov_rm_rm<UInt8, true>(state);
-			end_opcode();
+		template<bool _Tail>
+		forceinline void call(LocalState& state)
+		{
+			UInt8 connection = pop_arg<UInt8>(state);
+			call_function<_Tail>(state, connection, pop_arg<UInt16>(state));
+		}
 
-			do_opcode(op::Opcode::MOV_m16_r16)
-				ru::mov_rm_rm<UInt16, true>(state);
-			end_opcode();
+		forceinline void callr(LocalState& state)
+		{
+			UInt64 target = state.regs->by_index[pop_arg_bits<0, 4>(state)].u64;
+			call_function<false>(state, scast(UInt8, target >> 16), scast(UInt16, target));
+		}
 
-			do_opcode(op::Opcode::MOV_m32_r32)
-				ru::mov_rm_rm<UInt32, true>(state);
-			end_opcode();
+		forceinline bool ret(LocalState& state)
+		{
+			return finish_call(state);
+		}
 
-			do_opcode(op::Opcode::MOV_m64_r64)
-				ru::mov_rm_rm<UInt64, true>(state);
-			end_opcode();
 
+		/* Runs "func" with a zero of the unsigned type selected by a 2 bit size field */
+		template<typename _Func>
+		forceinline void sized(UInt8 size, _Func func)
+		{
+			switch (size)
+			{
+				case 0: func(UInt8{}); break;
+				case 1: func(UInt16{}); break;
+				case 2: func(UInt32{}); break;
+				default: func(UInt64{}); break;
+			}
+		}
 
-			do_opcode(op::Opcode::MOV_r8_imm8)
-				ru::mov_r_imm<UInt8>(state);
-			end_opcode();
+		template<std::unsigned_integral _Ty>
+		forceinline UInt8 compare(_Ty left, _Ty right)
+		{
+			using _Signed = std::make_signed_t<_Ty>;
+			return scast(UInt8, (left == right)
+				| ((scast(_Signed, left) < scast(_Signed, right)) << 1)
+				| ((left < right) << 2));
+		}
 
-			do_opcode(op::Opcode::MOV_r16_imm16)
-				ru::mov_r_imm<UInt16>(state);
-			end_opcode();
+		template<std::unsigned_integral _Ty>
+		forceinline UInt8 test_bits(_Ty left, _Ty right)
+		{
+			_Ty result = left & right;
+			return scast(UInt8, (result == 0) | ((scast(std::make_signed_t<_Ty>, result) < 0) << 1));
+		}
 
-			do_opcode(op::Opcode::MOV_r32_imm32)
-				ru::mov_r_imm<UInt32>(state);
-			end_opcode();
+		forceinline void cmp_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			sized(pop_arg_bits<0, 2>(state), [&]<typename _Ty>(_Ty) {
+				state.flags = compare(reg<_Ty>(state, bits<0, 4>(regs)), reg<_Ty>(state, bits<4, 4>(regs)));
+			});
+		}
 
-			do_opcode(op::Opcode::MOV_r64_imm64)
-				ru::mov_r_imm<UInt64>(state);
-			end_opcode();
+		forceinline void cmp_r_imm(LocalState& state)
+		{
+			UInt8 pars = pop_arg<UInt8>(state);
+			sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+				state.flags = compare(reg<_Ty>(state, bits<0, 4>(pars)), pop_arg<_Ty>(state));
+			});
+		}
 
+		forceinline void cmp_r_m(LocalState& state)
+		{
+			UInt8 pars = pop_arg<UInt8>(state);
+			sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+				state.flags = compare(reg<_Ty>(state, bits<0, 4>(pars)), pop_memloc<_Ty>(state));
+			});
+		}
 
-			do_opcode(op::Opcode::MOV_m8_imm8)
-				ru::mov_m_imm<UInt8>(state);
-			end_opcode();
+		forceinline void test_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			sized(pop_arg_bits<0, 2>(state), [&]<typename _Ty>(_Ty) {
+				state.flags = test_bits(reg<_Ty>(state, bits<0, 4>(regs)), reg<_Ty>(state, bits<4, 4>(regs)));
+			});
+		}
 
-			do_opcode(op::Opcode::MOV_m16_imm16)
-				ru::mov_m_imm<UInt16>(state);
-			end_opcode();
+		forceinline void test_r_imm(LocalState& state)
+		{
+			UInt8 pars = pop_arg<UInt8>(state);
+			sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+				state.flags = test_bits(reg<_Ty>(state, bits<0, 4>(pars)), pop_arg<_Ty>(state));
+			});
+		}
 
-			do_opcode(op::Opcode::MOV_m32_imm32)
-				ru::mov_m_imm<UInt32>(state);
-			end_opcode();
+		/* Backward branches are safepoints like calls, so loops without calls still collect.
+		 * Branches return whether they went backward.
+		 */
+		template<std::signed_integral _OffsetType>
+		forceinline bool branch(LocalState& state, _OffsetType offset)
+		{
+			if (offset < 0)
+				gc_safepoint();
+			move_ip(offset);
+			return offset < 0;
+		}
 
-			do_opcode(op::Opcode::MOV_m64_imm64)
-				ru::mov_m_imm<UInt64>(state);
-			end_opcode();
+		/* Offsets count from the end of the instruction, so they are popped last */
+		template<std::signed_integral _OffsetType>
+		forceinline bool jmp(LocalState& state)
+		{
+			_OffsetType offset = pop_arg<_OffsetType>(state);
+			return branch(state, offset);
+		}
 
+		template<std::signed_integral _OffsetType>
+		forceinline bool jcc(LocalState& state)
+		{
+			UInt8 condition = pop_arg_bits<0, 4>(state);
+			_OffsetType offset = pop_arg<_OffsetType>(state);
+			return op::condition_holds(condition, state.flags) && branch(state, offset);
+		}
 
-			do_opcode(op::Opcode::LEA)
-				ru::lea(state);
-			end_opcode();
+		template<std::signed_integral _OffsetType, bool _Memory>
+		forceinline bool cmpj(LocalState& state)
+		{
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 condition = pop_arg_bits<0, 4>(state);
+			sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+				if constexpr (_Memory)
+					state.flags = compare(reg<_Ty>(state, bits<0, 4>(pars)), pop_memloc<_Ty>(state));
+				else state.flags = compare(reg<_Ty>(state, bits<0, 4>(pars)), pop_arg<_Ty>(state));
+			});
+
+			_OffsetType offset = pop_arg<_OffsetType>(state);
+			return op::condition_holds(condition, state.flags) && branch(state, offset);
+		}
 
+		template<std::signed_integral _OffsetType>
+		forceinline bool loop(LocalState& state)
+		{
+			UInt8 counter = pop_arg_bits<0, 4>(state);
+			_OffsetType offset = pop_arg<_OffsetType>(state);
+			return --state.regs->by_index[counter].u64 && branch(state, offset);
+		}
 
-			do_opcode(op::Opcode::MMB_sb)
-				ru::mmb<UInt8>(state);
-			end_opcode();
+		forceinline void switch_(LocalState& state)
+		{
+			UInt64 index = state.regs->by_index[pop_arg_bits<0, 4>(state)].u64;
+			UInt16 count = pop_arg<UInt16>(state);
+			Int32 offset = pop_arg<Int32>(state);
+			if (index < count)
+				std::memcpy(&offset, state.ip.addr_bytes + index * sizeof(Int32), sizeof(Int32));
+			move_ip(scast(std::ptrdiff_t, count) * sizeof(Int32) + offset);
+		}
 
-			do_opcode(op::Opcode::MMB_sw)
-				ru::mmb<UInt16>(state);
-			end_opcode();
 
-			do_opcode(op::Opcode::MMB_sd)
-				ru::mmb<UInt32>(state);
-			end_opcode();
+		enum class Arithmetic { Add, Sub, Mul, Div, Rem, And, Or, Xor, Shl, Shr };
 
-			do_opcode(op::Opcode::MMB_sq)
-				ru::mmb<UInt64>(state);
-			end_opcode();
+		/* Integer promotion would turn narrow operands into int, where overflow is undefined */
+		template<Arithmetic _Op, std::integral _Ty>
+		forceinline _Ty arithmetic(_Ty left, _Ty right)
+		{
+			using _Unsigned = std::make_unsigned_t<_Ty>;
+			using _Wide = std::conditional_t<(sizeof(_Ty) < sizeof(unsigned int)), unsigned int, _Unsigned>;
+			constexpr _Ty Min = std::numeric_limits<_Ty>::min();
+
+			if constexpr (_Op == Arithmetic::Add)
+				return scast(_Ty, scast(_Wide, left) + scast(_Wide, right));
+			else if constexpr (_Op == Arithmetic::Sub)
+				return scast(_Ty, scast(_Wide, left) - scast(_Wide, right));
+			else if constexpr (_Op == Arithmetic::Mul)
+				return scast(_Ty, scast(_Wide, left) * scast(_Wide, right));
+			else if constexpr (_Op == Arithmetic::Div)
+			{
+				if (right == 0)
+					return scast(_Ty, -1);
+				if constexpr (std::signed_integral<_Ty>)
+					if (left == Min && right == -1)
+						return Min;
+				return scast(_Ty, left / right);
+			}
+			else if constexpr (_Op == Arithmetic::Rem)
+			{
+				if (right == 0)
+					return left;
+				if constexpr (std::signed_integral<_Ty>)
+					if (left == Min && right == -1)
+						return 0;
+				return scast(_Ty, left % right);
+			}
+			else if constexpr (_Op == Arithmetic::And)
+				return scast(_Ty, left & right);
+			else if constexpr (_Op == Arithmetic::Or)
+				return scast(_Ty, left | right);
+			else if constexpr (_Op == Arithmetic::Xor)
+				return scast(_Ty, left ^ right);
+			else if constexpr (_Op == Arithmetic::Shl)
+				return scast(_Ty, scast(_Wide, left) << (right & (sizeof(_Ty) * 8 - 1)));
+			else
+				return scast(_Ty, left >> (right & (sizeof(_Ty) * 8 - 1)));
+		}
 
+		template<Arithmetic _Op>
+		constexpr bool SignedArithmetic = _Op == Arithmetic::Div || _Op == Arithmetic::Rem || _Op == Arithmetic::Shr;
 
-			do_opcode(op::Opcode::NEW_r_s)
-				ru::new_r_s(state);
-			end_opcode();
+		/* The "signed" bit only instantiates a second body where the result differs */
+		template<Arithmetic _Op, std::unsigned_integral _Ty>
+		forceinline void store_arithmetic(LocalState& state, UInt8 dest, bool is_signed, _Ty left, _Ty right)
+		{
+			using _Signed = std::make_signed_t<_Ty>;
 
+			if constexpr (SignedArithmetic<_Op>)
+			{
+				if (is_signed)
+				{
+					reg<_Signed>(state, dest) = arithmetic<_Op>(scast(_Signed, left), scast(_Signed, right));
+					return;
+				}
+			}
+			reg<_Ty>(state, dest) = arithmetic<_Op>(left, right);
+		}
 
-			do_opcode(op::Opcode::NEW_m_s)
-				ru::new_m_s(state);
-			end_opcode();
+		template<Arithmetic _Op>
+		forceinline void arithmetic_r_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+				store_arithmetic<_Op>(state, bits<0, 4>(regs), test<6>(pars), reg<_Ty>(state, bits<4, 4>(regs)), reg<_Ty>(state, bits<0, 4>(pars)));
+			});
+		}
 
+		template<Arithmetic _Op>
+		forceinline void arithmetic_r_r_m(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			sized(bits<0, 2>(pars), [&]<typename _Ty>(_Ty) {
+				store_arithmetic<_Op>(state, bits<0, 4>(regs), test<2>(pars), reg<_Ty>(state, bits<4, 4>(regs)), pop_memloc<_Ty>(state));
+			});
+		}
 
-			do_opcode(op::Opcode::DEL_r)
-				ru::del_r(state);
+		template<Arithmetic _Op, std::floating_point _Ty>
+		forceinline _Ty float_arithmetic(_Ty left, _Ty right)
+		{
+			if constexpr (_Op == Arithmetic::Add)
+				return left + right;
+			else if constexpr (_Op == Arithmetic::Sub)
+				return left - right;
+			else if constexpr (_Op == Arithmetic::Mul)
+				return left * right;
+			else
+				return left / right;
+		}
+
+		/* Runs "func" with a zero of float or double */
+		template<typename _Func>
+		forceinline void float_sized(bool is_double, _Func func)
+		{
+			if (is_double)
+				func(double{});
+			else func(float{});
+		}
+
+		template<Arithmetic _Op>
+		forceinline void float_r_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			float_sized(test<4>(pars), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(regs)) = float_arithmetic<_Op>(reg<_Ty>(state, bits<4, 4>(regs)), reg<_Ty>(state, bits<0, 4>(pars)));
+			});
+		}
+
+		template<Arithmetic _Op>
+		forceinline void float_r_r_m(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			float_sized(test<0>(pars), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(regs)) = float_arithmetic<_Op>(reg<_Ty>(state, bits<4, 4>(regs)), pop_memloc<_Ty>(state));
+			});
+		}
+
+		forceinline void fsqrt_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			float_sized(pop_arg_bits<0, 1>(state), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(regs)) = std::sqrt(reg<_Ty>(state, bits<4, 4>(regs)));
+			});
+		}
+
+		forceinline void fsqrt_r_m(LocalState& state)
+		{
+			UInt8 pars = pop_arg<UInt8>(state);
+			float_sized(test<4>(pars), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(pars)) = std::sqrt(pop_memloc<_Ty>(state));
+			});
+		}
+
+		forceinline void ffma_r_r_r_r(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			float_sized(pop_arg_bits<0, 1>(state), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(regs)) = std::fma(reg<_Ty>(state, bits<4, 4>(regs)), reg<_Ty>(state, bits<0, 4>(sources)), reg<_Ty>(state, bits<4, 4>(sources)));
+			});
+		}
+
+		forceinline void ffma_r_r_r_m(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			float_sized(test<4>(pars), [&]<typename _Ty>(_Ty) {
+				reg<_Ty>(state, bits<0, 4>(regs)) = std::fma(reg<_Ty>(state, bits<4, 4>(regs)), reg<_Ty>(state, bits<0, 4>(pars)), pop_memloc<_Ty>(state));
+			});
+		}
+
+
+		/* Vector opcodes share <dest|src1>, <src2|count>, <type|extra> */
+		struct VectorOperands
+		{
+			void* dest;
+			const void* left;
+			const void* right;
+			Size count;
+			simd::ElementType type;
+			UInt8 extra;
+		};
+
+		forceinline VectorOperands pop_vector_operands(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 count = bits<4, 4>(sources);
+			UInt8 type = bits<0, 4>(pars);
+			return {
+				state.regs->by_index[bits<0, 4>(regs)].addr,
+				state.regs->by_index[bits<4, 4>(regs)].addr,
+				state.regs->by_index[bits<0, 4>(sources)].addr,
+				scast(Size, state.regs->by_index[count].u64),
+				scast(simd::ElementType, type),
+				bits<4, 4>(pars)
+			};
+		}
+
+		template<simd::Operation _Op>
+		forceinline void vbinary(LocalState& state)
+		{
+			VectorOperands v = pop_vector_operands(state);
+			simd::binary(_Op, v.type, v.dest, v.left, v.right, v.count);
+		}
+
+		forceinline void vfma(LocalState& state)
+		{
+			VectorOperands v = pop_vector_operands(state);
+			simd::fma(v.type, v.dest, v.left, v.right, v.count);
+		}
+
+		forceinline void vcmp(LocalState& state)
+		{
+			VectorOperands v = pop_vector_operands(state);
+			simd::compare(scast(op::Condition, v.extra), v.type, rcast(UInt8*, v.dest), v.left, v.right, v.count);
+		}
+
+		forceinline void vselect(LocalState& state)
+		{
+			VectorOperands v = pop_vector_operands(state);
+			simd::select(v.type, v.dest, rcast(const UInt8*, state.regs->by_index[v.extra].addr), v.left, v.right, v.count);
+		}
+
+		/* <dest_reg:4|src_reg:4>, <count_reg:4|type:4> */
+		template<simd::Reduction _Reduction>
+		forceinline void vreduce(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 type = bits<4, 4>(pars);
+			UInt8 count = bits<0, 4>(pars);
+			state.regs->by_index[bits<0, 4>(regs)].u64 = simd::reduce(_Reduction, scast(simd::ElementType, type),
+				state.regs->by_index[bits<4, 4>(regs)].addr, scast(Size, state.regs->by_index[count].u64));
+		}
+
+		forceinline void vdot(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			UInt8 type = bits<0, 4>(pop_arg<UInt8>(state));
+			UInt8 count = bits<4, 4>(sources);
+			state.regs->by_index[bits<0, 4>(regs)].u64 = simd::dot(scast(simd::ElementType, type), state.regs->by_index[bits<4, 4>(regs)].addr,
+				state.regs->by_index[bits<0, 4>(sources)].addr, scast(Size, state.regs->by_index[count].u64));
+		}
+
+		template<bool _Exclusive>
+		forceinline void vscan(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 type = bits<4, 4>(pars);
+			UInt8 count = bits<0, 4>(pars);
+			simd::scan(_Exclusive, scast(simd::ElementType, type), state.regs->by_index[bits<0, 4>(regs)].addr,
+				state.regs->by_index[bits<4, 4>(regs)].addr, scast(Size, state.regs->by_index[count].u64));
+		}
+
+
+		forceinline void mset(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 count = bits<0, 4>(pars);
+			UInt8 size = bits<4, 2>(pars);
+			bulk::fill(state.regs->by_index[bits<0, 4>(regs)].addr, state.regs->by_index[bits<4, 4>(regs)].u64,
+				Size(1) << size, scast(Size, state.regs->by_index[count].u64));
+		}
+
+		forceinline void mcmp(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			UInt8 size = bits<4, 4>(sources);
+			UInt8 left_reg = bits<4, 4>(regs);
+			UInt8 right_reg = bits<0, 4>(sources);
+			const UInt8* left = rcast(const UInt8*, state.regs->by_index[left_reg].addr);
+			const UInt8* right = rcast(const UInt8*, state.regs->by_index[right_reg].addr);
+			Size bytes = scast(Size, state.regs->by_index[size].u64);
+
+			Size offset = bulk::mismatch(left, right, bytes);
+			state.flags = offset < bytes ? compare(left[offset], right[offset]) : compare(UInt8(0), UInt8(0));
+			state.regs->by_index[bits<0, 4>(regs)].u64 = offset;
+		}
+
+		forceinline void mfind(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			UInt8 pattern_size = bits<0, 4>(pop_arg<UInt8>(state));
+			UInt8 size = bits<0, 4>(sources);
+			state.regs->by_index[bits<0, 4>(regs)].u64 = bulk::find(state.regs->by_index[bits<4, 4>(regs)].addr, scast(Size, state.regs->by_index[size].u64),
+				state.regs->by_index[bits<4, 4>(sources)].addr, scast(Size, state.regs->by_index[pattern_size].u64));
+		}
+
+		forceinline void mfindb(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 sources = pop_arg<UInt8>(state);
+			UInt8 size = bits<0, 4>(sources);
+			UInt8 value = bits<4, 4>(sources);
+			state.regs->by_index[bits<0, 4>(regs)].u64 = bulk::find(state.regs->by_index[bits<4, 4>(regs)].addr,
+				scast(Size, state.regs->by_index[size].u64), state.regs->by_index[value].u8);
+		}
+
+
+		/* GATHER and SCATTER share their encoding; the block register is the destination of
+		 * one and the source of the other.
+		 */
+		template<bool _Scatter>
+		forceinline void gather(LocalState& state)
+		{
+			UInt8 regs = pop_arg<UInt8>(state);
+			UInt8 pars = pop_arg<UInt8>(state);
+			UInt8 count = bits<0, 4>(pars);
+			UInt8 size = bits<4, 2>(pars);
+			UInt8 index_size = bits<6, 2>(pars);
+			void* table = &pop_memloc<std::byte>(state);
+			void* block = state.regs->by_index[bits<0, 4>(regs)].addr;
+			const void* indices = state.regs->by_index[bits<4, 4>(regs)].addr;
+
+			if constexpr (_Scatter)
+				simd::scatter(size, index_size, table, block, indices, scast(Size, state.regs->by_index[count].u64));
+			else simd::gather(size, index_size, block, table, indices, scast(Size, state.regs->by_index[count].u64));
+		}
+
+
+		/* Plain handler of a data opcode, as used by superinstructions. It never
+		 * quickens: inside a fused opcode the byte before ip is not this opcode.
+		 */
+		template<op::Opcode _Opcode>
+		forceinline void handler(LocalState& state)
+		{
+			using op::Opcode;
+
+			if constexpr (_Opcode == Opcode::MOV_r8_r8) mov_r_r<UInt8>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r16_r16) mov_r_r<UInt16>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r32_r32) mov_r_r<UInt32>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r64_r64) mov_r_r<UInt64>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r8_m8) mov_rm_rm<UInt8, false>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r16_m16) mov_rm_rm<UInt16, false>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r32_m32) mov_rm_rm<UInt32, false>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r64_m64) mov_rm_rm<UInt64, false>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m8_r8) mov_rm_rm<UInt8, true>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m16_r16) mov_rm_rm<UInt16, true>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m32_r32) mov_rm_rm<UInt32, true>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m64_r64) mov_rm_rm<UInt64, true>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r8_imm8) mov_r_imm<UInt8>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r16_imm16) mov_r_imm<UInt16>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r32_imm32) mov_r_imm<UInt32>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r64_imm64) mov_r_imm<UInt64>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m8_imm8) mov_m_imm<UInt8>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m16_imm16) mov_m_imm<UInt16>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m32_imm32) mov_m_imm<UInt32>(state);
+			else if constexpr (_Opcode == Opcode::MOV_m64_imm64) mov_m_imm<UInt64>(state);
+			else if constexpr (_Opcode == Opcode::LEA) lea(state);
+			else if constexpr (_Opcode == Opcode::MMB_sb) mmb<UInt8>(state);
+			else if constexpr (_Opcode == Opcode::MMB_sw) mmb<UInt16>(state);
+			else if constexpr (_Opcode == Opcode::MMB_sd) mmb<UInt32>(state);
+			else if constexpr (_Opcode == Opcode::MMB_sq) mmb<UInt64>(state);
+			else if constexpr (_Opcode == Opcode::NEW_r_s) new_r_s(state);
+			else if constexpr (_Opcode == Opcode::NEW_m_s) new_m_s(state);
+			else if constexpr (_Opcode == Opcode::DEL_r) del_r(state);
+			else if constexpr (_Opcode == Opcode::DEL_m) del_m(state);
+			else if constexpr (_Opcode == Opcode::MHR_r) mhr_r(state);
+			else if constexpr (_Opcode == Opcode::MHR_m) mhr_m(state);
+			else if constexpr (_Opcode == Opcode::CST_r) cst_r(state);
+			else if constexpr (_Opcode == Opcode::CST_m) cst_m(state);
+			else if constexpr (_Opcode == Opcode::MOV_r8_stk_d8) mov_rm_fixed<UInt8, false, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r16_stk_d8) mov_rm_fixed<UInt16, false, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r32_stk_d8) mov_rm_fixed<UInt32, false, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r64_stk_d8) mov_rm_fixed<UInt64, false, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_stk_d8_r8) mov_rm_fixed<UInt8, true, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_stk_d8_r16) mov_rm_fixed<UInt16, true, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_stk_d8_r32) mov_rm_fixed<UInt32, true, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_stk_d8_r64) mov_rm_fixed<UInt64, true, StackSegment, false, 0, 0>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r8_reg_idx1) mov_rm_fixed<UInt8, false, RegisterSegment, true, 0, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r16_reg_idx2) mov_rm_fixed<UInt16, false, RegisterSegment, true, 1, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r32_reg_idx4) mov_rm_fixed<UInt32, false, RegisterSegment, true, 2, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_r64_reg_idx8) mov_rm_fixed<UInt64, false, RegisterSegment, true, 3, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_reg_idx1_r8) mov_rm_fixed<UInt8, true, RegisterSegment, true, 0, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_reg_idx2_r16) mov_rm_fixed<UInt16, true, RegisterSegment, true, 1, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_reg_idx4_r32) mov_rm_fixed<UInt32, true, RegisterSegment, true, 2, NoDelta>(state);
+			else if constexpr (_Opcode == Opcode::MOV_reg_idx8_r64) mov_rm_fixed<UInt64, true, RegisterSegment, true, 3, NoDelta>(state);
+			else static_assert(_Opcode == Opcode::NOP, "opcode cannot be part of a superinstruction");
+		}
+
+		template<op::Opcode... _Opcodes>
+		forceinline void fused(LocalState& state)
+		{
+			(handler<_Opcodes>(state), ...);
+		}
+
+		/* Arithmetic opcodes come in Arithmetic order from "_First", r_r_r before r_r_m */
+		template<op::Opcode _First>
+		constexpr Arithmetic arithmetic_of(op::Opcode opcode)
+		{
+			return scast(Arithmetic, (scast(Size, opcode) - scast(Size, _First)) / 2);
+		}
+
+		template<op::Opcode _First>
+		constexpr bool register_form(op::Opcode opcode)
+		{
+			return (scast(Size, opcode) - scast(Size, _First)) % 2 == 0;
+		}
+
+		/* Data opcode over a decoded record, shared by execute_decoded() and the closure tier */
+		template<op::Opcode _Opcode>
+		forceinline void decoded(LocalState& state, const DecodedInstruction& inst)
+		{
+			using op::Opcode;
+
+			if constexpr (_Opcode == Opcode::NOP) {}
+			else if constexpr (_Opcode == Opcode::MOV_r8_r8)
+				reg<UInt8>(state, inst.reg) = reg<UInt8>(state, inst.aux);
+			else if constexpr (_Opcode == Opcode::MOV_r16_r16)
+				reg<UInt16>(state, inst.reg) = reg<UInt16>(state, inst.aux);
+			else if constexpr (_Opcode == Opcode::MOV_r32_r32)
+				reg<UInt32>(state, inst.reg) = reg<UInt32>(state, inst.aux);
+			else if constexpr (_Opcode == Opcode::MOV_r64_r64)
+				reg<UInt64>(state, inst.reg) = reg<UInt64>(state, inst.aux);
+			else if constexpr (_Opcode == Opcode::MOV_r8_m8)
+				reg<UInt8>(state, inst.reg) = decoded_memloc<UInt8>(state, inst);
+			else if constexpr (_Opcode == Opcode::MOV_r16_m16)
+				reg<UInt16>(state, inst.reg) = decoded_memloc<UInt16>(state, inst);
+			else if constexpr (_Opcode == Opcode::MOV_r32_m32)
+				reg<UInt32>(state, inst.reg) = decoded_memloc<UInt32>(state, inst);
+			else if constexpr (_Opcode == Opcode::MOV_r64_m64)
+				reg<UInt64>(state, inst.reg) = decoded_memloc<UInt64>(state, inst);
+			else if constexpr (_Opcode == Opcode::MOV_m8_r8)
+				decoded_memloc<UInt8>(state, inst) = reg<UInt8>(state, inst.reg);
+			else if constexpr (_Opcode == Opcode::MOV_m16_r16)
+				decoded_memloc<UInt16>(state, inst) = reg<UInt16>(state, inst.reg);
+			else if constexpr (_Opcode == Opcode::MOV_m32_r32)
+				decoded_memloc<UInt32>(state, inst) = reg<UInt32>(state, inst.reg);
+			else if constexpr (_Opcode == Opcode::MOV_m64_r64)
+				decoded_memloc<UInt64>(state, inst) = reg<UInt64>(state, inst.reg);
+			else if constexpr (_Opcode == Opcode::MOV_r8_imm8)
+				reg<UInt8>(state, inst.reg) = scast(UInt8, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_r16_imm16)
+				reg<UInt16>(state, inst.reg) = scast(UInt16, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_r32_imm32)
+				reg<UInt32>(state, inst.reg) = scast(UInt32, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_r64_imm64)
+				reg<UInt64>(state, inst.reg) = scast(UInt64, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_m8_imm8)
+				decoded_memloc<UInt8>(state, inst) = scast(UInt8, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_m16_imm16)
+				decoded_memloc<UInt16>(state, inst) = scast(UInt16, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_m32_imm32)
+				decoded_memloc<UInt32>(state, inst) = scast(UInt32, inst.imm);
+			else if constexpr (_Opcode == Opcode::MOV_m64_imm64)
+				decoded_memloc<UInt64>(state, inst) = scast(UInt64, inst.imm);
+			else if constexpr (_Opcode == Opcode::LEA)
+				state.regs->by_index[inst.reg].addr = &decoded_memloc<void*>(state, inst);
+			else if constexpr (_Opcode == Opcode::MMB_sb)
+				bulk::copy(state.regs->by_index[inst.reg].addr, state.regs->by_index[inst.aux].addr, scast(Size, inst.imm));
+			else if constexpr (_Opcode == Opcode::MMB_sw)
+				bulk::copy(state.regs->by_index[inst.reg].addr, state.regs->by_index[inst.aux].addr, scast(Size, inst.imm));
+			else if constexpr (_Opcode == Opcode::MMB_sd)
+				bulk::copy(state.regs->by_index[inst.reg].addr, state.regs->by_index[inst.aux].addr, scast(Size, inst.imm));
+			else if constexpr (_Opcode == Opcode::MMB_sq)
+				bulk::copy(state.regs->by_index[inst.reg].addr, state.regs->by_index[inst.aux].addr, scast(Size, inst.imm));
+			else if constexpr (_Opcode == Opcode::NEW_r_s)
+				state.regs->by_index[inst.reg].addr = state.heap->malloc(scast(Size, inst.imm), inst.aux);
+			else if constexpr (_Opcode == Opcode::NEW_m_s)
+				decoded_memloc<void*>(state, inst) = state.heap->malloc(scast(Size, inst.imm), inst.aux);
+			else if constexpr (_Opcode == Opcode::DEL_r)
+				state.heap->free(state.regs->by_index[inst.reg].addr);
+			else if constexpr (_Opcode == Opcode::DEL_m)
+				state.heap->free(decoded_memloc<void*>(state, inst));
+			else if constexpr (_Opcode == Opcode::MHR_r)
+			{
+				if (inst.aux)
+					state.heap->add_ref(state.regs->by_index[inst.reg].addr);
+				else state.heap->remove_ref(state.regs->by_index[inst.reg].addr);
+			}
+			else if constexpr (_Opcode == Opcode::MHR_m)
+			{
+				if (inst.aux)
+					state.heap->add_ref(decoded_memloc<void*>(state, inst));
+				else state.heap->remove_ref(decoded_memloc<void*>(state, inst));
+			}
+			else if constexpr (_Opcode == Opcode::CST_r)
+			{
+				void* reg = &state.regs->by_index[inst.reg]._value;
+				cast_from_to(bits<0, 4>(inst.aux), reg, bits<4, 4>(inst.aux), reg);
+			}
+			else if constexpr (_Opcode == Opcode::CST_m)
+			{
+				void* ptr = &decoded_memloc<void*>(state, inst);
+				cast_from_to(bits<0, 4>(inst.aux), ptr, bits<4, 4>(inst.aux), ptr);
+			}
+			else if constexpr (_Opcode == Opcode::CMP_r_r)
+				sized(scast(UInt8, inst.imm), [&]<typename _Ty>(_Ty) {
+					state.flags = compare(reg<_Ty>(state, inst.reg), reg<_Ty>(state, inst.aux));
+				});
+			else if constexpr (_Opcode == Opcode::CMP_r_imm)
+				sized(inst.aux, [&]<typename _Ty>(_Ty) {
+					state.flags = compare(reg<_Ty>(state, inst.reg), scast(_Ty, inst.imm));
+				});
+			else if constexpr (_Opcode == Opcode::CMP_r_m)
+				sized(inst.aux, [&]<typename _Ty>(_Ty) {
+					state.flags = compare(reg<_Ty>(state, inst.reg), decoded_memloc<_Ty>(state, inst));
+				});
+			else if constexpr (_Opcode == Opcode::TEST_r_r)
+				sized(scast(UInt8, inst.imm), [&]<typename _Ty>(_Ty) {
+					state.flags = test_bits(reg<_Ty>(state, inst.reg), reg<_Ty>(state, inst.aux));
+				});
+			else if constexpr (_Opcode == Opcode::TEST_r_imm)
+				sized(inst.aux, [&]<typename _Ty>(_Ty) {
+					state.flags = test_bits(reg<_Ty>(state, inst.reg), scast(_Ty, inst.imm));
+				});
+			else if constexpr (_Opcode >= Opcode::ADD_r_r_r && _Opcode <= Opcode::SHR_r_r_m)
+			{
+				constexpr Arithmetic Op = arithmetic_of<Opcode::ADD_r_r_r>(_Opcode);
+				UInt8 pars = scast(UInt8, inst.imm);
+				if constexpr (register_form<Opcode::ADD_r_r_r>(_Opcode))
+					sized(bits<4, 2>(pars), [&]<typename _Ty>(_Ty) {
+						store_arithmetic<Op>(state, inst.reg, test<6>(pars), reg<_Ty>(state, inst.aux), reg<_Ty>(state, bits<0, 4>(pars)));
+					});
+				else sized(bits<0, 2>(pars), [&]<typename _Ty>(_Ty) {
+						store_arithmetic<Op>(state, inst.reg, test<2>(pars), reg<_Ty>(state, inst.aux), decoded_memloc<_Ty>(state, inst));
+					});
+			}
+			else if constexpr (_Opcode >= Opcode::FADD_r_r_r && _Opcode <= Opcode::FDIV_r_r_m)
+			{
+				constexpr Arithmetic Op = arithmetic_of<Opcode::FADD_r_r_r>(_Opcode);
+				UInt8 pars = scast(UInt8, inst.imm);
+				if constexpr (register_form<Opcode::FADD_r_r_r>(_Opcode))
+					float_sized(test<4>(pars), [&]<typename _Ty>(_Ty) {
+						reg<_Ty>(state, inst.reg) = float_arithmetic<Op>(reg<_Ty>(state, inst.aux), reg<_Ty>(state, bits<0, 4>(pars)));
+					});
+				else float_sized(test<0>(pars), [&]<typename _Ty>(_Ty) {
+						reg<_Ty>(state, inst.reg) = float_arithmetic<Op>(reg<_Ty>(state, inst.aux), decoded_memloc<_Ty>(state, inst));
+					});
+			}
+			else if constexpr (_Opcode == Opcode::FSQRT_r_r)
+				float_sized(inst.imm & 1, [&]<typename _Ty>(_Ty) {
+					reg<_Ty>(state, inst.reg) = std::sqrt(reg<_Ty>(state, inst.aux));
+				});
+			else if constexpr (_Opcode == Opcode::FSQRT_r_m)
+				float_sized(inst.imm & 1, [&]<typename _Ty>(_Ty) {
+					reg<_Ty>(state, inst.reg) = std::sqrt(decoded_memloc<_Ty>(state, inst));
+				});
+			else if constexpr (_Opcode == Opcode::FFMA_r_r_r_r)
+			{
+				UInt8 sources = scast(UInt8, inst.imm);
+				float_sized((inst.imm >> 8) & 1, [&]<typename _Ty>(_Ty) {
+					reg<_Ty>(state, inst.reg) = std::fma(reg<_Ty>(state, inst.aux), reg<_Ty>(state, bits<0, 4>(sources)), reg<_Ty>(state, bits<4, 4>(sources)));
+				});
+			}
+			else if constexpr (_Opcode == Opcode::FFMA_r_r_r_m)
+			{
+				UInt8 pars = scast(UInt8, inst.imm);
+				float_sized(test<4>(pars), [&]<typename _Ty>(_Ty) {
+					reg<_Ty>(state, inst.reg) = std::fma(reg<_Ty>(state, inst.aux), reg<_Ty>(state, bits<0, 4>(pars)), decoded_memloc<_Ty>(state, inst));
+				});
+			}
+			else static_assert(_Opcode == Opcode::NOP, "opcode is never decoded");
+		}
+	}
+}
+
+
+
+#if defined(KRAM_THREADED_DISPATCH)
+#define dispatch_decoded() goto *(++inst)->handler
+#define jump_decoded() goto *inst->handler
+#define do_decoded(_Inst) CONCAT_MACROS(decoded_, _Inst) : {
+#else
+#define dispatch_decoded() ++inst; goto decoded_begin
+#define jump_decoded() goto decoded_begin
+#define do_decoded(_Inst) case Opcode::_Inst : {
+#endif
+#define end_decoded() } dispatch_decoded()
+/* Control flow records pick "inst" themselves */
+#define end_decoded_jump() } jump_decoded()
+
+namespace kram::runtime
+{
+	/* Start of the VM's copy of the running chunk's code */
+	static forceinline std::byte* code_base(const LocalState& state)
+	{
+		return state.targets->entry - state.regs->ch.addr_chunk->functions->codeOffset;
+	}
+
+	static bool run_loop_trace(LocalState& state, std::byte* base)
+	{
+		KramState* owner = state.runtime.owner;
+		if (!owner || state.runtime.safepoints)
+			return false;
+
+		Size resume;
+		if (!owner->traces().loop(&state.runtime, state.regs, state.regs->ch.addr_chunk, scast(Size, state.ip.addr_bytes - base), state.flags, resume))
+			return false;
+		state.ip.addr_bytes = base + resume;
+		return true;
+	}
+
+	/* Every TierLookupInterval backward branches, the interpreters look for a trace of the
+	 * loop headed at ip, "base" being the VM's copy of the code. Returns true once a trace
+	 * has run, or been recorded, and moved ip. Loops of a VM that collects at safepoints
+	 * stay in the interpreters: traces have none.
+	 */
+	static forceinline bool loop_trace(LocalState& state, std::byte* base)
+	{
+		if (--state.countdown)
+			return false;
+		state.countdown = TierLookupInterval;
+		return run_loop_trace(state, base);
+	}
+
+	/* Backward branches are safepoints like in the raw interpreter, with ip at their
+	 * target, and go on from wherever a loop trace left ip
+	 */
+	static forceinline const DecodedInstruction* decoded_branch(LocalState& state, const DecodedInstruction* inst, const DecodedCode* decoded, std::byte* base)
+	{
+		const DecodedInstruction* target = inst + scast(std::ptrdiff_t, inst->imm);
+		if (target <= inst)
+		{
+			state.ip.addr_bytes = base + inst->delta;
+			gc_safepoint();
+			if (loop_trace(state, base))
+				target = decoded->code + decoded->indices[scast(Size, state.ip.addr_bytes - base)];
+		}
+		return target;
+	}
+
+	/* Record the stream goes on from after a call or a return, in whichever chunk runs
+	 * now. nullptr when that chunk has no stream or ip starts none of its records.
+	 */
+	static forceinline const DecodedInstruction* resume_decoded(LocalState& state, const DecodedCode*& decoded, std::byte*& base)
+	{
+		const Chunk* chunk = state.regs->ch.addr_chunk;
+		if (chunk->decoded != decoded)
+		{
+			if (!chunk->decoded)
+				return nullptr;
+			decoded = chunk->decoded;
+			base = code_base(state);
+		}
+
+		Size index = decoded->indices[scast(Size, state.ip.addr_bytes - base)];
+		return index == NoRecord ? nullptr : decoded->code + index;
+	}
+
+	/* Runs a stream produced by predecode() from "inst", "base" being the VM's copy of
+	 * the code of the running chunk. Calls and returns carry on in the stream of the
+	 * chunk they reach, so the stream stops only at an end record or at a chunk without
+	 * one. Leaves state.ip where the raw interpreter goes on and returns true, or false
+	 * once the frame execute() entered has returned.
+	 * Called with "table" it only hands out its handler table, so the decoder can store
+	 * label addresses.
+	 */
+	static bool execute_decoded(LocalState* _state, const DecodedInstruction* inst, std::byte* base, const void* const** table = nullptr)
+	{
+#if defined(KRAM_THREADED_DISPATCH)
+		static const void* const handler_table[] = {
+			&&decoded_NOP,
+			&&decoded_MOV_r8_r8,
+			&&decoded_MOV_r16_r16,
+			&&decoded_MOV_r32_r32,
+			&&decoded_MOV_r64_r64,
+			&&decoded_MOV_r8_m8,
+			&&decoded_MOV_r16_m16,
+			&&decoded_MOV_r32_m32,
+			&&decoded_MOV_r64_m64,
+			&&decoded_MOV_m8_r8,
+			&&decoded_MOV_m16_r16,
+			&&decoded_MOV_m32_r32,
+			&&decoded_MOV_m64_r64,
+			&&decoded_MOV_r8_imm8,
+			&&decoded_MOV_r16_imm16,
+			&&decoded_MOV_r32_imm32,
+			&&decoded_MOV_r64_imm64,
+			&&decoded_MOV_m8_imm8,
+			&&decoded_MOV_m16_imm16,
+			&&decoded_MOV_m32_imm32,
+			&&decoded_MOV_m64_imm64,
+			&&decoded_LEA,
+			&&decoded_MMB_sb,
+			&&decoded_MMB_sw,
+			&&decoded_MMB_sd,
+			&&decoded_MMB_sq,
+			&&decoded_NEW_r_s,
+			&&decoded_NEW_m_s,
+			&&decoded_DEL_r,
+			&&decoded_DEL_m,
+			&&decoded_MHR_r,
+			&&decoded_MHR_m,
+			&&decoded_CST_r,
+			&&decoded_CST_m,
+
+			/* Compact MOV forms are decoded into their generic opcode */
+			&&decoded_MOV_r8_m8,
+			&&decoded_MOV_r16_m16,
+			&&decoded_MOV_r32_m32,
+			&&decoded_MOV_r64_m64,
+			&&decoded_MOV_m8_r8,
+			&&decoded_MOV_m16_r16,
+			&&decoded_MOV_m32_r32,
+			&&decoded_MOV_m64_r64,
+			&&decoded_MOV_r8_m8,
+			&&decoded_MOV_r16_m16,
+			&&decoded_MOV_r32_m32,
+			&&decoded_MOV_r64_m64,
+			&&decoded_MOV_m8_r8,
+			&&decoded_MOV_m16_r16,
+			&&decoded_MOV_m32_r32,
+			&&decoded_MOV_m64_r64,
+
+			/* Quickened opcodes are decoded into their generic opcode */
+			&&decoded_MOV_r8_m8,
+			&&decoded_MOV_r16_m16,
+			&&decoded_MOV_r32_m32,
+			&&decoded_MOV_r64_m64,
+			&&decoded_MOV_m8_r8,
+			&&decoded_MOV_m16_r16,
+			&&decoded_MOV_m32_r32,
+			&&decoded_MOV_m64_r64,
+			&&decoded_MOV_r8_m8,
+			&&decoded_MOV_r16_m16,
+			&&decoded_MOV_r32_m32,
+			&&decoded_MOV_r64_m64,
+			&&decoded_MOV_m8_r8,
+			&&decoded_MOV_m16_r16,
+			&&decoded_MOV_m32_r32,
+			&&decoded_MOV_m64_r64,
+			&&decoded_CST_r,
+			&&decoded_CST_m,
+
+			/* Superinstructions are expanded into their components by the decoder */
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+
+			&&decoded_CALL,
+			&&decoded_CALLR,
+			&&decoded_RET,
+			&&decoded_TAILCALL,
+
+			/* Short branch forms and CMPJ are decoded into long forms, SWITCH is interpreted only */
+			&&decoded_CMP_r_r,
+			&&decoded_CMP_r_imm,
+			&&decoded_CMP_r_m,
+			&&decoded_TEST_r_r,
+			&&decoded_TEST_r_imm,
+			&&decoded_end,
+			&&decoded_JMP_s32,
+			&&decoded_end,
+			&&decoded_JCC_s32,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_LOOP_s32,
+			&&decoded_end,
+
+			&&decoded_ADD_r_r_r,
+			&&decoded_ADD_r_r_m,
+			&&decoded_SUB_r_r_r,
+			&&decoded_SUB_r_r_m,
+			&&decoded_MUL_r_r_r,
+			&&decoded_MUL_r_r_m,
+			&&decoded_DIV_r_r_r,
+			&&decoded_DIV_r_r_m,
+			&&decoded_REM_r_r_r,
+			&&decoded_REM_r_r_m,
+			&&decoded_AND_r_r_r,
+			&&decoded_AND_r_r_m,
+			&&decoded_OR_r_r_r,
+			&&decoded_OR_r_r_m,
+			&&decoded_XOR_r_r_r,
+			&&decoded_XOR_r_r_m,
+			&&decoded_SHL_r_r_r,
+			&&decoded_SHL_r_r_m,
+			&&decoded_SHR_r_r_r,
+			&&decoded_SHR_r_r_m,
+			&&decoded_FADD_r_r_r,
+			&&decoded_FADD_r_r_m,
+			&&decoded_FSUB_r_r_r,
+			&&decoded_FSUB_r_r_m,
+			&&decoded_FMUL_r_r_r,
+			&&decoded_FMUL_r_r_m,
+			&&decoded_FDIV_r_r_r,
+			&&decoded_FDIV_r_r_m,
+			&&decoded_FSQRT_r_r,
+			&&decoded_FSQRT_r_m,
+			&&decoded_FFMA_r_r_r_r,
+			&&decoded_FFMA_r_r_r_m,
+
+			/* Vector and bulk memory opcodes call simd:: and bulk:: kernels from the interpreter */
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+			&&decoded_end,
+
+			&&decoded_end
+		};
+		static_assert(std::size(handler_table) == op::OpcodeCount + 1, "decoded handler table out of sync with op::Opcode");
+
+		if (table)
+		{
+			*table = handler_table;
+			return false;
+		}
+
+		LocalState& state = *_state;
+		const DecodedCode* decoded = state.regs->ch.addr_chunk->decoded;
+
+		goto *inst->handler;
+		{
+#else
+		if (table)
+			return false;
+
+		LocalState& state = *_state;
+		const DecodedCode* decoded = state.regs->ch.addr_chunk->decoded;
+
+	decoded_begin:
+		switch (inst->opcode)
+		{
+#endif
+			do_decoded(NOP)
+			end_decoded();
+
+			do_decoded(MOV_r8_r8)
+				ru::decoded<Opcode::MOV_r8_r8>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r16_r16)
+				ru::decoded<Opcode::MOV_r16_r16>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r32_r32)
+				ru::decoded<Opcode::MOV_r32_r32>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r64_r64)
+				ru::decoded<Opcode::MOV_r64_r64>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r8_m8)
+				ru::decoded<Opcode::MOV_r8_m8>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r16_m16)
+				ru::decoded<Opcode::MOV_r16_m16>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r32_m32)
+				ru::decoded<Opcode::MOV_r32_m32>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r64_m64)
+				ru::decoded<Opcode::MOV_r64_m64>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m8_r8)
+				ru::decoded<Opcode::MOV_m8_r8>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m16_r16)
+				ru::decoded<Opcode::MOV_m16_r16>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m32_r32)
+				ru::decoded<Opcode::MOV_m32_r32>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m64_r64)
+				ru::decoded<Opcode::MOV_m64_r64>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r8_imm8)
+				ru::decoded<Opcode::MOV_r8_imm8>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r16_imm16)
+				ru::decoded<Opcode::MOV_r16_imm16>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r32_imm32)
+				ru::decoded<Opcode::MOV_r32_imm32>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_r64_imm64)
+				ru::decoded<Opcode::MOV_r64_imm64>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m8_imm8)
+				ru::decoded<Opcode::MOV_m8_imm8>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m16_imm16)
+				ru::decoded<Opcode::MOV_m16_imm16>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m32_imm32)
+				ru::decoded<Opcode::MOV_m32_imm32>(state, *inst);
+			end_decoded();
+
+			do_decoded(MOV_m64_imm64)
+				ru::decoded<Opcode::MOV_m64_imm64>(state, *inst);
+			end_decoded();
+
+			do_decoded(LEA)
+				ru::decoded<Opcode::LEA>(state, *inst);
+			end_decoded();
+
+			do_decoded(MMB_sb)
+				ru::decoded<Opcode::MMB_sb>(state, *inst);
+			end_decoded();
+
+			do_decoded(MMB_sw)
+				ru::decoded<Opcode::MMB_sw>(state, *inst);
+			end_decoded();
+
+			do_decoded(MMB_sd)
+				ru::decoded<Opcode::MMB_sd>(state, *inst);
+			end_decoded();
+
+			do_decoded(MMB_sq)
+				ru::decoded<Opcode::MMB_sq>(state, *inst);
+			end_decoded();
+
+			do_decoded(NEW_r_s)
+				ru::decoded<Opcode::NEW_r_s>(state, *inst);
+			end_decoded();
+
+			do_decoded(NEW_m_s)
+				ru::decoded<Opcode::NEW_m_s>(state, *inst);
+			end_decoded();
+
+			do_decoded(DEL_r)
+				ru::decoded<Opcode::DEL_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(DEL_m)
+				ru::decoded<Opcode::DEL_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(MHR_r)
+				ru::decoded<Opcode::MHR_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(MHR_m)
+				ru::decoded<Opcode::MHR_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(CST_r)
+				ru::decoded<Opcode::CST_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(CST_m)
+				ru::decoded<Opcode::CST_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(CMP_r_r)
+				ru::decoded<Opcode::CMP_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(CMP_r_imm)
+				ru::decoded<Opcode::CMP_r_imm>(state, *inst);
+			end_decoded();
+
+			do_decoded(CMP_r_m)
+				ru::decoded<Opcode::CMP_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(TEST_r_r)
+				ru::decoded<Opcode::TEST_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(TEST_r_imm)
+				ru::decoded<Opcode::TEST_r_imm>(state, *inst);
+			end_decoded();
+
+			do_decoded(ADD_r_r_r)
+				ru::decoded<Opcode::ADD_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(ADD_r_r_m)
+				ru::decoded<Opcode::ADD_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(SUB_r_r_r)
+				ru::decoded<Opcode::SUB_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(SUB_r_r_m)
+				ru::decoded<Opcode::SUB_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(MUL_r_r_r)
+				ru::decoded<Opcode::MUL_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(MUL_r_r_m)
+				ru::decoded<Opcode::MUL_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(DIV_r_r_r)
+				ru::decoded<Opcode::DIV_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(DIV_r_r_m)
+				ru::decoded<Opcode::DIV_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(REM_r_r_r)
+				ru::decoded<Opcode::REM_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(REM_r_r_m)
+				ru::decoded<Opcode::REM_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(AND_r_r_r)
+				ru::decoded<Opcode::AND_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(AND_r_r_m)
+				ru::decoded<Opcode::AND_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(OR_r_r_r)
+				ru::decoded<Opcode::OR_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(OR_r_r_m)
+				ru::decoded<Opcode::OR_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(XOR_r_r_r)
+				ru::decoded<Opcode::XOR_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(XOR_r_r_m)
+				ru::decoded<Opcode::XOR_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(SHL_r_r_r)
+				ru::decoded<Opcode::SHL_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(SHL_r_r_m)
+				ru::decoded<Opcode::SHL_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(SHR_r_r_r)
+				ru::decoded<Opcode::SHR_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(SHR_r_r_m)
+				ru::decoded<Opcode::SHR_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FADD_r_r_r)
+				ru::decoded<Opcode::FADD_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FADD_r_r_m)
+				ru::decoded<Opcode::FADD_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FSUB_r_r_r)
+				ru::decoded<Opcode::FSUB_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FSUB_r_r_m)
+				ru::decoded<Opcode::FSUB_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FMUL_r_r_r)
+				ru::decoded<Opcode::FMUL_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FMUL_r_r_m)
+				ru::decoded<Opcode::FMUL_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FDIV_r_r_r)
+				ru::decoded<Opcode::FDIV_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FDIV_r_r_m)
+				ru::decoded<Opcode::FDIV_r_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FSQRT_r_r)
+				ru::decoded<Opcode::FSQRT_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FSQRT_r_m)
+				ru::decoded<Opcode::FSQRT_r_m>(state, *inst);
+			end_decoded();
+
+			do_decoded(FFMA_r_r_r_r)
+				ru::decoded<Opcode::FFMA_r_r_r_r>(state, *inst);
+			end_decoded();
+
+			do_decoded(FFMA_r_r_r_m)
+				ru::decoded<Opcode::FFMA_r_r_r_m>(state, *inst);
+			end_decoded();
+
+
+			do_decoded(JMP_s32)
+				inst = decoded_branch(state, inst, decoded, base);
+			end_decoded_jump();
+
+			do_decoded(JCC_s32)
+				inst = op::condition_holds(inst->aux, state.flags) ? decoded_branch(state, inst, decoded, base) : inst + 1;
+			end_decoded_jump();
+
+			do_decoded(LOOP_s32)
+				inst = --state.regs->by_index[inst->reg].u64 ? decoded_branch(state, inst, decoded, base) : inst + 1;
+			end_decoded_jump();
+
+
+			do_decoded(CALL)
+				state.ip.addr_bytes = base + inst->delta;
+				ru::call_function<false>(state, inst->aux, scast(FunctionOffset, inst->imm));
+				gc_safepoint();
+				if (!(inst = resume_decoded(state, decoded, base)))
+					return true;
+			end_decoded_jump();
+
+			do_decoded(CALLR)
+			{
+				UInt64 target = state.regs->by_index[inst->reg].u64;
+				state.ip.addr_bytes = base + inst->delta;
+				ru::call_function<false>(state, scast(UInt8, target >> 16), scast(UInt16, target));
+				gc_safepoint();
+				if (!(inst = resume_decoded(state, decoded, base)))
+					return true;
+			}
+			end_decoded_jump();
+
+			do_decoded(RET)
+				if (!ru::ret(state))
+					return false;
+				if (!(inst = resume_decoded(state, decoded, base)))
+					return true;
+			end_decoded_jump();
+
+			do_decoded(TAILCALL)
+				ru::call_function<true>(state, inst->aux, scast(FunctionOffset, inst->imm));
+				gc_safepoint();
+				if (!(inst = resume_decoded(state, decoded, base)))
+					return true;
+			end_decoded_jump();
+
+#if defined(KRAM_THREADED_DISPATCH)
+		decoded_end:
+#else
+			default:
+#endif
+				/* Past the last instruction there is nothing left to run, whatever the frame */
+				state.ip.addr_bytes = base + inst->imm;
+				return !inst->aux;
+		}
+	}
+
+	const void* _decoded_handler(op::Opcode opcode)
+	{
+		const void* const* table = nullptr;
+		execute_decoded(nullptr, nullptr, nullptr, &table);
+		return table ? table[scast(UInt8, opcode)] : nullptr;
+	}
+
+	UInt8 _execute_step(RuntimeState* _state, Registers* regs, const DecodedInstruction& inst, UInt8 flags)
+	{
+		DecodedInstruction code[2] = { inst, {} };
+		code[1].opcode = DecodedEnd;
+		code[1].handler = _decoded_handler(DecodedEnd);
+
+		LocalState state{ *_state };
+		state.regs = regs;
+		state.load();
+		state.flags = flags;
+		execute_decoded(&state, code, nullptr);
+		return state.flags;
+	}
+
+#if defined(KRAM_MUSTTAIL)
+#define dispatch_closure() KRAM_MUSTTAIL return inst[1].closure(state, inst + 1)
+#define jump_closure() KRAM_MUSTTAIL return inst->closure(state, inst)
+#else
+#define dispatch_closure() return inst + 1
+#define jump_closure() return inst
+#endif
+
+	/* Returned once the frame execute() entered has returned */
+	static const DecodedInstruction closure_returned{};
+
+	template<op::Opcode _Opcode>
+	static const DecodedInstruction* closure_handler(LocalState& state, const DecodedInstruction* inst)
+	{
+		ru::decoded<_Opcode>(state, *inst);
+		dispatch_closure();
+	}
+
+	/* Past the last instruction there is nothing left to run, as in execute_decoded() */
+	static const DecodedInstruction* closure_end(LocalState& state, const DecodedInstruction* inst)
+	{
+		state.ip.addr_bytes = code_base(state) + inst->imm;
+		return inst->aux ? &closure_returned : nullptr;
+	}
+
+	static const DecodedInstruction* closure_jmp(LocalState& state, const DecodedInstruction* inst)
+	{
+		inst = decoded_branch(state, inst, state.targets->closures, code_base(state));
+		jump_closure();
+	}
+
+	static const DecodedInstruction* closure_jcc(LocalState& state, const DecodedInstruction* inst)
+	{
+		inst = op::condition_holds(inst->aux, state.flags) ? decoded_branch(state, inst, state.targets->closures, code_base(state)) : inst + 1;
+		jump_closure();
+	}
+
+	static const DecodedInstruction* closure_loop(LocalState& state, const DecodedInstruction* inst)
+	{
+		inst = --state.regs->by_index[inst->reg].u64 ? decoded_branch(state, inst, state.targets->closures, code_base(state)) : inst + 1;
+		jump_closure();
+	}
+
+	/* Record the closures go on from after a call or a return, see resume_decoded() */
+	static forceinline const DecodedInstruction* resume_closures(LocalState& state)
+	{
+		const DecodedCode* closures = state.targets->closures;
+		if (!closures)
+			return nullptr;
+
+		Size index = closures->indices[scast(Size, state.ip.addr_bytes - code_base(state))];
+		return index == NoRecord ? nullptr : closures->code + index;
+	}
+
+	template<bool _Tail>
+	static const DecodedInstruction* closure_call(LocalState& state, const DecodedInstruction* inst)
+	{
+		state.ip.addr_bytes = code_base(state) + inst->delta;
+		ru::call_function<_Tail>(state, inst->aux, scast(FunctionOffset, inst->imm));
+		gc_safepoint();
+		if (!(inst = resume_closures(state)))
+			return nullptr;
+		jump_closure();
+	}
+
+	static const DecodedInstruction* closure_callr(LocalState& state, const DecodedInstruction* inst)
+	{
+		UInt64 target = state.regs->by_index[inst->reg].u64;
+		state.ip.addr_bytes = code_base(state) + inst->delta;
+		ru::call_function<false>(state, scast(UInt8, target >> 16), scast(UInt16, target));
+		gc_safepoint();
+		if (!(inst = resume_closures(state)))
+			return nullptr;
+		jump_closure();
+	}
+
+	static const DecodedInstruction* closure_ret(LocalState& state, const DecodedInstruction* inst)
+	{
+		if (!ru::ret(state))
+			return &closure_returned;
+		if (!(inst = resume_closures(state)))
+			return nullptr;
+		jump_closure();
+	}
+
+	/* The records execute_decoded() runs, with the same handlers: data records go through
+	 * ru::decoded(), and vector, bulk memory and SWITCH opcodes end the run.
+	 */
+	template<Size _Opcode>
+	constexpr ClosureHandler closure_entry()
+	{
+		constexpr Opcode opcode = scast(Opcode, _Opcode);
+		if constexpr (opcode <= Opcode::CST_m
+			|| (opcode >= Opcode::CMP_r_r && opcode <= Opcode::TEST_r_imm)
+			|| (opcode >= Opcode::ADD_r_r_r && opcode <= Opcode::FFMA_r_r_r_m))
+			return &closure_handler<opcode>;
+		else if constexpr (opcode == Opcode::JMP_s32)
+			return &closure_jmp;
+		else if constexpr (opcode == Opcode::JCC_s32)
+			return &closure_jcc;
+		else if constexpr (opcode == Opcode::LOOP_s32)
+			return &closure_loop;
+		else if constexpr (opcode == Opcode::CALL)
+			return &closure_call<false>;
+		else if constexpr (opcode == Opcode::TAILCALL)
+			return &closure_call<true>;
+		else if constexpr (opcode == Opcode::CALLR)
+			return &closure_callr;
+		else if constexpr (opcode == Opcode::RET)
+			return &closure_ret;
+		else return &closure_end;
+	}
+
+	template<Size... _Opcodes>
+	constexpr std::array<ClosureHandler, sizeof...(_Opcodes)> make_closure_table(std::index_sequence<_Opcodes...>)
+	{
+		return { closure_entry<_Opcodes>()... };
+	}
+
+	static constexpr std::array<ClosureHandler, op::OpcodeCount + 1> closure_table = make_closure_table(std::make_index_sequence<op::OpcodeCount + 1>());
+
+	ClosureHandler _closure_handler(op::Opcode opcode)
+	{
+		return scast(Size, opcode) < closure_table.size() ? closure_table[scast(UInt8, opcode)] : &closure_end;
+	}
+
+	/* Runs closure records from "inst" and returns like execute_decoded() */
+	static bool execute_closures(LocalState& state, const DecodedInstruction* inst)
+	{
+#if defined(KRAM_MUSTTAIL)
+		inst = inst->closure(state, inst);
+#else
+		while (inst && inst != &closure_returned)
+			inst = inst->closure(state, inst);
+#endif
+		return inst != &closure_returned;
+	}
+
+	/* Hands a frame of the raw interpreter back to the records of its chunk, its decoded
+	 * stream or else its closures, when ip starts one that is not an end record. Returns
+	 * false once the frame execute() entered has returned.
+	 */
+	static bool reenter_decoded(LocalState& state)
+	{
+		const DecodedCode* decoded = state.regs->ch.addr_chunk->decoded;
+		bool closures = !decoded;
+		if (closures)
+			decoded = state.targets->closures;
+
+		std::byte* base = code_base(state);
+		Size index = decoded->indices[scast(Size, state.ip.addr_bytes - base)];
+		if (index == NoRecord || decoded->code[index].opcode == DecodedEnd)
+			return true;
+		if (!closures)
+			return execute_decoded(&state, decoded->code + index, base);
+
+		if (KramState* owner = state.runtime.owner)
+			owner->closures().count_run();
+		return execute_closures(state, decoded->code + index);
+	}
+
+	void _cast_value(UInt8 types, void* value)
+	{
+		ru::cast_from_to(ru::bits<0, 4>(types), value, ru::bits<4, 4>(types), value);
+	}
+}
+
+namespace kram::runtime
+{
+	void execute(KramState* kstate, bin::Chunk* chunk, FunctionOffset function)
+	{
+		kstate->safepoint();
+
+		RuntimeState rstate{ &kstate->_rstack, kstate, &kstate->_code, kstate };
+		rstate.collector = kstate->_collector;
+		rstate.safepoints = kstate->paced() || rstate.collector;
+
+		std::byte* code = kstate->_code.code(chunk);
+		init_runtime(&rstate, chunk, code, function);
+		if (rstate.collector)
+			rstate.collector->safepoint(&rstate, &rstate.regs);
+
+		Size resume = chunk->functions[function].codeOffset;
+		UInt8 flags = 0;
+		if (jit::CompiledFunction native = kstate->_aot.find(chunk, function))
+			resume = native(&rstate.regs, rstate.stack->base + rstate.regs.sb.stack_offset, rstate.regs.sd.addr_stack_offset, rstate.heap);
+		else if (!kstate->_traces.run(&rstate, chunk, function, flags, resume))
+		{
+			if (jit::CompiledFunction compiled = kstate->_jit.promote(chunk, function))
+				resume = compiled(&rstate.regs, rstate.stack->base + rstate.regs.sb.stack_offset, rstate.regs.sd.addr_stack_offset, rstate.heap);
+		}
+
+		rstate.regs.ip.addr_bytes = code + resume;
+
+		LocalState state{ rstate };
+		state.flags = flags;
+		state.targets = kstate->_code.targets(chunk);
+		if (!chunk->decoded)
+			kstate->_closures.warm(chunk, state.targets);
+
+#if defined(KRAM_OPCODE_PROFILING)
+		OpcodeProfile* profile = kstate->_profile;
+		if (profile)
+			profile->break_sequence();
+#endif
+
+		/* Whatever native code left undone goes on in the stream of a predecoded chunk, or
+		 * on closure records once the chunk is warm, through calls and loops up to the
+		 * first instruction without a record
+		 */
+		decoded_reentry();
+
+#if defined(KRAM_THREADED_DISPATCH)
+		static const void* const dispatch_table[] = {
+			&&opcode_NOP,
+			&&opcode_MOV_r8_r8,
+			&&opcode_MOV_r16_r16,
+			&&opcode_MOV_r32_r32,
+			&&opcode_MOV_r64_r64,
+			&&opcode_MOV_r8_m8,
+			&&opcode_MOV_r16_m16,
+			&&opcode_MOV_r32_m32,
+			&&opcode_MOV_r64_m64,
+			&&opcode_MOV_m8_r8,
+			&&opcode_MOV_m16_r16,
+			&&opcode_MOV_m32_r32,
+			&&opcode_MOV_m64_r64,
+			&&opcode_MOV_r8_imm8,
+			&&opcode_MOV_r16_imm16,
+			&&opcode_MOV_r32_imm32,
+			&&opcode_MOV_r64_imm64,
+			&&opcode_MOV_m8_imm8,
+			&&opcode_MOV_m16_imm16,
+			&&opcode_MOV_m32_imm32,
+			&&opcode_MOV_m64_imm64,
+			&&opcode_LEA,
+			&&opcode_MMB_sb,
+			&&opcode_MMB_sw,
+			&&opcode_MMB_sd,
+			&&opcode_MMB_sq,
+			&&opcode_NEW_r_s,
+			&&opcode_NEW_m_s,
+			&&opcode_DEL_r,
+			&&opcode_DEL_m,
+			&&opcode_MHR_r,
+			&&opcode_MHR_m,
+			&&opcode_CST_r,
+			&&opcode_CST_m,
+			&&opcode_MOV_r8_stk_d8,
+			&&opcode_MOV_r16_stk_d8,
+			&&opcode_MOV_r32_stk_d8,
+			&&opcode_MOV_r64_stk_d8,
+			&&opcode_MOV_stk_d8_r8,
+			&&opcode_MOV_stk_d8_r16,
+			&&opcode_MOV_stk_d8_r32,
+			&&opcode_MOV_stk_d8_r64,
+			&&opcode_MOV_r8_reg_idx1,
+			&&opcode_MOV_r16_reg_idx2,
+			&&opcode_MOV_r32_reg_idx4,
+			&&opcode_MOV_r64_reg_idx8,
+			&&opcode_MOV_reg_idx1_r8,
+			&&opcode_MOV_reg_idx2_r16,
+			&&opcode_MOV_reg_idx4_r32,
+			&&opcode_MOV_reg_idx8_r64,
+			&&opcode_MOV_r8_m8_qreg,
+			&&opcode_MOV_r16_m16_qreg,
+			&&opcode_MOV_r32_m32_qreg,
+			&&opcode_MOV_r64_m64_qreg,
+			&&opcode_MOV_m8_r8_qreg,
+			&&opcode_MOV_m16_r16_qreg,
+			&&opcode_MOV_m32_r32_qreg,
+			&&opcode_MOV_m64_r64_qreg,
+			&&opcode_MOV_r8_m8_qreg_d8,
+			&&opcode_MOV_r16_m16_qreg_d8,
+			&&opcode_MOV_r32_m32_qreg_d8,
+			&&opcode_MOV_r64_m64_qreg_d8,
+			&&opcode_MOV_m8_r8_qreg_d8,
+			&&opcode_MOV_m16_r16_qreg_d8,
+			&&opcode_MOV_m32_r32_qreg_d8,
+			&&opcode_MOV_m64_r64_qreg_d8,
+			&&opcode_CST_r_q,
+			&&opcode_CST_m_q,
+			&&opcode_MOV_r64_m64__MOV_m64_r64,
+			&&opcode_MOV_r64_m64__MOV_r64_m64,
+			&&opcode_MOV_r64_stk_d8__MOV_stk_d8_r64,
+			&&opcode_MOV_r32_stk_d8__MOV_stk_d8_r32,
+			&&opcode_LEA__MMB_sb,
+			&&opcode_LEA__LEA__MMB_sb,
+			&&opcode_CALL,
+			&&opcode_CALLR,
+			&&opcode_RET,
+			&&opcode_TAILCALL,
+			&&opcode_CMP_r_r,
+			&&opcode_CMP_r_imm,
+			&&opcode_CMP_r_m,
+			&&opcode_TEST_r_r,
+			&&opcode_TEST_r_imm,
+			&&opcode_JMP_s8,
+			&&opcode_JMP_s32,
+			&&opcode_JCC_s8,
+			&&opcode_JCC_s32,
+			&&opcode_CMPJ_r_imm_s8,
+			&&opcode_CMPJ_r_imm_s32,
+			&&opcode_CMPJ_r_m_s8,
+			&&opcode_CMPJ_r_m_s32,
+			&&opcode_LOOP_s8,
+			&&opcode_LOOP_s32,
+			&&opcode_SWITCH,
+			&&opcode_ADD_r_r_r,
+			&&opcode_ADD_r_r_m,
+			&&opcode_SUB_r_r_r,
+			&&opcode_SUB_r_r_m,
+			&&opcode_MUL_r_r_r,
+			&&opcode_MUL_r_r_m,
+			&&opcode_DIV_r_r_r,
+			&&opcode_DIV_r_r_m,
+			&&opcode_REM_r_r_r,
+			&&opcode_REM_r_r_m,
+			&&opcode_AND_r_r_r,
+			&&opcode_AND_r_r_m,
+			&&opcode_OR_r_r_r,
+			&&opcode_OR_r_r_m,
+			&&opcode_XOR_r_r_r,
+			&&opcode_XOR_r_r_m,
+			&&opcode_SHL_r_r_r,
+			&&opcode_SHL_r_r_m,
+			&&opcode_SHR_r_r_r,
+			&&opcode_SHR_r_r_m,
+			&&opcode_FADD_r_r_r,
+			&&opcode_FADD_r_r_m,
+			&&opcode_FSUB_r_r_r,
+			&&opcode_FSUB_r_r_m,
+			&&opcode_FMUL_r_r_r,
+			&&opcode_FMUL_r_r_m,
+			&&opcode_FDIV_r_r_r,
+			&&opcode_FDIV_r_r_m,
+			&&opcode_FSQRT_r_r,
+			&&opcode_FSQRT_r_m,
+			&&opcode_FFMA_r_r_r_r,
+			&&opcode_FFMA_r_r_r_m,
+			&&opcode_VADD,
+			&&opcode_VSUB,
+			&&opcode_VMUL,
+			&&opcode_VMIN,
+			&&opcode_VMAX,
+			&&opcode_VFMA,
+			&&opcode_VCMP,
+			&&opcode_VSELECT,
+			&&opcode_VSUM,
+			&&opcode_VRMIN,
+			&&opcode_VRMAX,
+			&&opcode_VARGMIN,
+			&&opcode_VARGMAX,
+			&&opcode_VDOT,
+			&&opcode_VSCAN,
+			&&opcode_VSCANX,
+			&&opcode_MSET,
+			&&opcode_MCMP,
+			&&opcode_MFIND,
+			&&opcode_MFINDB,
+			&&opcode_GATHER,
+			&&opcode_SCATTER,
+
+			/* Bytes past the last opcode leave the loop, as the switch does without a case */
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end, &&execute_end,
+			&&execute_end, &&execute_end, &&execute_end, &&execute_end
+		};
+		static_assert(std::size(dispatch_table) == 256, "dispatch table must cover every byte value");
+		static_assert(op::OpcodeCount <= 256, "opcodes no longer fit in a byte");
+
+		dispatch();
+		{
+#else
+	instruction_begin:
+		profile_opcode();
+		switch (*(state.ip.addr_opcode++))
+		{
+#endif
+			do_opcode(NOP)
+			end_opcode();
+
+
+			do_opcode(MOV_r8_r8)
+				ru::mov_r_r<UInt8>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_r16)
+				ru::mov_r_r<UInt16>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_r32)
+				ru::mov_r_r<UInt32>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_r64)
+				ru::mov_r_r<UInt64>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r8_m8)
+				ru::quicken_mov<Opcode::MOV_r8_m8_qreg, Opcode::MOV_r8_m8_qreg_d8>(state);
+				ru::mov_rm_rm<UInt8, false>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_m16)
+				ru::quicken_mov<Opcode::MOV_r16_m16_qreg, Opcode::MOV_r16_m16_qreg_d8>(state);
+				ru::mov_rm_rm<UInt16, false>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_m32)
+				ru::quicken_mov<Opcode::MOV_r32_m32_qreg, Opcode::MOV_r32_m32_qreg_d8>(state);
+				ru::mov_rm_rm<UInt32, false>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_m64)
+				ru::quicken_mov<Opcode::MOV_r64_m64_qreg, Opcode::MOV_r64_m64_qreg_d8>(state);
+				ru::mov_rm_rm<UInt64, false>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_m8_r8)
+				ru::quicken_mov<Opcode::MOV_m8_r8_qreg, Opcode::MOV_m8_r8_qreg_d8>(state);
+				ru::mov_rm_rm<UInt8, true>(state);
+			end_opcode();
+
+			do_opcode(MOV_m16_r16)
+				ru::quicken_mov<Opcode::MOV_m16_r16_qreg, Opcode::MOV_m16_r16_qreg_d8>(state);
+				ru::mov_rm_rm<UInt16, true>(state);
+			end_opcode();
+
+			do_opcode(MOV_m32_r32)
+				ru::quicken_mov<Opcode::MOV_m32_r32_qreg, Opcode::MOV_m32_r32_qreg_d8>(state);
+				ru::mov_rm_rm<UInt32, true>(state);
+			end_opcode();
+
+			do_opcode(MOV_m64_r64)
+				ru::quicken_mov<Opcode::MOV_m64_r64_qreg, Opcode::MOV_m64_r64_qreg_d8>(state);
+				ru::mov_rm_rm<UInt64, true>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r8_imm8)
+				ru::mov_r_imm<UInt8>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_imm16)
+				ru::mov_r_imm<UInt16>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_imm32)
+				ru::mov_r_imm<UInt32>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_imm64)
+				ru::mov_r_imm<UInt64>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_m8_imm8)
+				ru::mov_m_imm<UInt8>(state);
+			end_opcode();
+
+			do_opcode(MOV_m16_imm16)
+				ru::mov_m_imm<UInt16>(state);
+			end_opcode();
+
+			do_opcode(MOV_m32_imm32)
+				ru::mov_m_imm<UInt32>(state);
+			end_opcode();
+
+			do_opcode(MOV_m64_imm64)
+				ru::mov_m_imm<UInt64>(state);
+			end_opcode();
+
+
+			do_opcode(LEA)
+				ru::lea(state);
+			end_opcode();
+
+
+			do_opcode(MMB_sb)
+				ru::mmb<UInt8>(state);
+			end_opcode();
+
+			do_opcode(MMB_sw)
+				ru::mmb<UInt16>(state);
+			end_opcode();
+
+			do_opcode(MMB_sd)
+				ru::mmb<UInt32>(state);
+			end_opcode();
+
+			do_opcode(MMB_sq)
+				ru::mmb<UInt64>(state);
+			end_opcode();
+
+
+			do_opcode(NEW_r_s)
+				ru::new_r_s(state);
+			end_opcode();
+
+
+			do_opcode(NEW_m_s)
+				ru::new_m_s(state);
+			end_opcode();
+
+
+			do_opcode(DEL_r)
+				ru::del_r(state);
+			end_opcode();
+
+
+			do_opcode(DEL_m)
+				ru::del_m(state);
+			end_opcode();
+
+
+			do_opcode(MHR_r)
+				ru::mhr_r(state);
+			end_opcode();
+
+
+			do_opcode(MHR_m)
+				ru::mhr_m(state);
+			end_opcode();
+
+
+			do_opcode(CST_r)
+				ru::cst_r_quicken(state);
 			end_opcode();
 
 
-			do_opcode(op::Opcode::DEL_m)
-				ru::del_m(state);
+			do_opcode(CST_m)
+				ru::cst_m_quicken(state);
 			end_opcode();
 
 
-			do_opcode(op::Opcode::MHR_r)
-				ru::mhr_r(state);
+			do_opcode(MOV_r8_stk_d8)
+				ru::mov_rm_fixed<UInt8, false, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_stk_d8)
+				ru::mov_rm_fixed<UInt16, false, ru::StackSegment, false, 0, 0>(state);
 			end_opcode();
 
+			do_opcode(MOV_r32_stk_d8)
+				ru::mov_rm_fixed<UInt32, false, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
 
-			do_opcode(op::Opcode::MHR_m)
-				ru::mhr_m(state);
+			do_opcode(MOV_r64_stk_d8)
+				ru::mov_rm_fixed<UInt64, false, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_stk_d8_r8)
+				ru::mov_rm_fixed<UInt8, true, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_stk_d8_r16)
+				ru::mov_rm_fixed<UInt16, true, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_stk_d8_r32)
+				ru::mov_rm_fixed<UInt32, true, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_stk_d8_r64)
+				ru::mov_rm_fixed<UInt64, true, ru::StackSegment, false, 0, 0>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r8_reg_idx1)
+				ru::mov_rm_fixed<UInt8, false, ru::RegisterSegment, true, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_reg_idx2)
+				ru::mov_rm_fixed<UInt16, false, ru::RegisterSegment, true, 1, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_reg_idx4)
+				ru::mov_rm_fixed<UInt32, false, ru::RegisterSegment, true, 2, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_reg_idx8)
+				ru::mov_rm_fixed<UInt64, false, ru::RegisterSegment, true, 3, ru::NoDelta>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_reg_idx1_r8)
+				ru::mov_rm_fixed<UInt8, true, ru::RegisterSegment, true, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_reg_idx2_r16)
+				ru::mov_rm_fixed<UInt16, true, ru::RegisterSegment, true, 1, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_reg_idx4_r32)
+				ru::mov_rm_fixed<UInt32, true, ru::RegisterSegment, true, 2, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_reg_idx8_r64)
+				ru::mov_rm_fixed<UInt64, true, ru::RegisterSegment, true, 3, ru::NoDelta>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r8_m8_qreg)
+				ru::mov_rm_quick<UInt8, false, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_m16_qreg)
+				ru::mov_rm_quick<UInt16, false, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_m32_qreg)
+				ru::mov_rm_quick<UInt32, false, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_m64_qreg)
+				ru::mov_rm_quick<UInt64, false, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_m8_r8_qreg)
+				ru::mov_rm_quick<UInt8, true, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_m16_r16_qreg)
+				ru::mov_rm_quick<UInt16, true, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_m32_r32_qreg)
+				ru::mov_rm_quick<UInt32, true, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+			do_opcode(MOV_m64_r64_qreg)
+				ru::mov_rm_quick<UInt64, true, ru::RegisterSegment, false, 0, ru::NoDelta>(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r8_m8_qreg_d8)
+				ru::mov_rm_quick<UInt8, false, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_r16_m16_qreg_d8)
+				ru::mov_rm_quick<UInt16, false, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_m32_qreg_d8)
+				ru::mov_rm_quick<UInt32, false, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_m64_qreg_d8)
+				ru::mov_rm_quick<UInt64, false, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_m8_r8_qreg_d8)
+				ru::mov_rm_quick<UInt8, true, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_m16_r16_qreg_d8)
+				ru::mov_rm_quick<UInt16, true, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_m32_r32_qreg_d8)
+				ru::mov_rm_quick<UInt32, true, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+			do_opcode(MOV_m64_r64_qreg_d8)
+				ru::mov_rm_quick<UInt64, true, ru::RegisterSegment, false, 0, 0>(state);
+			end_opcode();
+
+
+			do_opcode(CST_r_q)
+				ru::cst_r_q(state);
+			end_opcode();
+
+			do_opcode(CST_m_q)
+				ru::cst_m_q(state);
+			end_opcode();
+
+
+			do_opcode(MOV_r64_m64__MOV_m64_r64)
+				ru::fused<Opcode::MOV_r64_m64, Opcode::MOV_m64_r64>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_m64__MOV_r64_m64)
+				ru::fused<Opcode::MOV_r64_m64, Opcode::MOV_r64_m64>(state);
+			end_opcode();
+
+			do_opcode(MOV_r64_stk_d8__MOV_stk_d8_r64)
+				ru::fused<Opcode::MOV_r64_stk_d8, Opcode::MOV_stk_d8_r64>(state);
+			end_opcode();
+
+			do_opcode(MOV_r32_stk_d8__MOV_stk_d8_r32)
+				ru::fused<Opcode::MOV_r32_stk_d8, Opcode::MOV_stk_d8_r32>(state);
+			end_opcode();
+
+			do_opcode(LEA__MMB_sb)
+				ru::fused<Opcode::LEA, Opcode::MMB_sb>(state);
+			end_opcode();
+
+			do_opcode(LEA__LEA__MMB_sb)
+				ru::fused<Opcode::LEA, Opcode::LEA, Opcode::MMB_sb>(state);
+			end_opcode();
+
+
+			do_opcode(CALL)
+				ru::call<false>(state);
+				gc_safepoint();
+				decoded_reentry();
+			end_opcode();
+
+			do_opcode(CALLR)
+				ru::callr(state);
+				gc_safepoint();
+				decoded_reentry();
+			end_opcode();
+
+			do_opcode(RET)
+				if (!ru::ret(state))
+					goto execute_end;
+				decoded_reentry();
+			end_opcode();
+
+			do_opcode(TAILCALL)
+				ru::call<true>(state);
+				gc_safepoint();
+				decoded_reentry();
+			end_opcode();
+
+
+			do_opcode(CMP_r_r)
+				ru::cmp_r_r(state);
+			end_opcode();
+
+			do_opcode(CMP_r_imm)
+				ru::cmp_r_imm(state);
+			end_opcode();
+
+			do_opcode(CMP_r_m)
+				ru::cmp_r_m(state);
+			end_opcode();
+
+			do_opcode(TEST_r_r)
+				ru::test_r_r(state);
+			end_opcode();
+
+			do_opcode(TEST_r_imm)
+				ru::test_r_imm(state);
+			end_opcode();
+
+			do_opcode(JMP_s8)
+				if (ru::jmp<Int8>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(JMP_s32)
+				if (ru::jmp<Int32>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(JCC_s8)
+				if (ru::jcc<Int8>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(JCC_s32)
+				if (ru::jcc<Int32>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(CMPJ_r_imm_s8)
+				if (ru::cmpj<Int8, false>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(CMPJ_r_imm_s32)
+				if (ru::cmpj<Int32, false>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(CMPJ_r_m_s8)
+				if (ru::cmpj<Int8, true>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(CMPJ_r_m_s32)
+				if (ru::cmpj<Int32, true>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(LOOP_s8)
+				if (ru::loop<Int8>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(LOOP_s32)
+				if (ru::loop<Int32>(state))
+				{
+					back_edge();
+				}
+			end_opcode();
+
+			do_opcode(SWITCH)
+				ru::switch_(state);
+			end_opcode();
+
+
+			do_opcode(ADD_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Add>(state);
+			end_opcode();
+
+			do_opcode(ADD_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Add>(state);
+			end_opcode();
+
+			do_opcode(SUB_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Sub>(state);
+			end_opcode();
+
+			do_opcode(SUB_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Sub>(state);
+			end_opcode();
+
+			do_opcode(MUL_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Mul>(state);
+			end_opcode();
+
+			do_opcode(MUL_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Mul>(state);
+			end_opcode();
+
+			do_opcode(DIV_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Div>(state);
+			end_opcode();
+
+			do_opcode(DIV_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Div>(state);
+			end_opcode();
+
+			do_opcode(REM_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Rem>(state);
+			end_opcode();
+
+			do_opcode(REM_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Rem>(state);
+			end_opcode();
+
+			do_opcode(AND_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::And>(state);
+			end_opcode();
+
+			do_opcode(AND_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::And>(state);
+			end_opcode();
+
+			do_opcode(OR_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Or>(state);
+			end_opcode();
+
+			do_opcode(OR_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Or>(state);
+			end_opcode();
+
+			do_opcode(XOR_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Xor>(state);
+			end_opcode();
+
+			do_opcode(XOR_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Xor>(state);
+			end_opcode();
+
+			do_opcode(SHL_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Shl>(state);
+			end_opcode();
+
+			do_opcode(SHL_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Shl>(state);
+			end_opcode();
+
+			do_opcode(SHR_r_r_r)
+				ru::arithmetic_r_r_r<ru::Arithmetic::Shr>(state);
+			end_opcode();
+
+			do_opcode(SHR_r_r_m)
+				ru::arithmetic_r_r_m<ru::Arithmetic::Shr>(state);
+			end_opcode();
+
+
+			do_opcode(FADD_r_r_r)
+				ru::float_r_r_r<ru::Arithmetic::Add>(state);
 			end_opcode();
 
+			do_opcode(FADD_r_r_m)
+				ru::float_r_r_m<ru::Arithmetic::Add>(state);
+			end_opcode();
+
+			do_opcode(FSUB_r_r_r)
+				ru::float_r_r_r<ru::Arithmetic::Sub>(state);
+			end_opcode();
+
+			do_opcode(FSUB_r_r_m)
+				ru::float_r_r_m<ru::Arithmetic::Sub>(state);
+			end_opcode();
+
+			do_opcode(FMUL_r_r_r)
+				ru::float_r_r_r<ru::Arithmetic::Mul>(state);
+			end_opcode();
+
+			do_opcode(FMUL_r_r_m)
+				ru::float_r_r_m<ru::Arithmetic::Mul>(state);
+			end_opcode();
+
+			do_opcode(FDIV_r_r_r)
+				ru::float_r_r_r<ru::Arithmetic::Div>(state);
+			end_opcode();
+
+			do_opcode(FDIV_r_r_m)
+				ru::float_r_r_m<ru::Arithmetic::Div>(state);
+			end_opcode();
+
+			do_opcode(FSQRT_r_r)
+				ru::fsqrt_r_r(state);
+			end_opcode();
+
+			do_opcode(FSQRT_r_m)
+				ru::fsqrt_r_m(state);
+			end_opcode();
+
+			do_opcode(FFMA_r_r_r_r)
+				ru::ffma_r_r_r_r(state);
+			end_opcode();
+
+			do_opcode(FFMA_r_r_r_m)
+				ru::ffma_r_r_r_m(state);
+			end_opcode();
+
+
+			do_opcode(VADD)
+				ru::vbinary<simd::Operation::Add>(state);
+			end_opcode();
+
+			do_opcode(VSUB)
+				ru::vbinary<simd::Operation::Sub>(state);
+			end_opcode();
+
+			do_opcode(VMUL)
+				ru::vbinary<simd::Operation::Mul>(state);
+			end_opcode();
+
+			do_opcode(VMIN)
+				ru::vbinary<simd::Operation::Min>(state);
+			end_opcode();
+
+			do_opcode(VMAX)
+				ru::vbinary<simd::Operation::Max>(state);
+			end_opcode();
 
-			do_opcode(op::Opcode::CST_r)
-				ru::cst_r(state);
+			do_opcode(VFMA)
+				ru::vfma(state);
 			end_opcode();
 
+			do_opcode(VCMP)
+				ru::vcmp(state);
+			end_opcode();
+
+			do_opcode(VSELECT)
+				ru::vselect(state);
+			end_opcode();
+
+			do_opcode(VSUM)
+				ru::vreduce<simd::Reduction::Sum>(state);
+			end_opcode();
+
+			do_opcode(VRMIN)
+				ru::vreduce<simd::Reduction::Min>(state);
+			end_opcode();
+
+			do_opcode(VRMAX)
+				ru::vreduce<simd::Reduction::Max>(state);
+			end_opcode();
+
+			do_opcode(VARGMIN)
+				ru::vreduce<simd::Reduction::ArgMin>(state);
+			end_opcode();
+
+			do_opcode(VARGMAX)
+				ru::vreduce<simd::Reduction::ArgMax>(state);
+			end_opcode();
+
+			do_opcode(VDOT)
+				ru::vdot(state);
+			end_opcode();
+
+			do_opcode(VSCAN)
+				ru::vscan<false>(state);
+			end_opcode();
+
+			do_opcode(VSCANX)
+				ru::vscan<true>(state);
+			end_opcode();
+
+
+			do_opcode(MSET)
+				ru::mset(state);
+			end_opcode();
+
+			do_opcode(MCMP)
+				ru::mcmp(state);
+			end_opcode();
 
-			do_opcode(op::Opcode::CST_m)
-				ru::cst_m(state);
+			do_opcode(MFIND)
+				ru::mfind(state);
+			end_opcode();
+
+			do_opcode(MFINDB)
+				ru::mfindb(state);
+			end_opcode();
+
+
+			do_opcode(GATHER)
+				ru::gather<false>(state);
+			end_opcode();
+
+			do_opcode(SCATTER)
+				ru::gather<true>(state);
 			end_opcode();
 		}
+
+	execute_end:
+		state.store();
 	}
 }
 
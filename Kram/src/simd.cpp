@@ -0,0 +1,1060 @@
+#include "simd.h"
+
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(KRAM_SIMD_X86_TARGETS)
+	#include <immintrin.h>
+#endif
+
+using kram::op::Condition;
+
+namespace kram::simd
+{
+	typedef void (*BinaryKernel)(void* dest, const void* left, const void* right, Size count);
+	typedef void (*SelectKernel)(void* dest, const UInt8* mask, const void* left, const void* right, Size count);
+	typedef UInt64 (*ReduceKernel)(const void* left, const void* right, Size count);
+	typedef void (*ScanKernel)(void* dest, const void* src, Size count);
+	typedef void (*GatherKernel)(void* dest, const void* table, const void* indices, Size count);
+	typedef void (*ScatterKernel)(void* table, const void* src, const void* indices, Size count);
+
+	constexpr Size TypeSlots = 16;	/* a 4 bit type field never indexes out of a row */
+	constexpr Size CompareCount = 6;	/* Equal to Greater, the unsigned conditions fold onto them */
+
+	/* Integer promotion would turn narrow operands into int, where overflow is undefined */
+	template<Operation _Op, typename _Ty>
+	forceinline _Ty apply(_Ty left, _Ty right)
+	{
+		if constexpr (_Op == Operation::Min)
+			return right < left ? right : left;
+		else if constexpr (_Op == Operation::Max)
+			return left < right ? right : left;
+		else if constexpr (std::integral<_Ty>)
+		{
+			using _Wide = std::conditional_t<(sizeof(_Ty) < sizeof(unsigned int)), unsigned int, std::make_unsigned_t<_Ty>>;
+
+			if constexpr (_Op == Operation::Add)
+				return scast(_Ty, scast(_Wide, left) + scast(_Wide, right));
+			else if constexpr (_Op == Operation::Sub)
+				return scast(_Ty, scast(_Wide, left) - scast(_Wide, right));
+			else
+				return scast(_Ty, scast(_Wide, left) * scast(_Wide, right));
+		}
+		else
+		{
+			if constexpr (_Op == Operation::Add)
+				return left + right;
+			else if constexpr (_Op == Operation::Sub)
+				return left - right;
+			else
+				return left * right;
+		}
+	}
+
+	/* Integer sums and dots run on 64 bit two's complement, which wraps without UB */
+	template<typename _Ty>
+	using Accumulator = std::conditional_t<std::floating_point<_Ty>, _Ty, UInt64>;
+
+	template<typename _Ty>
+	forceinline Accumulator<_Ty> widen(_Ty value)
+	{
+		if constexpr (std::floating_point<_Ty>)
+			return value;
+		else if constexpr (std::signed_integral<_Ty>)
+			return scast(UInt64, scast(Int64, value));
+		else return scast(UInt64, value);
+	}
+
+	template<typename _Ty>
+	forceinline UInt64 raw(_Ty value)
+	{
+		if constexpr (std::same_as<_Ty, float>)
+			return std::bit_cast<UInt32>(value);
+		else if constexpr (std::same_as<_Ty, double>)
+			return std::bit_cast<UInt64>(value);
+		else return widen(value);
+	}
+
+	template<Condition _Cond, typename _Ty>
+	forceinline bool holds(_Ty left, _Ty right)
+	{
+		if constexpr (_Cond == Condition::Equal)
+			return left == right;
+		else if constexpr (_Cond == Condition::NotEqual)
+			return left != right;
+		else if constexpr (_Cond == Condition::Less)
+			return left < right;
+		else if constexpr (_Cond == Condition::GreaterEqual)
+			return left >= right;
+		else if constexpr (_Cond == Condition::LessEqual)
+			return left <= right;
+		else
+			return left > right;
+	}
+
+
+	/* Kernels are plain loops: each target below compiles them for its own instruction
+	 * set and leaves the vectorization to the compiler. Streaming kernels run whole 64
+	 * byte blocks through local copies, since a loop of fixed trip count over locals is
+	 * vectorized from -O2 on where the loop over the blocks themselves waits for -O3,
+	 * for its unknown count and the aliasing of its operands.
+	 */
+	template<typename _Ty>
+	constexpr Size lanes_of() { return 64 / sizeof(_Ty); }
+
+	/* Masks go through an unsigned integer as wide as the element, since loops mixing
+	 * widths are left to -O3 as well
+	 */
+	template<typename _Ty>
+	using Lane = std::conditional_t<sizeof(_Ty) == 1, UInt8, std::conditional_t<sizeof(_Ty) == 2, UInt16,
+		std::conditional_t<sizeof(_Ty) == 4, UInt32, UInt64>>>;
+
+	template<Operation _Op>
+	struct Binary
+	{
+		template<typename _Ty>
+		struct Kernel
+		{
+			static constexpr Size Lanes = lanes_of<_Ty>();
+
+			static forceinline void run(void* _dest, const void* _left, const void* _right, Size count)
+			{
+				_Ty* dest = rcast(_Ty*, _dest);
+				const _Ty* left = rcast(const _Ty*, _left);
+				const _Ty* right = rcast(const _Ty*, _right);
+				Size i = 0;
+				for (; i + Lanes <= count; i += Lanes)
+				{
+					_Ty a[Lanes], b[Lanes], out[Lanes];
+					std::memcpy(a, left + i, sizeof(a));
+					std::memcpy(b, right + i, sizeof(b));
+					for (Size j = 0; j < Lanes; j++)
+						out[j] = apply<_Op>(a[j], b[j]);
+					std::memcpy(dest + i, out, sizeof(out));
+				}
+				for (; i < count; i++)
+					dest[i] = apply<_Op>(left[i], right[i]);
+			}
+		};
+	};
+
+	template<typename _Ty>
+	struct Fma
+	{
+		static constexpr Size Lanes = lanes_of<_Ty>();
+
+		static forceinline _Ty step(_Ty left, _Ty right, _Ty dest)
+		{
+			if constexpr (std::floating_point<_Ty>)
+				return std::fma(left, right, dest);
+			else return apply<Operation::Add>(apply<Operation::Mul>(left, right), dest);
+		}
+
+		static forceinline void run(void* _dest, const void* _left, const void* _right, Size count)
+		{
+			_Ty* dest = rcast(_Ty*, _dest);
+			const _Ty* left = rcast(const _Ty*, _left);
+			const _Ty* right = rcast(const _Ty*, _right);
+			Size i = 0;
+			for (; i + Lanes <= count; i += Lanes)
+			{
+				_Ty a[Lanes], b[Lanes], out[Lanes];
+				std::memcpy(a, left + i, sizeof(a));
+				std::memcpy(b, right + i, sizeof(b));
+				std::memcpy(out, dest + i, sizeof(out));
+				for (Size j = 0; j < Lanes; j++)
+					out[j] = step(a[j], b[j], out[j]);
+				std::memcpy(dest + i, out, sizeof(out));
+			}
+			for (; i < count; i++)
+				dest[i] = step(left[i], right[i], dest[i]);
+		}
+	};
+
+	template<Condition _Cond>
+	struct Compare
+	{
+		template<typename _Ty>
+		struct Kernel
+		{
+			static constexpr Size Lanes = lanes_of<_Ty>();
+
+			static forceinline void run(void* _mask, const void* _left, const void* _right, Size count)
+			{
+				UInt8* mask = rcast(UInt8*, _mask);
+				const _Ty* left = rcast(const _Ty*, _left);
+				const _Ty* right = rcast(const _Ty*, _right);
+				Size i = 0;
+				for (; i + Lanes <= count; i += Lanes)
+				{
+					_Ty a[Lanes], b[Lanes];
+					Lane<_Ty> hits[Lanes];
+					UInt8 out[Lanes];
+					std::memcpy(a, left + i, sizeof(a));
+					std::memcpy(b, right + i, sizeof(b));
+					for (Size j = 0; j < Lanes; j++)
+						hits[j] = holds<_Cond>(a[j], b[j]);
+					for (Size j = 0; j < Lanes; j++)
+						out[j] = scast(UInt8, hits[j]);
+					std::memcpy(mask + i, out, sizeof(out));
+				}
+				for (; i < count; i++)
+					mask[i] = scast(UInt8, holds<_Cond>(left[i], right[i]));
+			}
+		};
+	};
+
+	template<typename _Ty>
+	struct Select
+	{
+		static constexpr Size Lanes = lanes_of<_Ty>();
+
+		static forceinline void run(void* _dest, const UInt8* mask, const void* _left, const void* _right, Size count)
+		{
+			_Ty* dest = rcast(_Ty*, _dest);
+			const _Ty* left = rcast(const _Ty*, _left);
+			const _Ty* right = rcast(const _Ty*, _right);
+			Size i = 0;
+			for (; i + Lanes <= count; i += Lanes)
+			{
+				_Ty a[Lanes], b[Lanes], out[Lanes];
+				UInt8 m[Lanes];
+				Lane<_Ty> wide[Lanes];
+				std::memcpy(m, mask + i, sizeof(m));
+				std::memcpy(a, left + i, sizeof(a));
+				std::memcpy(b, right + i, sizeof(b));
+				for (Size j = 0; j < Lanes; j++)
+					wide[j] = m[j];
+				for (Size j = 0; j < Lanes; j++)
+					out[j] = wide[j] ? a[j] : b[j];
+				std::memcpy(dest + i, out, sizeof(out));
+			}
+			for (; i < count; i++)
+				dest[i] = mask[i] ? left[i] : right[i];
+		}
+	};
+
+
+	/* Reductions keep one accumulator per lane of a 64 byte block, so the loop carries no
+	 * dependency from one element to the next. Each kernel reduces [begin, end) to a
+	 * State; merge() joins the States of consecutive ranges, left one first.
+	 */
+
+	template<typename _Ty>
+	struct Sum
+	{
+		using State = Accumulator<_Ty>;
+		static constexpr UInt64 Empty = 0;
+		static constexpr Size Lanes = lanes_of<State>();
+
+		static forceinline State run(const void* _src, const void*, Size begin, Size end)
+		{
+			const _Ty* src = rcast(const _Ty*, _src);
+			State lanes[Lanes] = {};
+			Size i = begin;
+			for (; i + Lanes <= end; i += Lanes)
+				for (Size j = 0; j < Lanes; j++)
+					lanes[j] += widen(src[i + j]);
+
+			State total = 0;
+			for (Size j = 0; j < Lanes; j++)
+				total += lanes[j];
+			for (; i < end; i++)
+				total += widen(src[i]);
+			return total;
+		}
+
+		static State merge(State left, State right) { return left + right; }
+		static UInt64 result(State state) { return raw(state); }
+	};
+
+	template<typename _Ty>
+	struct Dot
+	{
+		using State = Accumulator<_Ty>;
+		static constexpr UInt64 Empty = 0;
+		static constexpr Size Lanes = lanes_of<State>();
+
+		static forceinline State run(const void* _left, const void* _right, Size begin, Size end)
+		{
+			const _Ty* left = rcast(const _Ty*, _left);
+			const _Ty* right = rcast(const _Ty*, _right);
+			State lanes[Lanes] = {};
+			Size i = begin;
+			for (; i + Lanes <= end; i += Lanes)
+				for (Size j = 0; j < Lanes; j++)
+					lanes[j] += widen(left[i + j]) * widen(right[i + j]);
+
+			State total = 0;
+			for (Size j = 0; j < Lanes; j++)
+				total += lanes[j];
+			for (; i < end; i++)
+				total += widen(left[i]) * widen(right[i]);
+			return total;
+		}
+
+		static State merge(State left, State right) { return left + right; }
+		static UInt64 result(State state) { return raw(state); }
+	};
+
+	/* Ranges are never empty, so every lane starts from the first element */
+	template<Operation _Op>
+	struct Extreme
+	{
+		template<typename _Ty>
+		struct Kernel
+		{
+			using State = _Ty;
+			static constexpr UInt64 Empty = 0;
+			static constexpr Size Lanes = lanes_of<_Ty>();
+
+			static forceinline State run(const void* _src, const void*, Size begin, Size end)
+			{
+				const _Ty* src = rcast(const _Ty*, _src);
+				_Ty lanes[Lanes];
+				for (Size j = 0; j < Lanes; j++)
+					lanes[j] = src[begin];
+
+				Size i = begin;
+				for (; i + Lanes <= end; i += Lanes)
+					for (Size j = 0; j < Lanes; j++)
+						lanes[j] = apply<_Op>(lanes[j], src[i + j]);
+
+				_Ty best = src[begin];
+				for (Size j = 0; j < Lanes; j++)
+					best = apply<_Op>(best, lanes[j]);
+				for (; i < end; i++)
+					best = apply<_Op>(best, src[i]);
+				return best;
+			}
+
+			static State merge(State left, State right) { return apply<_Op>(left, right); }
+			static UInt64 result(State state) { return raw(state); }
+		};
+	};
+
+	template<Operation _Op>
+	struct Arg
+	{
+		template<typename _Ty>
+		struct Kernel
+		{
+			struct State
+			{
+				_Ty value;
+				Size index;
+			};
+
+			static constexpr UInt64 Empty = ~UInt64(0);
+			static constexpr Size Lanes = lanes_of<Size>();
+
+			static forceinline bool better(_Ty candidate, _Ty best)
+			{
+				if constexpr (_Op == Operation::Min)
+					return candidate < best;
+				else return best < candidate;
+			}
+
+			static forceinline State run(const void* _src, const void*, Size begin, Size end)
+			{
+				const _Ty* src = rcast(const _Ty*, _src);
+				_Ty values[Lanes];
+				Size indices[Lanes];
+				for (Size j = 0; j < Lanes; j++)
+				{
+					values[j] = src[begin];
+					indices[j] = begin;
+				}
+
+				Size i = begin;
+				for (; i + Lanes <= end; i += Lanes)
+				{
+					for (Size j = 0; j < Lanes; j++)
+					{
+						bool replace = better(src[i + j], values[j]);
+						values[j] = replace ? src[i + j] : values[j];
+						indices[j] = replace ? i + j : indices[j];
+					}
+				}
+
+				State best = { src[begin], begin };
+				for (Size j = 0; j < Lanes; j++)
+					best = merge(best, { values[j], indices[j] });
+				for (; i < end; i++)
+				{
+					if (better(src[i], best.value))
+						best = { src[i], i };
+				}
+				return best;
+			}
+
+			/* Lanes interleave indices, so ties go to the lowest one */
+			static State merge(State left, State right)
+			{
+				if (better(right.value, left.value) || (right.value == left.value && right.index < left.index))
+					return right;
+				return left;
+			}
+
+			static UInt64 result(State state) { return state.index; }
+		};
+	};
+
+	template<bool _Exclusive>
+	struct Scan
+	{
+		template<typename _Ty>
+		struct Kernel
+		{
+			using Type = _Ty;
+
+			static forceinline void run(void* _dest, const void* _src, Size begin, Size end, _Ty carry)
+			{
+				_Ty* dest = rcast(_Ty*, _dest);
+				const _Ty* src = rcast(const _Ty*, _src);
+				for (Size i = begin; i < end; i++)
+				{
+					_Ty next = apply<Operation::Add>(carry, src[i]);
+					dest[i] = _Exclusive ? carry : next;
+					carry = next;
+				}
+			}
+		};
+	};
+
+
+	template<typename _Ty, typename _Index>
+	struct Gather
+	{
+		using Element = _Ty;
+		using Index = _Index;
+
+		static forceinline void run(void* _dest, const void* _table, const void* _indices, Size count)
+		{
+			_Ty* dest = rcast(_Ty*, _dest);
+			const _Ty* table = rcast(const _Ty*, _table);
+			const _Index* indices = rcast(const _Index*, _indices);
+			for (Size i = 0; i < count; i++)
+				dest[i] = table[indices[i]];
+		}
+	};
+
+	template<typename _Ty, typename _Index>
+	struct Scatter
+	{
+		using Element = _Ty;
+		using Index = _Index;
+
+		static forceinline void run(void* _table, const void* _src, const void* _indices, Size count)
+		{
+			_Ty* table = rcast(_Ty*, _table);
+			const _Ty* src = rcast(const _Ty*, _src);
+			const _Index* indices = rcast(const _Index*, _indices);
+			for (Size i = 0; i < count; i++)
+				table[indices[i]] = src[i];
+		}
+	};
+
+
+	struct ScalarTarget
+	{
+		template<typename _Kernel>
+		static void binary(void* dest, const void* left, const void* right, Size count) { _Kernel::run(dest, left, right, count); }
+
+		template<typename _Kernel>
+		static void select(void* dest, const UInt8* mask, const void* left, const void* right, Size count) { _Kernel::run(dest, mask, left, right, count); }
+
+		template<typename _Kernel>
+		static typename _Kernel::State reduce(const void* left, const void* right, Size begin, Size end) { return _Kernel::run(left, right, begin, end); }
+
+		template<typename _Kernel>
+		static void scan(void* dest, const void* src, Size begin, Size end, typename _Kernel::Type carry) { _Kernel::run(dest, src, begin, end, carry); }
+
+		template<typename _Kernel>
+		static void gather(void* dest, const void* table, const void* indices, Size count) { _Kernel::run(dest, table, indices, count); }
+
+		template<typename _Kernel>
+		static void scatter(void* table, const void* src, const void* indices, Size count) { _Kernel::run(table, src, indices, count); }
+	};
+
+#if defined(KRAM_SIMD_X86_TARGETS)
+	struct Avx2Target
+	{
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static void binary(void* dest, const void* left, const void* right, Size count) { _Kernel::run(dest, left, right, count); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static void select(void* dest, const UInt8* mask, const void* left, const void* right, Size count) { _Kernel::run(dest, mask, left, right, count); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static typename _Kernel::State reduce(const void* left, const void* right, Size begin, Size end) { return _Kernel::run(left, right, begin, end); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static void scan(void* dest, const void* src, Size begin, Size end, typename _Kernel::Type carry) { _Kernel::run(dest, src, begin, end, carry); }
+
+		/* Four indices widened to 64 bits, as vpgatherq* takes them */
+		template<typename _Index>
+		KRAM_TARGET_AVX2 static forceinline __m256i offsets(const _Index* indices)
+		{
+			if constexpr (sizeof(_Index) == 1)
+			{
+				Int32 packed;
+				std::memcpy(&packed, indices, sizeof(packed));
+				return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+			}
+			else if constexpr (sizeof(_Index) == 2)
+				return _mm256_cvtepu16_epi64(_mm_loadl_epi64(rcast(const __m128i*, indices)));
+			else if constexpr (sizeof(_Index) == 4)
+				return _mm256_cvtepu32_epi64(_mm_loadu_si128(rcast(const __m128i*, indices)));
+			else return _mm256_loadu_si256(rcast(const __m256i*, indices));
+		}
+
+		/* Narrow elements and the tail stay on the plain loop */
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static void gather(void* _dest, const void* table, const void* _indices, Size count)
+		{
+			using _Ty = typename _Kernel::Element;
+			using _Index = typename _Kernel::Index;
+			_Ty* dest = rcast(_Ty*, _dest);
+			const _Index* indices = rcast(const _Index*, _indices);
+			Size i = 0;
+
+			if constexpr (sizeof(_Ty) == 4)
+			{
+				for (; i + 4 <= count; i += 4)
+					_mm_storeu_si128(rcast(__m128i*, dest + i), _mm256_i64gather_epi32(rcast(const int*, table), offsets(indices + i), 4));
+			}
+			else if constexpr (sizeof(_Ty) == 8)
+			{
+				for (; i + 4 <= count; i += 4)
+					_mm256_storeu_si256(rcast(__m256i*, dest + i), _mm256_i64gather_epi64(rcast(const long long*, table), offsets(indices + i), 8));
+			}
+			_Kernel::run(dest + i, table, indices + i, count - i);
+		}
+
+		/* AVX2 has no scatter */
+		template<typename _Kernel>
+		KRAM_TARGET_AVX2 static void scatter(void* table, const void* src, const void* indices, Size count) { _Kernel::run(table, src, indices, count); }
+	};
+
+	struct Avx512Target
+	{
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static void binary(void* dest, const void* left, const void* right, Size count) { _Kernel::run(dest, left, right, count); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static void select(void* dest, const UInt8* mask, const void* left, const void* right, Size count) { _Kernel::run(dest, mask, left, right, count); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static typename _Kernel::State reduce(const void* left, const void* right, Size begin, Size end) { return _Kernel::run(left, right, begin, end); }
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static void scan(void* dest, const void* src, Size begin, Size end, typename _Kernel::Type carry) { _Kernel::run(dest, src, begin, end, carry); }
+
+		/* The unmasked conversions and gathers start from an undefined register, which GCC
+		 * reports as maybe uninitialized: the masked forms over every lane start from zero
+		 */
+		template<typename _Index>
+		KRAM_TARGET_AVX512 static forceinline __m512i offsets(const _Index* indices)
+		{
+			if constexpr (sizeof(_Index) == 1)
+				return _mm512_maskz_cvtepu8_epi64(0xFF, _mm_loadl_epi64(rcast(const __m128i*, indices)));
+			else if constexpr (sizeof(_Index) == 2)
+				return _mm512_maskz_cvtepu16_epi64(0xFF, _mm_loadu_si128(rcast(const __m128i*, indices)));
+			else if constexpr (sizeof(_Index) == 4)
+				return _mm512_maskz_cvtepu32_epi64(0xFF, _mm256_loadu_si256(rcast(const __m256i*, indices)));
+			else return _mm512_loadu_si512(indices);
+		}
+
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static void gather(void* _dest, const void* table, const void* _indices, Size count)
+		{
+			using _Ty = typename _Kernel::Element;
+			using _Index = typename _Kernel::Index;
+			_Ty* dest = rcast(_Ty*, _dest);
+			const _Index* indices = rcast(const _Index*, _indices);
+			Size i = 0;
+
+			if constexpr (sizeof(_Ty) == 4)
+			{
+				for (; i + 8 <= count; i += 8)
+					_mm256_storeu_si256(rcast(__m256i*, dest + i), _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), 0xFF, offsets(indices + i), table, 4));
+			}
+			else if constexpr (sizeof(_Ty) == 8)
+			{
+				for (; i + 8 <= count; i += 8)
+					_mm512_storeu_si512(dest + i, _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, offsets(indices + i), table, 8));
+			}
+			_Kernel::run(dest + i, table, indices + i, count - i);
+		}
+
+		/* Lanes are stored from the lowest, which keeps the last of repeated indices */
+		template<typename _Kernel>
+		KRAM_TARGET_AVX512 static void scatter(void* table, const void* _src, const void* _indices, Size count)
+		{
+			using _Ty = typename _Kernel::Element;
+			using _Index = typename _Kernel::Index;
+			const _Ty* src = rcast(const _Ty*, _src);
+			const _Index* indices = rcast(const _Index*, _indices);
+			Size i = 0;
+
+			if constexpr (sizeof(_Ty) == 4)
+			{
+				for (; i + 8 <= count; i += 8)
+					_mm512_i64scatter_epi32(table, offsets(indices + i), _mm256_loadu_si256(rcast(const __m256i*, src + i)), 4);
+			}
+			else if constexpr (sizeof(_Ty) == 8)
+			{
+				for (; i + 8 <= count; i += 8)
+					_mm512_i64scatter_epi64(table, offsets(indices + i), _mm512_loadu_si512(src + i), 8);
+			}
+			_Kernel::run(table, src + i, indices + i, count - i);
+		}
+	};
+#endif
+
+	static void ignore_binary(void*, const void*, const void*, Size) {}
+	static void ignore_select(void*, const UInt8*, const void*, const void*, Size) {}
+	static UInt64 ignore_reduce(const void*, const void*, Size) { return 0; }
+	static void ignore_scan(void*, const void*, Size) {}
+
+
+	/* Workers are started on first use and live until exit. One split runs at a time;
+	 * a caller that finds the pool busy does all of its parts itself.
+	 */
+	class Pool
+	{
+	private:
+		std::mutex _busy;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _done;
+		std::vector<std::thread> _threads;
+		const std::function<void(Size)>* _job = nullptr;
+		Size _next = 0;
+		Size _parts = 0;
+		Size _pending = 0;
+		bool _stop = false;
+
+	public:
+		Pool() = default;
+		Pool(const Pool&) = delete;
+		Pool& operator= (const Pool&) = delete;
+
+		~Pool()
+		{
+			{
+				std::lock_guard lock{ _mutex };
+				_stop = true;
+			}
+			_wake.notify_all();
+			for (std::thread& thread : _threads)
+				thread.join();
+		}
+
+		/* Calls job(part) for every part in [0, parts) and returns once all are done */
+		void run(Size parts, const std::function<void(Size)>& job)
+		{
+			std::unique_lock busy{ _busy, std::try_to_lock };
+			if (!busy || parts < 2)
+			{
+				for (Size part = 0; part < parts; part++)
+					job(part);
+				return;
+			}
+
+			std::unique_lock lock{ _mutex };
+			while (_threads.size() < parts - 1)
+				_threads.emplace_back([this]() { work(); });
+
+			_job = &job;
+			_next = 0;
+			_parts = parts;
+			_pending = parts;
+			_wake.notify_all();
+
+			take(lock);
+			_done.wait(lock, [this]() { return _pending == 0; });
+			_job = nullptr;
+			_parts = 0;
+		}
+
+	private:
+		void take(std::unique_lock<std::mutex>& lock)
+		{
+			while (_next < _parts)
+			{
+				Size part = _next++;
+				lock.unlock();
+				(*_job)(part);
+				lock.lock();
+				if (--_pending == 0)
+					_done.notify_all();
+			}
+		}
+
+		void work()
+		{
+			std::unique_lock lock{ _mutex };
+			for (;;)
+			{
+				_wake.wait(lock, [this]() { return _stop || _next < _parts; });
+				if (_stop)
+					return;
+				take(lock);
+			}
+		}
+	};
+
+	static std::atomic<Size> parallel_threshold{ 0 };
+	static std::atomic<Size> parallel_threads{ 0 };
+
+	static Pool& pool()
+	{
+		static Pool instance;
+		return instance;
+	}
+
+	/* Consecutive ranges of whole 64 element blocks, none of them empty */
+	struct Split
+	{
+		static constexpr Size Granularity = 64;
+
+		Size count;
+		Size chunk;
+		Size parts;
+
+		explicit Split(Size count) :
+			count{ count },
+			chunk{ count },
+			parts{ 1 }
+		{
+			Size threshold = parallel_threshold.load(std::memory_order_relaxed);
+			if (threshold == 0 || count < threshold || count < 2 * Granularity)
+				return;
+
+			Size threads = parallel_threads.load(std::memory_order_relaxed);
+			if (threads == 0)
+				threads = std::max<Size>(std::thread::hardware_concurrency(), 1);
+
+			chunk = (count + threads - 1) / threads;
+			chunk = (chunk + Granularity - 1) / Granularity * Granularity;
+			parts = (count + chunk - 1) / chunk;
+		}
+
+		Size begin(Size part) const { return part * chunk; }
+		Size end(Size part) const { return std::min(begin(part) + chunk, count); }
+	};
+
+	template<typename _Target, typename _Kernel>
+	static UInt64 run_reduce(const void* left, const void* right, Size count)
+	{
+		if (count == 0)
+			return _Kernel::Empty;
+
+		Split split{ count };
+		if (split.parts < 2)
+			return _Kernel::result(_Target::template reduce<_Kernel>(left, right, 0, count));
+
+		std::vector<typename _Kernel::State> states(split.parts);
+		pool().run(split.parts, [&](Size part) {
+			states[part] = _Target::template reduce<_Kernel>(left, right, split.begin(part), split.end(part));
+		});
+
+		typename _Kernel::State state = states[0];
+		for (Size part = 1; part < split.parts; part++)
+			state = _Kernel::merge(state, states[part]);
+		return _Kernel::result(state);
+	}
+
+	/* Split scans sum every range first, then scan the ranges from their carries */
+	template<typename _Target, typename _Kernel>
+	static void run_scan(void* dest, const void* src, Size count)
+	{
+		using _Ty = typename _Kernel::Type;
+
+		Split split{ count };
+		if (split.parts < 2)
+		{
+			_Target::template scan<_Kernel>(dest, src, 0, count, _Ty{});
+			return;
+		}
+
+		std::vector<_Ty> carries(split.parts);
+		pool().run(split.parts, [&](Size part) {
+			carries[part] = scast(_Ty, _Target::template reduce<Sum<_Ty>>(src, nullptr, split.begin(part), split.end(part)));
+		});
+
+		_Ty carry{};
+		for (Size part = 0; part < split.parts; part++)
+		{
+			_Ty total = carries[part];
+			carries[part] = carry;
+			carry = apply<Operation::Add>(carry, total);
+		}
+
+		pool().run(split.parts, [&](Size part) {
+			_Target::template scan<_Kernel>(dest, src, split.begin(part), split.end(part), carries[part]);
+		});
+	}
+
+
+	/* Rows are indexed by ElementType */
+	template<typename _Target, template<typename> class _Kernel>
+	constexpr std::array<BinaryKernel, TypeSlots> binary_row()
+	{
+		return {
+			&_Target::template binary<_Kernel<Int8>>,
+			&_Target::template binary<_Kernel<Int16>>,
+			&_Target::template binary<_Kernel<Int32>>,
+			&_Target::template binary<_Kernel<Int64>>,
+			&_Target::template binary<_Kernel<UInt8>>,
+			&_Target::template binary<_Kernel<UInt16>>,
+			&_Target::template binary<_Kernel<UInt32>>,
+			&_Target::template binary<_Kernel<UInt64>>,
+			&_Target::template binary<_Kernel<float>>,
+			&_Target::template binary<_Kernel<double>>,
+			&ignore_binary, &ignore_binary, &ignore_binary, &ignore_binary, &ignore_binary, &ignore_binary
+		};
+	}
+
+	template<typename _Target>
+	constexpr std::array<SelectKernel, TypeSlots> select_row()
+	{
+		return {
+			&_Target::template select<Select<Int8>>,
+			&_Target::template select<Select<Int16>>,
+			&_Target::template select<Select<Int32>>,
+			&_Target::template select<Select<Int64>>,
+			&_Target::template select<Select<UInt8>>,
+			&_Target::template select<Select<UInt16>>,
+			&_Target::template select<Select<UInt32>>,
+			&_Target::template select<Select<UInt64>>,
+			&_Target::template select<Select<float>>,
+			&_Target::template select<Select<double>>,
+			&ignore_select, &ignore_select, &ignore_select, &ignore_select, &ignore_select, &ignore_select
+		};
+	}
+
+	template<typename _Target, template<typename> class _Kernel>
+	constexpr std::array<ReduceKernel, TypeSlots> reduce_row()
+	{
+		return {
+			&run_reduce<_Target, _Kernel<Int8>>,
+			&run_reduce<_Target, _Kernel<Int16>>,
+			&run_reduce<_Target, _Kernel<Int32>>,
+			&run_reduce<_Target, _Kernel<Int64>>,
+			&run_reduce<_Target, _Kernel<UInt8>>,
+			&run_reduce<_Target, _Kernel<UInt16>>,
+			&run_reduce<_Target, _Kernel<UInt32>>,
+			&run_reduce<_Target, _Kernel<UInt64>>,
+			&run_reduce<_Target, _Kernel<float>>,
+			&run_reduce<_Target, _Kernel<double>>,
+			&ignore_reduce, &ignore_reduce, &ignore_reduce, &ignore_reduce, &ignore_reduce, &ignore_reduce
+		};
+	}
+
+	template<typename _Target, template<typename> class _Kernel>
+	constexpr std::array<ScanKernel, TypeSlots> scan_row()
+	{
+		return {
+			&run_scan<_Target, _Kernel<Int8>>,
+			&run_scan<_Target, _Kernel<Int16>>,
+			&run_scan<_Target, _Kernel<Int32>>,
+			&run_scan<_Target, _Kernel<Int64>>,
+			&run_scan<_Target, _Kernel<UInt8>>,
+			&run_scan<_Target, _Kernel<UInt16>>,
+			&run_scan<_Target, _Kernel<UInt32>>,
+			&run_scan<_Target, _Kernel<UInt64>>,
+			&run_scan<_Target, _Kernel<float>>,
+			&run_scan<_Target, _Kernel<double>>,
+			&ignore_scan, &ignore_scan, &ignore_scan, &ignore_scan, &ignore_scan, &ignore_scan
+		};
+	}
+
+	/* Indexed by element_log2 * 4 + index_log2 */
+	template<typename _Target>
+	constexpr std::array<GatherKernel, 16> gather_table()
+	{
+		return {
+			&_Target::template gather<Gather<UInt8, UInt8>>, &_Target::template gather<Gather<UInt8, UInt16>>, &_Target::template gather<Gather<UInt8, UInt32>>, &_Target::template gather<Gather<UInt8, UInt64>>,
+			&_Target::template gather<Gather<UInt16, UInt8>>, &_Target::template gather<Gather<UInt16, UInt16>>, &_Target::template gather<Gather<UInt16, UInt32>>, &_Target::template gather<Gather<UInt16, UInt64>>,
+			&_Target::template gather<Gather<UInt32, UInt8>>, &_Target::template gather<Gather<UInt32, UInt16>>, &_Target::template gather<Gather<UInt32, UInt32>>, &_Target::template gather<Gather<UInt32, UInt64>>,
+			&_Target::template gather<Gather<UInt64, UInt8>>, &_Target::template gather<Gather<UInt64, UInt16>>, &_Target::template gather<Gather<UInt64, UInt32>>, &_Target::template gather<Gather<UInt64, UInt64>>
+		};
+	}
+
+	template<typename _Target>
+	constexpr std::array<ScatterKernel, 16> scatter_table()
+	{
+		return {
+			&_Target::template scatter<Scatter<UInt8, UInt8>>, &_Target::template scatter<Scatter<UInt8, UInt16>>, &_Target::template scatter<Scatter<UInt8, UInt32>>, &_Target::template scatter<Scatter<UInt8, UInt64>>,
+			&_Target::template scatter<Scatter<UInt16, UInt8>>, &_Target::template scatter<Scatter<UInt16, UInt16>>, &_Target::template scatter<Scatter<UInt16, UInt32>>, &_Target::template scatter<Scatter<UInt16, UInt64>>,
+			&_Target::template scatter<Scatter<UInt32, UInt8>>, &_Target::template scatter<Scatter<UInt32, UInt16>>, &_Target::template scatter<Scatter<UInt32, UInt32>>, &_Target::template scatter<Scatter<UInt32, UInt64>>,
+			&_Target::template scatter<Scatter<UInt64, UInt8>>, &_Target::template scatter<Scatter<UInt64, UInt16>>, &_Target::template scatter<Scatter<UInt64, UInt32>>, &_Target::template scatter<Scatter<UInt64, UInt64>>
+		};
+	}
+
+	struct Kernels
+	{
+		std::array<std::array<BinaryKernel, TypeSlots>, OperationCount> binary;
+		std::array<BinaryKernel, TypeSlots> fma;
+		std::array<std::array<BinaryKernel, TypeSlots>, CompareCount> compare;
+		std::array<SelectKernel, TypeSlots> select;
+		std::array<std::array<ReduceKernel, TypeSlots>, ReductionCount> reduce;
+		std::array<ReduceKernel, TypeSlots> dot;
+		std::array<std::array<ScanKernel, TypeSlots>, 2> scan;
+		std::array<GatherKernel, 16> gather;
+		std::array<ScatterKernel, 16> scatter;
+	};
+
+	template<typename _Target>
+	constexpr Kernels make_kernels()
+	{
+		return {
+			{
+				binary_row<_Target, Binary<Operation::Add>::template Kernel>(),
+				binary_row<_Target, Binary<Operation::Sub>::template Kernel>(),
+				binary_row<_Target, Binary<Operation::Mul>::template Kernel>(),
+				binary_row<_Target, Binary<Operation::Min>::template Kernel>(),
+				binary_row<_Target, Binary<Operation::Max>::template Kernel>()
+			},
+			binary_row<_Target, Fma>(),
+			{
+				binary_row<_Target, Compare<Condition::Equal>::template Kernel>(),
+				binary_row<_Target, Compare<Condition::NotEqual>::template Kernel>(),
+				binary_row<_Target, Compare<Condition::Less>::template Kernel>(),
+				binary_row<_Target, Compare<Condition::GreaterEqual>::template Kernel>(),
+				binary_row<_Target, Compare<Condition::LessEqual>::template Kernel>(),
+				binary_row<_Target, Compare<Condition::Greater>::template Kernel>()
+			},
+			select_row<_Target>(),
+			{
+				reduce_row<_Target, Sum>(),
+				reduce_row<_Target, Extreme<Operation::Min>::template Kernel>(),
+				reduce_row<_Target, Extreme<Operation::Max>::template Kernel>(),
+				reduce_row<_Target, Arg<Operation::Min>::template Kernel>(),
+				reduce_row<_Target, Arg<Operation::Max>::template Kernel>()
+			},
+			reduce_row<_Target, Dot>(),
+			{
+				scan_row<_Target, Scan<false>::template Kernel>(),
+				scan_row<_Target, Scan<true>::template Kernel>()
+			},
+			gather_table<_Target>(),
+			scatter_table<_Target>()
+		};
+	}
+
+	static constexpr Kernels ScalarKernels = make_kernels<ScalarTarget>();
+#if defined(KRAM_SIMD_X86_TARGETS)
+	static constexpr Kernels Avx2Kernels = make_kernels<Avx2Target>();
+	static constexpr Kernels Avx512Kernels = make_kernels<Avx512Target>();
+#endif
+
+
+	static Isa detect()
+	{
+#if defined(KRAM_SIMD_X86_TARGETS)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+			__builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+			return Isa::Avx512;
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return Isa::Avx2;
+#endif
+		return Isa::Scalar;
+	}
+
+	static std::atomic<UInt8> max_isa{ scast(UInt8, Isa::Avx512) };
+
+	Isa isa()
+	{
+		static const Isa detected = detect();
+		return scast(Isa, std::min(scast(UInt8, detected), max_isa.load(std::memory_order_relaxed)));
+	}
+
+	void limit(Isa max)
+	{
+		max_isa.store(scast(UInt8, max), std::memory_order_relaxed);
+	}
+
+	void parallel(Size threshold, Size threads)
+	{
+		parallel_threads.store(threads, std::memory_order_relaxed);
+		parallel_threshold.store(threshold, std::memory_order_relaxed);
+	}
+
+	static const Kernels& kernels()
+	{
+#if defined(KRAM_SIMD_X86_TARGETS)
+		switch (isa())
+		{
+			case Isa::Avx512: return Avx512Kernels;
+			case Isa::Avx2: return Avx2Kernels;
+			default: break;
+		}
+#endif
+		return ScalarKernels;
+	}
+
+
+	void binary(Operation op, ElementType type, void* dest, const void* left, const void* right, Size count)
+	{
+		if (scast(Size, op) < OperationCount)
+			kernels().binary[scast(Size, op)][scast(UInt8, type) & 0xF](dest, left, right, count);
+	}
+
+	void fma(ElementType type, void* dest, const void* left, const void* right, Size count)
+	{
+		kernels().fma[scast(UInt8, type) & 0xF](dest, left, right, count);
+	}
+
+	void compare(Condition condition, ElementType type, UInt8* mask, const void* left, const void* right, Size count)
+	{
+		Size index = scast(Size, condition);
+		if (index >= scast(Size, Condition::Below))
+			index -= scast(Size, Condition::Below) - scast(Size, Condition::Less);
+		if (index < CompareCount)
+			kernels().compare[index][scast(UInt8, type) & 0xF](mask, left, right, count);
+	}
+
+	void select(ElementType type, void* dest, const UInt8* mask, const void* left, const void* right, Size count)
+	{
+		kernels().select[scast(UInt8, type) & 0xF](dest, mask, left, right, count);
+	}
+
+	UInt64 reduce(Reduction reduction, ElementType type, const void* src, Size count)
+	{
+		if (scast(Size, reduction) < ReductionCount)
+			return kernels().reduce[scast(Size, reduction)][scast(UInt8, type) & 0xF](src, nullptr, count);
+		return 0;
+	}
+
+	UInt64 dot(ElementType type, const void* left, const void* right, Size count)
+	{
+		return kernels().dot[scast(UInt8, type) & 0xF](left, right, count);
+	}
+
+	void scan(bool exclusive, ElementType type, void* dest, const void* src, Size count)
+	{
+		kernels().scan[exclusive ? 1 : 0][scast(UInt8, type) & 0xF](dest, src, count);
+	}
+
+	void gather(UInt8 element_log2, UInt8 index_log2, void* dest, const void* table, const void* indices, Size count)
+	{
+		kernels().gather[((element_log2 & 3) << 2) | (index_log2 & 3)](dest, table, indices, count);
+	}
+
+	void scatter(UInt8 element_log2, UInt8 index_log2, void* table, const void* src, const void* indices, Size count)
+	{
+		kernels().scatter[((element_log2 & 3) << 2) | (index_log2 & 3)](table, src, indices, count);
+	}
+}
@@ -0,0 +1,570 @@
+#include "trace.h"
+
+#include "jit_x64.h"
+
+using kram::op::Opcode;
+using kram::runtime::DecodedInstruction;
+
+namespace kram::jit
+{
+	static bool writes_flags(Opcode opcode)
+	{
+		return opcode >= Opcode::CMP_r_r && opcode <= Opcode::TEST_r_imm;
+	}
+
+	static bool is_branch(Opcode opcode)
+	{
+		return opcode == Opcode::JMP_s32 || opcode == Opcode::JCC_s32 || opcode == Opcode::LOOP_s32;
+	}
+
+	Size record_trace(Trace& trace, runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size start, bool loop, UInt8& flags)
+	{
+		Size end = chunk->codeCount;
+		Size offset = start;
+
+		trace.start = start;
+		trace.end = start;
+		trace.size = 0;
+		trace.loop = false;
+		trace.frame = state->stack->base + regs->sb.stack_offset;
+		trace.statics = regs->sd.addr_stack_offset;
+		trace.steps.clear();
+
+#if defined(KRAM_JIT_X64)
+		/* A loop trace can not see the flags of the interpreter: it stops at a JCC reading them */
+		bool written = false;
+		std::vector<bool> visited(end, false);
+		std::vector<DecodedInstruction> insts;
+		while (offset < end && !visited[offset] && trace.steps.size() < MaxTraceLength)
+		{
+			insts.clear();
+			Size size = runtime::decode_one(chunk->code + offset, chunk->code + end, insts);
+			if (!size || !std::all_of(insts.begin(), insts.end(), &x64::supported))
+				break;
+			if (loop && !written && insts.front().opcode == Opcode::JCC_s32)
+				break;
+
+			visited[offset] = true;
+			Size next = offset + size;
+			for (const DecodedInstruction& inst : insts)
+			{
+				if (!is_branch(inst.opcode))
+				{
+					UInt64 base = inst.segment > 2 ? regs->by_index[inst.base].u64 : 0;
+					trace.steps.push_back({ inst, offset, base, false, 0 });
+					flags = runtime::_execute_step(state, regs, inst, flags);
+					written = written || writes_flags(inst.opcode);
+					continue;
+				}
+
+				Size target = scast(Size, scast(Int64, offset + size) + inst.imm);
+				bool taken = inst.opcode == Opcode::JMP_s32
+					|| (inst.opcode == Opcode::JCC_s32 && op::condition_holds(inst.aux, flags))
+					|| (inst.opcode == Opcode::LOOP_s32 && --regs->by_index[inst.reg].u64 != 0);
+				if (inst.opcode != Opcode::JMP_s32)
+				{
+					trace.steps.push_back({ inst, offset, 0, taken, taken ? offset + size : target });
+					if (taken && target == start)
+						trace.end = offset + size;
+				}
+				if (taken)
+					next = target;
+			}
+			trace.size += size;
+			offset = next;
+		}
+#endif
+
+		if (loop)
+		{
+			trace.loop = offset == start && !trace.steps.empty();
+			if (!trace.loop)
+				trace.steps.clear();
+		}
+		else trace.end = offset;
+		return offset;
+	}
+
+	/* Flags only live in the interpreter: the exits of a trace that writes them must not
+	 * lead to a JCC reading them
+	 */
+	static bool flags_survive_trace(const Trace& trace, const bin::Chunk* chunk)
+	{
+		if (std::none_of(trace.steps.begin(), trace.steps.end(), [](const TraceStep& step) { return writes_flags(step.inst.opcode); }))
+			return true;
+
+		Size function = 0;
+		for (Size i = 0; i < chunk->functionCount; i++)
+			if (chunk->functions[i].codeOffset <= trace.start && chunk->functions[i].codeOffset >= chunk->functions[function].codeOffset)
+				function = i;
+		Size start = chunk->functions[function].codeOffset;
+		runtime::DecodedFunction decoded = runtime::decode_function(chunk, start, function_end(chunk, start));
+		std::vector<bool> live = runtime::flags_live(chunk, decoded);
+
+		auto exits_safely = [&](Size offset) {
+			Size index = decoded.index(offset);
+			return index != runtime::NoRecord && !live[index];
+		};
+		if (!trace.loop && !exits_safely(trace.end))
+			return false;
+		/* Guards leave at the other side of a branch, or at the start of an instruction
+		 * whose base register a linear trace guards
+		 */
+		for (const TraceStep& step : trace.steps)
+		{
+			if (is_branch(step.inst.opcode) ? !exits_safely(step.other) : !trace.loop && step.inst.segment > 2 && !exits_safely(step.offset))
+				return false;
+		}
+		return true;
+	}
+
+#if defined(KRAM_JIT_X64)
+	using namespace x64;
+
+	/* What the trace compiler knows about a VM register at the current point of the trace.
+	 * A dirty value has not been written to Registers yet.
+	 */
+	struct TraceValue
+	{
+		bool known;
+		bool dirty;
+		UInt64 value;
+	};
+
+	struct SideExit
+	{
+		Size jump;
+		Size offset;
+		std::vector<std::pair<UInt8, UInt64>> writes;	/* deferred registers to rebuild */
+	};
+
+	struct TraceContext
+	{
+		const Trace& trace;
+		Emitter em;
+		TraceValue regs[16];
+		std::vector<SideExit> exits;
+	};
+
+	static void write_back(Emitter& em, UInt8 reg, UInt64 value)
+	{
+		em.mov_imm(HostReg::rcx, value);
+		em.store(8, RegsReg, reg_disp(reg), HostReg::rcx);
+	}
+
+	static void flush(TraceContext& ctx, UInt8 reg)
+	{
+		TraceValue& value = ctx.regs[reg & 0xf];
+		if (value.dirty)
+		{
+			write_back(ctx.em, reg & 0xf, value.value);
+			value.dirty = false;
+		}
+	}
+
+	static void define(TraceContext& ctx, UInt8 reg, UInt64 value)
+	{
+		ctx.regs[reg] = { true, true, value };
+	}
+
+	/* "reg" is about to be written by generated code. A partial write needs the deferred value in place. */
+	static void clobber(TraceContext& ctx, UInt8 reg, Size width)
+	{
+		if (width < 8)
+			flush(ctx, reg);
+		ctx.regs[reg] = { false, false, 0 };
+	}
+
+	static void side_exit(TraceContext& ctx, Size jump, Size offset)
+	{
+		SideExit exit{ jump, offset, {} };
+		for (UInt8 reg = 0; reg < 16; reg++)
+			if (ctx.regs[reg].dirty)
+				exit.writes.push_back({ reg, ctx.regs[reg].value });
+		ctx.exits.push_back(std::move(exit));
+	}
+
+	/* Leaves the trace unless "reg" still holds the value it had while recording */
+	static void guard_register(TraceContext& ctx, UInt8 reg, UInt64 value, Size offset)
+	{
+		ctx.em.load(8, HostReg::rax, RegsReg, reg_disp(reg));
+		ctx.em.mov_imm(HostReg::rcx, value);
+		ctx.em.cmp(HostReg::rax, HostReg::rcx);
+		side_exit(ctx, ctx.em.jne(), offset);
+		ctx.regs[reg] = { true, false, value };
+	}
+
+	static void load_register(TraceContext& ctx, Size width, HostReg dst, UInt8 reg)
+	{
+		if (ctx.regs[reg].known)
+			ctx.em.mov_imm(dst, ctx.regs[reg].value);
+		else ctx.em.load(width, dst, RegsReg, reg_disp(reg));
+	}
+
+	/* Folds the parts of the location the trace made constant. Returns true, with the
+	 * whole "address", when nothing is left to compute at run time; otherwise, or if
+	 * "materialize", the address is emitted into rax. Clobbers rcx.
+	 */
+	static bool trace_address(TraceContext& ctx, const TraceStep& step, bool can_exit, bool materialize, UInt64& address)
+	{
+		const DecodedInstruction& inst = step.inst;
+		Emitter& em = ctx.em;
+
+		bool base_known = true;
+		UInt64 base = 0;
+		switch (inst.segment)
+		{
+			case 0:
+				break;
+			case 1:
+				base = rcast(UInt64, ctx.trace.frame);
+				break;
+			case 2:
+				base = rcast(UInt64, ctx.trace.statics);
+				break;
+			default:
+				if (!ctx.regs[inst.base].known && can_exit)
+					guard_register(ctx, inst.base, step.base, step.offset);
+				base_known = ctx.regs[inst.base].known;
+				base = base_known ? ctx.regs[inst.base].value : 0;
+				break;
+		}
+
+		bool index_known = !inst.indexed || ctx.regs[inst.index].known;
+		address = base + inst.delta;
+		if (inst.indexed && index_known)
+			address += ctx.regs[inst.index].value << inst.scale;
+
+		if (base_known && index_known && !materialize)
+			return true;
+
+		if (base_known)
+			em.mov_imm(HostReg::rax, address);
+		else
+		{
+			em.load(8, HostReg::rax, RegsReg, reg_disp(inst.base));
+			if (address != 0)
+			{
+				em.mov_imm(HostReg::rcx, address);
+				em.add(HostReg::rax, HostReg::rcx);
+			}
+		}
+
+		if (!index_known)
+		{
+			em.load(8, HostReg::rcx, RegsReg, reg_disp(inst.index));
+			if (inst.scale)
+				em.shl_imm(HostReg::rcx, inst.scale);
+			em.add(HostReg::rax, HostReg::rcx);
+		}
+		return base_known && index_known;
+	}
+
+	static Size cast_type_size(UInt8 type)
+	{
+		if (type < 8)
+			return Size(1) << (type & 3);
+		return type == 8 ? 4 : 8;
+	}
+
+	/* CST in place at [base + disp] for integer<->integer and signed integer<->double.
+	 * Returns false for the conversions left to runtime::_cast_value. Clobbers rcx and xmm0.
+	 */
+	static bool emit_cast(Emitter& em, UInt8 types, HostReg base, Int32 disp)
+	{
+		UInt8 dst = types & 0xf;
+		UInt8 src = (types >> 4) & 0xf;
+
+		if (src < 8 && dst < 8)
+		{
+			if (src >= 4)
+				em.load_signed(cast_type_size(src), HostReg::rcx, base, disp);
+			else em.load(cast_type_size(src), HostReg::rcx, base, disp);
+			em.store(cast_type_size(dst), base, disp, HostReg::rcx);
+			return true;
+		}
+
+		if (src >= 4 && src < 8 && dst == 9)
+		{
+			em.load_signed(cast_type_size(src), HostReg::rcx, base, disp);
+			em.cvtsi2sd(HostReg::rcx);
+			em.movsd_store(base, disp);
+			return true;
+		}
+
+		if (src == 9 && (dst == 6 || dst == 7))
+		{
+			em.movsd_load(base, disp);
+			em.cvttsd2si(HostReg::rcx);
+			em.store(cast_type_size(dst), base, disp, HostReg::rcx);
+			return true;
+		}
+
+		return false;
+	}
+
+	static Size mov_width(Opcode opcode)
+	{
+		switch (opcode)
+		{
+			case Opcode::MOV_r8_m8: case Opcode::MOV_m8_r8: case Opcode::MOV_m8_imm8: return 1;
+			case Opcode::MOV_r16_m16: case Opcode::MOV_m16_r16: case Opcode::MOV_m16_imm16: return 2;
+			case Opcode::MOV_r32_m32: case Opcode::MOV_m32_r32: case Opcode::MOV_m32_imm32: return 4;
+			default: return 8;
+		}
+	}
+
+	static void compile_step(TraceContext& ctx, const TraceStep& step, bool can_exit)
+	{
+		const DecodedInstruction& inst = step.inst;
+		Emitter& em = ctx.em;
+		UInt64 address;
+
+		switch (inst.opcode)
+		{
+			case Opcode::MOV_r64_imm64:
+				define(ctx, inst.reg, inst.imm);
+				break;
+
+			case Opcode::MOV_r64_r64:
+				if (!ctx.regs[inst.aux].known)
+					goto generic;
+				define(ctx, inst.reg, ctx.regs[inst.aux].value);
+				break;
+
+			case Opcode::MOV_r8_m8:
+			case Opcode::MOV_r16_m16:
+			case Opcode::MOV_r32_m32:
+			case Opcode::MOV_r64_m64: {
+				Size width = mov_width(inst.opcode);
+				trace_address(ctx, step, can_exit, true, address);
+				clobber(ctx, inst.reg, width);
+				em.load(width, HostReg::rcx, HostReg::rax, 0);
+				em.store(width, RegsReg, reg_disp(inst.reg), HostReg::rcx);
+			} break;
+
+			case Opcode::MOV_m8_r8:
+			case Opcode::MOV_m16_r16:
+			case Opcode::MOV_m32_r32:
+			case Opcode::MOV_m64_r64: {
+				Size width = mov_width(inst.opcode);
+				trace_address(ctx, step, can_exit, true, address);
+				load_register(ctx, width, HostReg::rcx, inst.reg);
+				em.store(width, HostReg::rax, 0, HostReg::rcx);
+			} break;
+
+			case Opcode::MOV_m8_imm8:
+			case Opcode::MOV_m16_imm16:
+			case Opcode::MOV_m32_imm32:
+			case Opcode::MOV_m64_imm64:
+				trace_address(ctx, step, can_exit, true, address);
+				em.mov_imm(HostReg::rcx, inst.imm);
+				em.store(mov_width(inst.opcode), HostReg::rax, 0, HostReg::rcx);
+				break;
+
+			case Opcode::LEA:
+				if (trace_address(ctx, step, can_exit, false, address))
+					define(ctx, inst.reg, address);
+				else
+				{
+					clobber(ctx, inst.reg, 8);
+					em.store(8, RegsReg, reg_disp(inst.reg), HostReg::rax);
+				}
+				break;
+
+			case Opcode::CST_r:
+				if (ctx.regs[inst.reg].known)
+				{
+					UInt64 value = ctx.regs[inst.reg].value;
+					runtime::_cast_value(inst.aux, &value);
+					define(ctx, inst.reg, value);
+				}
+				else if (!emit_cast(em, inst.aux, RegsReg, reg_disp(inst.reg)))
+					emit_instruction(em, inst);
+				break;
+
+			case Opcode::CST_m:
+				trace_address(ctx, step, can_exit, true, address);
+				if (!emit_cast(em, inst.aux, HostReg::rax, 0))
+				{
+					em.mov(ArgRegs[1], HostReg::rax);
+					em.mov_imm(ArgRegs[0], inst.aux);
+					em.call(rcast(const void*, &runtime::_cast_value));
+				}
+				break;
+
+			default:
+			generic:
+				/* Generic templates read every operand from Registers */
+				flush(ctx, inst.reg);
+				flush(ctx, inst.aux);
+				/* src2 of the register forms of arithmetic */
+				if (inst.opcode >= Opcode::ADD_r_r_r && inst.opcode <= Opcode::SHR_r_r_m && (scast(Size, inst.opcode) - scast(Size, Opcode::ADD_r_r_r)) % 2 == 0)
+					flush(ctx, scast(UInt8, inst.imm));
+				if (inst.segment > 2)
+					flush(ctx, inst.base);
+				if (inst.indexed)
+					flush(ctx, inst.index);
+				emit_instruction(em, inst);
+				ctx.regs[inst.reg] = { false, false, 0 };
+				break;
+		}
+	}
+#endif
+
+	CompiledCode compile_trace(const Trace& trace)
+	{
+		CompiledCode result{ nullptr, nullptr, 0, 0 };
+
+#if defined(KRAM_JIT_X64)
+		if (trace.steps.empty())
+			return result;
+
+		TraceContext ctx{ trace, {}, {}, {} };
+		Emitter& em = ctx.em;
+		em.prologue();
+		em.mov_imm(HostReg::rcx, 0);
+		em.store(1, HostReg::rsp, FlagsDisp, HostReg::rcx);
+
+		/* Stack and static locations are folded against the recorded frame: check it once */
+		em.mov_imm(HostReg::rcx, rcast(UInt64, trace.frame));
+		em.cmp(FrameReg, HostReg::rcx);
+		side_exit(ctx, em.jne(), trace.start);
+		em.mov_imm(HostReg::rcx, rcast(UInt64, trace.statics));
+		em.cmp(StaticsReg, HostReg::rcx);
+		side_exit(ctx, em.jne(), trace.start);
+
+		/* Every round of a loop starts with nothing known about the VM registers */
+		Size head = em.size();
+		for (Size i = 0; i < trace.steps.size(); i++)
+		{
+			const TraceStep& step = trace.steps[i];
+			if (step.inst.opcode == Opcode::JCC_s32 || step.inst.opcode == Opcode::LOOP_s32)
+			{
+				if (step.inst.opcode == Opcode::LOOP_s32)
+					flush(ctx, step.inst.reg);
+				side_exit(ctx, emit_branch(em, step.inst, !step.taken), step.other);
+				if (step.inst.opcode == Opcode::LOOP_s32)
+					ctx.regs[step.inst.reg] = { false, false, 0 };
+				continue;
+			}
+
+			/* Only the first record of a superinstruction can leave: the interpreter resumes at
+			 * whole instructions. Loop traces compute register-segment locations instead.
+			 */
+			bool can_exit = !trace.loop && (i == 0 || trace.steps[i - 1].offset != step.offset);
+			compile_step(ctx, step, can_exit);
+		}
+
+		for (UInt8 reg = 0; reg < 16; reg++)
+			flush(ctx, reg);
+		if (trace.loop)
+			em.patch(em.jmp(), head);
+		else em.exit(trace.end);
+
+		for (const SideExit& exit : ctx.exits)
+		{
+			em.patch(exit.jump, em.size());
+			for (const auto& write : exit.writes)
+				write_back(em, write.first, write.second);
+			em.exit(exit.offset);
+		}
+
+		if (!install(em.code(), result))
+			return result;
+
+		result.bytecodeSize = trace.size;
+#endif
+
+		return result;
+	}
+
+
+	TraceCache::TraceCache() :
+		_entries{},
+		_loops{},
+		_threshold{ available() ? DefaultTraceThreshold : 0 }
+	{}
+
+	TraceCache::~TraceCache()
+	{
+		for (auto& entry : _entries)
+			jit::release(entry.second.code);
+		for (auto& entry : _loops)
+			jit::release(entry.second.code);
+		_entries.clear();
+		_loops.clear();
+	}
+
+	bool TraceCache::enter(Entry& entry, runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size start, bool loop, UInt8& flags, Size& resume)
+	{
+		if (entry.source != chunk->code)
+		{
+			jit::release(entry.code);
+			entry = { chunk->code, 0, 0, 0, false, { nullptr, nullptr, 0, 0 } };
+		}
+
+		if (entry.blacklisted)
+			return false;
+
+		if (entry.code.entry)
+		{
+			resume = entry.code.entry(regs, state->stack->base + regs->sb.stack_offset, regs->sd.addr_stack_offset, state->heap);
+
+			/* A trace that keeps failing its guards is slower than the method JIT */
+			if (resume != entry.end && ++entry.exits >= MaxTraceSideExits)
+			{
+				jit::release(entry.code);
+				entry.blacklisted = true;
+			}
+			return true;
+		}
+
+		if (++entry.calls < _threshold)
+			return false;
+
+		Trace trace;
+		resume = record_trace(trace, state, regs, chunk, start, loop, flags);
+		if (flags_survive_trace(trace, chunk))
+			entry.code = compile_trace(trace);
+		entry.end = trace.end;
+		entry.blacklisted = !entry.code.entry;
+		return true;
+	}
+
+	bool TraceCache::run(runtime::RuntimeState* state, const bin::Chunk* chunk, runtime::FunctionOffset function, UInt8& flags, Size& resume)
+	{
+		if (!_threshold)
+			return false;
+		return enter(_entries[{ chunk, function }], state, &state->regs, chunk, chunk->functions[function].codeOffset, false, flags, resume);
+	}
+
+	bool TraceCache::loop(runtime::RuntimeState* state, runtime::Registers* regs, const bin::Chunk* chunk, Size head, UInt8& flags, Size& resume)
+	{
+		if (!_threshold)
+			return false;
+		return enter(_loops[{ chunk, head }], state, regs, chunk, head, true, flags, resume);
+	}
+
+	void TraceCache::release(const bin::Chunk* chunk)
+	{
+		for (auto it = _entries.begin(); it != _entries.end();)
+		{
+			if (it->first.first == chunk)
+			{
+				jit::release(it->second.code);
+				it = _entries.erase(it);
+			}
+			else ++it;
+		}
+		for (auto it = _loops.begin(); it != _loops.end();)
+		{
+			if (it->first.first == chunk)
+			{
+				jit::release(it->second.code);
+				it = _loops.erase(it);
+			}
+			else ++it;
+		}
+	}
+}
@@ -3,7 +3,9 @@
 namespace kram
 {
 	KramState::KramState() :
-		_rstack{}
+		_rstack{},
+		_code{},
+		_jit{}
 	{
 		runtime::_build_stack(&_rstack, utils::RuntimeStackDefaultSize);
 	}
@@ -0,0 +1,152 @@
+#include "test.h"
+#include "aot.h"
+
+#include <filesystem>
+#include <sstream>
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+static constexpr DataType U64 = DataType::UnsignedQuadWord;
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+
+/* Rounds i = N..1 add 7i / 3 + i % 5 to r4 and count odd rounds in r5, then CMPJ checks
+ * the count. Signed, narrow and zero divisions, shifts and doubles follow before a CALL
+ * the interpreter runs, whose result lands in static 72.
+ */
+static void build_loop(bin::Chunk& chunk, UInt64 rounds)
+{
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r1, Value(rounds)));
+	main.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	main.push_back(mov(Q, Register::r5, Value(UInt64(0))));
+	main.push_back(mov(Q, static_at(56), Value(UInt64(1))));
+	auto body = main.push_back(mov(Q, Register::r0, Register::r1));
+	main.push_back(mov(Q, Register::r2, Value(UInt64(7))));
+	main.push_back(mul(U64, Register::r6, Register::r0, Register::r2));
+	main.push_back(mov(Q, Register::r2, Value(UInt64(3))));
+	main.push_back(div(U64, Register::r6, Register::r6, Register::r2));
+	main.push_back(mov(Q, Register::r2, Value(UInt64(5))));
+	main.push_back(rem(U64, Register::r7, Register::r0, Register::r2));
+	main.push_back(add(U64, Register::r4, Register::r4, Register::r6));
+	main.push_back(add(U64, Register::r4, Register::r4, Register::r7));
+	main.push_back(instruction::test(Q, Register::r1, Value(UInt64(1))));
+	auto even = main.push_back(jcc(op::Condition::Equal));
+	main.push_back(add(U64, Register::r5, Register::r5, static_at(56)));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(even, back);
+	main.branch(back, body);
+	auto check = main.push_back(cmpj(op::Condition::Equal, Q, Register::r5, Value(rounds / 2)));
+	main.push_back(mov(Q, static_at(16), Value(UInt64(0))));
+	auto skip = main.push_back(jmp());
+	auto found = main.push_back(mov(Q, static_at(16), Value(UInt64(1))));
+	auto done = main.push_back(mov(Q, static_at(0), Register::r4));
+	main.branch(check, found);
+	main.branch(skip, done);
+	main.push_back(mov(Q, static_at(8), Register::r5));
+
+	main.push_back(mov(Q, Register::r2, Value(UInt64(-7))));
+	main.push_back(mov(Q, Register::r3, Value(UInt64(2))));
+	main.push_back(div(DataType::SignedDoubleWord, Register::r6, Register::r2, Register::r3));
+	main.push_back(mov(Q, static_at(24), Register::r6));
+	main.push_back(shr(DataType::SignedByte, Register::r7, Register::r2, Register::r3));
+	main.push_back(mov(Q, static_at(32), Register::r7));
+	main.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+	main.push_back(div(U64, Register::r8, Register::r2, Register::r3));
+	main.push_back(rem(DataType::SignedQuadWord, Register::r0, Register::r2, Register::r3));
+	main.push_back(mov(Q, static_at(40), Register::r8));
+	main.push_back(mov(Q, static_at(48), Register::r0));
+	main.push_back(mov(Q, Register::r2, Value(2.0)));
+	main.push_back(sqrt(true, Register::r3, Register::r2));
+	main.push_back(fma(true, Register::r3, Register::r3, Register::r3, Register::r2));
+	main.push_back(mov(Q, static_at(64), Register::r3));
+
+	main.push_back(call(1));
+	main.push_back(mov(Q, static_at(72), Register::r0));
+	main.push_back(ret());
+
+	op::InstructionBuilder triple;
+	triple.push_back(mov(Q, Register::r2, Value(UInt64(3))));
+	triple.push_back(mul(U64, Register::r0, Register::r0, Register::r2));
+	triple.push_back(ret());
+
+	bin::FunctionBuilder callee = test::function(triple);
+	callee.convention(1, 1);
+	test::build(chunk, 80, { test::function(main), callee });
+}
+
+static std::filesystem::path library_path(const char* name)
+{
+#if defined(_WIN32)
+	const char* const Extension = ".dll";
+#else
+	const char* const Extension = ".so";
+#endif
+	return std::filesystem::temp_directory_path() / (std::string(name) + Extension);
+}
+
+/* Branches, compares and arithmetic are translated, and the library leaves only the CALL,
+ * the callee and what follows to the interpreter. The library is only run where the
+ * system C compiler is available.
+ */
+KRAM_TEST(aot_control_flow)
+{
+	constexpr UInt64 Rounds = 1000;
+
+	bin::Chunk raw, translated;
+	build_loop(raw, Rounds);
+	build_loop(translated, Rounds);
+
+	std::ostringstream source;
+	KRAM_CHECK(aot::translate(source, &translated, "kram_test") == 2);
+	KRAM_CHECK(source.str().find("goto kr_") != std::string::npos);
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &raw, 0);
+	KRAM_CHECK(test::load_static(raw, 16) == 1);
+	KRAM_CHECK(test::load_static(raw, 24) == 0xFFFFFFFDull);
+	KRAM_CHECK(test::load_static(raw, 40) == ~0ull);
+	KRAM_CHECK(test::load_static(raw, 48) == UInt64(-7));
+	KRAM_CHECK(test::load_static(raw, 72) == UInt64(-21));
+
+	std::filesystem::path library = library_path("kram_test_aot_control_flow");
+	if (!aot::build(&translated, library.string(), "kram_test"))
+		return;
+	KRAM_CHECK(state.aot().load(&translated, library.string(), "kram_test"));
+
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &translated, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() < 10);
+#endif
+	KRAM_CHECK(std::memcmp(raw.statics, translated.statics, raw.staticCount) == 0);
+}
+
+/* An exit between a CMP and the JCC reading its flags would lose them, so the function
+ * is left to the interpreter
+ */
+KRAM_TEST(aot_keeps_flags_in_the_interpreter)
+{
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r0, Value(UInt64(1))));
+	code.push_back(cmp(Q, Register::r0, Value(UInt64(1))));
+	code.push_back(lea(Register::r1, static_at(0)));
+	code.push_back(mset(DataSize::Byte, Register::r1, Register::r0, Register::r0));
+	auto equal = code.push_back(jcc(op::Condition::Equal));
+	code.push_back(mov(Q, static_at(0), Value(UInt64(0))));
+	code.branch(equal, code.push_back(ret()));
+
+	bin::Chunk chunk;
+	test::build(chunk, 8, { test::function(code) });
+
+	std::ostringstream source;
+	KRAM_CHECK(aot::translate(source, &chunk, "kram_test") == 0);
+}
@@ -0,0 +1,61 @@
+#include "test.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+
+/* left DIV right and left REM right, as stored to a 64 bit register */
+struct Division
+{
+	DataType type;
+	UInt64 left;
+	UInt64 right;
+	UInt64 quotient;
+	UInt64 remainder;
+};
+
+KRAM_TEST(division_never_traps)
+{
+	constexpr UInt64 Min = UInt64(1) << 63;
+	const Division cases[] = {
+		{ DataType::UnsignedQuadWord, 10, 3, 3, 1 },
+		{ DataType::UnsignedQuadWord, 10, 0, ~UInt64(0), 10 },
+		{ DataType::SignedQuadWord, UInt64(-7), 0, UInt64(-1), UInt64(-7) },
+		{ DataType::SignedQuadWord, Min, UInt64(-1), Min, 0 },
+		{ DataType::SignedQuadWord, UInt64(-7), 2, UInt64(-3), UInt64(-1) },
+		{ DataType::UnsignedDoubleWord, 5, 0, 0xFFFFFFFF, 5 }
+	};
+
+	op::InstructionBuilder code;
+	Size offset = 0;
+	for (const Division& division : cases)
+	{
+		code.push_back(mov(Q, Register::r0, Value(division.left)));
+		code.push_back(mov(Q, Register::r1, Value(division.right)));
+		code.push_back(mov(Q, Register::r2, Value(UInt64(0))));
+		code.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+		code.push_back(div(division.type, Register::r2, Register::r0, Register::r1));
+		code.push_back(rem(division.type, Register::r3, Register::r0, Register::r1));
+		code.push_back(mov(Q, location(Segment::Static, UnsignedInteger(offset)), Register::r2));
+		code.push_back(mov(Q, location(Segment::Static, UnsignedInteger(offset + 8)), Register::r3));
+		offset += 16;
+	}
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, offset, { test::function(code) });
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &chunk, 0);
+
+	offset = 0;
+	for (const Division& division : cases)
+	{
+		KRAM_CHECK(test::load_static(chunk, offset) == division.quotient);
+		KRAM_CHECK(test::load_static(chunk, offset + 8) == division.remainder);
+		offset += 16;
+	}
+}
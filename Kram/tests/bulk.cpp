@@ -0,0 +1,139 @@
+#include "test.h"
+#include "aot.h"
+#include "bulk.h"
+
+#include <filesystem>
+#include <sstream>
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+
+/* Statics 0-31 hold the quad words 1, 2, 3, 4; MMB shifts the first three up by one */
+static op::InstructionBuilder overlapping_copy()
+{
+	op::InstructionBuilder code;
+	for (UInt64 i = 0; i < 4; i++)
+		code.push_back(mov(Q, static_at(i * 8), Value(i + 1)));
+	code.push_back(lea(Register::r0, static_at(8)));
+	code.push_back(lea(Register::r1, static_at(0)));
+	code.push_back(mmb(DataSize::Byte, Register::r0, Register::r1, UnsignedInteger(24)));
+	return code;
+}
+
+static void check_overlapping_copy(const bin::Chunk& chunk)
+{
+	KRAM_CHECK(test::load_static(chunk, 0) == 1);
+	KRAM_CHECK(test::load_static(chunk, 8) == 1);
+	KRAM_CHECK(test::load_static(chunk, 16) == 2);
+	KRAM_CHECK(test::load_static(chunk, 24) == 3);
+}
+
+KRAM_TEST(bulk_memory_ops)
+{
+	op::InstructionBuilder code = overlapping_copy();
+
+	/* Four double words of 0x11223344 at 32 */
+	code.push_back(lea(Register::r0, static_at(32)));
+	code.push_back(mov(Q, Register::r1, Value(UInt64(0x11223344))));
+	code.push_back(mov(Q, Register::r2, Value(UInt64(4))));
+	code.push_back(mset(DataSize::DoubleWord, Register::r0, Register::r1, Register::r2));
+
+	/* 1, 1 against 1, 2 */
+	code.push_back(lea(Register::r1, static_at(0)));
+	code.push_back(lea(Register::r2, static_at(8)));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(16))));
+	code.push_back(mcmp(Register::r4, Register::r1, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(48), Register::r4));
+
+	/* The quad word 3 in 0-31, then the byte 0x33 in 32-47 and a byte that is not there */
+	code.push_back(mov(Q, static_at(56), Value(UInt64(3))));
+	code.push_back(lea(Register::r2, static_at(56)));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(32))));
+	code.push_back(mov(Q, Register::r5, Value(UInt64(8))));
+	code.push_back(mfind(Register::r4, Register::r1, Register::r3, Register::r2, Register::r5));
+	code.push_back(mov(Q, static_at(64), Register::r4));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(16))));
+	code.push_back(mov(Q, Register::r2, Value(UInt64(0x33))));
+	code.push_back(mfind(Register::r4, Register::r0, Register::r3, Register::r2));
+	code.push_back(mov(Q, static_at(72), Register::r4));
+	code.push_back(mov(Q, Register::r2, Value(UInt64(0x55))));
+	code.push_back(mfind(Register::r4, Register::r0, Register::r3, Register::r2));
+	code.push_back(mov(Q, static_at(80), Register::r4));
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 88, { test::function(code) });
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &chunk, 0);
+
+	check_overlapping_copy(chunk);
+	for (Size i = 0; i < 4; i++)
+		KRAM_CHECK(test::load_static<UInt32>(chunk, 32 + i * 4) == 0x11223344);
+	KRAM_CHECK(test::load_static(chunk, 48) == 8);
+	KRAM_CHECK(test::load_static(chunk, 64) == 24);
+	KRAM_CHECK(test::load_static(chunk, 72) == 1);
+	KRAM_CHECK(test::load_static(chunk, 80) == bulk::NotFound);
+}
+
+/* Translated MMB goes through the host's bulk::copy, so overlapping blocks move like memmove.
+ * The library is only run where the system C compiler is available.
+ */
+KRAM_TEST(aot_block_copy)
+{
+	op::InstructionBuilder code = overlapping_copy();
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 32, { test::function(code) });
+
+	std::ostringstream source;
+	KRAM_CHECK(aot::translate(source, &chunk, "kram_test") == 1);
+	KRAM_CHECK(source.str().find("kr_host->copy(") != std::string::npos);
+
+#if defined(_WIN32)
+	const char* const Extension = ".dll";
+#else
+	const char* const Extension = ".so";
+#endif
+	std::filesystem::path library = std::filesystem::temp_directory_path() / (std::string("kram_test_aot_block_copy") + Extension);
+	if (!aot::build(&chunk, library.string(), "kram_test"))
+		return;
+
+	KramState state;
+	test::interpreter_only(state);
+	KRAM_CHECK(state.aot().load(&chunk, library.string(), "kram_test"));
+	KRAM_CHECK(state.aot().find(&chunk, 0) != nullptr);
+	runtime::execute(&state, &chunk, 0);
+	check_overlapping_copy(chunk);
+}
+
+/* With streaming on for every size, blocks shorter than the distance to 16 byte alignment
+ * are copied and filled whole, without running past their end.
+ */
+KRAM_TEST(bulk_streaming_small_blocks)
+{
+	alignas(16) std::byte source[64], target[64];
+	for (Size i = 0; i < sizeof(source); i++)
+		source[i] = std::byte(i);
+
+	bulk::streaming(1);
+	for (Size size = 1; size < 40; size++)
+	{
+		std::memset(target, 0, sizeof(target));
+		bulk::copy(target + 3, source, size);
+		KRAM_CHECK(std::memcmp(target + 3, source, size) == 0);
+		KRAM_CHECK(target[3 + size] == std::byte(0));
+
+		std::memset(target, 0, sizeof(target));
+		bulk::fill(target + 1, 0xAB, 1, size);
+		KRAM_CHECK(target[size] == std::byte(0xAB) && target[1 + size] == std::byte(0));
+	}
+	bulk::streaming(Size(4) << 20);
+}
@@ -0,0 +1,255 @@
+#include "test.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+using op::Condition;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+static constexpr DataType U64 = DataType::UnsignedQuadWord;
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+static inline MemoryLocation stack_at(Size offset) { return location(Segment::Stack, UnsignedInteger(offset)); }
+
+/* Runs "chunk" from function 0 on the interpreter, then again with every call promoted to the JIT */
+template<typename _Check>
+static void run_tiers(bin::Chunk& chunk, _Check check)
+{
+	for (Size threshold : { Size(0), Size(1) })
+	{
+		KramState state;
+		test::interpreter_only(state);
+		state.jit().threshold(threshold);
+		for (Size i = 0; i < 2 * runtime::TierLookupInterval; i++)
+		{
+			std::memset(chunk.statics, 0, chunk.staticCount);
+			runtime::execute(&state, &chunk, 0);
+			check();
+		}
+	}
+}
+
+/* Callees get their own window: only declared registers and register arguments come in,
+ * only sr and register results go back.
+ */
+KRAM_TEST(call_register_windows)
+{
+	constexpr Size CallerStack = 16;
+
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r0, Value(UInt64(7))));
+	main.push_back(mov(Q, Register::r8, Value(UInt64(5))));
+	main.push_back(call(1));
+	main.push_back(mov(Q, static_at(0), Register::r0));
+	main.push_back(mov(Q, static_at(8), Register::sr));
+	main.push_back(mov(Q, static_at(16), Register::r8));
+	main.push_back(mov(Q, Register::r0, Value(UInt64(100))));
+	main.push_back(mov(Q, Register::r1, Value(UInt64(200))));
+	main.push_back(mov(Q, Register::r3, Value(UInt64(3))));
+	main.push_back(call(2));
+	main.push_back(mov(Q, static_at(24), Register::r0));
+	main.push_back(mov(Q, static_at(32), Register::r1));
+	main.push_back(mov(Q, static_at(40), Register::r3));
+	main.push_back(mov(Q, stack_at(CallerStack + runtime::FrameOverhead), Value(UInt64(1000))));
+	main.push_back(mov(Q, Register::r2, Value(UInt64((op::SelfConnection << 16) | 3))));
+	main.push_back(callr(Register::r2));
+	main.push_back(mov(Q, static_at(48), Register::sr));
+	main.push_back(ret());
+
+	/* Writes r0 and r8 of its own window only */
+	op::InstructionBuilder leaf;
+	leaf.push_back(mov(Q, Register::r0, Value(UInt64(99))));
+	leaf.push_back(mov(Q, Register::r8, Value(UInt64(98))));
+	leaf.push_back(mov(Q, Register::sr, Value(UInt64(42))));
+	leaf.push_back(ret());
+	bin::FunctionBuilder leafFunction = test::function(leaf);
+	leafFunction.registers(0x101);
+
+	/* Two register arguments and results, swapped; r3 stays local */
+	op::InstructionBuilder swap;
+	swap.push_back(mov(Q, Register::r2, Register::r0));
+	swap.push_back(mov(Q, Register::r0, Register::r1));
+	swap.push_back(mov(Q, Register::r1, Register::r2));
+	swap.push_back(mov(Q, Register::r3, Value(UInt64(55))));
+	swap.push_back(ret());
+	bin::FunctionBuilder swapFunction = test::function(swap);
+	swapFunction.convention(2, 2);
+
+	/* One stack parameter, returned in sr */
+	op::InstructionBuilder param;
+	param.push_back(mov(Q, Register::r3, stack_at(0)));
+	param.push_back(mov(Q, Register::sr, Register::r3));
+	param.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 56, { test::function(main, CallerStack), leafFunction, swapFunction, test::function(param, 0, 8) });
+
+	run_tiers(chunk, [&]() {
+		KRAM_CHECK(test::load_static(chunk, 0) == 7);
+		KRAM_CHECK(test::load_static(chunk, 8) == 42);
+		KRAM_CHECK(test::load_static(chunk, 16) == 5);
+		KRAM_CHECK(test::load_static(chunk, 24) == 200);
+		KRAM_CHECK(test::load_static(chunk, 32) == 100);
+		KRAM_CHECK(test::load_static(chunk, 40) == 3);
+		KRAM_CHECK(test::load_static(chunk, 48) == 1000);
+	});
+}
+
+/* count(r0, r1 = 1): returns r0 in sr by recursing r0 times */
+static bin::FunctionBuilder recursive_count(UInt16 self)
+{
+	op::InstructionBuilder code;
+	auto test_zero = code.push_back(cmpj(Condition::Equal, Q, Register::r0, Value(UInt64(0))));
+	code.push_back(sub(U64, Register::r0, Register::r0, Register::r1));
+	code.push_back(call(self));
+	code.push_back(add(U64, Register::sr, Register::sr, Register::r1));
+	code.push_back(ret());
+	auto base = code.push_back(mov(Q, Register::sr, Value(UInt64(0))));
+	code.push_back(ret());
+	code.branch(test_zero, base);
+	return test::function(code, 24);
+}
+
+KRAM_TEST(call_deep_recursion)
+{
+	constexpr UInt64 Depth = 20000;
+
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r0, Value(Depth)));
+	main.push_back(mov(Q, Register::r1, Value(UInt64(1))));
+	main.push_back(call(1));
+	main.push_back(mov(Q, static_at(0), Register::sr));
+	main.push_back(mov(Q, static_at(8), Register::r0));
+	main.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 16, { test::function(main), recursive_count(1) });
+
+	run_tiers(chunk, [&]() {
+		KRAM_CHECK(test::load_static(chunk, 0) == Depth);
+		KRAM_CHECK(test::load_static(chunk, 8) == Depth);
+	});
+}
+
+/* Records the address of its locals at the first call and at the deepest, then counts r0
+ * down to 0 through "recurse", adding 1 to r5 each time; sr gets the count.
+ */
+static op::InstructionBuilder count_down(bool written_tail_call)
+{
+	op::InstructionBuilder loop;
+	loop.push_back(lea(Register::r3, stack_at(0)));
+	loop.push_back(mov(Q, static_at(8), Register::r3));
+	auto test_zero = loop.push_back(cmpj(Condition::Equal, Q, Register::r0, Value(UInt64(0))));
+	loop.push_back(sub(U64, Register::r0, Register::r0, Register::r1));
+	loop.push_back(add(U64, Register::r5, Register::r5, Register::r1));
+	if (written_tail_call)
+		loop.push_back(tailcall(1));
+	else
+	{
+		loop.push_back(call(1));
+		loop.push_back(ret());
+	}
+	auto done = loop.push_back(mov(Q, Register::sr, Register::r5));
+	loop.push_back(ret());
+	loop.branch(test_zero, done);
+	return loop;
+}
+
+/* Calls count_down once to record the address of its locals in static 0, then "Depth"
+ * times, leaving the count in static 16
+ */
+static constexpr UInt64 Depth = 100000;
+
+static op::InstructionBuilder count_down_twice()
+{
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r0, Value(UInt64(0))));
+	main.push_back(mov(Q, Register::r1, Value(UInt64(1))));
+	main.push_back(call(1));
+	main.push_back(mov(Q, Register::r4, static_at(8)));
+	main.push_back(mov(Q, static_at(0), Register::r4));
+	main.push_back(mov(Q, Register::r0, Value(Depth)));
+	main.push_back(mov(Q, Register::r5, Value(UInt64(0))));
+	main.push_back(call(1));
+	main.push_back(mov(Q, static_at(16), Register::sr));
+	main.push_back(ret());
+	return main;
+}
+
+/* Each TAILCALL reuses the frame: the address of the callee's locals never moves, even
+ * across more tail calls than the whole stack could hold frames for.
+ */
+KRAM_TEST(tail_call_constant_stack)
+{
+	bin::Chunk chunk;
+	test::build(chunk, 24, { test::function(count_down_twice()), test::function(count_down(true), 256) });
+
+	run_tiers(chunk, [&]() {
+		KRAM_CHECK(test::load_static(chunk, 0) == test::load_static(chunk, 8));
+		KRAM_CHECK(test::load_static(chunk, 16) == Depth);
+	});
+}
+
+/* CALL then RET as written becomes TAILCALL on build, so the stack stays put as well */
+KRAM_TEST(tail_calls_fused_on_build)
+{
+	bin::Chunk chunk;
+	test::build(chunk, 24, { test::function(count_down_twice()), test::function(count_down(false), 256) });
+
+	run_tiers(chunk, [&]() {
+		KRAM_CHECK(test::load_static(chunk, 0) == test::load_static(chunk, 8));
+		KRAM_CHECK(test::load_static(chunk, 16) == Depth);
+	});
+}
+
+/* Calls per second into a leaf that returns its argument, interpreted and with the leaf
+ * promoted to the JIT by its call count.
+ */
+KRAM_BENCHMARK(calls)
+{
+	constexpr UInt64 Calls = 5'000'000;
+
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r1, Value(Calls)));
+	main.push_back(mov(Q, Register::r2, Value(UInt64(0))));
+	auto body = main.push_back(mov(Q, Register::r0, Register::r1));
+	main.push_back(call(1));
+	main.push_back(add(U64, Register::r2, Register::r2, Register::sr));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(back, body);
+	main.push_back(mov(Q, static_at(0), Register::r2));
+	main.push_back(ret());
+
+	op::InstructionBuilder leaf;
+	leaf.push_back(mov(Q, Register::sr, Register::r0));
+	leaf.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 8, { test::function(main), test::function(leaf) });
+
+	for (Size threshold : { Size(0), jit::DefaultThreshold })
+	{
+		KramState state;
+		test::interpreter_only(state);
+		state.jit().threshold(threshold);
+		double seconds = test::measure(5, [&]() { runtime::execute(&state, &chunk, 0); });
+
+		KRAM_CHECK(test::load_static(chunk, 0) == Calls * (Calls + 1) / 2);
+		test::report(threshold ? "calls, leaf on the JIT" : "calls, interpreted", Calls, seconds);
+	}
+}
+
+/* A frame far past the end of the stack grows it once: the new limit lies above that frame */
+KRAM_TEST(stack_resize_fits_frame)
+{
+	runtime::Stack stack;
+	runtime::_build_stack(&stack, 256);
+
+	for (Size top : { Size(100), Size(300), Size(5000) })
+	{
+		runtime::_resize_stack(&stack, top);
+		KRAM_CHECK(stack.base + top <= stack.limit);
+		KRAM_CHECK(stack.limit <= stack.roof);
+	}
+	runtime::_destroy_stack(&stack);
+}
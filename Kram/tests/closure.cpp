@@ -0,0 +1,149 @@
+#include "test.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+
+/* Two functions, each a run of data moves closed by RET */
+static void build_pair(bin::Chunk& chunk)
+{
+	op::InstructionBuilder first;
+	first.push_back(mov(Q, Register::r0, Value(UInt64(3))));
+	first.push_back(mov(Q, location(Segment::Static, 0), Register::r0));
+	first.push_back(ret());
+
+	op::InstructionBuilder second;
+	second.push_back(mov(Q, Register::r1, Value(UInt64(5))));
+	second.push_back(mov(Q, location(Segment::Stack, 0), Register::r1));
+	second.push_back(mov(Q, Register::r2, location(Segment::Stack, 0)));
+	second.push_back(mov(Q, location(Segment::Static, 8), Register::r2));
+	second.push_back(ret());
+	second.push_back(mov(Q, location(Segment::Static, 16), Value(UInt64(1))));
+
+	test::build(chunk, 24, { test::function(first), test::function(second, 8) });
+}
+
+/* Both functions run on records once warm, and neither runs past its RET */
+KRAM_TEST(closures_per_function)
+{
+	bin::Chunk chunk;
+	build_pair(chunk);
+
+	KramState state;
+	test::interpreter_only(state);
+	state.closures().threshold(1);
+
+	for (int i = 0; i < 3; i++)
+	{
+		std::memset(chunk.statics, 0, chunk.staticCount);
+		runtime::execute(&state, &chunk, 1);
+		KRAM_CHECK(test::load_static(chunk, 0) == 0);
+		KRAM_CHECK(test::load_static(chunk, 8) == 5);
+		KRAM_CHECK(test::load_static(chunk, 16) == 0);
+
+		runtime::execute(&state, &chunk, 0);
+		KRAM_CHECK(test::load_static(chunk, 0) == 3);
+	}
+}
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+
+/* "rounds" calls of a function tripling r0, summed into static 0 by a LOOP, with a
+ * CMPJ that stores 1 at static 8 once the sum is right
+ */
+static void build_calls(bin::Chunk& chunk, UInt64 rounds)
+{
+	const DataType U64 = DataType::UnsignedQuadWord;
+
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r1, Value(rounds)));
+	main.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	auto body = main.push_back(mov(Q, Register::r0, Register::r1));
+	main.push_back(call(1));
+	main.push_back(add(U64, Register::r4, Register::r4, Register::r0));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(back, body);
+	main.push_back(mov(Q, static_at(0), Register::r4));
+	auto check = main.push_back(cmpj(op::Condition::NotEqual, Q, Register::r4, Value(3 * rounds * (rounds + 1) / 2)));
+	main.push_back(mov(Q, static_at(8), Value(UInt64(1))));
+	auto done = main.push_back(ret());
+	main.branch(check, done);
+
+	op::InstructionBuilder triple;
+	triple.push_back(mov(Q, Register::r2, Value(UInt64(3))));
+	triple.push_back(mul(U64, Register::r0, Register::r0, Register::r2));
+	triple.push_back(ret());
+
+	bin::FunctionBuilder callee = test::function(triple);
+	callee.convention(1, 1);
+	test::build(chunk, 16, { test::function(main), callee });
+}
+
+/* A warm chunk runs its calls, returns and branches on closure records, and the raw
+ * interpreter never dispatches
+ */
+KRAM_TEST(closures_run_control_flow)
+{
+	constexpr UInt64 Rounds = 1000;
+
+	bin::Chunk chunk;
+	build_calls(chunk, Rounds);
+
+	KramState state;
+	test::interpreter_only(state);
+	state.closures().threshold(2);
+
+	runtime::execute(&state, &chunk, 0);
+	KRAM_CHECK(state.closures().runs() == 0);
+	KRAM_CHECK(test::load_static(chunk, 8) == 1);
+
+	std::memset(chunk.statics, 0, chunk.staticCount);
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &chunk, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() == 0);
+#endif
+
+	KRAM_CHECK(state.closures().runs() == 1);
+	KRAM_CHECK(test::load_static(chunk, 0) == 3 * Rounds * (Rounds + 1) / 2);
+	KRAM_CHECK(test::load_static(chunk, 8) == 1);
+}
+
+/* MSET has no record: the raw interpreter runs it and the LOOP after it, and every taken
+ * back edge hands the frame back to the closures
+ */
+KRAM_TEST(closures_reenter_at_back_edges)
+{
+	constexpr UInt64 Rounds = 100;
+
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r1, Value(Rounds)));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r4, Value(UInt64(1))));
+	auto body = code.push_back(lea(Register::r0, static_at(8)));
+	code.push_back(mov(Q, Register::r2, Register::r1));
+	code.push_back(add(DataType::UnsignedQuadWord, Register::r3, Register::r3, Register::r1));
+	code.push_back(mset(DataSize::Byte, Register::r0, Register::r2, Register::r4));
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(back, body);
+	code.push_back(mov(Q, static_at(0), Register::r3));
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 16, { test::function(code) });
+
+	KramState state;
+	test::interpreter_only(state);
+	state.closures().threshold(1);
+	runtime::execute(&state, &chunk, 0);
+
+	KRAM_CHECK(state.closures().runs() == Rounds);
+	KRAM_CHECK(test::load_static(chunk, 0) == Rounds * (Rounds + 1) / 2);
+	KRAM_CHECK(test::load_static<UInt8>(chunk, 8) == 1);
+}
@@ -0,0 +1,187 @@
+#include "test.h"
+#include "decoder.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+
+/* Data moves around a call and a loop, which the decoded stream runs through */
+static void build_mixed(bin::Chunk& chunk)
+{
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r0, Value(UInt64(7))));
+	main.push_back(mov(Q, location(Segment::Static, 0), Register::r0));
+	main.push_back(call(1));
+	main.push_back(mov(Q, location(Segment::Static, 16), Register::sr));
+	main.push_back(mov(Q, Register::r1, Value(UInt64(4))));
+	auto body = main.push_back(mov(Q, location(Segment::Static, Register::r1, Q, UnsignedInteger(24)), Register::r1));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(back, body);
+	main.push_back(ret());
+
+	op::InstructionBuilder callee;
+	callee.push_back(mov(Q, location(Segment::Static, 8), Value(UInt64(42))));
+	callee.push_back(mov(Q, Register::sr, Value(UInt64(99))));
+	callee.push_back(ret());
+
+	test::build(chunk, 64, { test::function(main, 8), test::function(callee) });
+}
+
+static void check_mixed(const bin::Chunk& chunk)
+{
+	KRAM_CHECK(test::load_static(chunk, 0) == 7);
+	KRAM_CHECK(test::load_static(chunk, 8) == 42);
+	KRAM_CHECK(test::load_static(chunk, 16) == 99);
+	for (UInt64 i = 1; i <= 4; i++)
+		KRAM_CHECK(test::load_static(chunk, 24 + i * 8) == i);
+}
+
+KRAM_TEST(predecode_runs_calls_and_loops)
+{
+	bin::Chunk chunk;
+	build_mixed(chunk);
+	KRAM_CHECK(runtime::predecode(&chunk));
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &chunk, 0);
+	check_mixed(chunk);
+
+	std::memset(chunk.statics, 0, chunk.staticCount);
+	runtime::execute(&state, &chunk, 1);
+	KRAM_CHECK(test::load_static(chunk, 8) == 42);
+	KRAM_CHECK(test::load_static(chunk, 0) == 0);
+}
+
+KRAM_TEST(predecode_matches_interpreter)
+{
+	bin::Chunk raw, decoded;
+	build_mixed(raw);
+	build_mixed(decoded);
+	KRAM_CHECK(runtime::predecode(&decoded));
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &raw, 0);
+	runtime::execute(&state, &decoded, 0);
+	check_mixed(raw);
+	KRAM_CHECK(std::memcmp(raw.statics, decoded.statics, raw.staticCount) == 0);
+}
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+
+/* Rounds i = N..1 add 3 * i, computed by a call, to r4 and count odd rounds in r5
+ * through TEST and JCC. CMPJ checks the count. Statics 0, 8 and 16 get the sum, the
+ * count and 1 if CMPJ found N / 2.
+ */
+static void build_control_flow(bin::Chunk& chunk, UInt64 rounds)
+{
+	const DataType U64 = DataType::UnsignedQuadWord;
+
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, static_at(24), Value(UInt64(1))));
+	main.push_back(mov(Q, Register::r1, Value(rounds)));
+	main.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	main.push_back(mov(Q, Register::r5, Value(UInt64(0))));
+	auto body = main.push_back(mov(Q, Register::r0, Register::r1));
+	main.push_back(call(1));
+	main.push_back(add(U64, Register::r4, Register::r4, Register::r0));
+	main.push_back(instruction::test(Q, Register::r1, Value(UInt64(1))));
+	auto even = main.push_back(jcc(op::Condition::Equal));
+	main.push_back(add(U64, Register::r5, Register::r5, static_at(24)));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(even, back);
+	main.branch(back, body);
+	auto check = main.push_back(cmpj(op::Condition::Equal, Q, Register::r5, Value(rounds / 2)));
+	main.push_back(mov(Q, static_at(16), Value(UInt64(0))));
+	auto skip = main.push_back(jmp());
+	auto found = main.push_back(mov(Q, static_at(16), Value(UInt64(1))));
+	auto done = main.push_back(mov(Q, static_at(0), Register::r4));
+	main.branch(check, found);
+	main.branch(skip, done);
+	main.push_back(mov(Q, static_at(8), Register::r5));
+	main.push_back(ret());
+
+	op::InstructionBuilder triple;
+	triple.push_back(mov(Q, Register::r2, Value(UInt64(3))));
+	triple.push_back(mul(U64, Register::r0, Register::r0, Register::r2));
+	triple.push_back(ret());
+
+	bin::FunctionBuilder callee = test::function(triple);
+	callee.convention(1, 1);
+	test::build(chunk, 32, { test::function(main), callee });
+}
+
+/* Compares, branches, arithmetic and calls all have records, so the raw interpreter
+ * never dispatches once the chunk is predecoded.
+ */
+KRAM_TEST(predecode_control_flow)
+{
+	constexpr UInt64 Rounds = 1000;
+
+	bin::Chunk raw, decoded;
+	build_control_flow(raw, Rounds);
+	build_control_flow(decoded, Rounds);
+	KRAM_CHECK(runtime::predecode(&decoded));
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &raw, 0);
+
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &decoded, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() == 0);
+#endif
+
+	KRAM_CHECK(test::load_static(decoded, 0) == 3 * Rounds * (Rounds + 1) / 2);
+	KRAM_CHECK(test::load_static(decoded, 8) == Rounds / 2);
+	KRAM_CHECK(test::load_static(decoded, 16) == 1);
+	KRAM_CHECK(std::memcmp(raw.statics, decoded.statics, raw.staticCount) == 0);
+}
+
+/* MSET has no record: the raw interpreter runs it and the LOOP after it, and the back
+ * edge hands the frame back to the stream every round.
+ */
+KRAM_TEST(predecode_reenters_at_back_edges)
+{
+	constexpr UInt64 Rounds = 100;
+
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r1, Value(Rounds)));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r4, Value(UInt64(1))));
+	auto body = code.push_back(lea(Register::r0, static_at(8)));
+	code.push_back(mov(Q, Register::r2, Register::r1));
+	code.push_back(add(DataType::UnsignedQuadWord, Register::r3, Register::r3, Register::r1));
+	code.push_back(mset(DataSize::Byte, Register::r0, Register::r2, Register::r4));
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(back, body);
+	code.push_back(mov(Q, static_at(0), Register::r3));
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 16, { test::function(code) });
+	KRAM_CHECK(runtime::predecode(&chunk));
+
+	KramState state;
+	test::interpreter_only(state);
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &chunk, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() == Rounds * 2 + 2);
+#endif
+
+	KRAM_CHECK(test::load_static(chunk, 0) == Rounds * (Rounds + 1) / 2);
+	KRAM_CHECK(test::load_static<UInt8>(chunk, 8) == 1);
+}
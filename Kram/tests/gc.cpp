@@ -0,0 +1,131 @@
+#include "test.h"
+#include "gc.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static inline void store_pointer(std::byte* at, const void* pointer)
+{
+	std::memcpy(at, &pointer, sizeof(pointer));
+}
+
+/* Roots and blocks are scanned at every byte offset: packed statics and blocks may hold
+ * pointers anywhere.
+ */
+KRAM_TEST(gc_unaligned_pointers)
+{
+	bin::Chunk chunk;
+	test::build(chunk, 24, {});
+
+	Heap heap;
+	gc::Collector collector{ heap };
+	collector.add_root(&chunk);
+
+	std::byte* reached = static_cast<std::byte*>(heap.malloc(64, false));
+	void* chained = heap.malloc(32, false);
+	heap.malloc(48, false);
+	store_pointer(chunk.statics + 3, reached);
+	store_pointer(reached + 13, chained);
+
+	KRAM_CHECK(collector.collect() == 1);
+	while (!collector.sweep());
+
+	std::memset(chunk.statics, 0, chunk.staticCount);
+	KRAM_CHECK(collector.collect() == 2);
+	while (!collector.sweep());
+	KRAM_CHECK(collector.collect() == 0);
+}
+
+/* Blocks with refs above 0 and pinned blocks are roots, and what they point to stays alive */
+KRAM_TEST(gc_roots)
+{
+	Heap heap;
+	gc::Collector collector{ heap };
+
+	std::byte* counted = static_cast<std::byte*>(heap.malloc(32, true));
+	std::byte* pinned = static_cast<std::byte*>(heap.malloc(2000, false));
+	store_pointer(counted + 8, heap.malloc(16, false));
+	store_pointer(pinned + 1001, heap.malloc(16, false));
+	collector.pin(pinned);
+
+	KRAM_CHECK(collector.collect() == 0);
+
+	collector.unpin(pinned);
+	Heap::decrease_ref(counted);
+	KRAM_CHECK(collector.collect() == 4);
+	while (!collector.sweep());
+	KRAM_CHECK(collector.collect() == 0);
+}
+
+/* With a layout, statics are read only at its pointers: a pointer past the layout or at
+ * an offset it does not name keeps nothing alive.
+ */
+KRAM_TEST(gc_static_layout)
+{
+	const bin::DataType pointer{ bin::TypeIdentifier::Pointer };
+	const bin::DataType pointers = bin::DataType{}.arrayOf(pointer, 2);
+
+	for (bool precise : { false, true })
+	{
+		bin::Chunk chunk;
+		test::build(chunk, 24, {});
+
+		Heap heap;
+		gc::Collector collector{ heap };
+		collector.add_root(&chunk);
+		if (precise)
+			collector.root_layout(&chunk, &pointers);
+
+		store_pointer(chunk.statics + 8, heap.malloc(16, false));
+		store_pointer(chunk.statics + 16, heap.malloc(16, false));
+		KRAM_CHECK(collector.collect() == (precise ? 1 : 0));
+	}
+}
+
+/* A loop paced by the collector, whose frame holds one zeroed block at the pointer of its
+ * layout and another at byte 9. Both end up in statics 0 and 8.
+ */
+KRAM_TEST(gc_frame_layout)
+{
+	const bin::DataType pointer{ bin::TypeIdentifier::Pointer };
+	const bin::DataType pointers = bin::DataType{}.arrayOf(pointer, 1);
+
+	constexpr DataSize Q = DataSize::QuadWord;
+	op::InstructionBuilder code;
+	code.push_back(new_(false, Register::r3, UnsignedInteger(8)));
+	code.push_back(mov(Q, location(Register::r3, UnsignedInteger(0)), Value(UInt64(0))));
+	code.push_back(mov(Q, location(Segment::Stack, UnsignedInteger(0)), Register::r3));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+	code.push_back(new_(false, Register::r0, UnsignedInteger(32)));
+	code.push_back(mov(Q, location(Segment::Stack, UnsignedInteger(9)), Register::r0));
+	code.push_back(mov(Q, Register::r0, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r1, Value(UInt64(100))));
+	auto body = code.push_back(mov(Q, Register::r2, Register::r1));
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(back, body);
+	code.push_back(mov(Q, Register::r0, location(Segment::Stack, UnsignedInteger(0))));
+	code.push_back(mov(Q, location(Segment::Static, UnsignedInteger(0)), Register::r0));
+	code.push_back(mov(Q, Register::r0, location(Segment::Stack, UnsignedInteger(9))));
+	code.push_back(mov(Q, location(Segment::Static, UnsignedInteger(8)), Register::r0));
+	code.push_back(ret());
+
+	for (bool precise : { false, true })
+	{
+		bin::Chunk chunk;
+		test::build(chunk, 16, { test::function(code, 24) });
+
+		KramState state;
+		test::interpreter_only(state);
+		gc::Collector collector{ state };
+		collector.pacing(1);
+		if (precise)
+			collector.root_layout(&chunk, 0, &pointers);
+		state.collector(&collector);
+		runtime::execute(&state, &chunk, 0);
+		state.collector(nullptr);
+
+		KRAM_CHECK(Heap::header(reinterpret_cast<void*>(test::load_static(chunk, 0))).size == 8);
+		KRAM_CHECK(Heap::header(reinterpret_cast<void*>(test::load_static(chunk, 8))).size == (precise ? Heap::FreeSlot : 32));
+	}
+}
@@ -0,0 +1,342 @@
+#include "test.h"
+#include "heap.h"
+#include "gc.h"
+
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+
+using namespace kram;
+
+/* Blocks still allocated, counted through the hooks tracing collectors use */
+static Size live_blocks(const Heap& heap)
+{
+	Size count = 0;
+	heap.for_each_run([&](const std::byte* slots, Size stride, Size carved) {
+		for (Size i = 0; i < carved; i++)
+			if (reinterpret_cast<const Heap::Header*>(slots + i * stride)->size != Heap::FreeSlot)
+				count++;
+	});
+	heap.for_each_large([&](const Heap::Header*) { count++; });
+	return count;
+}
+
+KRAM_TEST(heap_blocks)
+{
+	const Size sizes[] = { 0, 1, 16, 17, 100, 1000, Heap::SmallBlockLimit, Heap::SmallBlockLimit + 1, 5000 };
+
+	Heap heap;
+	std::vector<void*> blocks;
+	for (Size size : sizes)
+	{
+		void* block = heap.malloc(size);
+		KRAM_CHECK((reinterpret_cast<std::uintptr_t>(block) & 15) == 0);
+		KRAM_CHECK(Heap::header(block).size == size);
+		KRAM_CHECK(Heap::header(block).refs == 1);
+		std::memset(block, 0xA5, size);
+		blocks.push_back(block);
+	}
+	KRAM_CHECK(live_blocks(heap) == std::size(sizes));
+
+	for (Size i = 0; i < blocks.size(); i++)
+		KRAM_CHECK(Heap::header(blocks[i]).size == sizes[i]);
+
+	heap.free(blocks[1]);
+	heap.free(blocks[7]);
+	KRAM_CHECK(live_blocks(heap) == std::size(sizes) - 2);
+
+	/* A freed slot is handed out again for its size class */
+	void* again = heap.malloc(sizes[1]);
+	KRAM_CHECK(again == blocks[1]);
+	heap.free(again);
+}
+
+/* The collector frees what has no references left and keeps the rest */
+KRAM_TEST(heap_collects_unreferenced)
+{
+	Heap heap;
+	std::vector<void*> kept;
+	for (Size i = 0; i < 1000; i++)
+	{
+		Size size = i % 10 == 0 ? 2000 + i : i % 500;
+		void* block = heap.malloc(size, i % 3 == 0);
+		if (i % 3 == 0)
+			kept.push_back(block);
+	}
+
+	heap.garbage_collector();
+	KRAM_CHECK(live_blocks(heap) == kept.size());
+	for (void* block : kept)
+		KRAM_CHECK(Heap::header(block).refs == 1);
+
+	for (void* block : kept)
+		Heap::decrease_ref(block);
+	heap.garbage_collector();
+	KRAM_CHECK(live_blocks(heap) == 0);
+}
+
+/* The allocator before size classes: one new[] per block, linked into a list for the collector */
+class ListHeap
+{
+private:
+	struct Node
+	{
+		Node* next;
+		Node* prev;
+		Size size;
+		UInt64 refs;
+	};
+
+	Node* _last = nullptr;
+
+public:
+	~ListHeap()
+	{
+		for (Node* node = _last, *prev; node; node = prev)
+		{
+			prev = node->prev;
+			delete[] reinterpret_cast<std::byte*>(node);
+		}
+	}
+
+	void* malloc(Size block_size)
+	{
+		Node* header = reinterpret_cast<Node*>(new std::byte[block_size + sizeof(Node)]);
+		header->next = nullptr;
+		header->prev = _last;
+		header->refs = 1;
+		header->size = block_size;
+		if (_last)
+			_last->next = header;
+		_last = header;
+		return header + 1;
+	}
+
+	void free(void* ptr)
+	{
+		Node* node = reinterpret_cast<Node*>(ptr) - 1;
+		if (node->next)
+			node->next->prev = node->prev;
+		else _last = node->prev;
+		if (node->prev)
+			node->prev->next = node->next;
+		delete[] reinterpret_cast<std::byte*>(node);
+	}
+};
+
+/* Rounds of allocating "Live" small blocks of mixed sizes and freeing them in allocation order */
+static constexpr Size Live = 1000;
+
+template<typename _Heap>
+static void malloc_free(_Heap& heap, Size rounds)
+{
+	std::vector<void*> blocks(Live);
+	for (Size round = 0; round < rounds; round++)
+	{
+		for (Size i = 0; i < Live; i++)
+			blocks[i] = heap.malloc(16 + (i * 40 + round) % 240);
+		for (void* block : blocks)
+			heap.free(block);
+	}
+}
+
+template<typename _Heap>
+static double measure_malloc_free(Size rounds)
+{
+	_Heap heap;
+	return test::measure(5, [&]() { malloc_free(heap, rounds); });
+}
+
+KRAM_BENCHMARK(heap_malloc_free)
+{
+	constexpr Size Rounds = 2000;
+
+	test::report("malloc+free, size classes", Rounds * Live, measure_malloc_free<Heap>(Rounds));
+	test::report("malloc+free, new[] per block", Rounds * Live, measure_malloc_free<ListHeap>(Rounds));
+}
+
+/* Arena blocks, empty ones included, are distinct and non-null from the first allocation on */
+KRAM_TEST(heap_arena_blocks)
+{
+	Heap heap;
+	heap.arena(true);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		void* empty = heap.malloc(0);
+		void* other = heap.malloc(0);
+		void* large = heap.malloc(Heap::ArenaPageSize + 1);
+		KRAM_CHECK(empty != nullptr && other != nullptr && large != nullptr);
+		KRAM_CHECK(empty != other);
+		KRAM_CHECK((reinterpret_cast<std::uintptr_t>(other) & 15) == 0);
+		std::memset(large, 0x5A, Heap::ArenaPageSize + 1);
+		heap.reset();
+	}
+
+	heap.arena(false);
+	KRAM_CHECK(live_blocks(heap) == 0);
+}
+
+/* Blocks freed from another thread go back to their owner, large ones included */
+KRAM_TEST(heap_remote_free)
+{
+	constexpr Size Blocks = 1000;
+
+	Heap owner, other;
+	std::vector<void*> blocks(Blocks);
+	for (Size i = 0; i < Blocks; i++)
+		blocks[i] = owner.malloc(i % 10 == 0 ? 4000 : 48);
+
+	std::thread freer([&]() {
+		for (void* block : blocks)
+			other.free(block);
+	});
+	freer.join();
+
+	KRAM_CHECK(live_blocks(owner) == Blocks);
+	owner.drain_remote();
+	KRAM_CHECK(live_blocks(owner) == 0);
+	KRAM_CHECK(live_blocks(other) == 0);
+}
+
+/* Referenced blocks freed from another thread while their owner collects the unreferenced
+ * ones around them are released once: no slot comes back twice from the free lists
+ * afterwards.
+ */
+KRAM_TEST(heap_remote_free_during_collection)
+{
+	constexpr Size Blocks = 20000;
+
+	Heap owner, other;
+	for (int round = 0; round < 4; round++)
+	{
+		std::vector<void*> blocks(Blocks);
+		for (Size i = 0; i < Blocks; i++)
+			blocks[i] = owner.malloc(i % 64 == 0 ? 2000 : 48, i % 2 == round % 2);
+
+		std::atomic<bool> done{ false };
+		std::thread freer([&]() {
+			for (Size i = round % 2; i < Blocks; i += 2)
+				other.free(blocks[i]);
+			done.store(true, std::memory_order_release);
+		});
+		while (!done.load(std::memory_order_acquire))
+			owner.gc_step(Size(64));
+		freer.join();
+
+		owner.garbage_collector();
+		KRAM_CHECK(live_blocks(owner) == 0);
+
+		std::unordered_set<void*> seen;
+		for (void*& block : blocks)
+		{
+			block = owner.malloc(48);
+			KRAM_CHECK(seen.insert(block).second);
+		}
+		for (void* block : blocks)
+			owner.free(block);
+	}
+}
+
+/* Runs left without live slots go back to the shared pool when a collection ends, and
+ * the slots of runs that still hold a block stay on the free lists.
+ */
+KRAM_TEST(heap_release_runs)
+{
+	auto runs = [](const Heap& heap) {
+		Size count = 0;
+		heap.for_each_run([&](const std::byte*, Size, Size) { count++; });
+		return count;
+	};
+
+	Heap heap;
+	std::vector<void*> blocks(5000);
+	for (void*& block : blocks)
+		block = heap.malloc(48);
+	Size all = runs(heap);
+	KRAM_CHECK(all > 2);
+
+	for (Size i = 0; i + 1 < blocks.size(); i++)
+		heap.free(blocks[i]);
+	KRAM_CHECK(runs(heap) == all);
+	heap.garbage_collector();
+	KRAM_CHECK(runs(heap) == 1);
+	KRAM_CHECK(live_blocks(heap) == 1);
+
+	std::unordered_set<void*> seen{ blocks.back() };
+	for (Size i = 0; i < 100; i++)
+		KRAM_CHECK(seen.insert(heap.malloc(48, false)).second);
+
+	Heap::decrease_ref(blocks.back());
+	gc::Collector collector{ heap };
+	KRAM_CHECK(collector.collect() == 101);
+	while (!collector.sweep());
+	KRAM_CHECK(runs(heap) == 0);
+}
+
+/* Total malloc+free rate of 1, 2, 4... threads up to the core count, each with its own heap
+ * sharing the run pool, as KramStates on a thread pool do. Linear scaling keeps the rate
+ * per thread flat.
+ */
+KRAM_BENCHMARK(heap_thread_scaling)
+{
+	constexpr Size Rounds = 500;
+
+	Size cores = std::max<Size>(std::thread::hardware_concurrency(), 1);
+	for (Size threads = 1; ; threads *= 2)
+	{
+		threads = std::min(threads, cores);
+
+		double seconds = test::measure(3, [&]() {
+			std::vector<std::thread> workers;
+			for (Size i = 0; i < threads; i++)
+				workers.emplace_back([]() {
+					Heap heap;
+					malloc_free(heap, Rounds);
+				});
+			for (std::thread& worker : workers)
+				worker.join();
+		});
+
+		std::string name = std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+		test::report(name.c_str(), threads * Rounds * Live, seconds);
+		if (threads == cores)
+			break;
+	}
+}
+
+/* A loop with no calls reaches the collectors through its back edge, in every build */
+KRAM_TEST(heap_loop_safepoints)
+{
+	using namespace kram::assembler;
+	using namespace kram::assembler::instruction;
+
+	constexpr UInt64 Iterations = 1000;
+
+	op::InstructionBuilder code;
+	code.push_back(mov(DataSize::QuadWord, Register::r1, Value(Iterations)));
+	auto body = code.push_back(new_(false, Register::r0, UnsignedInteger(64)));
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(back, body);
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 0, { test::function(code) });
+
+	for (bool tracing : { false, true })
+	{
+		KramState state;
+		test::interpreter_only(state);
+		gc::Collector collector{ state };
+		if (tracing)
+		{
+			collector.pacing(1);
+			state.collector(&collector);
+		}
+		else state.gc_pacing(1, std::chrono::seconds(1));
+
+		runtime::execute(&state, &chunk, 0);
+		KRAM_CHECK(live_blocks(state) < Iterations);
+		state.collector(nullptr);
+	}
+}
@@ -0,0 +1,136 @@
+#include "test.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+
+/* A byte no opcode uses leaves the interpreter loop instead of jumping through the table */
+KRAM_TEST(invalid_opcode_exits)
+{
+	op::InstructionBuilder head;
+	head.push_back(mov(Q, location(Segment::Static, 0), Value(UInt64(1))));
+
+	op::InstructionBuilder code = head;
+	code.push_back(op::Instruction(op::Opcode::NOP));
+	code.push_back(mov(Q, location(Segment::Static, 8), Value(UInt64(2))));
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 16, { test::function(code) });
+	chunk.code[head.byte_count()] = std::byte{ 0xFF };
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &chunk, 0);
+
+	KRAM_CHECK(test::load_static(chunk, 0) == 1);
+	KRAM_CHECK(test::load_static(chunk, 8) == 0);
+}
+
+/* Sums 0..count-1 into statics[0] with three-address arithmetic and LOOP. "mixed" adds
+ * unrelated operations to the body, so the dispatch sees more than three opcodes.
+ */
+static op::InstructionBuilder sum_loop(UInt64 count, bool mixed = false)
+{
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r0, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r1, Value(count)));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(1))));
+	auto body = code.push_back(sub(DataType::UnsignedQuadWord, Register::r2, Register::r1, Register::r3));
+	code.push_back(add(DataType::UnsignedQuadWord, Register::r0, Register::r0, Register::r2));
+	if (mixed)
+	{
+		code.push_back(xor_(DataType::UnsignedQuadWord, Register::r4, Register::r0, Register::r2));
+		code.push_back(shl(DataType::UnsignedQuadWord, Register::r5, Register::r4, Register::r3));
+		code.push_back(and_(DataType::UnsignedDoubleWord, Register::r6, Register::r5, Register::r4));
+		code.push_back(or_(DataType::UnsignedWord, Register::r7, Register::r6, Register::r1));
+		code.push_back(mov(Q, Register::r8, Register::r7));
+	}
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(back, body);
+	code.push_back(mov(Q, location(Segment::Static, 0), Register::r0));
+	code.push_back(ret());
+	return code;
+}
+
+KRAM_TEST(loop_sum)
+{
+	bin::Chunk chunk;
+	test::build(chunk, 8, { test::function(sum_loop(1000)) });
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &chunk, 0);
+
+	KRAM_CHECK(test::load_static(chunk, 0) == 999 * 1000 / 2);
+}
+
+/* Sums 10..1 with a backward JMP and a forward JCC out of the loop, then skips two stores
+ * with CMPJ on a register and on memory. "padding" bytes of moves in the body push every
+ * branch but the last two to its 32 bit form.
+ */
+static op::InstructionBuilder branches(Size padding)
+{
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r0, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r1, Value(UInt64(10))));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(1))));
+	auto top = code.push_back(cmp(Q, Register::r1, Value(UInt64(0))));
+	auto exit = code.push_back(jcc(op::Condition::Equal));
+	for (Size i = 0; i < padding / 10; i++)
+		code.push_back(mov(Q, Register::r8, Value(UInt64(i))));
+	code.push_back(add(DataType::UnsignedQuadWord, Register::r0, Register::r0, Register::r1));
+	code.push_back(sub(DataType::UnsignedQuadWord, Register::r1, Register::r1, Register::r3));
+	auto back = code.push_back(jmp());
+	auto done = code.push_back(cmpj(op::Condition::Less, Q, Register::r0, Value(UInt64(100))));
+	code.push_back(mov(Q, location(Segment::Static, 8), Value(UInt64(1))));
+	auto skip = code.push_back(cmpj(op::Condition::Greater, Q, Register::r0, location(Segment::Static, 16)));
+	code.push_back(mov(Q, location(Segment::Static, 8), Value(UInt64(2))));
+	auto end = code.push_back(mov(Q, location(Segment::Static, 0), Register::r0));
+	code.push_back(ret());
+
+	code.branch(exit, done);
+	code.branch(back, top);
+	code.branch(done, skip);
+	code.branch(skip, end);
+	return code;
+}
+
+KRAM_TEST(branch_forms)
+{
+	for (Size padding : { Size(0), Size(400) })
+	{
+		bin::Chunk chunk;
+		test::build(chunk, 24, { test::function(branches(padding)) });
+
+		KramState state;
+		test::interpreter_only(state);
+		runtime::execute(&state, &chunk, 0);
+
+		KRAM_CHECK(test::load_static(chunk, 0) == 55);
+		KRAM_CHECK(test::load_static(chunk, 8) == 0);
+	}
+}
+
+/* Dispatches per second of the raw interpreter. Build once more with KRAM_NO_THREADED_DISPATCH
+ * to compare the computed-goto loop against the switch.
+ */
+KRAM_BENCHMARK(interpreter_dispatch)
+{
+	constexpr UInt64 Iterations = 10'000'000;
+
+	for (bool mixed : { false, true })
+	{
+		bin::Chunk chunk;
+		test::build(chunk, 8, { test::function(sum_loop(Iterations, mixed)) });
+
+		KramState state;
+		test::interpreter_only(state);
+		double seconds = test::measure(5, [&]() { runtime::execute(&state, &chunk, 0); });
+
+		KRAM_CHECK(test::load_static(chunk, 0) == (Iterations - 1) * Iterations / 2);
+		test::report(mixed ? "opcodes, 8 kinds" : "opcodes, 3 kinds", Iterations * (mixed ? 8 : 3), seconds);
+	}
+}
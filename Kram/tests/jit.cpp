@@ -0,0 +1,125 @@
+#include "test.h"
+#include "jit.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+static constexpr DataType U64 = DataType::UnsignedQuadWord;
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+
+/* Rounds i = N..1 add i * 3 / 2 to r4 and count rounds with i % 7 below 3 in r5; a CMPJ
+ * checks the count. Signed, narrow and zero divisions and shifts of -9 follow.
+ */
+static op::InstructionBuilder compare_loop(UInt64 rounds)
+{
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r1, Value(rounds)));
+	code.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r5, Value(UInt64(0))));
+	code.push_back(mov(Q, Register::r8, Value(UInt64(1))));
+	auto body = code.push_back(mov(Q, Register::r2, Value(UInt64(3))));
+	code.push_back(mul(U64, Register::r6, Register::r1, Register::r2));
+	code.push_back(mov(Q, Register::r2, Value(UInt64(2))));
+	code.push_back(div(U64, Register::r6, Register::r6, Register::r2));
+	code.push_back(add(U64, Register::r4, Register::r4, Register::r6));
+	code.push_back(mov(Q, Register::r2, Value(UInt64(7))));
+	code.push_back(rem(U64, Register::r7, Register::r1, Register::r2));
+	code.push_back(cmp(Q, Register::r7, Value(UInt64(3))));
+	auto above = code.push_back(jcc(op::Condition::AboveEqual));
+	code.push_back(add(U64, Register::r5, Register::r5, Register::r8));
+	auto back = code.push_back(loop(Register::r1));
+	code.branch(above, back);
+	code.branch(back, body);
+	code.push_back(instruction::test(Q, Register::r5, Value(UInt64(1))));
+	auto odd = code.push_back(jcc(op::Condition::NotEqual));
+	code.push_back(mov(Q, static_at(16), Value(UInt64(2))));
+	auto check = code.push_back(cmpj(op::Condition::Equal, Q, Register::r5, Value(rounds / 7 * 3)));
+	code.push_back(mov(Q, static_at(24), Value(UInt64(0))));
+	auto skip = code.push_back(jmp());
+	auto found = code.push_back(mov(Q, static_at(24), Value(UInt64(1))));
+	auto done = code.push_back(mov(Q, static_at(0), Register::r4));
+	code.branch(odd, done);
+	code.branch(check, found);
+	code.branch(skip, done);
+	code.push_back(mov(Q, static_at(8), Register::r5));
+
+	code.push_back(mov(Q, Register::r2, Value(UInt64(-9))));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(2))));
+	code.push_back(div(DataType::SignedDoubleWord, Register::r6, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(32), Register::r6));
+	code.push_back(rem(DataType::SignedWord, Register::r6, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(40), Register::r6));
+	code.push_back(shr(DataType::SignedByte, Register::r7, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(48), Register::r7));
+	code.push_back(shr(U64, Register::r7, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(56), Register::r7));
+	code.push_back(mov(Q, Register::r3, Value(UInt64(0))));
+	code.push_back(div(U64, Register::r6, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(64), Register::r6));
+	code.push_back(rem(DataType::SignedQuadWord, Register::r6, Register::r2, Register::r3));
+	code.push_back(mov(Q, static_at(72), Register::r6));
+	code.push_back(ret());
+	return code;
+}
+
+/* Everything up to the RET runs on the JIT, loop included, and leaves the statics the
+ * interpreter does
+ */
+KRAM_TEST(jit_control_flow)
+{
+	constexpr UInt64 Rounds = 700;
+
+	bin::Chunk raw, compiled;
+	test::build(raw, 80, { test::function(compare_loop(Rounds)) });
+	test::build(compiled, 80, { test::function(compare_loop(Rounds)) });
+
+	KramState state;
+	test::interpreter_only(state);
+	runtime::execute(&state, &raw, 0);
+	KRAM_CHECK(test::load_static(raw, 24) == 1);
+	KRAM_CHECK(test::load_static(raw, 32) == 0xFFFFFFFCull);
+	KRAM_CHECK(test::load_static(raw, 72) == UInt64(-9));
+	if (!jit::available())
+		return;
+
+	jit::CompiledCode code = jit::compile(&compiled, 0);
+	KRAM_CHECK(code.entry != nullptr);
+	KRAM_CHECK(code.bytecodeSize == jit::function_end(&compiled, 0) - compiled.functions[0].codeOffset);
+	jit::release(code);
+
+	state.jit().threshold(1);
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &compiled, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() < 3);
+#endif
+	KRAM_CHECK(std::memcmp(raw.statics, compiled.statics, raw.staticCount) == 0);
+}
+
+/* An exit between a CMP and the JCC reading its flags would lose them, so the function
+ * is not compiled
+ */
+KRAM_TEST(jit_keeps_flags_in_the_interpreter)
+{
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r0, Value(UInt64(1))));
+	code.push_back(cmp(Q, Register::r0, Value(UInt64(1))));
+	code.push_back(lea(Register::r1, static_at(0)));
+	code.push_back(mset(DataSize::Byte, Register::r1, Register::r0, Register::r0));
+	auto equal = code.push_back(jcc(op::Condition::Equal));
+	code.push_back(mov(Q, static_at(0), Value(UInt64(0))));
+	code.branch(equal, code.push_back(ret()));
+
+	bin::Chunk chunk;
+	test::build(chunk, 8, { test::function(code) });
+
+	jit::CompiledCode compiled = jit::compile(&chunk, 0);
+	KRAM_CHECK(compiled.entry == nullptr);
+}
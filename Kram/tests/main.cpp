@@ -0,0 +1,83 @@
+#include "test.h"
+
+#include <cstdio>
+
+namespace kram::test
+{
+	static Size failures = 0;
+
+	std::vector<TestCase>& registry()
+	{
+		static std::vector<TestCase> cases;
+		return cases;
+	}
+
+	void fail(const char* file, int line, const char* expression)
+	{
+		std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+		failures++;
+	}
+
+	bin::FunctionBuilder function(const op::InstructionBuilder& code, Size stack_size, Size parameters)
+	{
+		bin::FunctionBuilder builder;
+		builder.code(code);
+		builder.stack_size(stack_size);
+		builder.parameters(parameters);
+		return builder;
+	}
+
+	void build(bin::Chunk& chunk, Size statics, const std::vector<bin::FunctionBuilder>& functions)
+	{
+		bin::ChunkBuilder builder;
+		if (statics > 0)
+			builder.add_static(statics);
+		for (const bin::FunctionBuilder& function : functions)
+			builder.add_function(function);
+
+		builder.build(&chunk);
+		std::memset(chunk.statics, 0, chunk.staticCount);
+	}
+
+	void interpreter_only(KramState& state)
+	{
+		state.jit().threshold(0);
+		state.traces().threshold(0);
+		state.closures().threshold(0);
+	}
+
+	void report(const char* name, Size operations, double seconds)
+	{
+		std::printf("  %-32s %12.2f M/s %10.2f ns\n", name, operations / seconds / 1e6, seconds * 1e9 / operations);
+	}
+}
+
+/* kram_tests [--bench] [name...]: runs the tests, or the benchmarks, whose name is given (all by default) */
+int main(int argc, char** argv)
+{
+	using namespace kram;
+
+	bool benchmarks = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+	int first = benchmarks ? 2 : 1;
+
+	Size run = 0;
+	for (const test::TestCase& test : test::registry())
+	{
+		if (test.benchmark != benchmarks)
+			continue;
+
+		bool selected = first >= argc;
+		for (int i = first; i < argc && !selected; i++)
+			selected = std::strcmp(argv[i], test.name) == 0;
+		if (!selected)
+			continue;
+
+		std::printf("%s\n", test.name);
+		std::fflush(stdout);
+		test.function();
+		run++;
+	}
+
+	std::printf("%zu %s, %zu failed checks\n", scast(std::size_t, run), benchmarks ? "benchmarks" : "tests", scast(std::size_t, test::failures));
+	return test::failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+#include "test.h"
+#include "simd.h"
+
+#include <bit>
+#include <cmath>
+
+using namespace kram;
+using namespace kram::simd;
+
+/* Odd, so every kernel runs whole blocks and a tail */
+static constexpr Size Count = 131;
+
+/* Instruction sets of the running CPU, Scalar first */
+static std::vector<Isa> isas()
+{
+	limit(Isa::Avx512);
+	std::vector<Isa> found;
+	for (UInt8 i = 0; i <= scast(UInt8, isa()); i++)
+		found.push_back(scast(Isa, i));
+	return found;
+}
+
+/* Small integers with repeats, so floating results are exact and compares tie; every
+ * third integer is a large one that makes arithmetic wrap
+ */
+template<typename _Ty>
+static std::vector<_Ty> values(Size count, UInt64 seed)
+{
+	std::vector<_Ty> result(count);
+	for (Size i = 0; i < count; i++)
+	{
+		UInt64 hash = (i + seed) * 0x9E3779B97F4A7C15ull >> 17;
+		if constexpr (std::floating_point<_Ty>)
+			result[i] = _Ty(Int64(hash % 41) - 20);
+		else result[i] = scast(_Ty, i % 3 == 0 ? hash : hash % 41 - 20);
+	}
+	return result;
+}
+
+template<typename _Ty>
+static UInt64 bits(_Ty value)
+{
+	if constexpr (std::same_as<_Ty, float>)
+		return std::bit_cast<UInt32>(value);
+	else if constexpr (std::same_as<_Ty, double>)
+		return std::bit_cast<UInt64>(value);
+	else if constexpr (std::signed_integral<_Ty>)
+		return UInt64(Int64(value));
+	else return UInt64(value);
+}
+
+/* Integers wrap in the width of the element, or at 64 bits for sums */
+template<typename _Ty>
+static _Ty wrap_add(_Ty left, _Ty right)
+{
+	if constexpr (std::floating_point<_Ty>)
+		return left + right;
+	else return scast(_Ty, bits(left) + bits(right));
+}
+
+template<typename _Ty>
+static _Ty wrap_mul(_Ty left, _Ty right)
+{
+	if constexpr (std::floating_point<_Ty>)
+		return left * right;
+	else return scast(_Ty, bits(left) * bits(right));
+}
+
+template<typename _Ty>
+static _Ty reference(Operation op, _Ty left, _Ty right)
+{
+	switch (op)
+	{
+		case Operation::Add: return wrap_add(left, right);
+		case Operation::Sub:
+			if constexpr (std::floating_point<_Ty>)
+				return left - right;
+			else return scast(_Ty, bits(left) - bits(right));
+		case Operation::Mul: return wrap_mul(left, right);
+		case Operation::Min: return right < left ? right : left;
+		default: return left < right ? right : left;
+	}
+}
+
+template<typename _Ty>
+static bool reference(op::Condition condition, _Ty left, _Ty right)
+{
+	switch (condition)
+	{
+		case op::Condition::Equal: return left == right;
+		case op::Condition::NotEqual: return left != right;
+		case op::Condition::Less: case op::Condition::Below: return left < right;
+		case op::Condition::GreaterEqual: case op::Condition::AboveEqual: return left >= right;
+		case op::Condition::LessEqual: case op::Condition::BelowEqual: return left <= right;
+		default: return left > right;
+	}
+}
+
+template<typename _Ty>
+static UInt64 reference(Reduction reduction, const std::vector<_Ty>& src)
+{
+	if (reduction == Reduction::Sum)
+	{
+		if constexpr (std::floating_point<_Ty>)
+		{
+			_Ty total = 0;
+			for (_Ty value : src)
+				total += value;
+			return bits(total);
+		}
+		UInt64 total = 0;
+		for (_Ty value : src)
+			total += bits(value);
+		return total;
+	}
+
+	Size best = 0;
+	for (Size i = 1; i < src.size(); i++)
+	{
+		bool lower = reduction == Reduction::Min || reduction == Reduction::ArgMin;
+		if (lower ? src[i] < src[best] : src[best] < src[i])
+			best = i;
+	}
+	if (reduction == Reduction::ArgMin || reduction == Reduction::ArgMax)
+		return best;
+	return bits(src[best]);
+}
+
+template<typename _Ty>
+static UInt64 reference_dot(const std::vector<_Ty>& left, const std::vector<_Ty>& right)
+{
+	if constexpr (std::floating_point<_Ty>)
+	{
+		_Ty total = 0;
+		for (Size i = 0; i < left.size(); i++)
+			total += left[i] * right[i];
+		return bits(total);
+	}
+	UInt64 total = 0;
+	for (Size i = 0; i < left.size(); i++)
+		total += bits(left[i]) * bits(right[i]);
+	return total;
+}
+
+/* Runs every kernel on "count" elements of "type" and checks it against the loops above */
+template<typename _Ty>
+static void check_kernels(ElementType type, Size count)
+{
+	const std::vector<_Ty> left = values<_Ty>(count, 1), right = values<_Ty>(count, 7);
+	std::vector<_Ty> dest(count);
+
+	for (Size op = 0; op < OperationCount; op++)
+	{
+		binary(scast(Operation, op), type, dest.data(), left.data(), right.data(), count);
+		for (Size i = 0; i < count; i++)
+			KRAM_CHECK(dest[i] == reference(scast(Operation, op), left[i], right[i]));
+	}
+
+	/* In place, as blocks may alias */
+	dest = right;
+	binary(Operation::Add, type, dest.data(), left.data(), dest.data(), count);
+	for (Size i = 0; i < count; i++)
+		KRAM_CHECK(dest[i] == wrap_add(left[i], right[i]));
+
+	dest = right;
+	fma(type, dest.data(), left.data(), right.data(), count);
+	for (Size i = 0; i < count; i++)
+	{
+		if constexpr (std::floating_point<_Ty>)
+			KRAM_CHECK(dest[i] == std::fma(left[i], right[i], right[i]));
+		else KRAM_CHECK(dest[i] == wrap_add(wrap_mul(left[i], right[i]), right[i]));
+	}
+
+	std::vector<UInt8> mask(count);
+	const op::Condition conditions[] = {
+		op::Condition::Equal, op::Condition::NotEqual, op::Condition::Less, op::Condition::GreaterEqual,
+		op::Condition::LessEqual, op::Condition::Greater, op::Condition::Below, op::Condition::AboveEqual,
+		op::Condition::BelowEqual, op::Condition::Above
+	};
+	for (op::Condition condition : conditions)
+	{
+		compare(condition, type, mask.data(), left.data(), right.data(), count);
+		for (Size i = 0; i < count; i++)
+			KRAM_CHECK(mask[i] == UInt8(reference(condition, left[i], right[i])));
+	}
+
+	compare(op::Condition::Less, type, mask.data(), left.data(), right.data(), count);
+	select(type, dest.data(), mask.data(), left.data(), right.data(), count);
+	for (Size i = 0; i < count; i++)
+		KRAM_CHECK(dest[i] == (mask[i] ? left[i] : right[i]));
+
+	for (Size reduction = 0; reduction < ReductionCount; reduction++)
+	{
+		KRAM_CHECK(reduce(scast(Reduction, reduction), type, left.data(), count) == reference(scast(Reduction, reduction), left));
+		UInt64 empty = scast(Reduction, reduction) >= Reduction::ArgMin ? ~0ull : 0;
+		KRAM_CHECK(reduce(scast(Reduction, reduction), type, left.data(), 0) == empty);
+	}
+	KRAM_CHECK(dot(type, left.data(), right.data(), count) == reference_dot(left, right));
+
+	for (bool exclusive : { false, true })
+	{
+		dest = left;
+		scan(exclusive, type, dest.data(), dest.data(), count);
+		_Ty carry{};
+		for (Size i = 0; i < count; i++)
+		{
+			_Ty next = wrap_add(carry, left[i]);
+			KRAM_CHECK(dest[i] == (exclusive ? carry : next));
+			carry = next;
+		}
+	}
+}
+
+static void check_all_types(Size count)
+{
+	check_kernels<Int8>(ElementType::SignedByte, count);
+	check_kernels<Int16>(ElementType::SignedWord, count);
+	check_kernels<Int32>(ElementType::SignedDoubleWord, count);
+	check_kernels<Int64>(ElementType::SignedQuadWord, count);
+	check_kernels<UInt8>(ElementType::UnsignedByte, count);
+	check_kernels<UInt16>(ElementType::UnsignedWord, count);
+	check_kernels<UInt32>(ElementType::UnsignedDoubleWord, count);
+	check_kernels<UInt64>(ElementType::UnsignedQuadWord, count);
+	check_kernels<float>(ElementType::FloatingDecimal, count);
+	check_kernels<double>(ElementType::DoubleDecimal, count);
+}
+
+/* Every instruction set leaves what plain loops do, for every element type */
+KRAM_TEST(simd_kernels)
+{
+	for (Isa max : isas())
+	{
+		limit(max);
+		check_all_types(Count);
+	}
+	limit(Isa::Avx512);
+}
+
+/* Runs of 8 indices start with a repeated one, so a scatter has to keep the last */
+template<typename _Element, typename _Index>
+static void check_gather_scatter()
+{
+	constexpr Size Table = 251;
+
+	std::vector<_Element> table(Table), src(Count), dest(Count);
+	std::vector<_Index> indices(Count);
+	for (Size i = 0; i < Table; i++)
+		table[i] = scast(_Element, i * 0x9E3779B97F4A7C15ull);
+	for (Size i = 0; i < Count; i++)
+	{
+		indices[i] = scast(_Index, i % 8 < 2 ? 5 : i * 37 % Table);
+		src[i] = scast(_Element, ~i);
+	}
+
+	const UInt8 element_log2 = UInt8(std::countr_zero(sizeof(_Element)));
+	const UInt8 index_log2 = UInt8(std::countr_zero(sizeof(_Index)));
+
+	gather(element_log2, index_log2, dest.data(), table.data(), indices.data(), Count);
+	for (Size i = 0; i < Count; i++)
+		KRAM_CHECK(dest[i] == table[indices[i]]);
+
+	std::vector<_Element> expected = table;
+	for (Size i = 0; i < Count; i++)
+		expected[indices[i]] = src[i];
+	scatter(element_log2, index_log2, table.data(), src.data(), indices.data(), Count);
+	KRAM_CHECK(table == expected);
+}
+
+template<typename _Element>
+static void check_gather_scatter()
+{
+	check_gather_scatter<_Element, UInt8>();
+	check_gather_scatter<_Element, UInt16>();
+	check_gather_scatter<_Element, UInt32>();
+	check_gather_scatter<_Element, UInt64>();
+}
+
+KRAM_TEST(simd_gather_scatter)
+{
+	for (Isa max : isas())
+	{
+		limit(max);
+		check_gather_scatter<UInt8>();
+		check_gather_scatter<UInt16>();
+		check_gather_scatter<UInt32>();
+		check_gather_scatter<UInt64>();
+	}
+	limit(Isa::Avx512);
+}
+
+/* Reductions and scans split across the pool give what one thread does, over a count
+ * that leaves the last range short
+ */
+KRAM_TEST(simd_parallel)
+{
+	parallel(64, 4);
+	for (Isa max : isas())
+	{
+		limit(max);
+		check_all_types(Count * 31);
+	}
+	limit(Isa::Avx512);
+	parallel(0);
+}
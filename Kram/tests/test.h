@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "bindata.h"
+#include "asm_common.h"
+#include "vm.h"
+
+#include <chrono>
+
+namespace kram::test
+{
+	typedef void (*TestFunction)();
+
+	struct TestCase
+	{
+		const char* name;
+		TestFunction function;
+		bool benchmark;
+	};
+
+	std::vector<TestCase>& registry();
+
+	struct Registrar
+	{
+		inline Registrar(const char* name, TestFunction function, bool benchmark) { registry().push_back({ name, function, benchmark }); }
+	};
+
+	void fail(const char* file, int line, const char* expression);
+
+	/* A function running "code" with "stack_size" bytes of locals, r0-r8 taken from the code */
+	bin::FunctionBuilder function(const op::InstructionBuilder& code, Size stack_size = 0, Size parameters = 0);
+
+	/* Builds "chunk" with "statics" bytes of zeroed statics and the given functions */
+	void build(bin::Chunk& chunk, Size statics, const std::vector<bin::FunctionBuilder>& functions);
+
+	/* Turns off the JIT, traces and closure records, so only the interpreter runs */
+	void interpreter_only(KramState& state);
+
+	template<typename _Ty = UInt64>
+	inline _Ty load_static(const bin::Chunk& chunk, Size offset)
+	{
+		_Ty value;
+		std::memcpy(&value, chunk.statics + offset, sizeof(_Ty));
+		return value;
+	}
+
+	/* Best time of "rounds" runs of "body", in seconds */
+	template<typename _Func>
+	double measure(Size rounds, _Func body)
+	{
+		double best = 0;
+		for (Size i = 0; i < rounds; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			body();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (i == 0 || seconds < best)
+				best = seconds;
+		}
+		return best;
+	}
+
+	/* Prints "operations" done in "seconds" as a rate and as the time of one */
+	void report(const char* name, Size operations, double seconds);
+}
+
+#define KRAM_TEST(_Name) \
+	static void CONCAT_MACROS(test_, _Name)(); \
+	static const kram::test::Registrar CONCAT_MACROS(registrar_, _Name){ #_Name, &CONCAT_MACROS(test_, _Name), false }; \
+	static void CONCAT_MACROS(test_, _Name)()
+
+#define KRAM_BENCHMARK(_Name) \
+	static void CONCAT_MACROS(benchmark_, _Name)(); \
+	static const kram::test::Registrar CONCAT_MACROS(registrar_, _Name){ #_Name, &CONCAT_MACROS(benchmark_, _Name), true }; \
+	static void CONCAT_MACROS(benchmark_, _Name)()
+
+#define KRAM_CHECK(_Expression) ((_Expression) ? void() : kram::test::fail(__FILE__, __LINE__, #_Expression))
@@ -0,0 +1,151 @@
+#include "test.h"
+#include "decoder.h"
+
+using namespace kram;
+using namespace kram::assembler;
+using namespace kram::assembler::instruction;
+
+static constexpr DataSize Q = DataSize::QuadWord;
+static constexpr DataType U64 = DataType::UnsignedQuadWord;
+
+static inline MemoryLocation static_at(Size offset) { return location(Segment::Static, UnsignedInteger(offset)); }
+static inline MemoryLocation stack_at(Size offset) { return location(Segment::Stack, UnsignedInteger(offset)); }
+
+/* Rounds i = N..1 count the multiples of 64 in r5 and add i to r4 while i >= N / 2,
+ * subtracting 1 below: the first branch fails its guard now and then, the second
+ * on every round past halfway. A call then runs a loop of the callee in a frame of
+ * its own, whose last CMP a JCC reads after the loop.
+ */
+static void build_loops(bin::Chunk& chunk, UInt64 rounds)
+{
+	op::InstructionBuilder main;
+	main.push_back(mov(Q, Register::r1, Value(rounds)));
+	main.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	main.push_back(mov(Q, Register::r5, Value(UInt64(0))));
+	main.push_back(mov(Q, Register::r8, Value(UInt64(1))));
+	auto body = main.push_back(mov(Q, Register::r2, Value(UInt64(64))));
+	main.push_back(rem(U64, Register::r7, Register::r1, Register::r2));
+	main.push_back(cmp(Q, Register::r7, Value(UInt64(0))));
+	auto skip = main.push_back(jcc(op::Condition::NotEqual));
+	main.push_back(add(U64, Register::r5, Register::r5, Register::r8));
+	auto half = main.push_back(cmpj(op::Condition::Below, Q, Register::r1, Value(rounds / 2)));
+	main.push_back(add(U64, Register::r4, Register::r4, Register::r1));
+	auto next = main.push_back(jmp());
+	auto low = main.push_back(sub(U64, Register::r4, Register::r4, Register::r8));
+	auto back = main.push_back(loop(Register::r1));
+	main.branch(skip, half);
+	main.branch(half, low);
+	main.branch(next, back);
+	main.branch(back, body);
+	main.push_back(mov(Q, static_at(0), Register::r4));
+	main.push_back(mov(Q, static_at(8), Register::r5));
+	main.push_back(mov(Q, Register::r0, Value(UInt64(200))));
+	main.push_back(call(1));
+	main.push_back(mov(Q, static_at(16), Register::r0));
+	main.push_back(ret());
+
+	/* r0 = 1 + 2 + ... + r0 through a stack slot, static 24 set if it is above 100 */
+	op::InstructionBuilder sum;
+	sum.push_back(mov(Q, Register::r1, Register::r0));
+	sum.push_back(mov(Q, stack_at(0), Value(UInt64(0))));
+	auto round = sum.push_back(mov(Q, Register::r2, stack_at(0)));
+	sum.push_back(add(U64, Register::r2, Register::r2, Register::r1));
+	sum.push_back(mov(Q, stack_at(0), Register::r2));
+	sum.push_back(cmp(Q, Register::r2, Value(UInt64(100))));
+	sum.branch(sum.push_back(loop(Register::r1)), round);
+	auto small = sum.push_back(jcc(op::Condition::BelowEqual));
+	sum.push_back(mov(Q, static_at(24), Value(UInt64(1))));
+	auto done = sum.push_back(mov(Q, Register::r0, stack_at(0)));
+	sum.branch(small, done);
+	sum.push_back(ret());
+
+	bin::FunctionBuilder callee = test::function(sum, 8);
+	callee.convention(1, 1);
+	test::build(chunk, 32, { test::function(main), callee });
+}
+
+/* Loop traces recorded from the raw interpreter, the predecoded stream and closure
+ * records leave the statics the interpreter does, side exits and refused traces included
+ */
+KRAM_TEST(trace_loops)
+{
+	constexpr UInt64 Rounds = 3000;
+
+	bin::Chunk raw;
+	build_loops(raw, Rounds);
+	KramState reference;
+	test::interpreter_only(reference);
+	runtime::execute(&reference, &raw, 0);
+	KRAM_CHECK(test::load_static(raw, 8) == Rounds / 64);
+	KRAM_CHECK(test::load_static(raw, 16) == 200 * 201 / 2);
+	KRAM_CHECK(test::load_static(raw, 24) == 1);
+	if (!jit::available())
+		return;
+
+	for (int tier = 0; tier < 3; tier++)
+	{
+		bin::Chunk traced;
+		build_loops(traced, Rounds);
+		if (tier == 1)
+			KRAM_CHECK(runtime::predecode(&traced));
+
+		KramState state;
+		test::interpreter_only(state);
+		state.traces().threshold(1);
+		if (tier == 2)
+			state.closures().threshold(1);
+
+		for (int run = 0; run < 2; run++)
+		{
+			std::memset(traced.statics, 0, traced.staticCount);
+#if defined(KRAM_OPCODE_PROFILING)
+			runtime::OpcodeProfile profile;
+			state.profile(&profile);
+#endif
+			runtime::execute(&state, &traced, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+			state.profile(nullptr);
+
+			/* Past halfway the first loop keeps failing a guard and its trace is dropped */
+			if (tier == 0 && run == 0)
+				KRAM_CHECK(profile.dispatches() < Rounds * 6);
+#endif
+			KRAM_CHECK(std::memcmp(raw.statics, traced.statics, raw.staticCount) == 0);
+		}
+	}
+}
+
+/* A loop recorded at the first look for its trace closes over its back-edge and runs
+ * the rest on the trace from the second: the interpreter dispatches only around it
+ */
+KRAM_TEST(trace_closes_loop)
+{
+	constexpr UInt64 Rounds = 10000;
+
+	op::InstructionBuilder code;
+	code.push_back(mov(Q, Register::r1, Value(Rounds)));
+	code.push_back(mov(Q, Register::r4, Value(UInt64(0))));
+	auto body = code.push_back(add(U64, Register::r4, Register::r4, Register::r1));
+	code.push_back(mov(Q, static_at(0), Register::r4));
+	code.branch(code.push_back(loop(Register::r1)), body);
+	code.push_back(ret());
+
+	bin::Chunk chunk;
+	test::build(chunk, 8, { test::function(code) });
+	if (!jit::available())
+		return;
+
+	KramState state;
+	test::interpreter_only(state);
+	state.traces().threshold(1);
+#if defined(KRAM_OPCODE_PROFILING)
+	runtime::OpcodeProfile profile;
+	state.profile(&profile);
+#endif
+	runtime::execute(&state, &chunk, 0);
+#if defined(KRAM_OPCODE_PROFILING)
+	state.profile(nullptr);
+	KRAM_CHECK(profile.dispatches() < 3 * 2 * runtime::TierLookupInterval + 10);
+#endif
+	KRAM_CHECK(test::load_static(chunk, 0) == Rounds * (Rounds + 1) / 2);
+}